@@ -17,11 +17,13 @@ class ThorVision(ConanFile):
         self.tool_requires("cmake/[>=3.25.0 <3.30.0]")
         self.tool_requires("ninja/[>=1.12.0]")
         # self.requires("catch2/3.5.0")
+        self.test_requires("gtest/1.14.0")
 
     def requirements(self):
         self.requires("fmt/10.2.1")
         self.requires("spdlog/1.13.0")
         self.requires("nlohmann_json/3.11.3")
+        self.requires("libjpeg-turbo/3.0.2")
         # self.requires("json-schema-validator/2.3.0")
         self.requires("libxvc/0.0.3")
         self.requires("xdaqmetadata/0.0.1")
@@ -10,6 +10,8 @@
 #include <QStyleFactory>
 #include <filesystem>
 
+#include "parallel_jpeg_enc.h"
+#include "recording_sink.h"
 #include "xdaq_camera_control.h"
 #include "xdaqmetadata/logger.h"
 
@@ -24,6 +26,8 @@ namespace fs = std::filesystem;
 App::App(int &argc, char **argv) : QApplication(argc, argv)
 {
     gst_init(&argc, &argv);
+    register_recording_sink();
+    register_parallel_jpeg_enc();
 
     setStyle(QStyleFactory::create("windowsvista"));
     // qDebug() << QStyleFactory::keys();
@@ -0,0 +1,72 @@
+#include "bitrate_estimator.h"
+
+#include <gst/gstcaps.h>
+#include <gst/gststructure.h>
+
+#include <memory>
+
+#include "raw_recorder.h"
+
+
+namespace
+{
+// Conservative sizes of a recorded frame for a still scene with sensor noise; JPEG is
+// encoded at the default quality of 85, by the camera or by xvc for raw caps.
+auto constexpr JPEG_BYTES_PER_PIXEL = 0.3;
+auto constexpr H265_BYTES_PER_PIXEL = 0.02;
+}  // namespace
+
+
+std::uint64_t estimate_bitrate(const std::string &caps)
+{
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> parsed(
+        gst_caps_from_string(caps.c_str()), gst_caps_unref
+    );
+    if (!parsed || gst_caps_is_empty(parsed.get())) return 0;
+
+    auto structure = gst_caps_get_structure(parsed.get(), 0);
+    int width, height, fps_n, fps_d;
+    if (!gst_structure_get_int(structure, "width", &width) ||
+        !gst_structure_get_int(structure, "height", &height) ||
+        !gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d) || fps_d == 0) {
+        return 0;
+    }
+
+    auto bytes_per_pixel = gst_structure_has_name(structure, "video/x-h265")
+                               ? H265_BYTES_PER_PIXEL
+                               : JPEG_BYTES_PER_PIXEL;
+    auto pixels_per_second = static_cast<double>(width) * height * fps_n / fps_d;
+    return static_cast<std::uint64_t>(pixels_per_second * bytes_per_pixel);
+}
+
+std::uint64_t estimate_raw_bitrate(const std::string &caps)
+{
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> parsed(
+        gst_caps_from_string(caps.c_str()), gst_caps_unref
+    );
+    if (!parsed || gst_caps_is_empty(parsed.get())) return 0;
+
+    auto structure = gst_caps_get_structure(parsed.get(), 0);
+    int fps_n, fps_d;
+    if (!gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d) || fps_d == 0) {
+        return 0;
+    }
+    return RawRecorder::stored_frame_size(parsed.get()) * fps_n / fps_d;
+}
+
+
+void BitrateMeter::add(GstClockTime pts, std::size_t bytes)
+{
+    if (!GST_CLOCK_TIME_IS_VALID(pts)) return;
+
+    // A PTS that goes backwards means the stream restarted.
+    if (!GST_CLOCK_TIME_IS_VALID(_window_start) || pts < _window_start) {
+        _window_start = pts;
+        _window_bytes = 0;
+    } else if (auto elapsed = pts - _window_start; elapsed >= GST_SECOND) {
+        _rate.store(_window_bytes * GST_SECOND / elapsed, std::memory_order_relaxed);
+        _window_start = pts;
+        _window_bytes = 0;
+    }
+    _window_bytes += bytes;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <gst/gstclock.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Bytes per second a camera is expected to record with the given caps, such as
+// "image/jpeg,width=1280,height=720,framerate=30/1". Raw caps are estimated as JPEG, which
+// is how they are recorded unless the stream reaches the tee raw.
+// Returns 0 for caps without a size or frame rate.
+std::uint64_t estimate_bitrate(const std::string &caps);
+
+// Bytes per second of raw caps recorded losslessly by RawRecorder. Unlike JPEG this is
+// exact, since every frame has the same size. Returns 0 for caps it can't record.
+std::uint64_t estimate_raw_bitrate(const std::string &caps);
+
+
+// Measured bitrate of a stream, over windows of one second of PTS. One thread adds the
+// buffers; any thread may read the rate of the last complete window.
+class BitrateMeter
+{
+public:
+    // Streaming thread only.
+    void add(GstClockTime pts, std::size_t bytes);
+
+    // 0 until a full window has been seen.
+    std::uint64_t bytes_per_second() const { return _rate.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> _rate{0};
+    GstClockTime _window_start = GST_CLOCK_TIME_NONE;
+    std::uint64_t _window_bytes = 0;
+};
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include "block_writer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+// O_DIRECT wants buffers, offsets and sizes aligned to the logical block size.
+auto constexpr ALIGNMENT = std::size_t{4096};
+// Bounds of Options::for_bitrate; a 1 MB/s M-JPEG stream gets 4 blocks of 256 KiB.
+auto constexpr MIN_BLOCK_SIZE = std::size_t{256} << 10;
+auto constexpr MAX_BLOCK_SIZE = std::size_t{4} << 20;
+auto constexpr BLOCKS_PER_SECOND = std::uint64_t{8};
+auto constexpr MIN_QUEUE_BLOCKS = std::size_t{2};
+auto constexpr MAX_QUEUE_BLOCKS = std::size_t{64};
+
+std::size_t align_up(std::uint64_t bytes)
+{
+    return static_cast<std::size_t>((bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+}
+
+// Direct files are also read, for the sectors an unaligned write shares with its neighbours.
+int open_file(const fs::path &path, bool direct)
+{
+#if defined(_WIN32)
+    if (direct) return -1;
+    auto flags = _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY;
+    return _wopen(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#if defined(__linux__)
+    if (direct) flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT;
+#else
+    if (direct) return -1;
+#endif
+    return ::open(path.c_str(), flags, 0644);
+#endif
+}
+
+void close_file(int fd)
+{
+#if defined(_WIN32)
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+// Reserves space without changing the file's size, so a recording that stops early leaves
+// no zeros behind.
+bool preallocate(int fd, std::uint64_t bytes)
+{
+#if defined(__linux__)
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(bytes)) == 0;
+#elif defined(__APPLE__)
+    fstore_t store{F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(bytes), 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == 0) return true;
+    store.fst_flags = F_ALLOCATEALL;
+    return fcntl(fd, F_PREALLOCATE, &store) == 0;
+#else
+    (void) fd;
+    (void) bytes;
+    return false;
+#endif
+}
+
+// Gives back what was reserved past the end of the file, which ext4 keeps allocated until
+// the file is truncated, and drops the padding of direct writes.
+void truncate_file(int fd, std::uint64_t size)
+{
+#if defined(_WIN32)
+    (void) fd;
+    (void) size;
+#else
+    ftruncate(fd, static_cast<off_t>(size));
+#endif
+}
+
+bool sync_file(int fd)
+{
+#if defined(_WIN32)
+    return _commit(fd) == 0;
+#elif defined(__APPLE__)
+    // fsync leaves the data in the drive's cache on macOS.
+    return fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+bool write_at(int fd, const char *data, std::size_t size, std::uint64_t offset)
+{
+#if defined(_WIN32)
+    // Only the writer thread touches the file position.
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+    while (size > 0) {
+        auto chunk = static_cast<unsigned int>(std::min<std::size_t>(size, 1 << 30));
+        auto written = _write(fd, data, chunk);
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+#else
+    while (size > 0) {
+        auto written = pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+        offset += written;
+    }
+#endif
+    return true;
+}
+
+#if !defined(_WIN32)
+// Zeros what lies past the end of the file.
+bool read_at(int fd, char *data, std::size_t size, std::uint64_t offset)
+{
+    while (size > 0) {
+        auto read = pread(fd, data, size, static_cast<off_t>(offset));
+        if (read < 0 && errno == EINTR) continue;
+        if (read < 0) return false;
+        if (read == 0) {
+            std::memset(data, 0, size);
+            return true;
+        }
+        data += read;
+        size -= read;
+        offset += read;
+    }
+    return true;
+}
+#endif
+
+std::chrono::microseconds percentile(const std::vector<std::uint32_t> &sorted, double p)
+{
+    if (sorted.empty()) return std::chrono::microseconds{0};
+    auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return std::chrono::microseconds{sorted[index]};
+}
+}  // namespace
+
+
+BlockWriter::Options BlockWriter::Options::for_bitrate(std::uint64_t bytes_per_second)
+{
+    Options options;
+    if (bytes_per_second == 0) return options;
+    options.block_size =
+        std::clamp(align_up(bytes_per_second / BLOCKS_PER_SECOND), MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+    options.queue_blocks = std::clamp(
+        static_cast<std::size_t>(
+            (bytes_per_second + options.block_size - 1) / options.block_size
+        ),
+        MIN_QUEUE_BLOCKS,
+        MAX_QUEUE_BLOCKS
+    );
+    return options;
+}
+
+BlockWriter::BlockWriter(Options options)
+    : _options([&] {
+          options.block_size = std::max(ALIGNMENT, align_up(options.block_size));
+          options.queue_blocks = std::max<std::size_t>(1, options.queue_blocks);
+          return options;
+      }()),
+      _fd(-1),
+      _direct(false),
+      _bounce(nullptr),
+      _position(0),
+      _size(0),
+      _stopping(false),
+      _failed(false)
+{
+    for (std::size_t i = 0; i <= _options.queue_blocks; ++i) {
+        _blocks.push_back(
+            static_cast<char *>(::operator new(_options.block_size, std::align_val_t{ALIGNMENT}))
+        );
+    }
+    if (_options.direct) {
+        // The block, and the sector on each side it may share with the rest of the file.
+        _bounce = static_cast<char *>(
+            ::operator new(_options.block_size + 2 * ALIGNMENT, std::align_val_t{ALIGNMENT})
+        );
+    }
+    _free.assign(_blocks.begin() + 1, _blocks.end());
+    _current = {_blocks.front(), 0, 0};
+    _thread = std::jthread([this] { run(); });
+}
+
+BlockWriter::~BlockWriter()
+{
+    close();
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _changed.notify_all();
+    _thread.join();
+    for (auto block : _blocks) ::operator delete(block, std::align_val_t{ALIGNMENT});
+    if (_bounce) ::operator delete(_bounce, std::align_val_t{ALIGNMENT});
+}
+
+bool BlockWriter::open(const fs::path &path)
+{
+    close();
+
+    // One descriptor per file: mixing direct and buffered writes to the same file leaves the
+    // page cache and the disk disagreeing about the sectors both touched.
+    _direct = _options.direct;
+    _fd = _direct ? open_file(path, true) : -1;
+    if (_direct && _fd < 0) {
+        // tmpfs and some network filesystems refuse O_DIRECT.
+        spdlog::warn("Direct I/O unavailable for {}, using the page cache", path.string());
+        _direct = false;
+    }
+    if (!_direct) _fd = open_file(path, false);
+    if (_fd < 0) {
+        spdlog::error("Failed to open {}: {}", path.string(), std::strerror(errno));
+        return false;
+    }
+    if (_options.preallocate > 0 && !preallocate(_fd, _options.preallocate)) {
+        spdlog::debug("Could not preallocate {}", path.string());
+    }
+
+    _path = path;
+    _position = 0;
+    _size = 0;
+    _current.size = 0;
+    _current.offset = 0;
+    _failed = false;
+    return true;
+}
+
+bool BlockWriter::write(const void *data, std::size_t size)
+{
+    if (_fd < 0 || _failed) return false;
+
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        auto chunk = std::min(size, _options.block_size - _current.size);
+        std::memcpy(_current.data + _current.size, bytes, chunk);
+        _current.size += chunk;
+        _position += chunk;
+        _size = std::max(_size, _position);
+        bytes += chunk;
+        size -= chunk;
+        if (_current.size == _options.block_size && !submit()) return false;
+    }
+    return true;
+}
+
+bool BlockWriter::seek(std::uint64_t offset)
+{
+    if (_fd < 0) return false;
+    if (offset == _position) return true;
+    // Blocks are written in order, so a rewrite lands after what it overwrites.
+    if (!submit()) return false;
+    _position = offset;
+    _current.offset = offset;
+    return true;
+}
+
+bool BlockWriter::close()
+{
+    if (_fd < 0) return true;
+
+    submit();
+    std::vector<std::uint32_t> durations;
+    {
+        std::unique_lock lock(_mutex);
+        _changed.wait(lock, [this] { return _queue.empty(); });
+        durations.swap(_durations);
+    }
+
+    if (_options.preallocate > 0 || _direct) truncate_file(_fd, _size);
+    if (_options.sync && !sync_file(_fd)) {
+        spdlog::error("Failed to sync {}: {}", _path.string(), std::strerror(errno));
+        _failed = true;
+    }
+    close_file(_fd);
+    _fd = -1;
+
+    std::sort(durations.begin(), durations.end());
+    _latency.writes = durations.size();
+    _latency.bytes = _size;
+    _latency.p50 = percentile(durations, 0.5);
+    _latency.p99 = percentile(durations, 0.99);
+    _latency.p999 = percentile(durations, 0.999);
+    _latency.max = percentile(durations, 1.0);
+    spdlog::info(
+        "Wrote {} ({} MB in {} writes), write latency p50 {} us, p99 {} us, p99.9 {} us, "
+        "max {} us",
+        _path.string(),
+        _latency.bytes >> 20,
+        _latency.writes,
+        _latency.p50.count(),
+        _latency.p99.count(),
+        _latency.p999.count(),
+        _latency.max.count()
+    );
+    if (_failed) spdlog::error("Failed to write {}", _path.string());
+    return !_failed;
+}
+
+bool BlockWriter::submit()
+{
+    if (_current.size == 0) return !_failed;
+
+    std::unique_lock lock(_mutex);
+    _queue.push_back(_current);
+    _changed.notify_all();
+    _changed.wait(lock, [this] { return !_free.empty(); });
+    _current = {_free.back(), 0, _position};
+    _free.pop_back();
+    return !_failed;
+}
+
+void BlockWriter::run()
+{
+    std::unique_lock lock(_mutex);
+    while (true) {
+        _changed.wait(lock, [this] { return _stopping || !_queue.empty(); });
+        if (_queue.empty()) return;
+
+        // The block stays queued until it is written, so an empty queue means a drained one.
+        auto block = _queue.front();
+        lock.unlock();
+        auto begin = std::chrono::steady_clock::now();
+        auto written = _failed || write_block(block);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - begin
+        );
+        lock.lock();
+
+        if (!written) _failed = true;
+        _durations.push_back(
+            static_cast<std::uint32_t>(std::min<std::int64_t>(elapsed.count(), UINT32_MAX))
+        );
+        _queue.pop_front();
+        _free.push_back(block.data);
+        _changed.notify_all();
+    }
+}
+
+bool BlockWriter::write_block(const Block &block)
+{
+    auto aligned = block.size % ALIGNMENT == 0 && block.offset % ALIGNMENT == 0;
+    auto written = _direct && !aligned ? write_unaligned(block)
+                                       : write_at(_fd, block.data, block.size, block.offset);
+    if (written) return true;
+    spdlog::error(
+        "Failed to write {} bytes at {} of {}: {}",
+        block.size,
+        block.offset,
+        _path.string(),
+        std::strerror(errno)
+    );
+    return false;
+}
+bool BlockWriter::write_unaligned(const Block &block)
+{
+#if defined(_WIN32)
+    (void) block;
+    return false;
+#else
+    auto begin = block.offset / ALIGNMENT * ALIGNMENT;
+    auto end = align_up(block.offset + block.size);
+    auto head = block.offset > begin;
+    auto tail = block.offset + block.size < end;
+    // Blocks are written in order by this thread, so the sectors read back hold everything
+    // written before this block.
+    if (head && !read_at(_fd, _bounce, ALIGNMENT, begin)) return false;
+    if (tail && !(head && end - begin == ALIGNMENT) &&
+        !read_at(_fd, _bounce + (end - begin - ALIGNMENT), ALIGNMENT, end - ALIGNMENT)) {
+        return false;
+    }
+    std::memcpy(_bounce + (block.offset - begin), block.data, block.size);
+    return write_at(_fd, _bounce, end - begin, begin);
+#endif
+}
\ No newline at end of file
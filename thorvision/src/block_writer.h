@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// Sequential file writer for recordings. Small writes are copied into large aligned blocks
+// that a dedicated thread hands to the disk, so the streaming thread only stalls when the
+// disk falls a whole queue behind. Fragments can be preallocated so the filesystem doesn't
+// have to extend them block by block, and writes can bypass the page cache.
+class BlockWriter
+{
+public:
+    struct Options {
+
+        std::size_t block_size = 4 << 20;
+        // Full blocks the streaming thread may be ahead of the disk.
+        std::size_t queue_blocks = 8;
+        // Bytes reserved when a file is opened; the file keeps its written size.
+        std::uint64_t preallocate = 0;
+        // O_DIRECT on Linux. Writes that aren't sector-aligned, the tail and header
+        // rewrites, are padded out with the bytes already on the disk, and the file is cut
+        // back to its size by close().
+        bool direct = false;
+        // Flush the file to the disk before close() returns.
+        bool sync = false;
+
+        // Blocks of about 1/8 s of a stream of the given rate, and enough of them to ride out
+        // a second of disk stall. The defaults for a rate of 0.
+        static Options for_bitrate(std::uint64_t bytes_per_second);
+    };
+
+    // Durations of the write calls made for one file.
+    struct Latency {
+        std::uint64_t writes = 0;
+        std::uint64_t bytes = 0;
+        std::chrono::microseconds p50{0};
+        std::chrono::microseconds p99{0};
+        std::chrono::microseconds p999{0};
+        std::chrono::microseconds max{0};
+    };
+
+    explicit BlockWriter(Options options);
+    ~BlockWriter();
+    BlockWriter(const BlockWriter &) = delete;
+    BlockWriter &operator=(const BlockWriter &) = delete;
+
+    // One file at a time; open() closes the previous one.
+    bool open(const fs::path &path);
+    // Returns false once a write to the open file has failed.
+    bool write(const void *data, std::size_t size);
+    // Moves the write position, for muxers that rewrite their header when they finish.
+    bool seek(std::uint64_t offset);
+    std::uint64_t position() const { return _position; }
+    // Waits until everything written has reached the file and closes it.
+    bool close();
+
+    // Of the last closed file.
+    Latency latency() const { return _latency; }
+
+private:
+    struct Block {
+        char *data;
+        std::size_t size;
+        std::uint64_t offset;
+    };
+
+    void run();
+    // Queues the block being filled and waits for a free one to fill next.
+    bool submit();
+    bool write_block(const Block &block);
+    // Through _bounce, for a direct file.
+    bool write_unaligned(const Block &block);
+
+    const Options _options;
+    fs::path _path;
+    int _fd;
+    // Whether _fd was opened with O_DIRECT.
+    bool _direct;
+    // Aligned copy of a block and the sectors around it, for write_unaligned().
+    char *_bounce;
+    std::uint64_t _position;
+    std::uint64_t _size;
+    Block _current;
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::deque<Block> _queue;
+    std::vector<char *> _free;
+    std::vector<char *> _blocks;
+    bool _stopping;
+    std::atomic_bool _failed;
+    std::vector<std::uint32_t> _durations;  // us
+    Latency _latency;
+
+    std::jthread _thread;
+};
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "bus_reactor.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <mutex>
+
+
+struct BusWatch::Entry {
+    // Held while the handler runs, so reset() can wait for a dispatch in progress.
+    std::mutex mutex;
+    BusReactor::Handler handler;
+    GSource *source = nullptr;
+};
+
+
+namespace
+{
+gboolean dispatch(GstBus *, GstMessage *message, gpointer user_data)
+{
+    auto entry = static_cast<std::shared_ptr<BusWatch::Entry> *>(user_data)->get();
+    std::lock_guard lock(entry->mutex);
+    if (entry->handler) entry->handler(message);
+    return G_SOURCE_CONTINUE;
+}
+
+void release_entry(gpointer user_data)
+{
+    delete static_cast<std::shared_ptr<BusWatch::Entry> *>(user_data);
+}
+}  // namespace
+
+
+BusReactor &BusReactor::instance()
+{
+    static BusReactor reactor;
+    return reactor;
+}
+
+BusReactor::BusReactor()
+    : _context(g_main_context_new()), _loop(g_main_loop_new(_context, FALSE))
+{
+    _thread = std::jthread([this]() {
+        g_main_context_push_thread_default(_context);
+        g_main_loop_run(_loop);
+        g_main_context_pop_thread_default(_context);
+    });
+}
+
+BusReactor::~BusReactor()
+{
+    g_main_loop_quit(_loop);
+    _thread.join();
+    g_main_loop_unref(_loop);
+    g_main_context_unref(_context);
+}
+
+BusWatch BusReactor::watch(GstPipeline *pipeline, Handler handler)
+{
+    auto entry = std::make_shared<BusWatch::Entry>();
+    entry->handler = std::move(handler);
+
+    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+        gst_pipeline_get_bus(pipeline), gst_object_unref
+    );
+    entry->source = gst_bus_create_watch(bus.get());
+    if (!entry->source) {
+        spdlog::error("Failed to watch the bus of pipeline {}", GST_ELEMENT_NAME(pipeline));
+        return {};
+    }
+    g_source_set_callback(
+        entry->source,
+        reinterpret_cast<GSourceFunc>(dispatch),
+        new std::shared_ptr<BusWatch::Entry>(entry),
+        release_entry
+    );
+    g_source_attach(entry->source, _context);
+    return BusWatch(std::move(entry));
+}
+
+
+BusWatch &BusWatch::operator=(BusWatch &&other) noexcept
+{
+    if (this != &other) {
+        reset();
+        _entry = std::move(other._entry);
+    }
+    return *this;
+}
+
+void BusWatch::reset()
+{
+    if (!_entry) return;
+    g_source_destroy(_entry->source);
+    {
+        // Waits for a handler that is already running; later dispatches see no handler.
+        std::lock_guard lock(_entry->mutex);
+        _entry->handler = nullptr;
+    }
+    g_source_unref(_entry->source);
+    _entry.reset();
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glib.h>
+#include <gst/gstmessage.h>
+#include <gst/gstpipeline.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+
+class BusWatch;
+
+// One thread that waits on the buses of every camera pipeline at once. Each bus is a GSource
+// on the reactor's own GMainContext, so a message is dispatched as soon as it is posted
+// instead of on the next poll, and N cameras cost one thread instead of N.
+class BusReactor
+{
+public:
+    // Runs on the reactor thread, so it must not block and must not remove its own watch.
+    using Handler = std::function<void(GstMessage *message)>;
+
+    static BusReactor &instance();
+
+    BusReactor(const BusReactor &) = delete;
+    BusReactor &operator=(const BusReactor &) = delete;
+
+    [[nodiscard]] BusWatch watch(GstPipeline *pipeline, Handler handler);
+
+    // Null until the reactor thread is running.
+    std::thread::id thread_id() const { return _thread.get_id(); }
+
+private:
+    BusReactor();
+    ~BusReactor();
+
+    GMainContext *_context;
+    GMainLoop *_loop;
+    std::jthread _thread;
+};
+
+
+// Keeps a pipeline's bus dispatching to its handler. Once reset() or the destructor returns
+// the handler is not running and will not run again, so it may capture the watch's owner.
+class BusWatch
+{
+public:
+    BusWatch() = default;
+    ~BusWatch() { reset(); }
+    BusWatch(BusWatch &&) = default;
+    BusWatch &operator=(BusWatch &&other) noexcept;
+
+    void reset();
+
+private:
+    friend class BusReactor;
+    struct Entry;
+    explicit BusWatch(std::shared_ptr<Entry> entry) : _entry(std::move(entry)) {}
+
+    std::shared_ptr<Entry> _entry;
+};
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <QDockwidget>
 #include <QHBoxLayout>
 #include <QRadioButton>
+#include <QSettings>
+#include <algorithm>
 #include <string>
 
 #include "stream_window.h"
@@ -20,6 +22,7 @@ namespace
 {
 auto constexpr VIDEO_RAW = "video/x-raw";
 auto constexpr VIDEO_MJPEG = "image/jpeg";
+auto constexpr PREVIEW_FPS = "preview_fps";
 }  // namespace
 
 
@@ -32,6 +35,7 @@ CameraItemWidget::CameraItemWidget(Camera *camera, QWidget *parent)
     _fps = new QComboBox(this);
     _codec = new QComboBox(this);
     auto view = new QRadioButton(tr("View"), this);
+    auto preview_fps = new QComboBox(this);
     auto audio = new QCheckBox(tr("Audio"), this);
 
     _resolution->addItem("");
@@ -60,8 +64,22 @@ CameraItemWidget::CameraItemWidget(Camera *camera, QWidget *parent)
     layout->addWidget(_fps);
     layout->addWidget(_codec);
     layout->addWidget(view);
+    layout->addWidget(preview_fps);
     layout->addWidget(audio);
 
+    // The preview rate is independent of the capture rate; recordings always get every frame.
+    preview_fps->setToolTip(tr("Preview frame rate"));
+    preview_fps->addItem(tr("Full"), 0);
+    for (auto fps : {30, 15, 5}) {
+        preview_fps->addItem(QString::fromStdString(fmt::format("{} FPS", fps)), fps);
+    }
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    settings.beginGroup(QString::fromStdString(camera->name()));
+    preview_fps->setCurrentIndex(
+        std::max(0, preview_fps->findData(settings.value(PREVIEW_FPS, 0).toInt()))
+    );
+    settings.endGroup();
+
     const std::map<Resolution, QString> rm = {
         {{176, 144}, tr("144p")},
         {{320, 240}, tr("240p")},
@@ -371,16 +389,7 @@ CameraItemWidget::CameraItemWidget(Camera *camera, QWidget *parent)
                         }
                     }
                 );
-                stream_mainwindow->addDockWidget(Qt::TopDockWidgetArea, _stream_window);
-
-                auto windows = stream_mainwindow->findChildren<StreamWindow *>();
-                auto count = static_cast<int>(windows.size());
-
-                if (count == 3) {
-                    stream_mainwindow->splitDockWidget(windows[0], windows[2], Qt::Vertical);
-                } else if (count == 4) {
-                    stream_mainwindow->splitDockWidget(windows[1], windows[3], Qt::Vertical);
-                }
+                stream_mainwindow->add_stream(_stream_window);
 
                 stream_mainwindow->show();
                 // TODO: Stop the current camera before starting a new one.
@@ -405,14 +414,22 @@ CameraItemWidget::CameraItemWidget(Camera *camera, QWidget *parent)
             !stream_mainwindow->findChildren<StreamWindow *>().isEmpty() ? true : false
         );
     });
+    connect(preview_fps, &QComboBox::currentIndexChanged, [this, camera, preview_fps](int) {
+        auto fps = preview_fps->currentData().toInt();
+        QSettings settings("KonteX Neuroscience", "Thor Vision");
+        settings.beginGroup(QString::fromStdString(camera->name()));
+        settings.setValue(PREVIEW_FPS, fps);
+        settings.endGroup();
+        if (_stream_window) _stream_window->set_preview_fps(fps);
+    });
     connect(view, &QRadioButton::toggled, [this](bool checked) {
         if (_stream_window) {
             if (checked) {
                 spdlog::info("Show camera '{}' stream view", _stream_window->_camera->name());
-                _stream_window->show();
+                _stream_window->set_viewed(true);
             } else {
                 spdlog::info("Hide camera '{}' stream view", _stream_window->_camera->name());
-                _stream_window->hide();
+                _stream_window->set_viewed(false);
             }
         }
     });
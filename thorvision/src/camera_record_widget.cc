@@ -8,8 +8,10 @@
 #include <QLabel>
 #include <QRadioButton>
 #include <QSettings>
+#include <QSpinBox>
 
 #include "duration_spinbox.h"
+#include "trigger_config.h"
 
 
 namespace
@@ -19,6 +21,7 @@ auto constexpr TRIGGER_ON = "trigger_on";
 auto constexpr DIGITAL_CHANNEL = "digital_channel";
 auto constexpr TRIGGER_CONDITION = "trigger_condition";
 auto constexpr TRIGGER_DURATION = "trigger_duration";
+auto constexpr PRE_RECORD_TIME = "pre_record_time";
 }  // namespace
 
 
@@ -33,6 +36,7 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
     auto trigger_conditions = new QComboBox(this);
     spdlog::info("Creating DurationSpinBox.");
     auto trigger_duration = new DurationSpinBox(this);
+    auto pre_record_time = new QSpinBox(this);
 
     trigger_on->setDisabled(true);
     name->setText(QString::fromStdString(camera_name));
@@ -48,12 +52,18 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
     digital_channels->setSizeAdjustPolicy(QComboBox::AdjustToContents);
     trigger_conditions->setSizeAdjustPolicy(QComboBox::AdjustToContents);
 
+    pre_record_time->setRange(0, 10);
+    pre_record_time->setPrefix(tr("Pre "));
+    pre_record_time->setSuffix("s");
+    pre_record_time->setToolTip(tr("Seconds of video kept from before the recording starts"));
+
     layout->addWidget(name);
     layout->addWidget(continuous);
     layout->addWidget(trigger_on);
     layout->addWidget(digital_channels);
     layout->addWidget(trigger_conditions);
     layout->addWidget(trigger_duration);
+    layout->addWidget(pre_record_time);
 
     QSettings settings("KonteX Neuroscience", "Thor Vision");
     settings.beginGroup(name->text());
@@ -62,11 +72,13 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
     auto _digital_channel = settings.value(DIGITAL_CHANNEL, 0).toUInt();
     auto _trigger_condition = settings.value(TRIGGER_CONDITION, 0).toUInt();
     auto _trigger_duration = settings.value(TRIGGER_DURATION, 1).toUInt();
+    auto _pre_record_time = settings.value(PRE_RECORD_TIME, 0).toUInt();
     settings.setValue(CONTINUOUS, _continuous);
     settings.setValue(TRIGGER_ON, _trigger_on);
     settings.setValue(DIGITAL_CHANNEL, _digital_channel);
     settings.setValue(TRIGGER_CONDITION, _trigger_condition);
     settings.setValue(TRIGGER_DURATION, _trigger_duration);
+    settings.setValue(PRE_RECORD_TIME, _pre_record_time);
     settings.endGroup();
 
     continuous->setChecked(_continuous);
@@ -74,6 +86,7 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
     digital_channels->setCurrentIndex(_digital_channel);
     trigger_conditions->setCurrentIndex(_trigger_condition);
     trigger_duration->setValue(_trigger_duration);
+    pre_record_time->setValue(_pre_record_time);
 
     if (continuous->isChecked()) {
         digital_channels->setDisabled(true);
@@ -93,6 +106,7 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
             settings.beginGroup(name->text());
             settings.setValue(CONTINUOUS, checked);
             settings.endGroup();
+            TriggerConfigSlot::reload_camera(name->text().toStdString());
             digital_channels->setDisabled(checked);
             trigger_conditions->setDisabled(checked);
             trigger_duration->setDisabled(checked);
@@ -106,6 +120,7 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
         settings.beginGroup(name->text());
         settings.setValue(TRIGGER_ON, checked);
         settings.endGroup();
+        TriggerConfigSlot::reload_camera(name->text().toStdString());
     });
     connect(digital_channels, &QComboBox::currentIndexChanged, [name, digital_channels](int index) {
         spdlog::info(
@@ -118,6 +133,7 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
         settings.beginGroup(name->text());
         settings.setValue(DIGITAL_CHANNEL, index);
         settings.endGroup();
+        TriggerConfigSlot::reload_camera(name->text().toStdString());
     });
     connect(
         trigger_conditions,
@@ -133,6 +149,7 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
             settings.beginGroup(name->text());
             settings.setValue(TRIGGER_CONDITION, index);
             settings.endGroup();
+            TriggerConfigSlot::reload_camera(name->text().toStdString());
 
             trigger_duration->setDisabled(index != 2);  // ON For
         }
@@ -145,5 +162,16 @@ CameraRecordWidget::CameraRecordWidget(const std::string &camera_name, QWidget *
         settings.beginGroup(name->text());
         settings.setValue(TRIGGER_DURATION, value);
         settings.endGroup();
+        TriggerConfigSlot::reload_camera(name->text().toStdString());
+    });
+    connect(pre_record_time, &QSpinBox::valueChanged, [name](int value) {
+        spdlog::info(
+            "Set camera {} setting '{}' to {}s", name->text().toStdString(), PRE_RECORD_TIME, value
+        );
+        QSettings settings("KonteX Neuroscience", "Thor Vision");
+        settings.beginGroup(name->text());
+        settings.setValue(PRE_RECORD_TIME, value);
+        settings.endGroup();
+        TriggerConfigSlot::reload_camera(name->text().toStdString());
     });
 }
\ No newline at end of file
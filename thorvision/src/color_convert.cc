@@ -0,0 +1,449 @@
+#include "color_convert.h"
+
+#include <gst/video/video-color.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define X86_KERNELS
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+
+namespace
+{
+#if defined(X86_KERNELS) && !defined(_MSC_VER)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+enum Source { YUY2, NV12, I420, SOURCES };
+
+// One row of a source frame; for NV12 u points at the interleaved chroma.
+struct Row {
+    const unsigned char *y;
+    const unsigned char *u;
+    const unsigned char *v;
+};
+
+using RowFn = void (*)(const Row &, const ColourMatrix &, unsigned char *, int, int);
+
+struct Kernels {
+    const char *name;
+    RowFn rows[SOURCES][2];
+};
+
+template <template <Source, RGBFormat> class Kernel>
+Kernels make_kernels(const char *name)
+{
+    return {
+        name,
+        {
+            {Kernel<YUY2, RGBFormat::RGB888>::run, Kernel<YUY2, RGBFormat::RGBX>::run},
+            {Kernel<NV12, RGBFormat::RGB888>::run, Kernel<NV12, RGBFormat::RGBX>::run},
+            {Kernel<I420, RGBFormat::RGB888>::run, Kernel<I420, RGBFormat::RGBX>::run},
+        },
+    };
+}
+
+constexpr int bytes_per_pixel(RGBFormat format) { return format == RGBFormat::RGBX ? 4 : 3; }
+
+unsigned char clamp_byte(std::int32_t value)
+{
+    return static_cast<unsigned char>(std::clamp(value, 0, 255));
+}
+
+// Converts pixels [from, width) one at a time; also finishes the tail of the SIMD kernels.
+template <Source S, RGBFormat F>
+struct ScalarRow {
+    static void run(
+        const Row &row, const ColourMatrix &m, unsigned char *dst, int from, int width
+    )
+    {
+        auto round = 1 << (ColourMatrix::SHIFT - 1);
+        for (auto x = from; x < width; ++x) {
+            std::int32_t y, u, v;
+            if constexpr (S == YUY2) {
+                auto pair = row.y + (x & ~1) * 2;
+                y = row.y[x * 2];
+                u = pair[1];
+                v = pair[3];
+            } else if constexpr (S == NV12) {
+                y = row.y[x];
+                u = row.u[(x >> 1) * 2];
+                v = row.u[(x >> 1) * 2 + 1];
+            } else {
+                y = row.y[x];
+                u = row.u[x >> 1];
+                v = row.v[x >> 1];
+            }
+            auto luma = (y - m.y_offset) * m.y;
+            u -= 128;
+            v -= 128;
+
+            auto out = dst + x * bytes_per_pixel(F);
+            out[0] = clamp_byte((luma + v * m.v_to_r + round) >> ColourMatrix::SHIFT);
+            auto green = luma - u * m.u_to_g - v * m.v_to_g + round;
+            out[1] = clamp_byte(green >> ColourMatrix::SHIFT);
+            out[2] = clamp_byte((luma + u * m.u_to_b + round) >> ColourMatrix::SHIFT);
+            if constexpr (F == RGBFormat::RGBX) out[3] = 255;
+        }
+    }
+};
+
+
+#ifdef X86_KERNELS
+std::int32_t load_u32(const unsigned char *src)
+{
+    std::int32_t value;
+    std::memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+std::int32_t load_u16(const unsigned char *src)
+{
+    std::uint16_t value;
+    std::memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+// Shuffle mask that zero-extends bytes a, b, c, d into four 32-bit lanes.
+TARGET_SSE41 __m128i widen_mask(char a, char b, char c, char d)
+{
+    return _mm_setr_epi8(a, -1, -1, -1, b, -1, -1, -1, c, -1, -1, -1, d, -1, -1, -1);
+}
+
+TARGET_SSE41 void store_12(unsigned char *dst, __m128i pixels)
+{
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), pixels);
+    auto tail = _mm_extract_epi32(pixels, 2);
+    std::memcpy(dst + 8, &tail, sizeof(tail));
+}
+
+// Shuffles [R0..R3 G0..G3 B0..B3 X0..X3] into interleaved pixels.
+TARGET_SSE41 __m128i interleave_mask(RGBFormat format)
+{
+    return format == RGBFormat::RGBX
+               ? _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15)
+               : _mm_setr_epi8(0, 4, 8, 1, 5, 9, 2, 6, 10, 3, 7, 11, -1, -1, -1, -1);
+}
+
+// Four pixels per iteration in 32-bit lanes, so results match ScalarRow exactly.
+template <Source S, RGBFormat F>
+struct SSE41Row {
+    TARGET_SSE41 static void run(
+        const Row &row, const ColourMatrix &m, unsigned char *dst, int from, int width
+    )
+    {
+        auto y_offset = _mm_set1_epi32(m.y_offset);
+        auto y_scale = _mm_set1_epi32(m.y);
+        auto v_to_r = _mm_set1_epi32(m.v_to_r);
+        auto u_to_g = _mm_set1_epi32(m.u_to_g);
+        auto v_to_g = _mm_set1_epi32(m.v_to_g);
+        auto u_to_b = _mm_set1_epi32(m.u_to_b);
+        auto chroma_offset = _mm_set1_epi32(128);
+        auto round = _mm_set1_epi32(1 << (ColourMatrix::SHIFT - 1));
+        auto alpha = _mm_set1_epi32(255);
+        auto interleave = interleave_mask(F);
+
+        auto x = from;
+        for (; x + 4 <= width; x += 4) {
+            __m128i y, u, v;
+            if constexpr (S == YUY2) {
+                auto packed = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row.y + x * 2));
+                y = _mm_shuffle_epi8(packed, widen_mask(0, 2, 4, 6));
+                u = _mm_shuffle_epi8(packed, widen_mask(1, 1, 5, 5));
+                v = _mm_shuffle_epi8(packed, widen_mask(3, 3, 7, 7));
+            } else if constexpr (S == NV12) {
+                auto chroma = _mm_cvtsi32_si128(load_u32(row.u + x));
+                y = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load_u32(row.y + x)));
+                u = _mm_shuffle_epi8(chroma, widen_mask(0, 0, 2, 2));
+                v = _mm_shuffle_epi8(chroma, widen_mask(1, 1, 3, 3));
+            } else {
+                y = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(load_u32(row.y + x)));
+                u = _mm_shuffle_epi8(
+                    _mm_cvtsi32_si128(load_u16(row.u + x / 2)), widen_mask(0, 0, 1, 1)
+                );
+                v = _mm_shuffle_epi8(
+                    _mm_cvtsi32_si128(load_u16(row.v + x / 2)), widen_mask(0, 0, 1, 1)
+                );
+            }
+
+            auto luma = _mm_mullo_epi32(_mm_sub_epi32(y, y_offset), y_scale);
+            u = _mm_sub_epi32(u, chroma_offset);
+            v = _mm_sub_epi32(v, chroma_offset);
+
+            auto r = _mm_add_epi32(_mm_add_epi32(luma, _mm_mullo_epi32(v, v_to_r)), round);
+            auto g = _mm_sub_epi32(
+                _mm_sub_epi32(luma, _mm_mullo_epi32(u, u_to_g)), _mm_mullo_epi32(v, v_to_g)
+            );
+            g = _mm_add_epi32(g, round);
+            auto b = _mm_add_epi32(_mm_add_epi32(luma, _mm_mullo_epi32(u, u_to_b)), round);
+            r = _mm_srai_epi32(r, ColourMatrix::SHIFT);
+            g = _mm_srai_epi32(g, ColourMatrix::SHIFT);
+            b = _mm_srai_epi32(b, ColourMatrix::SHIFT);
+
+            // The saturating packs clamp to [0, 255] like clamp_byte().
+            auto pixels = _mm_packus_epi16(_mm_packus_epi32(r, g), _mm_packus_epi32(b, alpha));
+            pixels = _mm_shuffle_epi8(pixels, interleave);
+
+            auto out = dst + x * bytes_per_pixel(F);
+            if constexpr (F == RGBFormat::RGBX) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out), pixels);
+            } else {
+                store_12(out, pixels);
+            }
+        }
+        ScalarRow<S, F>::run(row, m, dst, x, width);
+    }
+};
+
+// Eight pixels per iteration; the sources are gathered with 128-bit shuffles and widened.
+template <Source S, RGBFormat F>
+struct AVX2Row {
+    TARGET_AVX2 static void run(
+        const Row &row, const ColourMatrix &m, unsigned char *dst, int from, int width
+    )
+    {
+        auto y_offset = _mm256_set1_epi32(m.y_offset);
+        auto y_scale = _mm256_set1_epi32(m.y);
+        auto v_to_r = _mm256_set1_epi32(m.v_to_r);
+        auto u_to_g = _mm256_set1_epi32(m.u_to_g);
+        auto v_to_g = _mm256_set1_epi32(m.v_to_g);
+        auto u_to_b = _mm256_set1_epi32(m.u_to_b);
+        auto chroma_offset = _mm256_set1_epi32(128);
+        auto round = _mm256_set1_epi32(1 << (ColourMatrix::SHIFT - 1));
+        auto alpha = _mm256_set1_epi32(255);
+        auto interleave = _mm256_broadcastsi128_si256(interleave_mask(F));
+
+        auto x = from;
+        for (; x + 8 <= width; x += 8) {
+            __m128i y8, u8, v8;
+            if constexpr (S == YUY2) {
+                auto packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row.y + x * 2));
+                y8 = _mm_shuffle_epi8(
+                    packed, _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 0, 0, 0, 0, 0, 0, 0, 0)
+                );
+                u8 = _mm_shuffle_epi8(
+                    packed, _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13, 0, 0, 0, 0, 0, 0, 0, 0)
+                );
+                v8 = _mm_shuffle_epi8(
+                    packed, _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15, 0, 0, 0, 0, 0, 0, 0, 0)
+                );
+            } else if constexpr (S == NV12) {
+                auto chroma = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row.u + x));
+                y8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row.y + x));
+                u8 = _mm_shuffle_epi8(
+                    chroma, _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, 0, 0, 0, 0, 0, 0, 0, 0)
+                );
+                v8 = _mm_shuffle_epi8(
+                    chroma, _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, 0, 0, 0, 0, 0, 0, 0, 0)
+                );
+            } else {
+                auto duplicate = _mm_setr_epi8(0, 0, 1, 1, 2, 2, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0);
+                y8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(row.y + x));
+                u8 = _mm_shuffle_epi8(_mm_cvtsi32_si128(load_u32(row.u + x / 2)), duplicate);
+                v8 = _mm_shuffle_epi8(_mm_cvtsi32_si128(load_u32(row.v + x / 2)), duplicate);
+            }
+            auto y = _mm256_cvtepu8_epi32(y8);
+            auto u = _mm256_sub_epi32(_mm256_cvtepu8_epi32(u8), chroma_offset);
+            auto v = _mm256_sub_epi32(_mm256_cvtepu8_epi32(v8), chroma_offset);
+
+            auto luma = _mm256_mullo_epi32(_mm256_sub_epi32(y, y_offset), y_scale);
+            auto r = _mm256_add_epi32(_mm256_add_epi32(luma, _mm256_mullo_epi32(v, v_to_r)), round);
+            auto g = _mm256_sub_epi32(
+                _mm256_sub_epi32(luma, _mm256_mullo_epi32(u, u_to_g)),
+                _mm256_mullo_epi32(v, v_to_g)
+            );
+            g = _mm256_add_epi32(g, round);
+            auto b = _mm256_add_epi32(_mm256_add_epi32(luma, _mm256_mullo_epi32(u, u_to_b)), round);
+            r = _mm256_srai_epi32(r, ColourMatrix::SHIFT);
+            g = _mm256_srai_epi32(g, ColourMatrix::SHIFT);
+            b = _mm256_srai_epi32(b, ColourMatrix::SHIFT);
+
+            // Packs work per 128-bit lane, so each lane ends up holding four whole pixels.
+            auto pixels = _mm256_packus_epi16(
+                _mm256_packus_epi32(r, g), _mm256_packus_epi32(b, alpha)
+            );
+            pixels = _mm256_shuffle_epi8(pixels, interleave);
+
+            auto out = dst + x * bytes_per_pixel(F);
+            if constexpr (F == RGBFormat::RGBX) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), pixels);
+            } else {
+                store_12(out, _mm256_castsi256_si128(pixels));
+                store_12(out + 12, _mm256_extracti128_si256(pixels, 1));
+            }
+        }
+        ScalarRow<S, F>::run(row, m, dst, x, width);
+    }
+};
+
+#if defined(_MSC_VER)
+bool cpu_has_sse41()
+{
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 19);
+}
+
+bool cpu_has_avx2()
+{
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    // The OS must save the YMM registers too.
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+}
+#else
+bool cpu_has_sse41() { return __builtin_cpu_supports("sse4.1"); }
+bool cpu_has_avx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+#endif
+
+// Fastest first.
+const std::vector<Kernels> &supported_kernels()
+{
+    static auto const supported = [] {
+        std::vector<Kernels> kernels;
+#ifdef X86_KERNELS
+        if (cpu_has_avx2()) kernels.push_back(make_kernels<AVX2Row>("AVX2"));
+        if (cpu_has_sse41()) kernels.push_back(make_kernels<SSE41Row>("SSE4.1"));
+#endif
+        kernels.push_back(make_kernels<ScalarRow>("scalar"));
+        return kernels;
+    }();
+    return supported;
+}
+
+const Kernels &kernels()
+{
+    static auto const selected = [] {
+        auto kernels = supported_kernels().front();
+        spdlog::info("Using {} colour conversion kernels", kernels.name);
+        return kernels;
+    }();
+    return selected;
+}
+
+bool convert(
+    const Kernels &kernels,
+    const GstVideoFrame &frame,
+    const ColourMatrix &matrix,
+    unsigned char *dst,
+    int dst_stride,
+    RGBFormat format
+)
+{
+    Source source;
+    switch (GST_VIDEO_FRAME_FORMAT(&frame)) {
+    case GST_VIDEO_FORMAT_YUY2: source = YUY2; break;
+    case GST_VIDEO_FORMAT_NV12: source = NV12; break;
+    case GST_VIDEO_FORMAT_I420: source = I420; break;
+    default: return false;
+    }
+    auto convert_row = kernels.rows[source][static_cast<int>(format)];
+
+    auto plane = [&frame](int index, int row) {
+        auto data = static_cast<const unsigned char *>(GST_VIDEO_FRAME_PLANE_DATA(&frame, index));
+        return data + row * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, index);
+    };
+    auto width = GST_VIDEO_FRAME_WIDTH(&frame);
+    auto height = GST_VIDEO_FRAME_HEIGHT(&frame);
+    for (auto y = 0; y < height; ++y) {
+        Row row{plane(0, y), nullptr, nullptr};
+        if (source == NV12) {
+            row.u = plane(1, y / 2);
+        } else if (source == I420) {
+            row.u = plane(1, y / 2);
+            row.v = plane(2, y / 2);
+        }
+        convert_row(row, matrix, dst + y * dst_stride, 0, width);
+    }
+    return true;
+}
+}  // namespace
+
+
+ColourMatrix ColourMatrix::from(const GstVideoInfo &info)
+{
+    // BT.601 unless the caps say otherwise; it is what JPEG and most USB cameras use.
+    gdouble kr = 0.299;
+    gdouble kb = 0.114;
+    if (!gst_video_color_matrix_get_Kr_Kb(info.colorimetry.matrix, &kr, &kb)) {
+        kr = 0.299;
+        kb = 0.114;
+    }
+    auto kg = 1.0 - kr - kb;
+    auto full_range = info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+    auto y = full_range ? 1.0 : 255.0 / 219.0;
+    auto c = full_range ? 1.0 : 255.0 / 224.0;
+
+    auto fixed = [](double value) {
+        return static_cast<std::int32_t>(std::lround(value * (1 << SHIFT)));
+    };
+    return {
+        full_range ? 0 : 16,
+        fixed(y),
+        fixed(c * 2.0 * (1.0 - kr)),
+        fixed(c * 2.0 * kb * (1.0 - kb) / kg),
+        fixed(c * 2.0 * kr * (1.0 - kr) / kg),
+        fixed(c * 2.0 * (1.0 - kb)),
+    };
+}
+
+bool can_convert_to_rgb(GstVideoFormat format)
+{
+    return format == GST_VIDEO_FORMAT_YUY2 || format == GST_VIDEO_FORMAT_NV12 ||
+           format == GST_VIDEO_FORMAT_I420;
+}
+
+bool convert_to_rgb(
+    const GstVideoFrame &frame,
+    const ColourMatrix &matrix,
+    unsigned char *dst,
+    int dst_stride,
+    RGBFormat format
+)
+{
+    return convert(kernels(), frame, matrix, dst, dst_stride, format);
+}
+
+const char *convert_kernel_name() { return kernels().name; }
+
+std::vector<const char *> convert_kernel_names()
+{
+    std::vector<const char *> names;
+    for (auto &kernels : supported_kernels()) names.push_back(kernels.name);
+    return names;
+}
+
+bool convert_to_rgb_with(
+    const char *kernels,
+    const GstVideoFrame &frame,
+    const ColourMatrix &matrix,
+    unsigned char *dst,
+    int dst_stride,
+    RGBFormat format
+)
+{
+    for (auto &supported : supported_kernels()) {
+        if (std::string_view(supported.name) == kernels) {
+            return convert(supported, frame, matrix, dst, dst_stride, format);
+        }
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <gst/video/video-format.h>
+#include <gst/video/video-frame.h>
+#include <gst/video/video-info.h>
+
+#include <cstdint>
+#include <vector>
+
+
+// YUV to RGB conversion for the painter preview, so the pipeline can hand over the decoder's
+// or the camera's own format instead of converting in videoconvert. Scalar, SSE4.1 and AVX2
+// kernels produce identical output; the fastest one the CPU supports is picked on first use.
+
+enum class RGBFormat { RGB888, RGBX };
+
+// Integer conversion coefficients in Q14, taken from the stream's colorimetry.
+struct ColourMatrix {
+    static auto constexpr SHIFT = 14;
+
+    std::int32_t y_offset;
+    std::int32_t y;
+    std::int32_t v_to_r;
+    std::int32_t u_to_g;
+    std::int32_t v_to_g;
+    std::int32_t u_to_b;
+
+    static ColourMatrix from(const GstVideoInfo &info);
+};
+
+// YUY2, NV12 and I420.
+bool can_convert_to_rgb(GstVideoFormat format);
+
+// Converts a mapped frame into dst, which holds height rows of dst_stride bytes.
+// Returns false if can_convert_to_rgb() doesn't accept the frame's format.
+bool convert_to_rgb(
+    const GstVideoFrame &frame,
+    const ColourMatrix &matrix,
+    unsigned char *dst,
+    int dst_stride,
+    RGBFormat format
+);
+
+// Name of the kernel set in use: "AVX2", "SSE4.1" or "scalar".
+const char *convert_kernel_name();
+
+// The kernel sets this CPU can run, fastest first; the first one is in use.
+std::vector<const char *> convert_kernel_names();
+
+// convert_to_rgb() with the named kernel set instead of the one in use, so each can be tested
+// and timed. Also false if the CPU can't run it.
+bool convert_to_rgb_with(
+    const char *kernels,
+    const GstVideoFrame &frame,
+    const ColourMatrix &matrix,
+    unsigned char *dst,
+    int dst_stride,
+    RGBFormat format
+);
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <QSettings>
 #include <QTimer>
 
+#include "trigger_config.h"
+
 
 namespace
 {
@@ -47,6 +49,7 @@ void DirNameComboBox::handle_editing_finished()
     if (!valid_dir_name_from_user_string(text)) {
         setItemText(1, default_dir_name);
         settings.setValue(DIR_NAME, default_dir_name);
+        TriggerConfigSlot::reload_all();
         QTimer::singleShot(0, this, [this, default_dir_name]() {
             setStyleSheet("");
             setCurrentText(default_dir_name);
@@ -56,6 +59,7 @@ void DirNameComboBox::handle_editing_finished()
     auto dir_name = text.trimmed();
     setItemText(1, dir_name);
     settings.setValue(DIR_NAME, dir_name);
+    TriggerConfigSlot::reload_all();
 }
 
 DirNameComboBox::DirNameComboBox(QWidget *parent) : QComboBox(parent)
@@ -84,6 +88,7 @@ DirNameComboBox::DirNameComboBox(QWidget *parent) : QComboBox(parent)
         auto dir_date = (index == 0);
         spdlog::info("Set record directory to {}", dir_date ? "Date" : "Custom");
         QSettings("KonteX Neuroscience", "Thor Vision").setValue(DIR_DATE, dir_date);
+        TriggerConfigSlot::reload_all();
         setEditable(!dir_date);
 
         if (dir_date) {
@@ -0,0 +1,235 @@
+#include "frame_index.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+
+namespace
+{
+auto constexpr MAGIC = std::array<char, 8>{'T', 'H', 'O', 'R', 'I', 'D', 'X', '\0'};
+auto constexpr HEADER_SIZE = std::size_t{16};
+auto constexpr WRITE_BUFFER = 1 << 16;
+// Frames that entered the branch but never reached the file, such as those cut off by a
+// stop, are dropped once this many are waiting.
+auto constexpr MAX_PENDING = std::size_t{1} << 16;
+auto constexpr NO_PTS = std::numeric_limits<std::uint64_t>::max();
+// Matroska's default timecode scale, in ns; PTS are stored as the container has them, like
+// the .bin's timestamps.
+auto constexpr CONTAINER_RESOLUTION = std::uint64_t{1'000'000};
+
+template <typename T>
+void put(char *&out, T value)
+{
+    std::memcpy(out, &value, sizeof(value));
+    out += sizeof(value);
+}
+
+template <typename T>
+T get(const char *&in)
+{
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+}
+}  // namespace
+
+
+FrameIndexWriter::FrameIndexWriter() : _buffer(WRITE_BUFFER), _frames(0) {}
+
+FrameIndexWriter::~FrameIndexWriter() { close(); }
+
+fs::path FrameIndexWriter::index_path(const fs::path &fragment)
+{
+    return fs::path(fragment).replace_extension(".idx");
+}
+
+void FrameIndexWriter::frame(std::uint64_t pts, std::optional<std::uint64_t> fpga_timestamp)
+{
+    std::lock_guard lock(_mutex);
+    _pending.push_back(Pending{pts, fpga_timestamp});
+    if (_pending.size() > MAX_PENDING) _pending.pop_front();
+}
+
+bool FrameIndexWriter::open(const fs::path &fragment)
+{
+    close();
+
+    std::lock_guard lock(_mutex);
+    _path = index_path(fragment);
+    _file.rdbuf()->pubsetbuf(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+    _file.open(_path, std::ios::binary | std::ios::trunc);
+    if (!_file) {
+        spdlog::error("Failed to create {}", _path.string());
+        return false;
+    }
+    std::array<char, HEADER_SIZE> header;
+    auto out = header.data();
+    std::memcpy(out, MAGIC.data(), MAGIC.size());
+    out += MAGIC.size();
+    put(out, VERSION);
+    put(out, static_cast<std::uint32_t>(RECORD_SIZE));
+    _file.write(header.data(), header.size());
+    return true;
+}
+
+void FrameIndexWriter::written(std::uint64_t pts, std::uint64_t offset, std::uint32_t size)
+{
+    std::lock_guard lock(_mutex);
+    if (!_file.is_open()) return;
+
+    // Frames reach the file in the order they entered the branch, so anything older than
+    // this one never made it.
+    std::optional<std::uint64_t> fpga_timestamp;
+    if (pts != NO_PTS) {
+        while (!_pending.empty() && _pending.front().pts < pts) _pending.pop_front();
+    }
+    if (!_pending.empty() && (pts == NO_PTS || _pending.front().pts == pts)) {
+        if (pts == NO_PTS) pts = _pending.front().pts;
+        fpga_timestamp = _pending.front().fpga_timestamp;
+        _pending.pop_front();
+    }
+
+    std::array<char, RECORD_SIZE> record;
+    auto out = record.data();
+    put(out, _frames++);
+    put(out, pts == NO_PTS ? pts : pts / CONTAINER_RESOLUTION * CONTAINER_RESOLUTION);
+    put(out, fpga_timestamp.value_or(0));
+    put(out, offset);
+    put(out, size);
+    put(out, fpga_timestamp ? HAS_METADATA : std::uint32_t{0});
+    _file.write(record.data(), record.size());
+}
+
+void FrameIndexWriter::close()
+{
+    std::lock_guard lock(_mutex);
+    if (!_file.is_open()) return;
+    _file.close();
+    if (!_file) spdlog::error("Failed to write {}", _path.string());
+}
+
+
+std::optional<FrameIndex> FrameIndex::load(const std::vector<fs::path> &fragments)
+{
+    FrameIndex index;
+    index._fragments = fragments;
+    for (std::size_t i = 0; i < fragments.size(); ++i) {
+        auto path = FrameIndexWriter::index_path(fragments[i]);
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), {});
+        if (data.size() < HEADER_SIZE || !std::equal(MAGIC.begin(), MAGIC.end(), data.begin())) {
+            spdlog::error("{} is not a frame index", path.string());
+            return std::nullopt;
+        }
+        const char *in = data.data() + MAGIC.size();
+        auto version = get<std::uint32_t>(in);
+        auto record_size = get<std::uint32_t>(in);
+        if (version != FrameIndexWriter::VERSION || record_size < FrameIndexWriter::RECORD_SIZE) {
+            spdlog::error("{} has unsupported version {}", path.string(), version);
+            return std::nullopt;
+        }
+        // A fragment still being recorded can end in part of a record.
+        auto count = (data.size() - HEADER_SIZE) / record_size;
+        for (std::size_t j = 0; j < count; ++j) {
+            in = data.data() + HEADER_SIZE + j * record_size;
+            Frame frame;
+            frame.frame = get<std::uint64_t>(in);
+            frame.pts = get<std::uint64_t>(in);
+            frame.fpga_timestamp = get<std::uint64_t>(in);
+            frame.offset = get<std::uint64_t>(in);
+            frame.size = get<std::uint32_t>(in);
+            frame.flags = get<std::uint32_t>(in);
+            frame.fragment = static_cast<std::uint32_t>(i);
+            if (frame.flags & FrameIndexWriter::HAS_METADATA) {
+                index._with_metadata.push_back(index._frames.size());
+            }
+            index._frames.push_back(frame);
+        }
+    }
+    return index;
+}
+
+std::optional<FrameIndex> FrameIndex::load_recording(const fs::path &prefix)
+{
+    std::vector<fs::path> fragments;
+    std::error_code ec;
+    auto name = prefix.filename().string() + "-";
+    for (const auto &entry : fs::directory_iterator(prefix.parent_path(), ec)) {
+        auto path = entry.path();
+        if (path.extension() == ".idx" || path.extension() == ".bin") continue;
+        // Not "<prefix>2-00000", nor another camera's "<prefix>-2-00000".
+        auto stem = path.stem().string();
+        if (stem.size() == name.size() || !stem.starts_with(name) ||
+            !std::all_of(stem.begin() + name.size(), stem.end(), [](char c) {
+                return c >= '0' && c <= '9';
+            })) {
+            continue;
+        }
+        if (fs::exists(FrameIndexWriter::index_path(path))) fragments.push_back(path);
+    }
+    if (ec) {
+        spdlog::error("Failed to list {}: {}", prefix.parent_path().string(), ec.message());
+        return std::nullopt;
+    }
+    // splitmuxsink numbers the fragments with zero padding, so names sort in recording order.
+    std::sort(fragments.begin(), fragments.end());
+    return load(fragments);
+}
+
+const FrameIndex::Frame *FrameIndex::at_frame(std::uint64_t frame) const
+{
+    if (_frames.empty() || frame < _frames.front().frame) return nullptr;
+    // Numbers only have gaps where a fragment was deleted, so this is nearly always a hit.
+    auto guess = frame - _frames.front().frame;
+    if (guess < _frames.size() && _frames[guess].frame == frame) return &_frames[guess];
+    auto it = std::lower_bound(_frames.begin(), _frames.end(), frame, [](auto &f, auto n) {
+        return f.frame < n;
+    });
+    return it != _frames.end() && it->frame == frame ? &*it : nullptr;
+}
+
+const FrameIndex::Frame *FrameIndex::at_pts(std::uint64_t pts) const
+{
+    auto it = std::lower_bound(_frames.begin(), _frames.end(), pts, [](auto &f, auto t) {
+        return f.pts < t;
+    });
+    return it != _frames.end() ? &*it : nullptr;
+}
+
+const FrameIndex::Frame *FrameIndex::at_fpga_timestamp(std::uint64_t fpga_timestamp) const
+{
+    auto it = std::lower_bound(
+        _with_metadata.begin(),
+        _with_metadata.end(),
+        fpga_timestamp,
+        [this](auto i, auto t) { return _frames[i].fpga_timestamp < t; }
+    );
+    return it != _with_metadata.end() ? &_frames[*it] : nullptr;
+}
+
+bool FrameIndex::read(const Frame &frame, std::vector<char> &jpeg) const
+{
+    std::ifstream file(_fragments.at(frame.fragment), std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(frame.offset));
+    jpeg.resize(frame.size);
+    file.read(jpeg.data(), static_cast<std::streamsize>(jpeg.size()));
+    if (!file) return false;
+    auto marker = [&](std::size_t at, char code) {
+        return jpeg[at] == '\xFF' && jpeg[at + 1] == code;
+    };
+    if (jpeg.size() < 4 || !marker(0, '\xD8') || !marker(jpeg.size() - 2, '\xD9')) {
+        spdlog::warn(
+            "Frame {} is not where the index of {} says",
+            frame.frame,
+            _fragments.at(frame.fragment).string()
+        );
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// The .idx written next to every fragment of a JPEG recording, which says where each frame
+// is in the file, so a reader can seek to a frame without demuxing from the start. It holds
+// a 16-byte header, "THORIDX" NUL, a uint32 version and a uint32 record size, followed by one
+// packed little-endian record per frame:
+//   frame           uint64  number of the frame in the recording, counting from 0
+//   pts             uint64  timestamp the container stores for the frame, ns
+//   fpga_timestamp  uint64  XDAQ FPGA timestamp, 0 if the frame had no metadata
+//   offset          uint64  byte offset of the JPEG's SOI marker in the fragment
+//   size            uint32  bytes of the JPEG, from its SOI marker to its EOI marker
+//   flags           uint32  HAS_METADATA
+class FrameIndexWriter
+{
+public:
+    static auto constexpr VERSION = std::uint32_t{1};
+    static auto constexpr RECORD_SIZE = std::size_t{40};
+    static auto constexpr HAS_METADATA = std::uint32_t{1};
+
+    FrameIndexWriter();
+    ~FrameIndexWriter();
+    FrameIndexWriter(const FrameIndexWriter &) = delete;
+    FrameIndexWriter &operator=(const FrameIndexWriter &) = delete;
+
+    static fs::path index_path(const fs::path &fragment);
+
+    // Streaming thread of the recording branch, for every frame that enters it.
+    void frame(std::uint64_t pts, std::optional<std::uint64_t> fpga_timestamp);
+
+    // Sink thread. A frame is written as it reaches the file; its metadata is looked up by
+    // the pts the muxer gave it.
+    bool open(const fs::path &fragment);
+    void written(std::uint64_t pts, std::uint64_t offset, std::uint32_t size);
+    void close();
+
+private:
+    struct Pending {
+        std::uint64_t pts;
+        std::optional<std::uint64_t> fpga_timestamp;
+    };
+
+    std::mutex _mutex;
+    std::deque<Pending> _pending;
+    std::vector<char> _buffer;
+    std::ofstream _file;
+    fs::path _path;
+    // Frames written to earlier fragments.
+    std::uint64_t _frames;
+};
+
+
+// Reads the .idx files of a recording. Frames are found by number in constant time and by
+// PTS or FPGA timestamp by binary search.
+class FrameIndex
+{
+public:
+    struct Frame {
+        std::uint64_t frame;
+        std::uint64_t pts;
+        std::uint64_t fpga_timestamp;
+        std::uint64_t offset;
+        std::uint32_t size;
+        std::uint32_t flags;
+        // Into fragments().
+        std::uint32_t fragment;
+    };
+
+    // The index of the fragments, in recording order; nullopt if a .idx can't be read.
+    static std::optional<FrameIndex> load(const std::vector<fs::path> &fragments);
+    // Every fragment named after prefix, the path handed to xvc, as splitmuxsink names them,
+    // "<prefix>-<number>", that has a .idx.
+    static std::optional<FrameIndex> load_recording(const fs::path &prefix);
+
+    const std::vector<fs::path> &fragments() const { return _fragments; }
+    const std::vector<Frame> &frames() const { return _frames; }
+    std::size_t size() const { return _frames.size(); }
+
+    // Null if the recording has no such frame, for example one whose fragment was deleted
+    // by max-files.
+    const Frame *at_frame(std::uint64_t frame) const;
+    // The first frame at or after pts.
+    const Frame *at_pts(std::uint64_t pts) const;
+    // The first frame at or after fpga_timestamp; frames without metadata are skipped.
+    const Frame *at_fpga_timestamp(std::uint64_t fpga_timestamp) const;
+
+    // Reads the frame's JPEG from its fragment. False if the bytes there don't start with an
+    // SOI and end with an EOI marker, which means the index doesn't match the fragment.
+    bool read(const Frame &frame, std::vector<char> &jpeg) const;
+
+private:
+    std::vector<fs::path> _fragments;
+    std::vector<Frame> _frames;
+    // Indices into _frames of the frames with metadata, for the FPGA timestamp search.
+    std::vector<std::size_t> _with_metadata;
+};
\ No newline at end of file
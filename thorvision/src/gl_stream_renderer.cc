@@ -0,0 +1,332 @@
+#include "gl_stream_renderer.h"
+
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+#include <QGenericMatrix>
+#include <QOpenGLContext>
+#include <QPainter>
+#include <QSurfaceFormat>
+#include <QVector3D>
+#include <cstring>
+
+
+
+namespace
+{
+// Full-screen quad from gl_VertexID, so no vertex buffer is needed.
+auto constexpr VERTEX_SHADER = R"(
+out vec2 v_uv;
+void main()
+{
+    vec2 pos = vec2(float(gl_VertexID & 1), float((gl_VertexID >> 1) & 1));
+    v_uv = vec2(pos.x, 1.0 - pos.y);
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// u_layout matches GLStreamRenderer::Layout.
+auto constexpr FRAGMENT_SHADER = R"(
+in vec2 v_uv;
+out vec4 frag_color;
+uniform sampler2D plane0;
+uniform sampler2D plane1;
+uniform sampler2D plane2;
+uniform int u_layout;
+uniform float frame_width;
+uniform mat3 yuv_to_rgb;
+uniform vec3 yuv_offset;
+void main()
+{
+    vec3 yuv;
+    if (u_layout == 0) {
+        yuv = vec3(texture(plane0, v_uv).r, texture(plane1, v_uv).r, texture(plane2, v_uv).r);
+    } else if (u_layout == 1) {
+        yuv = vec3(texture(plane0, v_uv).r, texture(plane1, v_uv).rg);
+    } else if (u_layout == 2) {
+        // YUY2 texels hold two pixels: Y0 U Y1 V.
+        vec4 pair = texture(plane0, v_uv);
+        float odd = mod(floor(v_uv.x * frame_width), 2.0);
+        yuv = vec3(mix(pair.r, pair.b, odd), pair.g, pair.a);
+    } else {
+        frag_color = vec4(texture(plane0, v_uv).rgb, 1.0);
+        return;
+    }
+    frag_color = vec4(clamp(yuv_to_rgb * (yuv - yuv_offset), 0.0, 1.0), 1.0);
+}
+)";
+
+void set_colour_matrix(QOpenGLShaderProgram &program, const GstVideoInfo &info)
+{
+    gdouble kr = 0.299;
+    gdouble kb = 0.114;
+    if (!gst_video_color_matrix_get_Kr_Kb(info.colorimetry.matrix, &kr, &kb)) {
+        kr = 0.299;
+        kb = 0.114;
+    }
+    auto kg = 1.0 - kr - kb;
+    auto full_range = info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255;
+    auto y = full_range ? 1.0 : 255.0 / 219.0;
+    auto c = full_range ? 1.0 : 255.0 / 224.0;
+
+    // Row-major; multiplies (Y, Cb, Cr).
+    const float values[] = {
+        static_cast<float>(y),
+        0.0f,
+        static_cast<float>(c * 2.0 * (1.0 - kr)),
+        static_cast<float>(y),
+        static_cast<float>(-c * 2.0 * kb * (1.0 - kb) / kg),
+        static_cast<float>(-c * 2.0 * kr * (1.0 - kr) / kg),
+        static_cast<float>(y),
+        static_cast<float>(c * 2.0 * (1.0 - kb)),
+        0.0f,
+    };
+    program.setUniformValue("yuv_to_rgb", QMatrix3x3(values));
+    auto y_offset = full_range ? 0.0f : 16.0f / 255.0f;
+    program.setUniformValue("yuv_offset", QVector3D(y_offset, 128.0f / 255.0f, 128.0f / 255.0f));
+}
+}  // namespace
+
+
+GLStreamRenderer::GLStreamRenderer(QWidget *parent)
+    : QOpenGLWidget(parent),
+      _plane_count(0),
+      _layout(Layout::Unsupported),
+      _format(GST_VIDEO_FORMAT_UNKNOWN),
+      _width(0),
+      _height(0),
+      _has_image(false),
+      _metadata{0, 0, 0, 0, 0, 0},
+      _frames_rendered(0),
+      _render_time(0)
+{
+    auto format = QSurfaceFormat::defaultFormat();
+    if (QOpenGLContext::openGLModuleType() == QOpenGLContext::LibGL) {
+        format.setVersion(3, 3);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+    } else {
+        format.setVersion(3, 0);
+    }
+    setFormat(format);
+}
+
+GLStreamRenderer::~GLStreamRenderer()
+{
+    makeCurrent();
+    release_planes();
+    _vao.destroy();
+    _program.reset();
+    doneCurrent();
+}
+
+void GLStreamRenderer::set_frame(FrameRef frame)
+{
+    _frame = std::move(frame);
+    update();
+}
+
+void GLStreamRenderer::initializeGL()
+{
+    initializeOpenGLFunctions();
+    spdlog::info(
+        "OpenGL preview renderer on {} {}",
+        reinterpret_cast<const char *>(glGetString(GL_RENDERER)),
+        reinterpret_cast<const char *>(glGetString(GL_VERSION))
+    );
+
+    QByteArray header = context()->isOpenGLES() ? "#version 300 es\nprecision mediump float;\n"
+                                                : "#version 330 core\n";
+    _program = std::make_unique<QOpenGLShaderProgram>();
+    if (!_program->addShaderFromSourceCode(QOpenGLShader::Vertex, header + VERTEX_SHADER) ||
+        !_program->addShaderFromSourceCode(QOpenGLShader::Fragment, header + FRAGMENT_SHADER) ||
+        !_program->link()) {
+        spdlog::error("Failed to build the preview shader: {}", _program->log().toStdString());
+        _program.reset();
+        return;
+    }
+    _vao.create();
+
+    _program->bind();
+    _program->setUniformValue("plane0", 0);
+    _program->setUniformValue("plane1", 1);
+    _program->setUniformValue("plane2", 2);
+    _program->release();
+}
+
+void GLStreamRenderer::paintGL()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    auto uploaded = false;
+    if (_frame && _program) {
+        auto &info = _frame.frame().info;
+        if (GST_VIDEO_INFO_FORMAT(&info) != _format || GST_VIDEO_INFO_WIDTH(&info) != _width ||
+            GST_VIDEO_INFO_HEIGHT(&info) != _height) {
+            configure(info);
+        }
+        if (_layout != Layout::Unsupported) {
+            upload(_frame);
+            _has_image = uploaded = true;
+        }
+        _metadata = _frame.metadata();
+        // Uploaded; give the sample back to the pipeline.
+        _frame = {};
+    }
+
+    if (_has_image && _program) {
+        _program->bind();
+        QOpenGLVertexArrayObject::Binder vao(&_vao);
+        for (auto i = 0; i < _plane_count; ++i) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, _planes[i].texture);
+        }
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glActiveTexture(GL_TEXTURE0);
+        _program->release();
+    }
+
+    if (uploaded) {
+        ++_frames_rendered;
+        _render_time += std::chrono::steady_clock::now() - start;
+    }
+
+    QPainter painter(this);
+    _overlay.paint(painter, size(), _metadata);
+}
+
+void GLStreamRenderer::configure(const GstVideoInfo &info)
+{
+    release_planes();
+
+    _format = GST_VIDEO_INFO_FORMAT(&info);
+    _width = GST_VIDEO_INFO_WIDTH(&info);
+    _height = GST_VIDEO_INFO_HEIGHT(&info);
+
+    auto plane = [&info](int component, int texel_bytes, GLenum internal_format, GLenum format) {
+        Plane p;
+        p.width = GST_VIDEO_INFO_COMP_WIDTH(&info, component);
+        p.height = GST_VIDEO_INFO_COMP_HEIGHT(&info, component);
+        p.texel_bytes = texel_bytes;
+        p.internal_format = internal_format;
+        p.format = format;
+        return p;
+    };
+
+    switch (_format) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_Y42B:
+    case GST_VIDEO_FORMAT_Y444:
+        _layout = Layout::Planar;
+        _plane_count = 3;
+        for (auto i = 0; i < 3; ++i) _planes[i] = plane(i, 1, GL_R8, GL_RED);
+        break;
+    case GST_VIDEO_FORMAT_NV12:
+        _layout = Layout::SemiPlanar;
+        _plane_count = 2;
+        _planes[0] = plane(0, 1, GL_R8, GL_RED);
+        _planes[1] = plane(1, 2, GL_RG8, GL_RG);
+        break;
+    case GST_VIDEO_FORMAT_YUY2:
+        _layout = Layout::Packed422;
+        _plane_count = 1;
+        _planes[0] = plane(0, 4, GL_RGBA8, GL_RGBA);
+        _planes[0].width = (_width + 1) / 2;
+        break;
+    case GST_VIDEO_FORMAT_RGB:
+        _layout = Layout::RGB;
+        _plane_count = 1;
+        _planes[0] = plane(0, 3, GL_RGB8, GL_RGB);
+        break;
+    default:
+        spdlog::error("OpenGL preview can't render {}", GST_VIDEO_INFO_NAME(&info));
+        _layout = Layout::Unsupported;
+        _plane_count = 0;
+        return;
+    }
+
+    // YUY2 pairs must not be blended with their neighbours.
+    GLint filter = _layout == Layout::Packed422 ? GL_NEAREST : GL_LINEAR;
+    for (auto i = 0; i < _plane_count; ++i) {
+        auto &p = _planes[i];
+        glGenTextures(1, &p.texture);
+        glBindTexture(GL_TEXTURE_2D, p.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            p.internal_format,
+            p.width,
+            p.height,
+            0,
+            p.format,
+            GL_UNSIGNED_BYTE,
+            nullptr
+        );
+        glGenBuffers(1, &p.pbo);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _program->bind();
+    _program->setUniformValue("u_layout", static_cast<int>(_layout));
+    _program->setUniformValue("frame_width", static_cast<float>(_width));
+    set_colour_matrix(*_program, info);
+    _program->release();
+
+    spdlog::info(
+        "OpenGL preview configured for {}x{} {}", _width, _height, GST_VIDEO_INFO_NAME(&info)
+    );
+}
+
+void GLStreamRenderer::upload(const FrameRef &frame)
+{
+    // Rows are repacked tightly into the PBOs, RGB rows are not 4-byte aligned. Set for every
+    // upload, since the QPainter that draws the overlay shares the context and its state.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    for (auto i = 0; i < _plane_count; ++i) {
+        auto &p = _planes[i];
+        auto row_bytes = p.width * p.texel_bytes;
+        auto size = static_cast<GLsizeiptr>(row_bytes) * p.height;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p.pbo);
+        // Orphan the previous storage so the copy never waits for the last upload to finish.
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        auto dst = static_cast<unsigned char *>(glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+        ));
+        if (!dst) {
+            spdlog::error("Failed to map the preview pixel buffer");
+            continue;
+        }
+        auto src = frame.data(i);
+        auto stride = frame.stride(i);
+        for (auto row = 0; row < p.height; ++row) {
+            std::memcpy(dst + row * row_bytes, src + row * stride, row_bytes);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        glBindTexture(GL_TEXTURE_2D, p.texture);
+        glTexSubImage2D(
+            GL_TEXTURE_2D, 0, 0, 0, p.width, p.height, p.format, GL_UNSIGNED_BYTE, nullptr
+        );
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GLStreamRenderer::release_planes()
+{
+    for (auto &p : _planes) {
+        if (p.texture) glDeleteTextures(1, &p.texture);
+        if (p.pbo) glDeleteBuffers(1, &p.pbo);
+        p = Plane{};
+    }
+    _plane_count = 0;
+    _format = GST_VIDEO_FORMAT_UNKNOWN;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLWidget>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "stream_overlay.h"
+#include "video_frame.h"
+
+
+// Preview backend that streams YUV planes into textures through pixel buffer objects and
+// converts colour in a fragment shader, so the pipeline doesn't have to convert to RGB.
+// Needs OpenGL 3.3 core or OpenGL ES 3.0; Mesa's llvmpipe provides both.
+class GLStreamRenderer : public QOpenGLWidget, protected QOpenGLExtraFunctions
+{
+    Q_OBJECT
+
+public:
+    // Formats uploaded without conversion, in the order the converter should prefer them.
+    static auto constexpr CAPS_FORMATS = "{ I420, Y42B, Y444, NV12, YUY2, RGB }";
+
+    explicit GLStreamRenderer(QWidget *parent = nullptr);
+    ~GLStreamRenderer();
+
+    void set_frame(FrameRef frame);
+
+    std::uint64_t frames_rendered() const { return _frames_rendered; }
+    std::chrono::nanoseconds render_time() const { return _render_time; }
+
+protected:
+    void initializeGL() override;
+    void paintGL() override;
+
+private:
+    enum class Layout { Planar = 0, SemiPlanar = 1, Packed422 = 2, RGB = 3, Unsupported };
+
+    struct Plane {
+        GLuint texture = 0;
+        GLuint pbo = 0;
+        int width = 0;
+        int height = 0;
+        int texel_bytes = 0;
+        GLenum internal_format = 0;
+        GLenum format = 0;
+    };
+
+    void configure(const GstVideoInfo &info);
+    void upload(const FrameRef &frame);
+    void release_planes();
+
+    std::unique_ptr<QOpenGLShaderProgram> _program;
+    QOpenGLVertexArrayObject _vao;
+    std::array<Plane, 3> _planes;
+    int _plane_count;
+    Layout _layout;
+    GstVideoFormat _format;
+    int _width;
+    int _height;
+    bool _has_image;
+
+    FrameRef _frame;
+    XDAQFrameData _metadata;
+    StreamOverlay _overlay;
+
+    std::uint64_t _frames_rendered;
+    std::chrono::nanoseconds _render_time;
+};
\ No newline at end of file
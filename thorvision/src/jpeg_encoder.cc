@@ -0,0 +1,227 @@
+#include "jpeg_encoder.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+
+// After <cstdio>, which it needs for FILE.
+#include <jpeglib.h>
+
+
+namespace
+{
+// libjpeg's default error handler exits the process.
+struct ErrorManager {
+    jpeg_error_mgr pub;
+    std::jmp_buf jump;
+};
+
+void error_exit(j_common_ptr cinfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    spdlog::error("JPEG encoding failed: {}", message);
+    std::longjmp(reinterpret_cast<ErrorManager *>(cinfo->err)->jump, 1);
+}
+
+void output_message(j_common_ptr cinfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    spdlog::debug("libjpeg: {}", message);
+}
+
+// Copies component into a plane of stride x rows bytes, repeating the last column and row
+// of the frame into the padding.
+void gather(
+    const RawImage::Component &component,
+    int width,
+    int height,
+    std::uint8_t *plane,
+    std::size_t stride,
+    std::size_t rows
+)
+{
+    for (std::size_t y = 0; y < rows; ++y) {
+        auto out = plane + y * stride;
+        if (y >= static_cast<std::size_t>(height)) {
+            std::copy_n(plane + (height - 1) * stride, stride, out);
+            continue;
+        }
+        auto row = component.data + static_cast<std::ptrdiff_t>(y) * component.stride;
+        if (component.pstride == 1) {
+            std::copy_n(row, width, out);
+        } else {
+            for (auto x = 0; x < width; ++x) out[x] = row[x * component.pstride];
+        }
+        std::fill(out + width, out + stride, out[width - 1]);
+    }
+}
+}  // namespace
+
+
+struct JpegEncoder::State {
+    jpeg_compress_struct cinfo;
+    ErrorManager error;
+    // Where jpeg_mem_dest puts the frame; members, since they must survive a longjmp.
+    unsigned char *out = nullptr;
+    unsigned long out_size = 0;
+};
+
+JpegEncoder::JpegEncoder() : _state(std::make_unique<State>())
+{
+    _state->cinfo.err = jpeg_std_error(&_state->error.pub);
+    _state->error.pub.error_exit = error_exit;
+    _state->error.pub.output_message = output_message;
+    jpeg_create_compress(&_state->cinfo);
+}
+
+JpegEncoder::~JpegEncoder() { jpeg_destroy_compress(&_state->cinfo); }
+
+std::uint8_t *JpegEncoder::encode(const RawImage &image, int quality, std::size_t &size)
+{
+    auto &cinfo = _state->cinfo;
+    _state->out = nullptr;
+    _state->out_size = 0;
+    if (setjmp(_state->error.jump)) {
+        jpeg_abort_compress(&cinfo);
+        std::free(_state->out);
+        return nullptr;
+    }
+
+    jpeg_mem_dest(&cinfo, &_state->out, &_state->out_size);
+    cinfo.image_width = static_cast<JDIMENSION>(image.width);
+    cinfo.image_height = static_cast<JDIMENSION>(image.height);
+    cinfo.input_components = image.components;
+    cinfo.in_color_space = image.components == 1 ? JCS_GRAYSCALE : JCS_YCbCr;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.dct_method = JDCT_ISLOW;
+    // The samples go in as they are; only luma is sampled at the full rate.
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = image.components == 1 ? 1 : 1 << image.w_sub;
+    cinfo.comp_info[0].v_samp_factor = image.components == 1 ? 1 : 1 << image.h_sub;
+    for (auto c = 1; c < image.components; ++c) {
+        cinfo.comp_info[c].h_samp_factor = 1;
+        cinfo.comp_info[c].v_samp_factor = 1;
+    }
+    jpeg_start_compress(&cinfo, TRUE);
+
+    // libjpeg reads whole blocks, so the planes are padded to whole MCUs.
+    std::size_t strides[3];
+    for (auto c = 0; c < image.components; ++c) {
+        auto component = &cinfo.comp_info[c];
+        strides[c] = static_cast<std::size_t>(cinfo.MCUs_per_row) *
+                     component->h_samp_factor * DCTSIZE;
+        auto rows = static_cast<std::size_t>(cinfo.total_iMCU_rows) *
+                    component->v_samp_factor * DCTSIZE;
+        _planes[c].resize(strides[c] * rows);
+        gather(
+            image.component[c],
+            static_cast<int>(component->downsampled_width),
+            static_cast<int>(component->downsampled_height),
+            _planes[c].data(),
+            strides[c],
+            rows
+        );
+    }
+
+    JSAMPROW rows[3][MAX_SAMP_FACTOR * DCTSIZE];
+    JSAMPARRAY planes[3] = {rows[0], rows[1], rows[2]};
+    for (JDIMENSION mcu_row = 0; cinfo.next_scanline < cinfo.image_height; ++mcu_row) {
+        for (auto c = 0; c < image.components; ++c) {
+            auto lines = cinfo.comp_info[c].v_samp_factor * DCTSIZE;
+            for (auto line = 0; line < lines; ++line) {
+                rows[c][line] = _planes[c].data() + (mcu_row * lines + line) * strides[c];
+            }
+        }
+        jpeg_write_raw_data(&cinfo, planes, cinfo.max_v_samp_factor * DCTSIZE);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    size = _state->out_size;
+    return _state->out;
+}
+
+
+JpegEncoderPool::JpegEncoderPool(unsigned int threads, int quality, std::size_t max_in_flight)
+    : _quality(quality),
+      _max_in_flight(max_in_flight > 0 ? max_in_flight : 2 * std::max(1u, threads)),
+      _stopping(false)
+{
+    for (unsigned int i = 0; i < std::max(1u, threads); ++i) {
+        _threads.emplace_back([this] { run(); });
+    }
+}
+
+JpegEncoderPool::~JpegEncoderPool()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _changed.notify_all();
+    _threads.clear();
+    for (auto &job : _jobs) std::free(job->data);
+}
+
+bool JpegEncoderPool::full() const
+{
+    std::lock_guard lock(_mutex);
+    return _jobs.size() >= _max_in_flight;
+}
+
+bool JpegEncoderPool::empty() const
+{
+    std::lock_guard lock(_mutex);
+    return _jobs.empty();
+}
+
+void JpegEncoderPool::submit(const RawImage &image, void *tag)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _jobs.push_back(std::make_unique<Job>(Job{image, tag, nullptr, 0, false}));
+        _queue.push_back(_jobs.back().get());
+    }
+    _changed.notify_all();
+}
+
+std::optional<JpegEncoderPool::Encoded> JpegEncoderPool::next(bool wait)
+{
+    std::unique_lock lock(_mutex);
+    if (_jobs.empty()) return std::nullopt;
+    if (wait) {
+        _changed.wait(lock, [this] { return _jobs.front()->done; });
+    } else if (!_jobs.front()->done) {
+        return std::nullopt;
+    }
+    auto job = std::move(_jobs.front());
+    _jobs.pop_front();
+    return Encoded{job->tag, job->data, job->size};
+}
+
+void JpegEncoderPool::run()
+{
+    JpegEncoder encoder;
+    std::unique_lock lock(_mutex);
+    while (true) {
+        _changed.wait(lock, [this] { return _stopping || !_queue.empty(); });
+        if (_stopping) return;
+
+        auto job = _queue.front();
+        _queue.pop_front();
+        lock.unlock();
+        std::size_t size = 0;
+        auto data = encoder.encode(job->image, _quality, size);
+        lock.lock();
+
+        job->data = data;
+        job->size = size;
+        job->done = true;
+        _changed.notify_all();
+    }
+}
\ No newline at end of file
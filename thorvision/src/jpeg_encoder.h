@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+// An 8-bit YUV or gray frame as laid out in memory, described per component so packed,
+// semi-planar and planar layouts all fit; see GstVideoFrame.
+struct RawImage {
+    struct Component {
+        const std::uint8_t *data;
+        int stride;  // Bytes between rows.
+        int pstride;  // Bytes between samples of a row.
+    };
+
+    int width;
+    int height;
+    int components;  // 1 for gray, 3 for YUV.
+    // log2 of the chroma subsampling: 1, 1 for 4:2:0, 1, 0 for 4:2:2.
+    int w_sub;
+    int h_sub;
+    Component component[3];
+};
+
+
+// Encodes frames to baseline JPEG with libjpeg, from the raw samples, so nothing is colour
+// converted or resampled on the way. Keeps its libjpeg state and plane buffers between
+// frames; one per thread.
+class JpegEncoder
+{
+public:
+    JpegEncoder();
+    ~JpegEncoder();
+    JpegEncoder(const JpegEncoder &) = delete;
+    JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+    // Encoded bytes, allocated with malloc; null on failure.
+    std::uint8_t *encode(const RawImage &image, int quality, std::size_t &size);
+
+private:
+    struct State;
+    std::unique_ptr<State> _state;
+    // Planes padded to whole JPEG blocks by repeating the last column and row.
+    std::vector<std::uint8_t> _planes[3];
+};
+
+
+// Encodes consecutive frames on a pool of threads and hands them back in the order they were
+// submitted. Every frame is encoded on its own, so the output is byte for byte that of a
+// single JpegEncoder whatever the number of threads.
+class JpegEncoderPool
+{
+public:
+    struct Encoded {
+        // As passed to submit().
+        void *tag;
+        // malloc'ed; null if the frame failed to encode.
+        std::uint8_t *data;
+        std::size_t size;
+    };
+
+    // max_in_flight bounds the frames submitted but not taken back yet; 0 means two per thread.
+    JpegEncoderPool(unsigned int threads, int quality, std::size_t max_in_flight = 0);
+    ~JpegEncoderPool();
+    JpegEncoderPool(const JpegEncoderPool &) = delete;
+    JpegEncoderPool &operator=(const JpegEncoderPool &) = delete;
+
+    unsigned int threads() const { return static_cast<unsigned int>(_threads.size()); }
+
+    // The rest is for one thread. The image must stay readable until its frame is taken back.
+    bool full() const;
+    bool empty() const;
+    void submit(const RawImage &image, void *tag);
+    // The oldest frame once it is encoded. Without wait, nullopt while it still is.
+    std::optional<Encoded> next(bool wait);
+
+private:
+    struct Job {
+        RawImage image;
+        void *tag;
+        std::uint8_t *data;
+        std::size_t size;
+        bool done;
+    };
+
+    void run();
+
+    const int _quality;
+    const std::size_t _max_in_flight;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    // In submission order, until taken back.
+    std::deque<std::unique_ptr<Job>> _jobs;
+    // Not picked up by a thread yet.
+    std::deque<Job *> _queue;
+    bool _stopping;
+
+    std::vector<std::jthread> _threads;
+};
\ No newline at end of file
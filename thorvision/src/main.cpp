@@ -1,8 +1,18 @@
+#include <string_view>
+
 #include "app.h"
+#include "parallel_jpeg_enc.h"
+#include "storage_probe.h"
 
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && std::string_view(argv[1]) == "--storage-benchmark") {
+        return run_storage_benchmark(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--jpeg-benchmark") {
+        return run_jpeg_benchmark(argc - 2, argv + 2);
+    }
     const App app(argc, argv);
     return app.exec();
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "metadata_ring.h"
+
+#include <cstring>
+
+
+std::size_t MetadataRing::home(GstClockTime pts)
+{
+    // PTS are multiples of the frame duration; mix them so neighbours spread over the slots.
+    auto hash = pts * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(hash >> 32) & (SLOTS - 1);
+}
+
+void MetadataRing::push(GstClockTime pts, const XDAQFrameData &metadata)
+{
+    // Reuse the slot holding this PTS, an empty one or one left from before a PTS reset;
+    // otherwise evict the oldest frame among the probed slots.
+    auto first = home(pts);
+    auto victim = &_slots[first];
+    for (auto i = 0; i < PROBES; ++i) {
+        auto &slot = _slots[(first + i) & (SLOTS - 1)];
+        auto slot_pts = slot.pts.load(std::memory_order_relaxed);
+        if (slot_pts >= pts) {
+            victim = &slot;
+            break;
+        }
+        if (slot_pts < victim->pts.load(std::memory_order_relaxed)) victim = &slot;
+    }
+
+    std::array<std::uint64_t, WORDS> words;
+    std::memcpy(words.data(), &metadata, sizeof(metadata));
+
+    auto sequence = victim->sequence.load(std::memory_order_relaxed);
+    victim->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    victim->pts.store(pts, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < WORDS; ++i) {
+        victim->words[i].store(words[i], std::memory_order_relaxed);
+    }
+    victim->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+std::optional<XDAQFrameData> MetadataRing::find(GstClockTime pts)
+{
+    _lookups.fetch_add(1, std::memory_order_relaxed);
+    auto first = home(pts);
+    for (auto i = 0; i < PROBES; ++i) {
+        XDAQFrameData metadata;
+        if (read(_slots[(first + i) & (SLOTS - 1)], pts, metadata)) return metadata;
+    }
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+bool MetadataRing::read(const Slot &slot, GstClockTime pts, XDAQFrameData &metadata) const
+{
+    // One retry: the writer updates a slot at most once per frame, so a second overlap would
+    // mean this entry is being replaced anyway.
+    for (auto attempt = 0; attempt < 2; ++attempt) {
+        auto before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+
+        auto slot_pts = slot.pts.load(std::memory_order_relaxed);
+        std::array<std::uint64_t, WORDS> words;
+        for (std::size_t i = 0; i < WORDS; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+
+        if (slot_pts != pts) return false;
+        std::memcpy(&metadata, words.data(), sizeof(metadata));
+        return true;
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <gst/gstclock.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+#include "xdaqmetadata/metadata_handler.h"
+
+
+// XDAQ metadata of recent frames, keyed by PTS. One thread writes (the parser probe) and one
+// reads (the appsink); both take constant time and never wait for each other. Each slot is a
+// seqlock, so a read that races a write is retried once and then counted as a miss.
+// Entries are only evicted by newer frames, so frames that reach the appsink out of order
+// or after drops are still found for the last few hundred PTS.
+class MetadataRing
+{
+public:
+    static auto constexpr SLOTS = 1024;
+    // Slots a PTS may land in; a write replaces the oldest of them.
+    static auto constexpr PROBES = 4;
+
+    // Writer thread only.
+    void push(GstClockTime pts, const XDAQFrameData &metadata);
+    // Reader thread only.
+    std::optional<XDAQFrameData> find(GstClockTime pts);
+
+    std::uint64_t lookups() const { return _lookups.load(std::memory_order_relaxed); }
+    std::uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+
+private:
+    static_assert(sizeof(XDAQFrameData) % sizeof(std::uint64_t) == 0);
+    static auto constexpr WORDS = sizeof(XDAQFrameData) / sizeof(std::uint64_t);
+
+    struct Slot {
+        // Odd while the writer is in the middle of updating the slot.
+        std::atomic<std::uint32_t> sequence{0};
+        std::atomic<GstClockTime> pts{GST_CLOCK_TIME_NONE};
+        std::array<std::atomic<std::uint64_t>, WORDS> words{};
+    };
+
+    static std::size_t home(GstClockTime pts);
+    bool read(const Slot &slot, GstClockTime pts, XDAQFrameData &metadata) const;
+
+    std::array<Slot, SLOTS> _slots;
+    std::atomic<std::uint64_t> _lookups{0};
+    std::atomic<std::uint64_t> _misses{0};
+};
\ No newline at end of file
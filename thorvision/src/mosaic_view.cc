@@ -0,0 +1,178 @@
+#include "mosaic_view.h"
+
+#include <QImage>
+#include <QPainter>
+#include <QScreen>
+#include <algorithm>
+#include <cmath>
+
+#include "preview_branch.h"
+#include "stream_window.h"
+
+
+namespace
+{
+// The size of the frames a tile's preview branch delivers, see PreviewBranch::set_size().
+QSize frame_size(const QSize &size, qreal ratio)
+{
+    auto physical = size * ratio;
+    return {
+        PreviewBranch::frame_size(physical.width()), PreviewBranch::frame_size(physical.height())
+    };
+}
+}  // namespace
+
+
+MosaicView::MosaicView(QWidget *parent) : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setMinimumSize(320, 240);
+
+    _refresh_timer = new QTimer(this);
+    _refresh_timer->setTimerType(Qt::PreciseTimer);
+    connect(_refresh_timer, &QTimer::timeout, this, &MosaicView::refresh);
+}
+
+void MosaicView::add(StreamWindow *window)
+{
+    _tiles.push_back(Tile{window, {}, {}, {}});
+    layout_tiles();
+    update();
+}
+
+void MosaicView::remove(StreamWindow *window)
+{
+    _tiles.erase(
+        std::remove_if(
+            _tiles.begin(),
+            _tiles.end(),
+            [window](const Tile &tile) { return tile.window == window; }
+        ),
+        _tiles.end()
+    );
+    layout_tiles();
+    update();
+}
+
+void MosaicView::showEvent(QShowEvent *e)
+{
+    auto refresh_rate = screen() ? screen()->refreshRate() : 60.0;
+    _refresh_timer->start(static_cast<int>(1000.0 / std::max(refresh_rate, 1.0)));
+    QWidget::showEvent(e);
+}
+
+void MosaicView::hideEvent(QHideEvent *e)
+{
+    _refresh_timer->stop();
+    for (auto &tile : _tiles) {
+        tile.window->set_tile_size(QSize());
+        tile.frame = {};
+    }
+    QWidget::hideEvent(e);
+}
+
+void MosaicView::resizeEvent(QResizeEvent *e)
+{
+    layout_tiles();
+    QWidget::resizeEvent(e);
+}
+
+bool MosaicView::layout_tiles()
+{
+    auto viewed = static_cast<int>(std::count_if(_tiles.begin(), _tiles.end(), [](auto &tile) {
+        return tile.window->viewed();
+    }));
+    auto columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(viewed))));
+    auto rows = std::max(1, (viewed + columns - 1) / columns);
+
+    auto index = 0;
+    auto moved = false;
+    for (auto &tile : _tiles) {
+        QRect rect;
+        if (tile.window->viewed()) {
+            auto column = index % columns;
+            auto row = index / columns;
+            ++index;
+            auto left = column * width() / columns;
+            auto top = row * height() / rows;
+            // Even, like the frames the preview branch scales to, so they fit the tile exactly
+            // at integer pixel ratios; the odd pixel left over stays black.
+            rect = QRect(
+                left,
+                top,
+                ((column + 1) * width() / columns - left) & ~1,
+                ((row + 1) * height() / rows - top) & ~1
+            );
+        }
+        moved = moved || rect != tile.rect;
+        tile.rect = rect;
+    }
+    return moved;
+}
+
+void MosaicView::refresh()
+{
+    // Picks up windows that were hidden or shown through their View button.
+    if (layout_tiles()) update();
+
+    auto visible = visibleRegion();
+    auto ratio = devicePixelRatioF();
+    for (auto &tile : _tiles) {
+        if (tile.rect.isEmpty() || !visible.intersects(tile.rect)) {
+            tile.window->set_tile_size(QSize());
+            tile.frame = {};
+            continue;
+        }
+        tile.window->set_tile_size(tile.rect.size() * ratio);
+        if (auto frame = tile.window->_mailbox.take()) {
+            tile.frame = std::move(frame);
+            update(tile.rect);
+        }
+    }
+}
+
+void MosaicView::paintEvent(QPaintEvent *e)
+{
+    QPainter painter(this);
+    painter.fillRect(e->rect(), Qt::black);
+
+    auto ratio = devicePixelRatioF();
+    for (auto &tile : _tiles) {
+        if (tile.rect.isEmpty() || !e->region().intersects(tile.rect)) continue;
+
+        painter.save();
+        painter.setClipRect(tile.rect);
+        painter.translate(tile.rect.topLeft());
+        auto size = tile.rect.size();
+
+        if (tile.frame && tile.frame.rgb()) {
+            auto format = tile.frame.rgb_format() == RGBFormat::RGBX ? QImage::Format_RGBX8888
+                                                                     : QImage::Format_RGB888;
+            QImage image(
+                tile.frame.rgb(),
+                tile.frame.width(),
+                tile.frame.height(),
+                tile.frame.rgb_stride(),
+                format
+            );
+            // Each camera's preview branch scales to its tile, so this is usually a copy.
+            if (image.size() == frame_size(size, ratio)) {
+                image.setDevicePixelRatio(ratio);
+                painter.drawImage(0, 0, image);
+            } else {
+                painter.setRenderHint(QPainter::SmoothPixmapTransform);
+                painter.drawImage(QRect(QPoint(0, 0), size), image, image.rect());
+                painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+            }
+        }
+        if (tile.frame) tile.overlay.paint(painter, size, tile.frame.metadata());
+
+        painter.setPen(Qt::white);
+        painter.drawText(
+            QRect(QPoint(0, 0), size).adjusted(0, 6, -8, 0),
+            Qt::AlignTop | Qt::AlignRight,
+            QString::fromStdString(tile.window->_camera->name())
+        );
+        painter.restore();
+    }
+}
\ No newline at end of file
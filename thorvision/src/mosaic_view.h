@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QPaintEvent>
+#include <QRect>
+#include <QTimer>
+#include <QWidget>
+#include <vector>
+
+#include "stream_overlay.h"
+#include "video_frame.h"
+
+
+class StreamWindow;
+
+// Draws every viewed camera as a tile of one widget in a single paint pass, instead of one
+// dock widget with its own paint pass per camera. Once per display refresh each visible tile
+// takes the newest frame from its window's mailbox; tiles outside the visible region close
+// their camera's preview gate and are not painted.
+class MosaicView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit MosaicView(QWidget *parent = nullptr);
+
+    void add(StreamWindow *window);
+    // Must be called before the window's frame pool goes away.
+    void remove(StreamWindow *window);
+
+    QSize sizeHint() const override { return {800, 600}; }
+
+protected:
+    void showEvent(QShowEvent *e) override;
+    void hideEvent(QHideEvent *e) override;
+    void resizeEvent(QResizeEvent *e) override;
+    void paintEvent(QPaintEvent *e) override;
+
+private:
+    struct Tile {
+        StreamWindow *window;
+        FrameRef frame;
+        StreamOverlay overlay;
+        QRect rect;
+    };
+
+    void refresh();
+    // Returns whether any tile moved.
+    bool layout_tiles();
+
+    std::vector<Tile> _tiles;
+    QTimer *_refresh_timer;
+};
\ No newline at end of file
@@ -0,0 +1,423 @@
+#include "parallel_jpeg_enc.h"
+
+#include <fmt/core.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "jpeg_encoder.h"
+
+
+struct _ThorJpegEnc {
+    GstElement parent;
+
+    GstPad *sinkpad;
+    GstPad *srcpad;
+    guint threads;
+    gint quality;
+    guint max_in_flight;
+
+    // Created on the first caps. Its tags are mapped GstVideoFrames, each holding a ref to
+    // its buffer until the frame is pushed.
+    JpegEncoderPool *pool;
+    GstVideoInfo info;
+};
+
+G_DEFINE_TYPE(ThorJpegEnc, thor_jpeg_enc, GST_TYPE_ELEMENT)
+
+
+namespace
+{
+auto constexpr DEFAULT_QUALITY = 85;
+
+auto constexpr BENCHMARK_FRAMES = 240;
+// Cycled through, so the encoders don't work from a cache-hot frame.
+auto constexpr BENCHMARK_DISTINCT_FRAMES = 8;
+const char *const BENCHMARK_CAPS[] = {
+    "video/x-raw,format=YUY2,width=1280,height=720,framerate=30/1",
+    "video/x-raw,format=YUY2,width=640,height=360,framerate=260/1",
+    "video/x-raw,format=YUY2,width=1920,height=1080,framerate=30/1",
+};
+
+enum Property {
+    PROP_0,
+    PROP_THREADS,
+    PROP_QUALITY,
+    PROP_MAX_IN_FLIGHT,
+};
+
+GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE(
+        "{ I420, YV12, NV12, NV21, YUY2, UYVY, YVYU, Y42B, Y41B, Y444, GRAY8 }"
+    ))
+);
+
+GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS("image/jpeg, width = (int) [ 1, 65535 ], height = (int) [ 1, 65535 ]")
+);
+
+void set_property(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+{
+    auto enc = THOR_JPEG_ENC(object);
+    switch (id) {
+    case PROP_THREADS: enc->threads = g_value_get_uint(value); break;
+    case PROP_QUALITY: enc->quality = g_value_get_int(value); break;
+    case PROP_MAX_IN_FLIGHT: enc->max_in_flight = g_value_get_uint(value); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+void get_property(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+{
+    auto enc = THOR_JPEG_ENC(object);
+    switch (id) {
+    case PROP_THREADS: g_value_set_uint(value, enc->threads); break;
+    case PROP_QUALITY: g_value_set_int(value, enc->quality); break;
+    case PROP_MAX_IN_FLIGHT: g_value_set_uint(value, enc->max_in_flight); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+RawImage raw_image(const GstVideoFrame &frame)
+{
+    RawImage image{};
+    image.width = GST_VIDEO_FRAME_WIDTH(&frame);
+    image.height = GST_VIDEO_FRAME_HEIGHT(&frame);
+    image.components = static_cast<int>(GST_VIDEO_FRAME_N_COMPONENTS(&frame));
+    if (image.components > 1) {
+        image.w_sub = GST_VIDEO_FORMAT_INFO_W_SUB(frame.info.finfo, 1);
+        image.h_sub = GST_VIDEO_FORMAT_INFO_H_SUB(frame.info.finfo, 1);
+    }
+    for (auto c = 0; c < image.components; ++c) {
+        image.component[c] = {
+            static_cast<const std::uint8_t *>(GST_VIDEO_FRAME_COMP_DATA(&frame, c)),
+            GST_VIDEO_FRAME_COMP_STRIDE(&frame, c),
+            GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, c),
+        };
+    }
+    return image;
+}
+
+void release(const JpegEncoderPool::Encoded &encoded)
+{
+    auto frame = static_cast<GstVideoFrame *>(encoded.tag);
+    gst_video_frame_unmap(frame);
+    delete frame;
+    std::free(encoded.data);
+}
+
+GstFlowReturn push(ThorJpegEnc *enc, const JpegEncoderPool::Encoded &encoded)
+{
+    if (!encoded.data) {
+        release(encoded);
+        GST_ELEMENT_ERROR(enc, STREAM, ENCODE, ("Could not encode a frame."), (nullptr));
+        return GST_FLOW_ERROR;
+    }
+    auto frame = static_cast<GstVideoFrame *>(encoded.tag);
+    auto buffer = gst_buffer_new_wrapped_full(
+        static_cast<GstMemoryFlags>(0),
+        encoded.data,
+        encoded.size,
+        0,
+        encoded.size,
+        encoded.data,
+        std::free
+    );
+    // Timestamps, flags and the XDAQ metadata of the raw frame.
+    gst_buffer_copy_into(buffer, frame->buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+    GST_BUFFER_FLAG_UNSET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    gst_video_frame_unmap(frame);
+    delete frame;
+    return gst_pad_push(enc->srcpad, buffer);
+}
+
+// Pushes every frame in flight, or drops them once a push has failed.
+GstFlowReturn drain(ThorJpegEnc *enc)
+{
+    auto ret = GST_FLOW_OK;
+    while (enc->pool && !enc->pool->empty()) {
+        auto encoded = *enc->pool->next(true);
+        if (ret == GST_FLOW_OK) {
+            ret = push(enc, encoded);
+        } else {
+            release(encoded);
+        }
+    }
+    return ret;
+}
+
+void discard(ThorJpegEnc *enc)
+{
+    while (enc->pool && !enc->pool->empty()) release(*enc->pool->next(true));
+}
+
+GstFlowReturn chain(GstPad *, GstObject *parent, GstBuffer *buffer)
+{
+    auto enc = THOR_JPEG_ENC(parent);
+    if (!enc->pool) {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+    // The mapped frame keeps its own ref to the buffer.
+    auto frame = new GstVideoFrame;
+    auto mapped = gst_video_frame_map(frame, &enc->info, buffer, GST_MAP_READ);
+    gst_buffer_unref(buffer);
+    if (!mapped) {
+        delete frame;
+        GST_ELEMENT_ERROR(enc, STREAM, FORMAT, ("Could not map a frame."), (nullptr));
+        return GST_FLOW_ERROR;
+    }
+
+    auto ret = GST_FLOW_OK;
+    while (ret == GST_FLOW_OK && enc->pool->full()) ret = push(enc, *enc->pool->next(true));
+    enc->pool->submit(raw_image(*frame), frame);
+    while (ret == GST_FLOW_OK) {
+        auto encoded = enc->pool->next(false);
+        if (!encoded) break;
+        ret = push(enc, *encoded);
+    }
+    return ret;
+}
+
+gboolean set_caps(ThorJpegEnc *enc, GstCaps *caps)
+{
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, caps)) return FALSE;
+    enc->info = info;
+    if (!enc->pool) {
+        auto threads = enc->threads > 0 ? enc->threads : std::thread::hardware_concurrency();
+        enc->pool = new JpegEncoderPool(threads, enc->quality, enc->max_in_flight);
+        GST_INFO_OBJECT(enc, "Encoding on %u threads", enc->pool->threads());
+    }
+
+    auto src_caps = gst_caps_new_simple(
+        "image/jpeg",
+        "width",
+        G_TYPE_INT,
+        GST_VIDEO_INFO_WIDTH(&info),
+        "height",
+        G_TYPE_INT,
+        GST_VIDEO_INFO_HEIGHT(&info),
+        "framerate",
+        GST_TYPE_FRACTION,
+        GST_VIDEO_INFO_FPS_N(&info),
+        GST_VIDEO_INFO_FPS_D(&info),
+        "pixel-aspect-ratio",
+        GST_TYPE_FRACTION,
+        GST_VIDEO_INFO_PAR_N(&info),
+        GST_VIDEO_INFO_PAR_D(&info),
+        nullptr
+    );
+    auto pushed = gst_pad_push_event(enc->srcpad, gst_event_new_caps(src_caps));
+    gst_caps_unref(src_caps);
+    return pushed;
+}
+
+gboolean sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+    auto enc = THOR_JPEG_ENC(parent);
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+        // Frames of the old caps go out first.
+        drain(enc);
+        GstCaps *caps;
+        gst_event_parse_caps(event, &caps);
+        auto set = set_caps(enc, caps);
+        gst_event_unref(event);
+        return set;
+    }
+    case GST_EVENT_FLUSH_STOP: discard(enc); break;
+    default:
+        // Serialized events such as EOS stay behind the frames before them.
+        if (GST_EVENT_IS_SERIALIZED(event)) drain(enc);
+        break;
+    }
+    return gst_pad_event_default(pad, parent, event);
+}
+
+GstStateChangeReturn change_state(GstElement *element, GstStateChange transition)
+{
+    auto ret = GST_ELEMENT_CLASS(thor_jpeg_enc_parent_class)->change_state(element, transition);
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        auto enc = THOR_JPEG_ENC(element);
+        discard(enc);
+        delete enc->pool;
+        enc->pool = nullptr;
+    }
+    return ret;
+}
+
+void finalize(GObject *object)
+{
+    auto enc = THOR_JPEG_ENC(object);
+    discard(enc);
+    delete enc->pool;
+    G_OBJECT_CLASS(thor_jpeg_enc_parent_class)->finalize(object);
+}
+}  // namespace
+
+
+static void thor_jpeg_enc_class_init(ThorJpegEncClass *klass)
+{
+    auto object_class = G_OBJECT_CLASS(klass);
+    object_class->set_property = set_property;
+    object_class->get_property = get_property;
+    object_class->finalize = finalize;
+
+    auto flags = static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+    g_object_class_install_property(
+        object_class,
+        PROP_THREADS,
+        g_param_spec_uint(
+            "threads", "Threads", "Encoding threads, 0 for one per core", 0, 64, 0, flags
+        )
+    );
+    g_object_class_install_property(
+        object_class,
+        PROP_QUALITY,
+        g_param_spec_int(
+            "quality", "Quality", "Quality of encoding", 0, 100, DEFAULT_QUALITY, flags
+        )
+    );
+    g_object_class_install_property(
+        object_class,
+        PROP_MAX_IN_FLIGHT,
+        g_param_spec_uint(
+            "max-in-flight",
+            "Max in flight",
+            "Frames encoded at once, 0 for two per thread",
+            0,
+            1024,
+            0,
+            flags
+        )
+    );
+
+    auto element_class = GST_ELEMENT_CLASS(klass);
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_set_static_metadata(
+        element_class,
+        "Thor parallel JPEG encoder",
+        "Codec/Encoder/Image",
+        "Encodes consecutive frames to JPEG on a pool of threads",
+        "KonteX Neuroscience"
+    );
+    element_class->change_state = change_state;
+}
+
+static void thor_jpeg_enc_init(ThorJpegEnc *enc)
+{
+    enc->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+    gst_pad_set_chain_function(enc->sinkpad, chain);
+    gst_pad_set_event_function(enc->sinkpad, sink_event);
+    GST_PAD_SET_ACCEPT_TEMPLATE(enc->sinkpad);
+    gst_element_add_pad(GST_ELEMENT(enc), enc->sinkpad);
+
+    enc->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+    gst_pad_use_fixed_caps(enc->srcpad);
+    gst_element_add_pad(GST_ELEMENT(enc), enc->srcpad);
+
+    enc->threads = 0;
+    enc->quality = DEFAULT_QUALITY;
+    enc->max_in_flight = 0;
+    enc->pool = nullptr;
+    gst_video_info_init(&enc->info);
+}
+
+
+bool register_parallel_jpeg_enc()
+{
+    static auto registered =
+        gst_element_register(nullptr, "thorjpegenc", GST_RANK_NONE, THOR_TYPE_JPEG_ENC);
+    return registered;
+}
+
+int run_jpeg_benchmark(int argc, char **argv)
+{
+    gst_init(nullptr, nullptr);
+    std::vector<std::string> caps(argv, argv + argc);
+    if (caps.empty()) caps.assign(std::begin(BENCHMARK_CAPS), std::end(BENCHMARK_CAPS));
+
+    std::vector<unsigned int> threads;
+    auto cores = std::max(1u, std::thread::hardware_concurrency());
+    for (auto n = 1u; n < cores; n *= 2) threads.push_back(n);
+    threads.push_back(cores);
+
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> supported(
+        gst_static_caps_get(&sink_template.static_caps), gst_caps_unref
+    );
+    for (auto &string : caps) {
+        std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> parsed(
+            gst_caps_from_string(string.c_str()), gst_caps_unref
+        );
+        GstVideoInfo info;
+        if (!parsed || !gst_caps_can_intersect(parsed.get(), supported.get()) ||
+            !gst_video_info_from_caps(&info, parsed.get())) {
+            fmt::print(stderr, "Can't encode {}\n", string);
+            return 2;
+        }
+
+        // A gradient under sensor-like noise, about as hard to compress as a camera's frames.
+        std::mt19937 random;
+        GstVideoFrame frames[BENCHMARK_DISTINCT_FRAMES];
+        for (auto &frame : frames) {
+            auto buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&info), nullptr);
+            GstMapInfo map;
+            gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+            for (gsize i = 0; i < map.size; ++i) {
+                map.data[i] = static_cast<guint8>(i * 3 / 7 + (random() & 15));
+            }
+            gst_buffer_unmap(buffer, &map);
+            gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ);
+            gst_buffer_unref(buffer);
+        }
+
+        auto rate = GST_VIDEO_INFO_FPS_N(&info) > 0
+                        ? static_cast<double>(GST_VIDEO_INFO_FPS_N(&info)) /
+                              GST_VIDEO_INFO_FPS_D(&info)
+                        : 0;
+        fmt::print("{}\n", string);
+        for (auto n : threads) {
+            JpegEncoderPool pool(n, DEFAULT_QUALITY);
+            std::uint64_t bytes = 0;
+            auto take = [&] {
+                auto encoded = *pool.next(true);
+                bytes += encoded.size;
+                std::free(encoded.data);
+            };
+            auto begin = std::chrono::steady_clock::now();
+            for (auto i = 0; i < BENCHMARK_FRAMES; ++i) {
+                while (pool.full()) take();
+                pool.submit(raw_image(frames[i % BENCHMARK_DISTINCT_FRAMES]), nullptr);
+            }
+            while (!pool.empty()) take();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+            auto fps = BENCHMARK_FRAMES / elapsed.count();
+            fmt::print(
+                "  {:2} threads: {:6.0f} fps, {:.1f}x the caps' rate, {:.0f} KB per frame\n",
+                n,
+                fps,
+                rate > 0 ? fps / rate : 0,
+                static_cast<double>(bytes) / BENCHMARK_FRAMES / 1024
+            );
+        }
+        for (auto &frame : frames) gst_video_frame_unmap(&frame);
+    }
+    return 0;
+}
\ No newline at end of file
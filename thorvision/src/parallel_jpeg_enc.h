@@ -0,0 +1,28 @@
+#pragma once
+
+#include <gst/gstelement.h>
+
+
+// "thorjpegenc": a JPEG encoder for raw video that encodes consecutive frames on a
+// JpegEncoderPool and pushes them in order. Takes
+//   threads        encoding threads (default 0, one per core)
+//   quality        as jpegenc's (default 85)
+//   max-in-flight  frames being encoded at once (default 0, two per thread)
+// which apply when it next starts. Frames leave up to max-in-flight frames late, so it suits
+// recording branches rather than live previews.
+G_BEGIN_DECLS
+
+#define THOR_TYPE_JPEG_ENC (thor_jpeg_enc_get_type())
+G_DECLARE_FINAL_TYPE(ThorJpegEnc, thor_jpeg_enc, THOR, JPEG_ENC, GstElement)
+
+G_END_DECLS
+
+
+// Registers the element with GStreamer; safe to call more than once.
+bool register_parallel_jpeg_enc();
+
+// The command line benchmark: ThorVision --jpeg-benchmark [caps...]
+// Encodes frames of each raw caps on 1, 2, 4, ... threads, up to one per core, and prints the
+// frame rates against the caps'. Without caps it runs the TEST cameras' caps and 1080p30.
+// Returns 0, or 2 for caps it can't encode.
+int run_jpeg_benchmark(int argc, char **argv);
\ No newline at end of file
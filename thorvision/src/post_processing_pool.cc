@@ -0,0 +1,189 @@
+#include "post_processing_pool.h"
+
+#include <spdlog/spdlog.h>
+
+#include <QSettings>
+#include <algorithm>
+#include <exception>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sys/qos.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+auto constexpr POST_PROCESSING_THREADS = "post_processing_threads";
+
+void lower_thread_priority()
+{
+#if defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#else
+    // Linux applies nice values per thread.
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+}  // namespace
+
+
+PostProcessingPool &PostProcessingPool::instance()
+{
+    static PostProcessingPool pool;
+    return pool;
+}
+
+PostProcessingPool::PostProcessingPool()
+    : _concurrency(0), _running(0), _stopping(false), _next_id(1)
+{
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    auto fallback = std::max(1u, std::thread::hardware_concurrency() / 4);
+    set_concurrency(settings.value(POST_PROCESSING_THREADS, fallback).toInt());
+}
+
+PostProcessingPool::~PostProcessingPool()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _work_available.notify_all();
+    // Queued jobs are dropped; running ones finish before the workers are joined.
+}
+
+void PostProcessingPool::set_concurrency(int threads)
+{
+    threads = std::max(1, threads);
+    {
+        std::lock_guard lock(_mutex);
+        _concurrency = threads;
+        while (static_cast<int>(_workers.size()) < threads) {
+            _workers.emplace_back(&PostProcessingPool::run, this);
+        }
+    }
+    _work_available.notify_all();
+    spdlog::info("Post-processing runs up to {} jobs at a time", threads);
+}
+
+int PostProcessingPool::concurrency() const
+{
+    std::lock_guard lock(_mutex);
+    return _concurrency;
+}
+
+PostProcessingPool::JobId PostProcessingPool::submit(std::string name, fs::path file, Work work)
+{
+    JobId id;
+    {
+        std::lock_guard lock(_mutex);
+        id = _next_id++;
+        _queue.push_back(Job{id, std::move(name), std::move(file), std::move(work)});
+        ++_stats.queued;
+    }
+    _work_available.notify_one();
+    return id;
+}
+
+bool PostProcessingPool::cancel(JobId id)
+{
+    std::unique_lock lock(_mutex);
+    auto job = std::find_if(_queue.begin(), _queue.end(), [id](auto &job) { return job.id == id; });
+    if (job == _queue.end()) return false;
+    spdlog::info("Cancelled post-processing of {}", job->file.string());
+    _queue.erase(job);
+    --_stats.queued;
+    ++_stats.cancelled;
+    if (_queue.empty() && _running == 0) _idle.notify_all();
+    return true;
+}
+
+std::size_t PostProcessingPool::cancel_all()
+{
+    std::lock_guard lock(_mutex);
+    auto count = _queue.size();
+    _queue.clear();
+    _stats.queued = 0;
+    _stats.cancelled += count;
+    if (_running == 0) _idle.notify_all();
+    if (count > 0) spdlog::info("Cancelled {} queued post-processing jobs", count);
+    return count;
+}
+
+std::size_t PostProcessingPool::remaining() const
+{
+    std::lock_guard lock(_mutex);
+    return _queue.size() + _running;
+}
+
+void PostProcessingPool::wait()
+{
+    std::unique_lock lock(_mutex);
+    _idle.wait(lock, [this] { return _queue.empty() && _running == 0; });
+}
+
+PostProcessingPool::Stats PostProcessingPool::stats() const
+{
+    std::lock_guard lock(_mutex);
+    return _stats;
+}
+
+void PostProcessingPool::run()
+{
+    lower_thread_priority();
+
+    std::unique_lock lock(_mutex);
+    while (true) {
+        _work_available.wait(lock, [this] {
+            return _stopping || (!_queue.empty() && _running < _concurrency);
+        });
+        if (_stopping) return;
+
+        auto job = std::move(_queue.front());
+        _queue.pop_front();
+        --_stats.queued;
+        ++_running;
+        ++_stats.running;
+        lock.unlock();
+
+        std::error_code error;
+        auto bytes = fs::file_size(job.file, error);
+        if (error) bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto ok = true;
+        try {
+            job.work(job.file);
+        } catch (const std::exception &e) {
+            spdlog::error("Post-processing {} failed: {}", job.file.string(), e.what());
+            ok = false;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        spdlog::info(
+            "{}: post-processed {} ({:.1f} MB) in {} ms, {:.1f} MB/s",
+            job.name,
+            job.file.string(),
+            bytes / 1e6,
+            ms,
+            bytes / 1e3 / std::max<long long>(ms, 1)
+        );
+
+        lock.lock();
+        --_running;
+        --_stats.running;
+        ++(ok ? _stats.completed : _stats.failed);
+        _stats.bytes += bytes;
+        _stats.busy += elapsed;
+        if (_queue.empty() && _running == 0) _idle.notify_all();
+        // Another worker may have been held back by the concurrency limit.
+        _work_available.notify_one();
+    }
+}
\ No newline at end of file
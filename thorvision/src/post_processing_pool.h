@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// Process-wide queue for work on closed recording fragments, such as extracting the frame
+// metadata. Runs at most concurrency() jobs at a time on threads with a lower OS priority than
+// capture, so a burst of short fragments from many cameras can't starve the pipelines.
+class PostProcessingPool
+{
+public:
+    using JobId = std::uint64_t;
+    using Work = std::function<void(const fs::path &file)>;
+
+    struct Stats {
+        std::size_t queued = 0;
+        std::size_t running = 0;
+        std::uint64_t completed = 0;
+        std::uint64_t failed = 0;
+        std::uint64_t cancelled = 0;
+        // Size of the files processed so far and the time spent on them, for throughput.
+        std::uint64_t bytes = 0;
+        std::chrono::nanoseconds busy{0};
+    };
+
+    static PostProcessingPool &instance();
+
+    PostProcessingPool(const PostProcessingPool &) = delete;
+    PostProcessingPool &operator=(const PostProcessingPool &) = delete;
+
+    // Raising the limit starts workers right away; lowering it takes effect as jobs finish.
+    void set_concurrency(int threads);
+    int concurrency() const;
+
+    // `name` only identifies the job in the log.
+    JobId submit(std::string name, fs::path file, Work work);
+    // Removes a job that hasn't started yet. A running job can't be interrupted.
+    bool cancel(JobId id);
+    std::size_t cancel_all();
+
+    // Jobs queued or running.
+    std::size_t remaining() const;
+    // Blocks until every job submitted so far has finished or been cancelled.
+    void wait();
+    Stats stats() const;
+
+private:
+    struct Job {
+        JobId id;
+        std::string name;
+        fs::path file;
+        Work work;
+    };
+
+    PostProcessingPool();
+    ~PostProcessingPool();
+
+    void run();
+
+    mutable std::mutex _mutex;
+    std::condition_variable _work_available;
+    std::condition_variable _idle;
+    std::deque<Job> _queue;
+    std::vector<std::jthread> _workers;
+    int _concurrency;
+    int _running;
+    bool _stopping;
+    JobId _next_id;
+    Stats _stats;
+};
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "pre_record_ring.h"
+
+
+PreRecordRing::~PreRecordRing() { clear(); }
+
+void PreRecordRing::set_budget(GstClockTime duration, std::size_t bytes)
+{
+    std::lock_guard lock(_mutex);
+    if (duration == _duration && bytes == _byte_budget) return;
+    _duration = duration;
+    _byte_budget = bytes;
+    if (!enabled()) clear();
+}
+
+void PreRecordRing::push(GstBuffer *buffer)
+{
+    auto pts = GST_BUFFER_PTS(buffer);
+    std::lock_guard lock(_mutex);
+    if (!enabled() || !GST_CLOCK_TIME_IS_VALID(pts)) return;
+
+    if (_count == CAPACITY) pop_front();
+    _buffers[(_head + _count) % CAPACITY] = gst_buffer_ref(buffer);
+    ++_count;
+    _bytes += gst_buffer_get_size(buffer);
+
+    // Always keep the newest frame, even if it alone is over the budget.
+    while (_count > 1) {
+        auto age = pts - GST_BUFFER_PTS(_buffers[_head]);
+        if (_bytes <= _byte_budget && age <= _duration) break;
+        pop_front();
+    }
+}
+
+std::vector<GstBuffer *> PreRecordRing::collect_before(GstClockTime pts)
+{
+    std::vector<GstBuffer *> buffers;
+    std::lock_guard lock(_mutex);
+    buffers.reserve(_count);
+    for (std::size_t i = 0; i < _count; ++i) {
+        auto buffer = _buffers[(_head + i) % CAPACITY];
+        if (GST_BUFFER_PTS(buffer) >= pts) break;
+        buffers.push_back(gst_buffer_ref(buffer));
+    }
+    return buffers;
+}
+
+void PreRecordRing::pop_front()
+{
+    auto buffer = _buffers[_head];
+    _bytes -= gst_buffer_get_size(buffer);
+    gst_buffer_unref(buffer);
+    _buffers[_head] = nullptr;
+    _head = (_head + 1) % CAPACITY;
+    --_count;
+}
+
+void PreRecordRing::clear()
+{
+    while (_count > 0) pop_front();
+    _head = 0;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <gst/gstbuffer.h>
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+
+// The most recent encoded frames of a camera, kept so a recording can start a few seconds
+// before the moment it was asked for. Holds buffer references in a fixed number of slots
+// and evicts the oldest frames past a duration or byte budget, so memory stays bounded
+// however long the stream runs.
+class PreRecordRing
+{
+public:
+    // 10 s at 260 fps with room to spare.
+    static auto constexpr CAPACITY = 4096;
+
+    PreRecordRing() = default;
+    ~PreRecordRing();
+    PreRecordRing(const PreRecordRing &) = delete;
+    PreRecordRing &operator=(const PreRecordRing &) = delete;
+
+    // A zero duration or byte budget disables the ring and releases what it holds.
+    void set_budget(GstClockTime duration, std::size_t bytes);
+
+    // Keeps a reference to buffer.
+    void push(GstBuffer *buffer);
+
+    // References to the kept frames with a PTS before pts, oldest first. The caller owns them.
+    std::vector<GstBuffer *> collect_before(GstClockTime pts);
+
+private:
+    bool enabled() const { return _duration > 0 && _byte_budget > 0; }
+    void pop_front();
+    void clear();
+
+    std::mutex _mutex;
+    std::array<GstBuffer *, CAPACITY> _buffers{};
+    std::size_t _head = 0;
+    std::size_t _count = 0;
+    std::size_t _bytes = 0;
+
+    GstClockTime _duration = 0;
+    std::size_t _byte_budget = 0;
+};
\ No newline at end of file
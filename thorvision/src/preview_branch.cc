@@ -0,0 +1,230 @@
+#include "preview_branch.h"
+
+#include <fmt/core.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <memory>
+
+
+namespace
+{
+auto constexpr APPSINK = "appsink";
+auto constexpr VIDEO_CONVERT = "videoconvert";
+auto constexpr TEE = "tee";
+
+using PadPtr = std::unique_ptr<GstPad, decltype(&gst_object_unref)>;
+using ElementPtr = std::unique_ptr<GstElement, decltype(&gst_object_unref)>;
+
+bool is_factory(GstElement *element, const char *name)
+{
+    auto factory = gst_element_get_factory(element);
+    if (!factory) return false;
+    return g_strcmp0(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), name) == 0;
+}
+
+// Links src -> first ... last -> sink in place of the direct src -> sink link.
+bool insert_between(GstPad *src, GstPad *sink, GstElement *first, GstElement *last)
+{
+    PadPtr first_sink(gst_element_get_static_pad(first, "sink"), gst_object_unref);
+    PadPtr last_src(gst_element_get_static_pad(last, "src"), gst_object_unref);
+
+    gst_pad_unlink(src, sink);
+    if (gst_pad_link(src, first_sink.get()) != GST_PAD_LINK_OK ||
+        gst_pad_link(last_src.get(), sink) != GST_PAD_LINK_OK) {
+        spdlog::error("Failed to link {} into the preview branch", GST_ELEMENT_NAME(first));
+        return false;
+    }
+    return true;
+}
+
+// Follows the preview branch upstream from the appsink to the tee and returns the tee's src pad
+// that feeds it. Without a tee the whole pipeline is the preview, and the most upstream sink
+// pad is returned instead.
+GstPad *find_branch_pad(GstPad *appsink_pad)
+{
+    auto pad = GST_PAD(gst_object_ref(appsink_pad));
+    // Bounded in case the branch loops back on itself.
+    for (auto i = 0; i < 32; ++i) {
+        auto peer = gst_pad_get_peer(pad);
+        if (!peer) break;
+        ElementPtr element(gst_pad_get_parent_element(peer), gst_object_unref);
+        if (element && is_factory(element.get(), TEE)) {
+            gst_object_unref(pad);
+            return peer;
+        }
+        auto sink = element ? gst_element_get_static_pad(element.get(), "sink") : nullptr;
+        gst_object_unref(peer);
+        if (!sink) break;
+        gst_object_unref(pad);
+        pad = sink;
+    }
+    return pad;
+}
+}  // namespace
+
+
+PreviewBranch::PreviewBranch(GstPipeline *pipeline, const char *formats)
+    : _caps_filter(nullptr),
+      _converts(false),
+      _gate_pad(nullptr),
+      _gate_probe(0),
+      _open(true),
+      _frame_interval(0),
+      _wait_for_key_frame(false),
+      _next_pts(0),
+      _width(0),
+      _height(0)
+{
+    ElementPtr appsink(gst_bin_get_by_name(GST_BIN(pipeline), APPSINK), gst_object_unref);
+    if (!appsink) {
+        spdlog::warn("Pipeline has no appsink, preview frames will not be scaled");
+        return;
+    }
+
+    if (formats) {
+        _format = formats;
+        auto caps = gst_caps_from_string(fmt::format("video/x-raw,format={}", _format).c_str());
+        g_object_set(appsink.get(), "caps", caps, nullptr);
+        gst_caps_unref(caps);
+    }
+
+    // Otherwise keep whatever pixel format the appsink was set up to receive.
+    GstCaps *appsink_caps = nullptr;
+    if (_format.empty()) g_object_get(appsink.get(), "caps", &appsink_caps, nullptr);
+    if (appsink_caps) {
+        if (!gst_caps_is_empty(appsink_caps) && !gst_caps_is_any(appsink_caps)) {
+            auto structure = gst_caps_get_structure(appsink_caps, 0);
+            if (auto format = gst_structure_get_string(structure, "format")) _format = format;
+        }
+        gst_caps_unref(appsink_caps);
+    }
+
+    PadPtr appsink_pad(gst_element_get_static_pad(appsink.get(), "sink"), gst_object_unref);
+    PadPtr upstream_pad(gst_pad_get_peer(appsink_pad.get()), gst_object_unref);
+    if (!upstream_pad) {
+        spdlog::warn("Appsink is not linked, preview frames will not be scaled");
+        return;
+    }
+    ElementPtr upstream(gst_pad_get_parent_element(upstream_pad.get()), gst_object_unref);
+
+    _gate_pad = find_branch_pad(appsink_pad.get());
+    _gate_probe = gst_pad_add_probe(_gate_pad, GST_PAD_PROBE_TYPE_BUFFER, gate, this, nullptr);
+    // A closed gate must not keep the pipeline from reaching PLAYING.
+    g_object_set(appsink.get(), "async", FALSE, nullptr);
+
+    auto scale = gst_element_factory_make("videoscale", "preview_scale");
+    auto caps_filter = gst_element_factory_make("capsfilter", "preview_caps");
+    if (!scale || !caps_filter) {
+        spdlog::error("Failed to create the preview scaler");
+        if (scale) gst_object_unref(scale);
+        if (caps_filter) gst_object_unref(caps_filter);
+        return;
+    }
+    // Stretch to the window like the painter used to, instead of letterboxing.
+    g_object_set(scale, "add-borders", FALSE, nullptr);
+    gst_bin_add_many(GST_BIN(pipeline), scale, caps_filter, nullptr);
+
+    // Scale ahead of the colour converter when there is one, so it only converts
+    // preview-sized frames.
+    auto linked = false;
+    if (upstream && is_factory(upstream.get(), VIDEO_CONVERT)) {
+        PadPtr convert_pad(gst_element_get_static_pad(upstream.get(), "sink"), gst_object_unref);
+        PadPtr decoded_pad(gst_pad_get_peer(convert_pad.get()), gst_object_unref);
+        linked = decoded_pad &&
+                 insert_between(decoded_pad.get(), convert_pad.get(), scale, scale) &&
+                 insert_between(upstream_pad.get(), appsink_pad.get(), caps_filter, caps_filter);
+        _converts = linked;
+    } else {
+        linked = gst_element_link(scale, caps_filter) &&
+                 insert_between(upstream_pad.get(), appsink_pad.get(), scale, caps_filter);
+    }
+    if (!linked) return;
+
+    _caps_filter = GST_ELEMENT(gst_object_ref(caps_filter));
+}
+
+PreviewBranch::~PreviewBranch()
+{
+    if (_gate_pad) {
+        gst_pad_remove_probe(_gate_pad, _gate_probe);
+        gst_object_unref(_gate_pad);
+    }
+    if (_caps_filter) gst_object_unref(_caps_filter);
+}
+
+void PreviewBranch::set_open(bool open)
+{
+    _open = open;
+}
+
+void PreviewBranch::set_max_fps(int fps)
+{
+    _frame_interval = fps > 0 ? GST_SECOND / fps : 0;
+}
+
+GstPadProbeReturn PreviewBranch::gate(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto branch = static_cast<PreviewBranch *>(user_data);
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    auto key_frame = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    if (!branch->_open.load(std::memory_order_relaxed)) {
+        // The decoder loses its references with the frames dropped here.
+        branch->_wait_for_key_frame = true;
+        return GST_PAD_PROBE_DROP;
+    }
+    if (!key_frame) return branch->_wait_for_key_frame ? GST_PAD_PROBE_DROP : GST_PAD_PROBE_OK;
+    branch->_wait_for_key_frame = false;
+
+    auto interval = branch->_frame_interval.load(std::memory_order_relaxed);
+    auto pts = GST_BUFFER_PTS(buffer);
+    if (interval == 0 || !GST_CLOCK_TIME_IS_VALID(pts)) return GST_PAD_PROBE_OK;
+    auto next = branch->_next_pts;
+    // A little slack so capture jitter doesn't push every other frame past the deadline.
+    if (pts + interval / 4 < next && next - pts <= 2 * interval) return GST_PAD_PROBE_DROP;
+    // Step from the previous deadline to keep the average rate, unless the stream jumped.
+    auto on_schedule = pts + interval / 4 >= next && pts < next + interval;
+    branch->_next_pts = on_schedule ? next + interval : pts + interval;
+    return GST_PAD_PROBE_OK;
+}
+
+void PreviewBranch::set_size(int width, int height)
+{
+    if (!_caps_filter) return;
+
+    width = frame_size(width);
+    height = frame_size(height);
+    if (width == _width && height == _height) return;
+    _width = width;
+    _height = height;
+    update_caps();
+}
+
+bool PreviewBranch::set_formats(const char *formats)
+{
+    if (!_caps_filter || !_converts) return false;
+    if (_format == formats) return true;
+    _format = formats;
+    if (_width > 0) update_caps();
+    return true;
+}
+
+void PreviewBranch::update_caps()
+{
+    // A string so that a list of formats can be passed through.
+    auto caps_string = fmt::format(
+        "video/x-raw,width={},height={},pixel-aspect-ratio=1/1", _width, _height
+    );
+    if (!_format.empty()) caps_string += fmt::format(",format={}", _format);
+    auto caps = gst_caps_from_string(caps_string.c_str());
+    if (!caps) {
+        spdlog::error("Invalid preview caps {}", caps_string);
+        return;
+    }
+    spdlog::info("Set preview caps to {}", caps_string);
+    // capsfilter triggers upstream renegotiation by itself when its caps change.
+    g_object_set(_caps_filter, "caps", caps, nullptr);
+    gst_caps_unref(caps);
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <gst/gstelement.h>
+#include <gst/gstpad.h>
+#include <gst/gstpipeline.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+
+// The part of a camera pipeline that feeds the "appsink" preview.
+// Inserts a scaler and a caps filter in front of the appsink so frames arrive at the size
+// they are painted at, and gates the branch where it leaves the tee, so frames nobody looks at
+// are neither decoded nor converted. The recording branch always gets every frame.
+class PreviewBranch
+{
+public:
+    // Must be called while the pipeline is still in the NULL state. `formats` replaces the
+    // pixel formats the appsink accepts, as a caps string value such as "{ I420, NV12 }";
+    // by default the appsink keeps the format it was set up with.
+    explicit PreviewBranch(GstPipeline *pipeline, const char *formats = nullptr);
+    ~PreviewBranch();
+    PreviewBranch(const PreviewBranch &) = delete;
+    PreviewBranch &operator=(const PreviewBranch &) = delete;
+
+    bool valid() const { return _caps_filter != nullptr; }
+
+    // The size frames arrive at when `size` is asked for: even, so that chroma-subsampled
+    // formats stay negotiable.
+    static int frame_size(int size) { return std::max(2, size & ~1); }
+
+    // Both renegotiate the preview caps and are safe to call while the pipeline is playing.
+    void set_size(int width, int height);
+    // Narrows the pixel formats to a subset of those the branch was built with. Needs a
+    // videoconvert ahead of the appsink; returns false without one.
+    bool set_formats(const char *formats);
+
+    // Both are safe to call from any thread while the pipeline is playing.
+    // A closed branch drops every frame; reopening waits for the next key frame.
+    void set_open(bool open);
+    // Caps the preview below the capture rate; 0 lets every frame through. Only frames that
+    // can be decoded on their own are skipped, so H.265 previews are capped by key frames.
+    void set_max_fps(int fps);
+
+private:
+    static GstPadProbeReturn gate(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    void update_caps();
+
+    GstElement *_caps_filter;
+    bool _converts;
+    GstPad *_gate_pad;
+    gulong _gate_probe;
+    std::atomic_bool _open;
+    std::atomic<GstClockTime> _frame_interval;
+    // Streaming thread only.
+    bool _wait_for_key_frame;
+    GstClockTime _next_pts;
+    std::string _format;
+    int _width;
+    int _height;
+};
\ No newline at end of file
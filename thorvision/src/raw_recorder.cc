@@ -0,0 +1,365 @@
+#include "raw_recorder.h"
+
+#include <fmt/core.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+
+#include "sidecar_writer.h"
+
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+auto constexpr FRAME_MARKER = std::string_view("FRAME\n");
+// Lets the disk fall this far behind while a segment is closed on the appsink thread,
+// without holding up the tee and the other branches.
+auto constexpr QUEUE_TIME = 2 * GST_SECOND;
+auto constexpr DRAIN_TIMEOUT = 30s;
+// For a single unsplit segment, whose length isn't known.
+auto constexpr UNSPLIT_PREALLOCATE = std::uint64_t{1} << 30;
+
+// Y4M's name for the chroma layout of info, or null if Y4M can't hold it.
+const char *colorspace(const GstVideoInfo &info)
+{
+    auto format = info.finfo;
+    if (GST_VIDEO_FORMAT_INFO_HAS_ALPHA(format) || GST_VIDEO_FORMAT_INFO_IS_COMPLEX(format)) {
+        return nullptr;
+    }
+    for (guint c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS(format); ++c) {
+        if (GST_VIDEO_FORMAT_INFO_DEPTH(format, c) != 8) return nullptr;
+    }
+    if (GST_VIDEO_FORMAT_INFO_IS_GRAY(format)) return "mono";
+    if (!GST_VIDEO_FORMAT_INFO_IS_YUV(format)) return nullptr;
+
+    auto w_sub = GST_VIDEO_FORMAT_INFO_W_SUB(format, 1);
+    auto h_sub = GST_VIDEO_FORMAT_INFO_H_SUB(format, 1);
+    if (w_sub == 1 && h_sub == 1) return "420jpeg";
+    if (w_sub == 1 && h_sub == 0) return "422";
+    if (w_sub == 0 && h_sub == 0) return "444";
+    if (w_sub == 2 && h_sub == 0) return "411";
+    return nullptr;
+}
+
+std::size_t frame_size(const GstVideoInfo &info)
+{
+    std::size_t size = 0;
+    for (guint c = 0; c < GST_VIDEO_INFO_N_COMPONENTS(&info); ++c) {
+        size += static_cast<std::size_t>(GST_VIDEO_INFO_COMP_WIDTH(&info, c)) *
+                GST_VIDEO_INFO_COMP_HEIGHT(&info, c);
+    }
+    return size;
+}
+}  // namespace
+
+
+bool RawRecorder::supports(const GstCaps *caps)
+{
+    GstVideoInfo info;
+    return caps && gst_video_info_from_caps(&info, caps) && colorspace(info);
+}
+
+std::uint64_t RawRecorder::stored_frame_size(const GstCaps *caps)
+{
+    GstVideoInfo info;
+    if (!caps || !gst_video_info_from_caps(&info, caps) || !colorspace(info)) return 0;
+    return FRAME_MARKER.size() + frame_size(info);
+}
+
+RawRecorder::RawRecorder(fs::path prefix, Options options)
+    : _prefix(std::move(prefix)),
+      _options(std::move(options)),
+      _pipeline(nullptr),
+      _tee(nullptr),
+      _tee_pad(nullptr),
+      _queue(nullptr),
+      _sink(nullptr),
+      _caps(nullptr),
+      _segment(0),
+      _segment_frames(0),
+      _open(false),
+      _last_running_time(0),
+      _metadata_buffer(1 << 20),
+      _failed(false),
+      _eos(false)
+{
+    gst_video_info_init(&_info);
+}
+
+RawRecorder::~RawRecorder()
+{
+    stop();
+    gst_caps_replace(&_caps, nullptr);
+}
+
+bool RawRecorder::start(GstElement *pipeline, GstElement *tee)
+{
+    _queue = gst_element_factory_make("queue", nullptr);
+    _sink = gst_element_factory_make("appsink", nullptr);
+    if (!_queue || !_sink) {
+        spdlog::error("Failed to create the raw recording branch");
+        if (_queue) gst_object_unref(_queue);
+        if (_sink) gst_object_unref(_sink);
+        _queue = _sink = nullptr;
+        return false;
+    }
+    g_object_set(
+        _queue,
+        "max-size-buffers",
+        0u,
+        "max-size-bytes",
+        0u,
+        "max-size-time",
+        static_cast<guint64>(QUEUE_TIME),
+        nullptr
+    );
+    g_object_set(_sink, "sync", FALSE, "async", FALSE, nullptr);
+    GstAppSinkCallbacks callbacks{};
+    callbacks.eos = eos;
+    callbacks.new_sample = new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(_sink), &callbacks, this, nullptr);
+
+    _pipeline = pipeline;
+    gst_bin_add_many(GST_BIN(pipeline), _queue, _sink, nullptr);
+    gst_element_link(_queue, _sink);
+    gst_element_sync_state_with_parent(_sink);
+    gst_element_sync_state_with_parent(_queue);
+
+    // Linked last, so the first frame finds the branch playing.
+    _tee = GST_ELEMENT(gst_object_ref(tee));
+    auto templ = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(tee), "src_%u");
+    _tee_pad = templ ? gst_element_request_pad(tee, templ, nullptr, nullptr) : nullptr;
+    auto queue_pad = gst_element_get_static_pad(_queue, "sink");
+    auto linked = _tee_pad && gst_pad_link(_tee_pad, queue_pad) == GST_PAD_LINK_OK;
+    gst_object_unref(queue_pad);
+    if (!linked) {
+        spdlog::error("Failed to link the raw recording branch");
+        stop();
+        return false;
+    }
+    spdlog::info("Recording raw video to {}-*.y4m", _prefix.string());
+    return true;
+}
+
+bool RawRecorder::stop()
+{
+    if (!_queue) return !_failed;
+
+    auto drained = true;
+    if (_tee_pad && gst_pad_is_linked(_tee_pad)) {
+        // Unlinked between two buffers, then the queue drains into the appsink.
+        gst_pad_add_probe(
+            _tee_pad,
+            GST_PAD_PROBE_TYPE_IDLE,
+            [](GstPad *pad, GstPadProbeInfo *, gpointer user_data) {
+                auto self = static_cast<RawRecorder *>(user_data);
+                auto queue_pad = gst_element_get_static_pad(self->_queue, "sink");
+                gst_pad_unlink(pad, queue_pad);
+                gst_pad_send_event(queue_pad, gst_event_new_eos());
+                gst_object_unref(queue_pad);
+                return GST_PAD_PROBE_REMOVE;
+            },
+            this,
+            nullptr
+        );
+        if (GST_STATE(_pipeline) == GST_STATE_PLAYING) {
+            std::unique_lock lock(_mutex);
+            drained = _drained.wait_for(lock, DRAIN_TIMEOUT, [this] { return _eos; });
+            if (!drained) spdlog::error("Raw recording {} did not drain", _prefix.string());
+        }
+    }
+
+    gst_element_set_state(_sink, GST_STATE_NULL);
+    gst_element_set_state(_queue, GST_STATE_NULL);
+    gst_bin_remove_many(GST_BIN(_pipeline), _queue, _sink, nullptr);
+    _queue = _sink = nullptr;
+    if (_tee_pad) {
+        gst_element_release_request_pad(_tee, _tee_pad);
+        gst_object_unref(_tee_pad);
+        _tee_pad = nullptr;
+    }
+    gst_object_unref(_tee);
+    _tee = nullptr;
+
+    // The appsink thread has stopped with the branch.
+    if (_open) close_segment(_last_running_time);
+    return drained && !_failed;
+}
+
+GstFlowReturn RawRecorder::new_sample(GstAppSink *sink, gpointer user_data)
+{
+    auto self = static_cast<RawRecorder *>(user_data);
+    std::unique_ptr<GstSample, decltype(&gst_sample_unref)> sample(
+        gst_app_sink_pull_sample(sink), gst_sample_unref
+    );
+    if (!sample) return GST_FLOW_OK;
+    return self->write(sample.get()) ? GST_FLOW_OK : GST_FLOW_ERROR;
+}
+
+void RawRecorder::eos(GstAppSink *, gpointer user_data)
+{
+    auto self = static_cast<RawRecorder *>(user_data);
+    {
+        std::lock_guard lock(self->_mutex);
+        self->_eos = true;
+    }
+    self->_drained.notify_all();
+}
+
+bool RawRecorder::write(GstSample *sample)
+{
+    if (_failed) return false;
+    auto buffer = gst_sample_get_buffer(sample);
+    if (!buffer) return true;
+
+    auto caps = gst_sample_get_caps(sample);
+    if (caps != _caps && !(caps && _caps && gst_caps_is_equal(caps, _caps))) {
+        if (_open) {
+            spdlog::info("Raw recording {} changed caps, starting a new segment", _prefix.string());
+            close_segment(_last_running_time);
+        }
+        if (!configure(caps)) return false;
+    }
+
+    auto pts = GST_BUFFER_PTS(buffer);
+    auto segment = gst_sample_get_segment(sample);
+    auto running_time =
+        segment && GST_CLOCK_TIME_IS_VALID(pts)
+            ? gst_segment_to_running_time(segment, GST_FORMAT_TIME, pts)
+            : _last_running_time;
+    if (!_open || (_options.segment_frames > 0 && _segment_frames == _options.segment_frames)) {
+        if (_open) close_segment(running_time);
+        if (!open_segment(running_time)) return false;
+    }
+
+    GstVideoFrame frame;
+    if (!gst_video_frame_map(&frame, &_info, buffer, GST_MAP_READ)) {
+        spdlog::warn("Raw recording {} dropped an unreadable frame", _prefix.string());
+        return true;
+    }
+    pack(frame);
+    gst_video_frame_unmap(&frame);
+    if (!_writer->write(FRAME_MARKER.data(), FRAME_MARKER.size()) ||
+        !_writer->write(_frame.data(), _frame.size())) {
+        _failed = true;
+        return false;
+    }
+
+    if (auto metadata = frame_metadata(buffer)) {
+        // Packed little-endian records, exactly as SidecarWriter writes them.
+        char record[SidecarWriter::RECORD_SIZE];
+        std::uint64_t timestamp = running_time;
+        std::memcpy(record, &timestamp, sizeof(timestamp));
+        std::memcpy(record + sizeof(timestamp), metadata, sizeof(XDAQFrameData));
+        _metadata.write(record, sizeof(record));
+    }
+    ++_segment_frames;
+    _last_running_time = running_time;
+    return true;
+}
+
+bool RawRecorder::configure(GstCaps *caps)
+{
+    const char *chroma = nullptr;
+    if (!caps || !gst_video_info_from_caps(&_info, caps) || !(chroma = colorspace(_info))) {
+        spdlog::error("Raw recording {} can't store its caps as Y4M", _prefix.string());
+        _failed = true;
+        return false;
+    }
+    auto fps_n = GST_VIDEO_INFO_FPS_N(&_info) > 0 ? GST_VIDEO_INFO_FPS_N(&_info) : 30;
+    auto fps_d = GST_VIDEO_INFO_FPS_N(&_info) > 0 ? GST_VIDEO_INFO_FPS_D(&_info) : 1;
+    _header = fmt::format(
+        "YUV4MPEG2 W{} H{} F{}:{} Ip A{}:{} C{}\n",
+        GST_VIDEO_INFO_WIDTH(&_info),
+        GST_VIDEO_INFO_HEIGHT(&_info),
+        fps_n,
+        fps_d,
+        GST_VIDEO_INFO_PAR_N(&_info),
+        GST_VIDEO_INFO_PAR_D(&_info),
+        chroma
+    );
+    _frame.resize(frame_size(_info));
+
+    // A split segment is preallocated to exactly the size it will have.
+    auto frame_bytes = FRAME_MARKER.size() + _frame.size();
+    auto options = BlockWriter::Options::for_bitrate(
+        gst_util_uint64_scale_int(frame_bytes, fps_n, fps_d)
+    );
+    options.direct = _options.direct;
+    options.preallocate =
+        _options.segment_frames > 0
+            ? _header.size() + _options.segment_frames * frame_bytes
+            : UNSPLIT_PREALLOCATE;
+    _writer = std::make_unique<BlockWriter>(options);
+    gst_caps_replace(&_caps, caps);
+    return true;
+}
+
+bool RawRecorder::open_segment(GstClockTime running_time)
+{
+    // Numbered like splitmuxsink's fragments.
+    _location = fmt::format("{}-{:05d}.y4m", _prefix.string(), _segment++);
+    if (!_writer->open(_location) || !_writer->write(_header.data(), _header.size())) {
+        _failed = true;
+        return false;
+    }
+    auto metadata_path = SidecarWriter::sidecar_path(_location);
+    _metadata.rdbuf()->pubsetbuf(
+        _metadata_buffer.data(), static_cast<std::streamsize>(_metadata_buffer.size())
+    );
+    _metadata.open(metadata_path, std::ios::binary | std::ios::trunc);
+    if (!_metadata) spdlog::error("Failed to create {}", metadata_path.string());
+
+    _open = true;
+    _segment_frames = 0;
+    _segments.push_back(_location);
+    auto keep = static_cast<std::size_t>(_options.max_files);
+    while (keep > 0 && _segments.size() > keep) {
+        std::error_code ec;
+        fs::remove(_segments.front(), ec);
+        fs::remove(SidecarWriter::sidecar_path(_segments.front()), ec);
+        _segments.pop_front();
+    }
+    if (_options.fragment_opened) _options.fragment_opened(_location, running_time);
+    return true;
+}
+
+void RawRecorder::close_segment(GstClockTime running_time)
+{
+    _open = false;
+    if (!_writer->close()) _failed = true;
+    _metadata.close();
+    spdlog::info(
+        "Raw segment closed. File saved: {} ({} frames)", _location.string(), _segment_frames
+    );
+    if (_options.fragment_closed) _options.fragment_closed(_location, running_time);
+}
+
+void RawRecorder::pack(const GstVideoFrame &frame)
+{
+    // Y4M stores Y, Cb and Cr as whole planes. Planar components are copied a row at a
+    // time; packed and semi-planar ones are picked out sample by sample.
+    auto out = _frame.data();
+    for (guint c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS(&frame); ++c) {
+        auto width = GST_VIDEO_FRAME_COMP_WIDTH(&frame, c);
+        auto height = GST_VIDEO_FRAME_COMP_HEIGHT(&frame, c);
+        auto stride = GST_VIDEO_FRAME_COMP_STRIDE(&frame, c);
+        auto pstride = GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, c);
+        auto data = static_cast<const guint8 *>(GST_VIDEO_FRAME_COMP_DATA(&frame, c));
+        for (auto y = 0; y < height; ++y) {
+            auto row = data + static_cast<std::ptrdiff_t>(y) * stride;
+            if (pstride == 1) {
+                std::memcpy(out, row, width);
+            } else {
+                for (auto x = 0; x < width; ++x) out[x] = static_cast<char>(row[x * pstride]);
+            }
+            out += width;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <gst/app/gstappsink.h>
+#include <gst/gstelement.h>
+#include <gst/video/video.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "block_writer.h"
+
+
+namespace fs = std::filesystem;
+
+
+// Records raw video losslessly as YUV4MPEG2 (.y4m) segments instead of encoding it. Frames
+// are rearranged from the camera's packed or semi-planar layout into the planar one Y4M
+// stores and written through a BlockWriter into segments preallocated to their exact size,
+// so the disk is the only limit on the frame rate. Every frame has the same size, so frame
+// k of a segment is at a fixed offset. The metadata of each segment goes to a .bin next to
+// it, in the same format as for JPEG fragments. When the caps change, the segment is closed
+// and the next one begins with a header for the new caps, so every segment holds one frame
+// size; caps Y4M can't hold fail the recording.
+class RawRecorder
+{
+public:
+    // location is the segment; running_time that of its first or last frame.
+    using Fragment = std::function<void(const fs::path &location, GstClockTime running_time)>;
+
+    struct Options {
+        // Frames per segment; 0 records one segment.
+        std::uint64_t segment_frames = 0;
+        // Segments kept when splitting, oldest deleted first; 0 keeps them all.
+        int max_files = 0;
+        bool direct = false;
+        // Called on the appsink thread, like splitmuxsink's fragment messages.
+        Fragment fragment_opened;
+        Fragment fragment_closed;
+    };
+
+    // 8-bit YUV or gray video that Y4M can hold.
+    static bool supports(const GstCaps *caps);
+    // Bytes a frame of caps takes in a segment, 0 if it isn't supported.
+    static std::uint64_t stored_frame_size(const GstCaps *caps);
+
+    RawRecorder(fs::path prefix, Options options);
+    ~RawRecorder();
+    RawRecorder(const RawRecorder &) = delete;
+    RawRecorder &operator=(const RawRecorder &) = delete;
+
+    // Links queue ! appsink to a new pad of tee, which must carry raw video.
+    bool start(GstElement *pipeline, GstElement *tee);
+    // Ends the branch with EOS and blocks until the last segment is on disk, then removes
+    // the branch. False if the branch didn't drain in time or a write failed.
+    bool stop();
+
+private:
+    static GstFlowReturn new_sample(GstAppSink *sink, gpointer user_data);
+    static void eos(GstAppSink *sink, gpointer user_data);
+
+    // Appsink thread.
+    bool write(GstSample *sample);
+    // Takes the format of the frames that follow from caps.
+    bool configure(GstCaps *caps);
+    bool open_segment(GstClockTime running_time);
+    void close_segment(GstClockTime running_time);
+    // Copies every component of frame into _frame, plane after plane.
+    void pack(const GstVideoFrame &frame);
+
+    const fs::path _prefix;
+    const Options _options;
+
+    GstElement *_pipeline;
+    GstElement *_tee;
+    GstPad *_tee_pad;
+    GstElement *_queue;
+    GstElement *_sink;
+
+    // Of the frames being recorded; null before the first.
+    GstCaps *_caps;
+    GstVideoInfo _info;
+    std::string _header;
+    std::vector<char> _frame;
+    std::unique_ptr<BlockWriter> _writer;
+    std::uint64_t _segment;
+    std::uint64_t _segment_frames;
+    bool _open;
+    fs::path _location;
+    GstClockTime _last_running_time;
+    std::deque<fs::path> _segments;
+    std::ofstream _metadata;
+    std::vector<char> _metadata_buffer;
+    bool _failed;
+
+    std::mutex _mutex;
+    std::condition_variable _drained;
+    bool _eos;
+};
\ No newline at end of file
@@ -6,10 +6,12 @@
 #include <QPushButton>
 #include <QSettings>
 
+#include "storage_probe.h"
+#include "stripe_planner.h"
+
 
 namespace
 {
-auto constexpr SAVE_PATHS = "save_paths";
 auto constexpr DIR_NAME = "dir_name";
 auto constexpr DIR_DATE = "dir_date";
 
@@ -19,8 +21,15 @@ auto constexpr MAX_FILES = "max_files";
 }  // namespace
 
 
-RecordConfirmDialog::RecordConfirmDialog(const QString &specs, QWidget *parent)
-    : QDialog(parent), _dont_ask_again(false)
+RecordConfirmDialog::RecordConfirmDialog(
+    const QString &specs, std::uint64_t bytes_per_second, QWidget *parent
+)
+    : QDialog(parent),
+      _dont_ask_again(false),
+      _bytes_per_second(bytes_per_second),
+      _bandwidth(nullptr),
+      _measure(nullptr),
+      _ok(nullptr)
 {
     setWindowTitle(tr("Record Settings Confirm"));
 
@@ -28,7 +37,11 @@ RecordConfirmDialog::RecordConfirmDialog(const QString &specs, QWidget *parent)
     auto dir_date = settings.value(DIR_DATE, true).toBool();
     auto dir_name = dir_date ? tr("YYYY-MM-DD_HH-MM-SS")
                              : settings.value(DIR_NAME, tr("directory_name")).toString();
-    auto save_path = settings.value(SAVE_PATHS).toStringList().first();
+    QStringList locations;
+    for (const auto &target : stripe_targets()) {
+        _save_paths << target.path;
+        locations << target.path + "/" + dir_name;
+    }
 
     auto continuous = settings.value(CONTINUOUS, true).toBool();
     auto max_size_time = settings.value(MAX_SIZE_TIME, 10).toInt();
@@ -49,7 +62,7 @@ RecordConfirmDialog::RecordConfirmDialog(const QString &specs, QWidget *parent)
                           "Record Mode: %2<br>"
                           "File Duration: %3<br>"
                           "Maximum files: %4")
-                           .arg(save_path + "/" + dir_name)
+                           .arg(locations.join(", "))
                            .arg(continuous ? tr("Continuous") : tr("Split"))
                            .arg(continuous ? tr("N/A") : QString::number(max_size_time) + "min")
                            .arg(continuous ? tr("N/A") : QString::number(max_files));
@@ -57,27 +70,98 @@ RecordConfirmDialog::RecordConfirmDialog(const QString &specs, QWidget *parent)
     auto record_info = new QLabel(record_text, this);
     record_info->setWordWrap(true);
 
+    auto bandwidth_widget = new QWidget(this);
+    auto bandwidth_layout = new QHBoxLayout(bandwidth_widget);
+    bandwidth_layout->setContentsMargins(0, 0, 0, 0);
+    _bandwidth = new QLabel(bandwidth_widget);
+    _bandwidth->setWordWrap(true);
+    _measure = new QPushButton(tr("Measure"), bandwidth_widget);
+    _measure->setToolTip(tr("Measure the sustained write speed of the save path"));
+    _measure->setFixedWidth(_measure->sizeHint().width());
+    bandwidth_layout->addWidget(_bandwidth, 1);
+    bandwidth_layout->addWidget(_measure);
+
     auto button_widget = new QWidget(this);
     auto button_layout = new QHBoxLayout(button_widget);
     auto dont_ask_again_checkbox = new QCheckBox(tr("Don't ask me again"), this);
-    auto ok = new QPushButton(tr("OK"), this);
+    _ok = new QPushButton(tr("OK"), this);
     auto cancel = new QPushButton(tr("Cancel"), this);
-    ok->setFixedWidth(ok->sizeHint().width());
+    _ok->setFixedWidth(_ok->sizeHint().width());
     cancel->setFixedWidth(cancel->sizeHint().width());
 
     button_layout->addWidget(dont_ask_again_checkbox);
     button_layout->addStretch();
-    button_layout->addWidget(ok);
+    button_layout->addWidget(_ok);
     button_layout->addWidget(cancel);
 
     layout->addWidget(info);
     layout->addWidget(camera_specs);
     layout->addWidget(record_info);
+    layout->addWidget(bandwidth_widget);
     layout->addWidget(button_widget);
 
-    connect(ok, &QPushButton::clicked, this, &QDialog::accept);
+    connect(_ok, &QPushButton::clicked, this, &QDialog::accept);
     connect(cancel, &QPushButton::clicked, this, &QDialog::reject);
     connect(dont_ask_again_checkbox, &QCheckBox::toggled, [this](bool checked) {
         _dont_ask_again = checked;
     });
+    connect(_measure, &QPushButton::clicked, this, &RecordConfirmDialog::measure);
+
+    update_bandwidth();
+    // The first recording to a path measures it, so the check has something to go by.
+    if (!stripe_bandwidth(stripe_targets())) measure();
+}
+
+RecordConfirmDialog::~RecordConfirmDialog()
+{
+    // Joined before the QObject goes away, which discards the pending update.
+    if (_probe.joinable()) _probe.join();
+}
+
+void RecordConfirmDialog::update_bandwidth()
+{
+    auto check = BandwidthCheck::evaluate(stripe_bandwidth(stripe_targets()), _bytes_per_second);
+    auto required = QString::number(check.required, 'f', 1);
+    auto available = QString::number(check.available, 'f', 0);
+
+    QString text;
+    switch (check.verdict) {
+    case BandwidthCheck::Verdict::Unknown:
+        text = tr("<b>Disk Bandwidth:</b> %1 MB/s needed, save path not measured yet")
+                   .arg(required);
+        break;
+    case BandwidthCheck::Verdict::Ok:
+        text = tr("<b>Disk Bandwidth:</b> %1 MB/s needed of %2 MB/s").arg(required, available);
+        break;
+    case BandwidthCheck::Verdict::Warn:
+        text = tr("<b>Disk Bandwidth:</b> <font color='darkorange'>%1 MB/s needed of %2 MB/s, "
+                  "more than %3% of what the disk sustains. Frames may be dropped.</font>")
+                   .arg(required, available)
+                   .arg(check.headroom);
+        break;
+    case BandwidthCheck::Verdict::Block:
+        text = tr("<b>Disk Bandwidth:</b> <font color='red'>%1 MB/s needed but the disk sustains "
+                  "only %2 MB/s. Record fewer cameras or use a lower resolution or frame "
+                  "rate.</font>")
+                   .arg(required, available);
+        break;
+    }
+    _bandwidth->setText(text);
+    _ok->setEnabled(check.verdict != BandwidthCheck::Verdict::Block);
+}
+
+void RecordConfirmDialog::measure()
+{
+    if (_probe.joinable()) return;
+
+    _measure->setEnabled(false);
+    _bandwidth->setText(tr("<b>Disk Bandwidth:</b> measuring %1 ...").arg(_save_paths.join(", ")));
+    _probe = std::jthread([this, paths = _save_paths] {
+        for (const auto &path : paths) measure_bandwidth(path, probe_size_mb());
+        QMetaObject::invokeMethod(this, [this] {
+            _probe.join();
+            _measure->setEnabled(true);
+            update_bandwidth();
+        });
+    });
 }
\ No newline at end of file
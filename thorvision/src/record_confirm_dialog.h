@@ -1,6 +1,11 @@
 #pragma once
 
 #include <QDialog>
+#include <QLabel>
+#include <QPushButton>
+#include <QStringList>
+#include <cstdint>
+#include <thread>
 
 
 class RecordConfirmDialog : public QDialog
@@ -8,10 +13,25 @@ class RecordConfirmDialog : public QDialog
     Q_OBJECT
 
 public:
-    RecordConfirmDialog(const QString &specs, QWidget *parent = nullptr);
+    // bytes_per_second is what the open cameras are expected to write together. Recording
+    // can't be confirmed while it is over the measured bandwidth of the save paths.
+    RecordConfirmDialog(
+        const QString &specs, std::uint64_t bytes_per_second, QWidget *parent = nullptr
+    );
+    ~RecordConfirmDialog();
 
     bool dont_ask_again() const { return _dont_ask_again; }
 
 private:
+    void update_bandwidth();
+    // Measures the save paths on a worker thread and updates the dialog when it's done.
+    void measure();
+
     bool _dont_ask_again;
+    QStringList _save_paths;
+    std::uint64_t _bytes_per_second;
+    QLabel *_bandwidth;
+    QPushButton *_measure;
+    QPushButton *_ok;
+    std::jthread _probe;
 };
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "camera_record_widget.h"
 #include "dir_name_combobox.h"
 #include "save_paths_combobox.h"
+#include "trigger_config.h"
 
 
 namespace
@@ -25,18 +26,20 @@ auto constexpr CONTINUOUS = "continuous";
 auto constexpr SPLIT_RECORD = "split_record";
 auto constexpr MAX_SIZE_TIME = "max_size_time";
 auto constexpr MAX_FILES = "max_files";
+auto constexpr ALIGNED_SPLITS = "aligned_splits";
 
 // auto constexpr ADDITIONAL_METADATA = "additional_metadata";
 
 auto constexpr OPEN_VIDEO_FOLDER = "open_video_folder";
 
 auto constexpr SAVE_PATHS = "save_paths";
+auto constexpr STRIPE_PATHS = "stripe_paths";
 }  // namespace
 
 
 RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
 {
-    setFixedSize(690, 360);
+    setFixedSize(690, 400);
     setWindowTitle(tr(" "));
 
     auto title = new QLabel(tr("REC Settings"), this);
@@ -53,8 +56,11 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
     auto max_size_time = new QSpinBox(this);
     auto max_files_text = new QLabel(tr("Max files"), this);
     auto max_files = new QSpinBox(this);
+    auto aligned_splits = new QCheckBox(tr("Align splits across cameras"), this);
     // auto additional_metadata = new QCheckBox(tr("Extract metadata in seperate files"), this);
     auto open_video_folder = new QCheckBox(tr("Open video folder after recording"), this);
+    auto stripe_text = new QLabel(tr("Spread cameras over"), this);
+    auto stripe_paths = new QSpinBox(this);
 
     max_size_time->setFixedWidth(60);
     max_size_time->setRange(1, 60);
@@ -63,6 +69,19 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
     max_files->setFixedWidth(60);
     max_files->setRange(1, 60);
 
+    aligned_splits->setToolTip(
+        tr("Split every camera's files on the same XDAQ FPGA timestamps, so each set of files "
+           "covers the same time window")
+    );
+
+    stripe_paths->setFixedWidth(80);
+    stripe_paths->setRange(1, 10);
+    stripe_paths->setSuffix(tr(" paths"));
+    stripe_paths->setToolTip(
+        tr("Record to the most recent save paths, placing each camera by the measured speed "
+           "and free space of the disks")
+    );
+
     auto record_mode_widget = new QWidget(this);
     auto record_mode_layout = new QHBoxLayout(record_mode_widget);
     record_mode_layout->addWidget(continuous);
@@ -71,6 +90,11 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
     record_mode_layout->addWidget(max_files_text);
     record_mode_layout->addWidget(max_files);
 
+    auto stripe_widget = new QWidget(this);
+    auto stripe_layout = new QHBoxLayout(stripe_widget);
+    stripe_layout->addWidget(stripe_text);
+    stripe_layout->addWidget(stripe_paths);
+
     auto file_location_widget = new QWidget(this);
     auto file_location_layout = new QHBoxLayout(file_location_widget);
     spdlog::info("Creating SavePathsComboBox.");
@@ -89,6 +113,8 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
     // file_settings_layout->addWidget(additional_metadata, 1, 1, Qt::AlignRight);
     file_settings_layout->addWidget(open_video_folder, 1, 1, Qt::AlignRight);
     file_settings_layout->addWidget(file_location_widget, 0, 0, 1, 2, Qt::AlignCenter);
+    file_settings_layout->addWidget(stripe_widget, 2, 0, Qt::AlignLeft);
+    file_settings_layout->addWidget(aligned_splits, 2, 1, Qt::AlignRight);
 
     layout->addWidget(title, 0, 0);
     layout->addWidget(_camera_list, 1, 0);
@@ -99,8 +125,10 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
     auto _split_record = settings.value(SPLIT_RECORD, false).toBool();
     auto _max_size_time = settings.value(MAX_SIZE_TIME, 10).toInt();
     auto _max_files = settings.value(MAX_FILES, 10).toInt();
+    auto _aligned_splits = settings.value(ALIGNED_SPLITS, true).toBool();
     // auto _additional_metadata = settings.value(ADDITIONAL_METADATA, false).toBool();
     auto _open_video_folder = settings.value(OPEN_VIDEO_FOLDER, true).toBool();
+    auto _stripe_paths = settings.value(STRIPE_PATHS, 1).toInt();
     settings.setValue(CONTINUOUS, _continuous);
     settings.setValue(SPLIT_RECORD, _split_record);
     settings.setValue(MAX_SIZE_TIME, _max_size_time);
@@ -111,27 +139,44 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
     split_record->setChecked(_split_record);
     max_size_time->setValue(_max_size_time);
     max_files->setValue(_max_files);
+    aligned_splits->setChecked(_aligned_splits);
     // additional_metadata->setChecked(_additional_metadata);
     open_video_folder->setChecked(_open_video_folder);
+    stripe_paths->setValue(_stripe_paths);
 
     max_size_time->setDisabled(continuous->isChecked());
     max_files->setDisabled(continuous->isChecked());
-
-    connect(split_record, &QRadioButton::toggled, this, [max_size_time, max_files](bool checked) {
-        spdlog::info("RadioButton 'split_record' selected option: {}", checked);
-        QSettings settings("KonteX Neuroscience", "Thor Vision");
-        settings.setValue(CONTINUOUS, !checked);
-        settings.setValue(SPLIT_RECORD, checked);
-        max_size_time->setDisabled(!checked);
-        max_files->setDisabled(!checked);
-    });
+    aligned_splits->setDisabled(continuous->isChecked());
+
+    connect(
+        split_record,
+        &QRadioButton::toggled,
+        this,
+        [max_size_time, max_files, aligned_splits](bool checked) {
+            spdlog::info("RadioButton 'split_record' selected option: {}", checked);
+            QSettings settings("KonteX Neuroscience", "Thor Vision");
+            settings.setValue(CONTINUOUS, !checked);
+            settings.setValue(SPLIT_RECORD, checked);
+            TriggerConfigSlot::reload_all();
+            max_size_time->setDisabled(!checked);
+            max_files->setDisabled(!checked);
+            aligned_splits->setDisabled(!checked);
+        }
+    );
     connect(max_size_time, &QSpinBox::valueChanged, this, [](int minutes) {
         spdlog::info("SpinBox 'max_size_time' selected minutes: {}", minutes);
         QSettings("KonteX Neuroscience", "Thor Vision").setValue(MAX_SIZE_TIME, minutes);
+        TriggerConfigSlot::reload_all();
     });
     connect(max_files, &QSpinBox::valueChanged, this, [](int files) {
         spdlog::info("SpinBox 'max_files' selected file: {}", files);
         QSettings("KonteX Neuroscience", "Thor Vision").setValue(MAX_FILES, files);
+        TriggerConfigSlot::reload_all();
+    });
+    connect(aligned_splits, &QCheckBox::clicked, this, [](bool checked) {
+        spdlog::info("CheckBox 'aligned_splits' selected option: {}", checked);
+        QSettings("KonteX Neuroscience", "Thor Vision").setValue(ALIGNED_SPLITS, checked);
+        TriggerConfigSlot::reload_all();
     });
     connect(select_save_path, &QPushButton::clicked, [this, save_paths]() {
         auto path = QFileDialog::getExistingDirectory(this);
@@ -148,12 +193,17 @@ RecordSettings::RecordSettings(QWidget *parent) : QDialog(parent)
                 paths << save_paths->itemText(i);
             }
             QSettings("KonteX Neuroscience", "Thor Vision").setValue(SAVE_PATHS, path);
+            TriggerConfigSlot::reload_all();
         }
     });
     // connect(additional_metadata, &QCheckBox::clicked, [](bool checked) {
     //     spdlog::info("CheckBox 'additional_metadata' selected option: {}", checked);
     //     QSettings("KonteX Neuroscience", "Thor Vision").setValue(ADDITIONAL_METADATA, checked);
     // });
+    connect(stripe_paths, &QSpinBox::valueChanged, this, [](int paths) {
+        spdlog::info("SpinBox 'stripe_paths' selected paths: {}", paths);
+        QSettings("KonteX Neuroscience", "Thor Vision").setValue(STRIPE_PATHS, paths);
+    });
     connect(open_video_folder, &QCheckBox::clicked, this, [](bool checked) {
         spdlog::info("CheckBox 'open_video_folder' selected option: {}", checked);
         QSettings("KonteX Neuroscience", "Thor Vision").setValue(OPEN_VIDEO_FOLDER, checked);
@@ -0,0 +1,303 @@
+#include "recording_gate.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+
+
+namespace
+{
+// The gate waiting for the tee pad that start() requests.
+struct PadClaim {
+    std::shared_ptr<RecordingGate> gate;
+    std::atomic<bool> claimed;
+};
+
+// Follows the branch downstream from a tee pad to its splitmuxsink; returns a reference.
+GstElement *find_splitmuxsink(GstPad *pad)
+{
+    auto current = GST_PAD(gst_object_ref(pad));
+    for (auto depth = 0; depth < 8; ++depth) {
+        auto peer = gst_pad_get_peer(current);
+        gst_object_unref(current);
+        if (!peer) return nullptr;
+        auto element = gst_pad_get_parent_element(peer);
+        auto factory = element ? gst_element_get_factory(element) : nullptr;
+        if (factory && g_strcmp0(GST_OBJECT_NAME(factory), "splitmuxsink") == 0) {
+            gst_object_unref(peer);
+            return element;
+        }
+        // Into a bin through its ghost pad, or on through the element's source pad.
+        if (GST_IS_GHOST_PAD(peer)) {
+            auto target = gst_ghost_pad_get_target(GST_GHOST_PAD(peer));
+            if (element) gst_object_unref(element);
+            element = target ? gst_pad_get_parent_element(target) : nullptr;
+            if (target) gst_object_unref(target);
+            factory = element ? gst_element_get_factory(element) : nullptr;
+            if (factory && g_strcmp0(GST_OBJECT_NAME(factory), "splitmuxsink") == 0) {
+                gst_object_unref(peer);
+                return element;
+            }
+        }
+        gst_object_unref(peer);
+        if (!element) return nullptr;
+        current = gst_element_get_static_pad(element, "src");
+        gst_object_unref(element);
+        if (!current) return nullptr;
+    }
+    gst_object_unref(current);
+    return nullptr;
+}
+}  // namespace
+
+
+RecordingGate::RecordingGate(
+    GstClockTime start_pts,
+    std::shared_ptr<PreRecordRing> pre_record,
+    std::shared_ptr<SidecarWriter> sidecar,
+    std::shared_ptr<FrameIndexWriter> index
+)
+    : _start(start_pts),
+      _stop(GST_CLOCK_TIME_NONE),
+      _start_tick(NO_TICK),
+      _start_running_time(GST_CLOCK_TIME_NONE),
+      _pre_record_pts(0),
+      _pre_record_tick(0),
+      _pre_record_running_time(0),
+      _split_interval(0),
+      _pre_record(std::move(pre_record)),
+      _flushing(false),
+      _started(false),
+      _sidecar(std::move(sidecar)),
+      _index(std::move(index)),
+      _splitmuxsink(nullptr),
+      _split_boundary(NO_TICK),
+      _has_segment(false)
+{
+    gst_segment_init(&_segment, GST_FORMAT_TIME);
+}
+
+RecordingGate::~RecordingGate()
+{
+    if (_splitmuxsink) gst_object_unref(_splitmuxsink);
+}
+
+std::shared_ptr<RecordingGate> RecordingGate::open(
+    GstElement *tee,
+    GstClockTime start_pts,
+    const std::function<void()> &start,
+    std::shared_ptr<PreRecordRing> pre_record,
+    std::shared_ptr<SidecarWriter> sidecar,
+    std::shared_ptr<FrameIndexWriter> index
+)
+{
+    PadClaim claim{
+        std::make_shared<RecordingGate>(
+            start_pts, std::move(pre_record), std::move(sidecar), std::move(index)
+        ),
+        false
+    };
+    auto added = [](GstElement *, GstPad *pad, gpointer user_data) {
+        auto &claim = *static_cast<PadClaim *>(user_data);
+        if (GST_PAD_DIRECTION(pad) != GST_PAD_SRC || claim.claimed.exchange(true)) return;
+        // The probe owns a reference, so the gate lives as long as the pad keeps the probe.
+        gst_pad_add_probe(
+            pad,
+            GST_PAD_PROBE_TYPE_BUFFER,
+            filter,
+            new std::shared_ptr<RecordingGate>(claim.gate),
+            [](gpointer data) { delete static_cast<std::shared_ptr<RecordingGate> *>(data); }
+        );
+    };
+    // The tee announces the pad as it is requested, before start() can link the branch and
+    // set it playing, so the probe is in place ahead of the first buffer.
+    auto handler = g_signal_connect(tee, "pad-added", G_CALLBACK(+added), &claim);
+    start();
+    g_signal_handler_disconnect(tee, handler);
+
+    if (!claim.claimed) {
+        spdlog::warn("Recording did not add a tee branch, it can't be trimmed to the trigger");
+        return nullptr;
+    }
+    return claim.gate;
+}
+
+void RecordingGate::open_at(
+    GstClockTime start_pts, GstClockTime pre_record_pts, FirstFrame first_frame
+)
+{
+    _pre_record_pts = pre_record_pts;
+    _first_frame = std::move(first_frame);
+    _start.store(start_pts, std::memory_order_release);
+}
+
+void RecordingGate::open_at_tick(
+    std::uint64_t tick, std::uint64_t pre_record_tick, FirstFrame first_frame
+)
+{
+    _pre_record_tick = pre_record_tick;
+    _first_frame = std::move(first_frame);
+    _start_tick.store(tick, std::memory_order_release);
+}
+
+void RecordingGate::open_at_running_time(
+    GstClockTime start, GstClockTime pre_record_start, FirstFrame first_frame
+)
+{
+    _pre_record_running_time = pre_record_start;
+    _first_frame = std::move(first_frame);
+    _start_running_time.store(start, std::memory_order_release);
+}
+
+void RecordingGate::close_at(GstClockTime stop_pts)
+{
+    _stop.store(stop_pts, std::memory_order_release);
+}
+
+void RecordingGate::split_on_ticks(std::uint64_t interval, Split split)
+{
+    _split = std::move(split);
+    _split_interval.store(interval, std::memory_order_release);
+}
+
+GstPadProbeReturn RecordingGate::filter(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto &gate = *static_cast<std::shared_ptr<RecordingGate> *>(user_data);
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    auto pts = GST_BUFFER_PTS(buffer);
+    // The tee can push to the pad before start() has linked the branch; nothing of it would
+    // arrive, so the gate mustn't start or flush the pre-record into it yet.
+    if (!gst_pad_is_linked(pad)) return GST_PAD_PROBE_DROP;
+
+    // GST_CLOCK_TIME_NONE is the largest clock time, so an open gate never drops.
+    if (!gate->_flushing && GST_CLOCK_TIME_IS_VALID(pts)) {
+        if (auto tick = gate->_start_tick.load(std::memory_order_acquire); tick != NO_TICK) {
+            auto metadata = frame_metadata(buffer);
+            if (!metadata || metadata->fpga_timestamp < tick) return GST_PAD_PROBE_DROP;
+            // From the first frame on the boundary, the PTS orders the frames again.
+            gate->_start.store(pts, std::memory_order_relaxed);
+            gate->_start_tick.store(NO_TICK, std::memory_order_relaxed);
+        }
+        auto start = gate->_start_running_time.load(std::memory_order_acquire);
+        if (GST_CLOCK_TIME_IS_VALID(start)) {
+            if (gate->running_time(pad, pts) < start) return GST_PAD_PROBE_DROP;
+            // The segment is known now, so the rest is done in PTS as for open_at().
+            gate->_pre_record_pts = gate->position(gate->_pre_record_running_time);
+            gate->_start.store(pts, std::memory_order_relaxed);
+            gate->_start_running_time.store(GST_CLOCK_TIME_NONE, std::memory_order_relaxed);
+        }
+        if (pts < gate->_start.load(std::memory_order_acquire) ||
+            pts >= gate->_stop.load(std::memory_order_acquire)) {
+            return GST_PAD_PROBE_DROP;
+        }
+        if (!gate->_started) {
+            gate->_started = true;
+            if (gate->_first_frame) gate->_first_frame(buffer, gate->running_time(pad, pts));
+            gate->_first_frame = nullptr;
+        }
+        if (gate->_split_interval.load(std::memory_order_acquire) > 0) gate->split(pad, buffer);
+        if (gate->_pre_record) gate->flush_pre_record(pad, pts);
+    }
+    gate->record(pad, buffer);
+    return GST_PAD_PROBE_OK;
+}
+
+void RecordingGate::flush_pre_record(GstPad *pad, GstClockTime pts)
+{
+    // Sticky events have already gone out ahead of this first buffer, so the earlier frames
+    // land in the same segment. The probe runs again for each of them and lets them through.
+    auto buffers = _pre_record->collect_before(pts);
+    _pre_record.reset();
+    // A synchronized start keeps the same stretch of time before the boundary on every camera.
+    std::erase_if(buffers, [this](GstBuffer *buffer) {
+        auto metadata = frame_metadata(buffer);
+        auto early = GST_BUFFER_PTS(buffer) < _pre_record_pts ||
+                     (_pre_record_tick > 0 && metadata &&
+                      metadata->fpga_timestamp < _pre_record_tick);
+        if (early) gst_buffer_unref(buffer);
+        return early;
+    });
+    spdlog::info("Flushing {} pre-record frames into {}", buffers.size(), GST_PAD_NAME(pad));
+
+    _flushing = true;
+    auto result = GST_FLOW_OK;
+    for (auto buffer : buffers) {
+        if (result == GST_FLOW_OK) {
+            result = gst_pad_push(pad, buffer);
+        } else {
+            gst_buffer_unref(buffer);
+        }
+    }
+    _flushing = false;
+    if (result != GST_FLOW_OK) {
+        spdlog::warn("Pre-record flush stopped: {}", gst_flow_get_name(result));
+    }
+}
+
+void RecordingGate::record(GstPad *pad, GstBuffer *buffer)
+{
+    if (!_sidecar && !_index) return;
+    auto metadata = frame_metadata(buffer);
+    auto time = running_time(pad, GST_BUFFER_PTS(buffer));
+    if (_index) {
+        _index->frame(time, metadata ? std::optional(metadata->fpga_timestamp) : std::nullopt);
+    }
+    if (_sidecar && metadata) _sidecar->record(time, *metadata);
+}
+
+void RecordingGate::split(GstPad *pad, GstBuffer *buffer)
+{
+    auto metadata = frame_metadata(buffer);
+    if (!metadata) return;
+    auto interval = _split_interval.load(std::memory_order_relaxed);
+    auto boundary = metadata->fpga_timestamp / interval * interval;
+    if (_split_boundary != NO_TICK && boundary <= _split_boundary) return;
+
+    if (_split_boundary == NO_TICK) {
+        // xvc has set the splitmuxsink up by the time the first frame arrives.
+        _splitmuxsink = find_splitmuxsink(pad);
+        if (!_splitmuxsink) {
+            spdlog::warn(
+                "No splitmuxsink behind {}, fragments can't be aligned", GST_PAD_NAME(pad)
+            );
+            _split_interval.store(0, std::memory_order_relaxed);
+            return;
+        }
+        g_object_set(
+            _splitmuxsink,
+            "max-size-time",
+            static_cast<guint64>(0),
+            "max-size-bytes",
+            static_cast<guint64>(0),
+            nullptr
+        );
+    } else {
+        // The frame hasn't reached the muxer yet, so it is the first of the next fragment.
+        g_signal_emit_by_name(
+            _splitmuxsink, "split-at-running-time", running_time(pad, GST_BUFFER_PTS(buffer))
+        );
+    }
+    _split_boundary = boundary;
+    if (_split) _split(boundary, metadata->fpga_timestamp);
+}
+
+GstClockTime RecordingGate::running_time(GstPad *pad, GstClockTime pts)
+{
+    if (!_has_segment) {
+        if (auto event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0)) {
+            gst_event_copy_segment(event, &_segment);
+            gst_event_unref(event);
+            _has_segment = true;
+        }
+    }
+    return _has_segment ? gst_segment_to_running_time(&_segment, GST_FORMAT_TIME, pts) : pts;
+}
+
+GstClockTime RecordingGate::position(GstClockTime running_time)
+{
+    if (!_has_segment) return running_time;
+    auto pts = gst_segment_position_from_running_time(&_segment, GST_FORMAT_TIME, running_time);
+    // Before the segment began; every frame of it is later.
+    return GST_CLOCK_TIME_IS_VALID(pts) ? pts : 0;
+}
\ No newline at end of file
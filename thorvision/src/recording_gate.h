@@ -0,0 +1,117 @@
+#pragma once
+
+#include <gst/gstelement.h>
+#include <gst/gstpad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+
+#include "frame_index.h"
+#include "pre_record_ring.h"
+#include "sidecar_writer.h"
+
+
+// Trims the tee branch of one recording to the frames with start <= PTS < stop, so a
+// triggered recording begins and ends on the triggering frame no matter how long xvc takes
+// to build or tear down the branch. A gate opened with a start of GST_CLOCK_TIME_NONE stays
+// shut until open_at() or open_at_tick(), so several cameras can be prepared one by one and
+// then started on the same frame.
+class RecordingGate
+{
+public:
+    // Streaming thread; gets the first frame that enters the branch and its running time,
+    // before any pre-record frames are flushed ahead of it.
+    using FirstFrame = std::function<void(GstBuffer *buffer, GstClockTime running_time)>;
+    // Streaming thread; the fragment opened next begins on the frame with FPGA timestamp
+    // frame_tick, the first at or past boundary. Also called for the first fragment.
+    using Split = std::function<void(std::uint64_t boundary, std::uint64_t frame_tick)>;
+
+    RecordingGate(
+        GstClockTime start_pts,
+        std::shared_ptr<PreRecordRing> pre_record,
+        std::shared_ptr<SidecarWriter> sidecar,
+        std::shared_ptr<FrameIndexWriter> index
+    );
+    ~RecordingGate();
+    RecordingGate(const RecordingGate &) = delete;
+    RecordingGate &operator=(const RecordingGate &) = delete;
+
+    // Runs start, which must add a branch to the tee, and gates the tee pad it requested as
+    // the tee adds it, so no frame gets into the branch ahead of the gate.
+    // If pre_record is given, its frames from before the first recorded one are pushed into
+    // the branch ahead of it, with their original timestamps. If sidecar is given, it gets
+    // the metadata of every frame that enters the branch, and so does index. Returns null
+    // if start didn't add a pad.
+    static std::shared_ptr<RecordingGate> open(
+        GstElement *tee,
+        GstClockTime start_pts,
+        const std::function<void()> &start,
+        std::shared_ptr<PreRecordRing> pre_record = nullptr,
+        std::shared_ptr<SidecarWriter> sidecar = nullptr,
+        std::shared_ptr<FrameIndexWriter> index = nullptr
+    );
+
+    // Lets frames through from start_pts on. Pre-record frames are only flushed from
+    // pre_record_pts on.
+    void open_at(GstClockTime start_pts, GstClockTime pre_record_pts, FirstFrame first_frame);
+    // The same in running time, which is what the pipeline clock relates to; the branch's
+    // segment maps it to PTS, so it holds however far the two have drifted apart.
+    void open_at_running_time(
+        GstClockTime start, GstClockTime pre_record_start, FirstFrame first_frame
+    );
+    // Lets frames through from the first one whose XDAQ FPGA timestamp is at least tick,
+    // which lines up cameras whose pipelines don't share a running time. Frames without
+    // metadata are dropped until then. Pre-record frames are only flushed from
+    // pre_record_tick on.
+    void open_at_tick(std::uint64_t tick, std::uint64_t pre_record_tick, FirstFrame first_frame);
+
+    // Drops every buffer from stop_pts on; the branch can then be stopped at leisure.
+    void close_at(GstClockTime stop_pts);
+
+    // Cuts the branch's fragments on the first frame at or past every multiple of interval
+    // in XDAQ FPGA timestamp ticks, so cameras that share the FPGA clock split on the same
+    // boundaries. The splitmuxsink downstream stops splitting on its own time. Call before
+    // the gate opens.
+    void split_on_ticks(std::uint64_t interval, Split split);
+
+private:
+    static GstPadProbeReturn filter(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+
+    void flush_pre_record(GstPad *pad, GstClockTime pts);
+    void record(GstPad *pad, GstBuffer *buffer);
+    void split(GstPad *pad, GstBuffer *buffer);
+    GstClockTime running_time(GstPad *pad, GstClockTime pts);
+    // The PTS at a running time of the branch's segment, once running_time() has found it.
+    GstClockTime position(GstClockTime running_time);
+
+    static auto constexpr NO_TICK = std::numeric_limits<std::uint64_t>::max();
+
+    std::atomic<GstClockTime> _start;
+    std::atomic<GstClockTime> _stop;
+    std::atomic<std::uint64_t> _start_tick;
+    std::atomic<GstClockTime> _start_running_time;
+    // Written before _start, _start_tick or _start_running_time is released.
+    GstClockTime _pre_record_pts;
+    std::uint64_t _pre_record_tick;
+    GstClockTime _pre_record_running_time;
+    FirstFrame _first_frame;
+    std::atomic<std::uint64_t> _split_interval;
+    // Written before _split_interval is released.
+    Split _split;
+
+    // Only touched by the streaming thread pushing into the pad.
+    std::shared_ptr<PreRecordRing> _pre_record;
+    bool _flushing;
+    bool _started;
+    std::shared_ptr<SidecarWriter> _sidecar;
+    std::shared_ptr<FrameIndexWriter> _index;
+    // Found on the first split; the boundary the current fragment started from.
+    GstElement *_splitmuxsink;
+    std::uint64_t _split_boundary;
+    // The branch's segment, to turn PTS into the running time the muxer stores.
+    GstSegment _segment;
+    bool _has_segment;
+};
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "recording_manifest.h"
+
+#include <spdlog/spdlog.h>
+
+#include <QDateTime>
+#include <algorithm>
+#include <fstream>
+#include <system_error>
+
+
+RecordingManifest::RecordingManifest(std::vector<fs::path> directories)
+    : _directories(std::move(directories))
+{
+    _json["version"] = 1;
+    _json["started"] = QDateTime::currentDateTime().toString(Qt::ISODate).toStdString();
+    _json["directories"] = nlohmann::json::array();
+    for (const auto &directory : _directories) {
+        _json["directories"].push_back(directory.generic_string());
+    }
+    _json["cameras"] = nlohmann::json::array();
+}
+
+void RecordingManifest::add_camera(
+    const std::string &name,
+    int id,
+    const fs::path &prefix,
+    std::uint64_t bytes_per_second,
+    double path_bandwidth
+)
+{
+    std::lock_guard lock(_mutex);
+    _json["cameras"].push_back({
+        {"name", name},
+        {"id", id},
+        {"directory", prefix.parent_path().generic_string()},
+        {"prefix", prefix.filename().generic_string()},
+        {"bytes_per_second", bytes_per_second},
+        {"path_bandwidth_mb_s", path_bandwidth},
+        {"fragments", nlohmann::json::array()},
+    });
+    _prefixes.push_back(prefix.generic_string());
+    _next_split.emplace_back();
+    write();
+}
+
+void RecordingManifest::fragment_opened(const fs::path &location, GstClockTime running_time)
+{
+    std::lock_guard lock(_mutex);
+    auto camera = camera_of(location);
+    if (camera < 0) return;
+
+    nlohmann::json fragment = {
+        {"file", location.filename().generic_string()},
+        {"start", running_time},
+    };
+    if (auto &split = _next_split[camera]) {
+        fragment["boundary"] = split->first;
+        fragment["first_tick"] = split->second;
+        split.reset();
+    }
+    _json["cameras"][camera]["fragments"].push_back(std::move(fragment));
+    write();
+}
+
+void RecordingManifest::fragment_closed(const fs::path &location, GstClockTime running_time)
+{
+    std::lock_guard lock(_mutex);
+    auto camera = camera_of(location);
+    if (camera < 0) return;
+
+    auto &fragments = _json["cameras"][camera]["fragments"];
+    auto file = location.filename().generic_string();
+    auto it = std::find_if(fragments.rbegin(), fragments.rend(), [&](const auto &fragment) {
+        return fragment["file"] == file;
+    });
+    if (it == fragments.rend()) {
+        fragments.push_back({{"file", file}});
+        it = fragments.rbegin();
+    }
+    std::error_code ec;
+    auto size = fs::file_size(location, ec);
+    (*it)["end"] = running_time;
+    (*it)["size"] = ec ? 0 : size;
+    write();
+}
+
+void RecordingManifest::set_split_interval(std::uint64_t interval, std::uint64_t tick_rate)
+{
+    std::lock_guard lock(_mutex);
+    if (_json.contains("split")) return;
+    _json["split"] = {
+        {"interval", interval},
+        {"tick_rate", tick_rate},
+        {"boundaries", nlohmann::json::array()},
+    };
+    write();
+}
+
+void RecordingManifest::split_at(
+    const fs::path &prefix, std::uint64_t boundary, std::uint64_t frame_tick
+)
+{
+    std::lock_guard lock(_mutex);
+    auto camera = camera_of(prefix);
+    if (camera < 0 || !_json.contains("split")) return;
+
+    _next_split[camera] = {boundary, frame_tick};
+    auto &boundaries = _json["split"]["boundaries"];
+    auto it = std::lower_bound(boundaries.begin(), boundaries.end(), boundary);
+    if (it == boundaries.end() || *it != boundary) boundaries.insert(it, boundary);
+}
+
+int RecordingManifest::camera_of(const fs::path &location) const
+{
+    // The longest match, since "camera-1" is also a prefix of "camera-10"'s fragments.
+    auto path = location.generic_string();
+    auto camera = -1;
+    for (std::size_t i = 0; i < _prefixes.size(); ++i) {
+        if (!path.starts_with(_prefixes[i])) continue;
+        if (camera < 0 || _prefixes[i].size() > _prefixes[camera].size()) {
+            camera = static_cast<int>(i);
+        }
+    }
+    return camera;
+}
+
+void RecordingManifest::write()
+{
+    auto text = _json.dump(2);
+    for (const auto &directory : _directories) {
+        // Written next to the old copy and renamed over it, so a reader never sees half a file.
+        auto path = directory / FILE_NAME;
+        auto temporary = directory / (std::string(FILE_NAME) + ".tmp");
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file << text;
+            if (!file) {
+                spdlog::error("Failed to write {}", temporary.generic_string());
+                continue;
+            }
+        }
+        std::error_code ec;
+        fs::rename(temporary, path, ec);
+        if (ec) spdlog::error("Failed to replace {}: {}", path.generic_string(), ec.message());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <gst/gstclock.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+// manifest.json of one recording: which save path every camera went to and every fragment
+// that has been written, so a recording spread over several disks can be put back together.
+// A copy is kept in the recording directory on each of them.
+class RecordingManifest
+{
+public:
+    static auto constexpr FILE_NAME = "manifest.json";
+
+    // directories: the recording directory on every save path the recording uses.
+    explicit RecordingManifest(std::vector<fs::path> directories);
+
+    // UI thread, before the recording starts. prefix is the path handed to xvc.
+    void add_camera(
+        const std::string &name,
+        int id,
+        const fs::path &prefix,
+        std::uint64_t bytes_per_second,
+        double path_bandwidth
+    );
+
+    // Bus thread. Fragments of other recordings are ignored.
+    void fragment_opened(const fs::path &location, GstClockTime running_time);
+    void fragment_closed(const fs::path &location, GstClockTime running_time);
+
+    // Fragments split on FPGA timestamp boundaries, see RecordingGate::split_on_ticks().
+    // Adds the boundary table, which lists every boundary some camera has split on. interval
+    // and tick_rate are in ticks and ticks per second.
+    void set_split_interval(std::uint64_t interval, std::uint64_t tick_rate);
+    // Streaming thread of the camera recording to prefix. The fragment it opens next is
+    // marked with the boundary it starts from and the timestamp of its first frame. Doesn't
+    // write the file, which is left to the fragment-opened message that follows.
+    void split_at(const fs::path &prefix, std::uint64_t boundary, std::uint64_t frame_tick);
+
+private:
+    // Index into _json["cameras"] of the camera that records to location, or -1.
+    int camera_of(const fs::path &location) const;
+    // Replaces every copy; called with _mutex.
+    void write();
+
+    const std::vector<fs::path> _directories;
+    std::mutex _mutex;
+    nlohmann::json _json;
+    std::vector<std::string> _prefixes;
+    // Per camera, the boundary and first frame timestamp of the fragment opened next.
+    std::vector<std::optional<std::pair<std::uint64_t, std::uint64_t>>> _next_split;
+};
\ No newline at end of file
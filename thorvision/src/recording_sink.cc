@@ -0,0 +1,466 @@
+#include "recording_sink.h"
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+#include "block_writer.h"
+
+
+namespace
+{
+// Where index_frame() is in the muxer's output.
+struct FrameFinder {
+    // A block header came without its frame, which is then the next buffer.
+    bool frame_next;
+    GstClockTime frame_pts;
+    std::uint64_t frame_size;
+};
+}  // namespace
+
+
+struct _ThorRecordingSink {
+    GstBaseSink parent;
+
+    gchar *location;
+    guint block_size;
+    guint queue_blocks;
+    guint64 preallocate;
+    gboolean direct;
+
+    // Created on the first start and kept across fragments, since splitmuxsink cycles the
+    // sink through READY for every new location.
+    BlockWriter *writer;
+    std::shared_ptr<FrameIndexWriter> *index;
+    FrameFinder finder;
+};
+
+G_DEFINE_TYPE(ThorRecordingSink, thor_recording_sink, GST_TYPE_BASE_SINK)
+
+
+namespace
+{
+auto constexpr DEFAULT_BLOCK_SIZE = 4u << 20;
+auto constexpr DEFAULT_QUEUE_BLOCKS = 8u;
+// The Matroska elements a frame is nested in.
+auto constexpr CLUSTER_ID = std::uint64_t{0x1F43B675};
+auto constexpr BLOCK_GROUP_ID = std::uint64_t{0xA0};
+auto constexpr BLOCK_ID = std::uint64_t{0xA1};
+auto constexpr SIMPLE_BLOCK_ID = std::uint64_t{0xA3};
+// Timecode and flags, after the track number that starts a block.
+auto constexpr BLOCK_HEADER_TAIL = 3;
+
+enum Property {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_BLOCK_SIZE,
+    PROP_QUEUE_BLOCKS,
+    PROP_PREALLOCATE,
+    PROP_DIRECT,
+};
+
+GstStaticPadTemplate sink_template =
+    GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+void set_property(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+{
+    auto sink = THOR_RECORDING_SINK(object);
+    switch (id) {
+    case PROP_LOCATION:
+        g_free(sink->location);
+        sink->location = g_value_dup_string(value);
+        break;
+    case PROP_BLOCK_SIZE: sink->block_size = g_value_get_uint(value); break;
+    case PROP_QUEUE_BLOCKS: sink->queue_blocks = g_value_get_uint(value); break;
+    case PROP_PREALLOCATE: sink->preallocate = g_value_get_uint64(value); break;
+    case PROP_DIRECT: sink->direct = g_value_get_boolean(value); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+void get_property(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+{
+    auto sink = THOR_RECORDING_SINK(object);
+    switch (id) {
+    case PROP_LOCATION: g_value_set_string(value, sink->location); break;
+    case PROP_BLOCK_SIZE: g_value_set_uint(value, sink->block_size); break;
+    case PROP_QUEUE_BLOCKS: g_value_set_uint(value, sink->queue_blocks); break;
+    case PROP_PREALLOCATE: g_value_set_uint64(value, sink->preallocate); break;
+    case PROP_DIRECT: g_value_set_boolean(value, sink->direct); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+void finalize(GObject *object)
+{
+    auto sink = THOR_RECORDING_SINK(object);
+    delete sink->writer;
+    delete sink->index;
+    g_free(sink->location);
+    G_OBJECT_CLASS(thor_recording_sink_parent_class)->finalize(object);
+}
+
+gboolean start(GstBaseSink *base)
+{
+    auto sink = THOR_RECORDING_SINK(base);
+    if (!sink->location) {
+        GST_ELEMENT_ERROR(sink, RESOURCE, NOT_FOUND, ("No file name specified."), (nullptr));
+        return FALSE;
+    }
+    if (!sink->writer) {
+        BlockWriter::Options options;
+        options.block_size = sink->block_size;
+        options.queue_blocks = sink->queue_blocks;
+        options.preallocate = sink->preallocate;
+        options.direct = sink->direct;
+        sink->writer = new BlockWriter(options);
+    }
+    if (!sink->writer->open(fs::path(sink->location))) {
+        GST_ELEMENT_ERROR(
+            sink, RESOURCE, OPEN_WRITE, ("Could not open \"%s\".", sink->location), GST_ERROR_SYSTEM
+        );
+        return FALSE;
+    }
+    if (sink->index) (*sink->index)->open(fs::path(sink->location));
+    sink->finder = FrameFinder{false, GST_CLOCK_TIME_NONE, 0};
+    return TRUE;
+}
+
+gboolean stop(GstBaseSink *base)
+{
+    auto sink = THOR_RECORDING_SINK(base);
+    if (sink->index) (*sink->index)->close();
+    if (sink->writer && !sink->writer->close()) {
+        GST_ELEMENT_ERROR(
+            sink, RESOURCE, WRITE, ("Could not write \"%s\".", sink->location), (nullptr)
+        );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// An EBML variable-length integer; element IDs keep their length marker.
+std::optional<std::uint64_t> read_vint(const guint8 *&p, const guint8 *end, bool id)
+{
+    if (p >= end || *p == 0) return std::nullopt;
+    auto length = 1;
+    while (!(*p & (0x80 >> (length - 1)))) ++length;
+    if (end - p < length) return std::nullopt;
+    std::uint64_t value = id ? *p : *p & (0xFF >> length);
+    for (auto i = 1; i < length; ++i) value = value << 8 | p[i];
+    p += length;
+    return value;
+}
+
+struct Block {
+    // Of the frame, from the start of the buffer.
+    std::size_t offset;
+    std::uint64_t size;
+};
+
+// Walks the elements a matroskamux buffer starts with, into a Cluster and BlockGroup, up to
+// the frame of a Block or SimpleBlock. Null if the buffer doesn't hold a block header, as
+// for Cues, tags and the header rewrite at the end.
+std::optional<Block> find_block(const GstMapInfo &map)
+{
+    auto p = static_cast<const guint8 *>(map.data);
+    auto end = p + map.size;
+    while (p < end) {
+        auto id = read_vint(p, end, true);
+        auto size = id ? read_vint(p, end, false) : std::nullopt;
+        if (!size) return std::nullopt;
+        // Their children follow, and a live Cluster has no size anyway.
+        if (*id == CLUSTER_ID || *id == BLOCK_GROUP_ID) continue;
+        if (*id == SIMPLE_BLOCK_ID || *id == BLOCK_ID) {
+            auto block = p;
+            if (!read_vint(p, end, false) || end - p < BLOCK_HEADER_TAIL) return std::nullopt;
+            p += BLOCK_HEADER_TAIL;
+            auto header = static_cast<std::uint64_t>(p - block);
+            if (*size < header) return std::nullopt;
+            return Block{static_cast<std::size_t>(p - map.data), *size - header};
+        }
+        if (*size > static_cast<std::uint64_t>(end - p)) return std::nullopt;
+        p += *size;
+    }
+    return std::nullopt;
+}
+
+// matroskamux pushes a block's header, stamped with the frame's timestamp, and then the
+// frame as a buffer of its own; other muxers may write both in one buffer. Either way the
+// frame is where the block layout puts it, and is only indexed if a JPEG starts there. The
+// buffer is written at position in the file.
+void index_frame(
+    FrameFinder &finder,
+    FrameIndexWriter &index,
+    std::uint64_t position,
+    GstBuffer *buffer,
+    const GstMapInfo &map
+)
+{
+    auto pts = GST_BUFFER_PTS(buffer);
+    std::size_t offset = 0;
+    std::uint64_t size = map.size;
+    if (finder.frame_next) {
+        finder.frame_next = false;
+        if (GST_CLOCK_TIME_IS_VALID(finder.frame_pts)) pts = finder.frame_pts;
+        size = finder.frame_size;
+    } else {
+        auto block = find_block(map);
+        if (!block) return;
+        if (block->offset == map.size) {
+            finder.frame_next = true;
+            finder.frame_pts = pts;
+            finder.frame_size = block->size;
+            return;
+        }
+        offset = block->offset;
+        size = block->size;
+    }
+    if (map.size - offset < 2 || map.data[offset] != 0xFF || map.data[offset + 1] != 0xD8) {
+        return;
+    }
+    index.written(
+        pts,
+        position + offset,
+        static_cast<std::uint32_t>(std::min<std::uint64_t>(size, UINT32_MAX))
+    );
+}
+
+// What index_filesink() keeps for its probe.
+struct FilesinkIndex {
+    GstElement *sink;
+    std::shared_ptr<FrameIndexWriter> index;
+    FrameFinder finder;
+    // Where filesink writes the next buffer.
+    std::uint64_t position;
+    bool open;
+};
+
+GstPadProbeReturn index_filesink_data(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto &state = *static_cast<FilesinkIndex *>(user_data);
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        auto event = GST_PAD_PROBE_INFO_EVENT(info);
+        switch (GST_EVENT_TYPE(event)) {
+        // splitmuxsink restarts the muxer for every fragment, after it has set the location.
+        case GST_EVENT_STREAM_START: {
+            if (state.open) state.index->close();
+            gchar *location = nullptr;
+            g_object_get(state.sink, "location", &location, nullptr);
+            state.open = location && state.index->open(fs::path(location));
+            g_free(location);
+            state.finder = FrameFinder{false, GST_CLOCK_TIME_NONE, 0};
+            state.position = 0;
+            break;
+        }
+        // filesink seeks to the start of a byte segment, as event() does.
+        case GST_EVENT_SEGMENT: {
+            const GstSegment *segment;
+            gst_event_parse_segment(event, &segment);
+            if (segment->format == GST_FORMAT_BYTES) state.position = segment->start;
+            break;
+        }
+        case GST_EVENT_EOS:
+            if (state.open) state.index->close();
+            state.open = false;
+            break;
+        default: break;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) return GST_PAD_PROBE_OK;
+    if (state.open && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER)) {
+        index_frame(state.finder, *state.index, state.position, buffer, map);
+    }
+    state.position += map.size;
+    gst_buffer_unmap(buffer, &map);
+    return GST_PAD_PROBE_OK;
+}
+
+GstFlowReturn render(GstBaseSink *base, GstBuffer *buffer)
+{
+    auto sink = THOR_RECORDING_SINK(base);
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) return GST_FLOW_ERROR;
+    if (sink->index && !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER)) {
+        index_frame(sink->finder, **sink->index, sink->writer->position(), buffer, map);
+    }
+    auto written = sink->writer->write(map.data, map.size);
+    gst_buffer_unmap(buffer, &map);
+    if (!written) {
+        GST_ELEMENT_ERROR(
+            sink, RESOURCE, WRITE, ("Could not write \"%s\".", sink->location), (nullptr)
+        );
+        return GST_FLOW_ERROR;
+    }
+    return GST_FLOW_OK;
+}
+
+gboolean event(GstBaseSink *base, GstEvent *event)
+{
+    auto sink = THOR_RECORDING_SINK(base);
+    // Muxers seek back with a byte segment to finish their header, as with filesink.
+    if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+        const GstSegment *segment;
+        gst_event_parse_segment(event, &segment);
+        if (segment->format == GST_FORMAT_BYTES && !sink->writer->seek(segment->start)) {
+            GST_ELEMENT_ERROR(
+                sink, RESOURCE, SEEK, ("Could not seek \"%s\".", sink->location), (nullptr)
+            );
+            gst_event_unref(event);
+            return FALSE;
+        }
+    }
+    return GST_BASE_SINK_CLASS(thor_recording_sink_parent_class)->event(base, event);
+}
+
+gboolean query(GstBaseSink *base, GstQuery *query)
+{
+    auto sink = THOR_RECORDING_SINK(base);
+    switch (GST_QUERY_TYPE(query)) {
+    case GST_QUERY_SEEKING: {
+        GstFormat format;
+        gst_query_parse_seeking(query, &format, nullptr, nullptr, nullptr);
+        auto seekable = format == GST_FORMAT_BYTES || format == GST_FORMAT_DEFAULT;
+        gst_query_set_seeking(query, format, seekable, 0, -1);
+        return TRUE;
+    }
+    case GST_QUERY_POSITION: {
+        GstFormat format;
+        gst_query_parse_position(query, &format, nullptr);
+        if ((format != GST_FORMAT_BYTES && format != GST_FORMAT_DEFAULT) || !sink->writer) break;
+        gst_query_set_position(query, GST_FORMAT_BYTES, sink->writer->position());
+        return TRUE;
+    }
+    case GST_QUERY_FORMATS:
+        gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+        return TRUE;
+    default: break;
+    }
+    return GST_BASE_SINK_CLASS(thor_recording_sink_parent_class)->query(base, query);
+}
+}  // namespace
+
+
+static void thor_recording_sink_class_init(ThorRecordingSinkClass *klass)
+{
+    auto object_class = G_OBJECT_CLASS(klass);
+    object_class->set_property = set_property;
+    object_class->get_property = get_property;
+    object_class->finalize = finalize;
+
+    auto flags = static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+    g_object_class_install_property(
+        object_class,
+        PROP_LOCATION,
+        g_param_spec_string(
+            "location", "File Location", "Location of the file to write", nullptr, flags
+        )
+    );
+    g_object_class_install_property(
+        object_class,
+        PROP_BLOCK_SIZE,
+        g_param_spec_uint(
+            "block-size", "Block size", "Bytes per write", 4096, G_MAXINT, DEFAULT_BLOCK_SIZE, flags
+        )
+    );
+    g_object_class_install_property(
+        object_class,
+        PROP_QUEUE_BLOCKS,
+        g_param_spec_uint(
+            "queue-blocks",
+            "Queue blocks",
+            "Full blocks buffered ahead of the disk",
+            1,
+            256,
+            DEFAULT_QUEUE_BLOCKS,
+            flags
+        )
+    );
+    g_object_class_install_property(
+        object_class,
+        PROP_PREALLOCATE,
+        g_param_spec_uint64(
+            "preallocate", "Preallocate", "Bytes reserved for each file", 0, G_MAXINT64, 0, flags
+        )
+    );
+    g_object_class_install_property(
+        object_class,
+        PROP_DIRECT,
+        g_param_spec_boolean("direct", "Direct I/O", "Bypass the page cache", FALSE, flags)
+    );
+
+    auto element_class = GST_ELEMENT_CLASS(klass);
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_set_static_metadata(
+        element_class,
+        "Thor recording sink",
+        "Sink/File",
+        "Writes to a file in large preallocated blocks from a writer thread",
+        "KonteX Neuroscience"
+    );
+
+    auto base_class = GST_BASE_SINK_CLASS(klass);
+    base_class->start = start;
+    base_class->stop = stop;
+    base_class->render = render;
+    base_class->event = event;
+    base_class->query = query;
+}
+
+static void thor_recording_sink_init(ThorRecordingSink *sink)
+{
+    sink->location = nullptr;
+    sink->block_size = DEFAULT_BLOCK_SIZE;
+    sink->queue_blocks = DEFAULT_QUEUE_BLOCKS;
+    sink->preallocate = 0;
+    sink->direct = FALSE;
+    sink->writer = nullptr;
+    sink->index = nullptr;
+    sink->finder = FrameFinder{false, GST_CLOCK_TIME_NONE, 0};
+    // Like filesink, a file is written as fast as buffers arrive.
+    gst_base_sink_set_sync(GST_BASE_SINK(sink), FALSE);
+}
+
+
+void thor_recording_sink_set_index(
+    ThorRecordingSink *sink, std::shared_ptr<FrameIndexWriter> index
+)
+{
+    delete sink->index;
+    sink->index = index ? new std::shared_ptr<FrameIndexWriter>(std::move(index)) : nullptr;
+}
+
+void index_filesink(GstElement *sink, std::shared_ptr<FrameIndexWriter> index)
+{
+    auto pad = gst_element_get_static_pad(sink, "sink");
+    if (!pad) return;
+    // The pad owns the state with the probe; the sink outlives its own pad.
+    gst_pad_add_probe(
+        pad,
+        static_cast<GstPadProbeType>(
+            GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM
+        ),
+        index_filesink_data,
+        new FilesinkIndex{sink, std::move(index), {false, GST_CLOCK_TIME_NONE, 0}, 0, false},
+        [](gpointer data) {
+            auto state = static_cast<FilesinkIndex *>(data);
+            if (state->open) state->index->close();
+            delete state;
+        }
+    );
+    gst_object_unref(pad);
+}
+
+bool register_recording_sink()
+{
+    static auto registered = gst_element_register(
+        nullptr, "thorrecordingsink", GST_RANK_NONE, THOR_TYPE_RECORDING_SINK
+    );
+    return registered;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <gst/base/gstbasesink.h>
+#include <gst/gstelement.h>
+
+#include <memory>
+
+#include "frame_index.h"
+
+
+// "thorrecordingsink": a file sink for splitmuxsink fragments that writes through a
+// BlockWriter. Takes the same "location" as filesink, plus
+//   block-size   bytes per write (default 4 MiB)
+//   queue-blocks full blocks buffered ahead of the disk (default 8)
+//   preallocate  bytes reserved for each fragment (default 0)
+//   direct       bypass the page cache with O_DIRECT where supported (default false)
+// and logs the write latency percentiles of every fragment it closes. Given a
+// FrameIndexWriter, it indexes every JPEG frame of a fragment as it is written.
+G_BEGIN_DECLS
+
+#define THOR_TYPE_RECORDING_SINK (thor_recording_sink_get_type())
+G_DECLARE_FINAL_TYPE(ThorRecordingSink, thor_recording_sink, THOR, RECORDING_SINK, GstBaseSink)
+
+G_END_DECLS
+
+
+void thor_recording_sink_set_index(
+    ThorRecordingSink *sink, std::shared_ptr<FrameIndexWriter> index
+);
+
+// Indexes the JPEG frames a filesink writes for splitmuxsink the way thorrecordingsink does,
+// for recordings that don't go through it. Each fragment is indexed from the start of its
+// stream to its EOS.
+void index_filesink(GstElement *sink, std::shared_ptr<FrameIndexWriter> index);
+
+// Registers the element with GStreamer; safe to call more than once.
+bool register_recording_sink();
\ No newline at end of file
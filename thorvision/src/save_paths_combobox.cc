@@ -9,6 +9,8 @@
 #include <QStandardPaths>
 #include <filesystem>
 
+#include "trigger_config.h"
+
 
 namespace fs = std::filesystem;
 
@@ -86,5 +88,6 @@ SavePathsComboBox::SavePathsComboBox(QWidget *parent) : QComboBox(parent)
             paths << itemText(i);
         }
         QSettings("KonteX Neuroscience", "Thor Vision").setValue(SAVE_PATHS, paths);
+        TriggerConfigSlot::reload_all();
     });
 }
\ No newline at end of file
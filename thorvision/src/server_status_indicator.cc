@@ -3,53 +3,113 @@
 #include <spdlog/spdlog.h>
 
 #include <QHBoxLayout>
-#include <QLabel>
-#include <QPushButton>
-#include <thread>
+#include <algorithm>
+#include <utility>
 
 
 using namespace std::chrono_literals;
 
 
-ServerStatusIndicator::ServerStatusIndicator(QWidget *parent)
-    : QWidget(parent), _current_status(false), _running(true)
+namespace
 {
+auto constexpr PROBE_TIMEOUT = 500ms;
+// How long the server may stay silent while up before it is probed.
+auto constexpr HEARTBEAT = 2s;
+auto constexpr RETRY_MIN = 250ms;
+// Device events are rare, so a server coming back is mostly found by probing; it is seen
+// within this long, no later than with the old fixed 500 ms poll.
+auto constexpr RETRY_MAX = 500ms;
+}  // namespace
+
+
+ServerStatusIndicator::ServerStatusIndicator(QWidget *parent, Probe probe)
+    : QWidget(parent),
+      _probe(std::move(probe)),
+      _activity(false),
+      _running(true),
+      _current_status(false)
+{
+    if (!_probe) {
+        _probe = [](std::chrono::milliseconds timeout) {
+            return xvc::server_status(timeout) == xvc::Status::ON;
+        };
+    }
+
     auto title_text = new QLabel(tr("Server status:"), this);
-    auto status_text = new QLabel(tr("Loading..."), this);
+    _status_text = new QLabel(tr("Loading..."), this);
     auto layout = new QHBoxLayout(this);
-    status_text->setStyleSheet("color: black;");
+    _status_text->setStyleSheet("color: black;");
     layout->addWidget(title_text);
-    layout->addWidget(status_text);
-
-    _thread = std::jthread([this, status_text]() {
-        auto const timeout = 500ms;
-
-        while (_running) {
-            auto status = xvc::server_status(timeout);
-            auto on = (status == xvc::Status::ON);
-
-            QMetaObject::invokeMethod(
-                status_text,
-                [on, status_text]() {
-                    if (on) {
-                        status_text->setText(tr("Available"));
-                        status_text->setStyleSheet("color: green;");
-                    } else {
-                        status_text->setText(tr("Loading..."));
-                        status_text->setStyleSheet("color: black;");
-                    }
-                },
-                Qt::QueuedConnection
-            );
-
-            if (_current_status != on) {
-                spdlog::info("Server status: {}", on ? "Available" : "Loading...");
-                _current_status = on;
-                emit status_change(on);
-            }
-            std::this_thread::sleep_for(500ms);
+    layout->addWidget(_status_text);
+
+    _thread = std::jthread(&ServerStatusIndicator::run, this);
+}
+
+ServerStatusIndicator::~ServerStatusIndicator()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _running = false;
+    }
+    _wake.notify_one();
+}
+
+void ServerStatusIndicator::notify_activity()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _activity = true;
+        _last_seen = std::chrono::steady_clock::now();
+    }
+    _wake.notify_one();
+}
+
+void ServerStatusIndicator::run()
+{
+    std::chrono::milliseconds retry = RETRY_MIN;
+    std::unique_lock lock(_mutex);
+    while (_running) {
+        // Traffic since the last heartbeat proves the server is up without probing it.
+        auto heard = _current_status && std::chrono::steady_clock::now() - _last_seen < HEARTBEAT;
+        if (!heard) {
+            lock.unlock();
+            auto on = _probe(PROBE_TIMEOUT);
+            lock.lock();
+            // Nothing is signalled once the destructor has started.
+            if (!_running) break;
+            if (on) _last_seen = std::chrono::steady_clock::now();
+            if (on != _current_status) set_status(on);
         }
-    });
+        _activity = false;
+
+        if (_current_status) {
+            retry = RETRY_MIN;
+            _wake.wait_until(lock, _last_seen + HEARTBEAT, [this] { return !_running; });
+        } else {
+            // A message from the server cuts the backoff short.
+            auto woken = _wake.wait_for(lock, retry, [this] { return !_running || _activity; });
+            retry = woken ? RETRY_MIN : std::min<std::chrono::milliseconds>(retry * 2, RETRY_MAX);
+        }
+    }
 }
 
-ServerStatusIndicator::~ServerStatusIndicator() { _running = false; }
\ No newline at end of file
+void ServerStatusIndicator::set_status(bool on)
+{
+    spdlog::info("Server status: {}", on ? "Available" : "Loading...");
+    _current_status = on;
+    emit status_change(on);
+
+    QMetaObject::invokeMethod(
+        _status_text,
+        [on, status_text = _status_text]() {
+            if (on) {
+                status_text->setText(tr("Available"));
+                status_text->setStyleSheet("color: green;");
+            } else {
+                status_text->setText(tr("Loading..."));
+                status_text->setStyleSheet("color: black;");
+            }
+        },
+        Qt::QueuedConnection
+    );
+}
\ No newline at end of file
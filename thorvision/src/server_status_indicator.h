@@ -2,23 +2,49 @@
 
 #include <xdaqvc/server.h>
 
+#include <QLabel>
 #include <QWidget>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <thread>
 
 
+// Tracks whether the camera server is reachable. Probes back off from 250 to 500 ms while the
+// server is down and only run as a heartbeat while it is up; any traffic reported through
+// notify_activity() counts as a heartbeat and wakes a waiting probe at once. The label and
+// status_change are only updated when the status actually changes.
 class ServerStatusIndicator : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit ServerStatusIndicator(QWidget *parent = nullptr);
+    // Returns whether the server answered within the timeout.
+    using Probe = std::function<bool(std::chrono::milliseconds timeout)>;
+
+    // Probes with xvc::server_status unless given another probe.
+    explicit ServerStatusIndicator(QWidget *parent = nullptr, Probe probe = {});
     ~ServerStatusIndicator();
 
+    // Thread-safe; called for every message received from the server.
+    void notify_activity();
+
 private:
-    std::jthread _thread;
+    void run();
+    void set_status(bool on);
+
+    QLabel *_status_text;
+    Probe _probe;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _activity;
+    bool _running;
     bool _current_status;
-    std::atomic_bool _running;
+    std::chrono::steady_clock::time_point _last_seen;
+    std::jthread _thread;
 
 signals:
     void status_change(bool is_server_on);
@@ -0,0 +1,207 @@
+#include "sidecar_writer.h"
+
+#include <glib.h>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+
+namespace
+{
+// Large enough that a fragment is written in a handful of appends.
+auto constexpr WRITE_BUFFER = 1 << 20;
+// Once this many records are waiting, those older than the horizon behind the newest one are
+// written out early, which bounds memory for long unsplit recordings. splitmuxsink announces
+// a split well within this time, since only the branch queue lies between the recording
+// probe and the muxer.
+auto constexpr SPILL_RECORDS = 1 << 16;
+auto constexpr SPILL_HORIZON = 5 * GST_SECOND;
+// Matroska's default timestamp scale, which splitmuxsink's matroskamux keeps. Timestamps are
+// stored rounded down to it, so that is what the post-recording parser reads back.
+auto constexpr CONTAINER_RESOLUTION = GST_MSECOND;
+
+GQuark metadata_quark()
+{
+    static auto quark = g_quark_from_static_string("thorvision-frame-metadata");
+    return quark;
+}
+}  // namespace
+
+
+void attach_frame_metadata(GstBuffer *buffer, const XDAQFrameData &metadata)
+{
+    gst_mini_object_set_qdata(
+        GST_MINI_OBJECT(buffer),
+        metadata_quark(),
+        new XDAQFrameData(metadata),
+        [](gpointer data) { delete static_cast<XDAQFrameData *>(data); }
+    );
+}
+
+const XDAQFrameData *frame_metadata(GstBuffer *buffer)
+{
+    return static_cast<const XDAQFrameData *>(
+        gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer), metadata_quark())
+    );
+}
+
+
+SidecarWriter::SidecarWriter(fs::path prefix)
+    : _prefix(prefix.string()),
+      _opened(false),
+      _closed(false),
+      _stopping(false),
+      _buffer(WRITE_BUFFER)
+{
+    _thread = std::jthread(&SidecarWriter::run, this);
+}
+
+SidecarWriter::~SidecarWriter()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _changed.notify_one();
+    _thread.join();
+}
+
+fs::path SidecarWriter::sidecar_path(const fs::path &fragment)
+{
+    return fs::path(fragment).replace_extension(".bin");
+}
+
+void SidecarWriter::record(GstClockTime timestamp, const XDAQFrameData &metadata)
+{
+    bool spill;
+    {
+        std::lock_guard lock(_mutex);
+        _pending.push_back(Record{timestamp, metadata});
+        spill = _pending.size() == SPILL_RECORDS;
+    }
+    if (spill) _changed.notify_one();
+}
+
+bool SidecarWriter::fragment_opened(const fs::path &location, GstClockTime running_time)
+{
+    if (!owns(location)) return false;
+    {
+        std::lock_guard lock(_mutex);
+        _fragments.push_back(Fragment{location, running_time});
+        _opened = true;
+        _closed = false;
+    }
+    _changed.notify_one();
+    return true;
+}
+
+bool SidecarWriter::fragment_closed(const fs::path &location, GstClockTime running_time)
+{
+    if (!owns(location)) return false;
+    {
+        std::lock_guard lock(_mutex);
+        if (!_opened) return true;
+        _fragments.push_back(Fragment{fs::path(), running_time});
+        _closed = true;
+    }
+    _changed.notify_one();
+    return true;
+}
+
+bool SidecarWriter::idle() const
+{
+    std::lock_guard lock(_mutex);
+    return !_opened || _closed;
+}
+
+bool SidecarWriter::owns(const fs::path &location) const
+{
+    return location.string().starts_with(_prefix);
+}
+
+void SidecarWriter::run()
+{
+    std::unique_lock lock(_mutex);
+    for (;;) {
+        _changed.wait(lock, [this] {
+            return _stopping || !_fragments.empty() || _pending.size() >= SPILL_RECORDS;
+        });
+        // Taken in one go, so the streaming thread never waits for more than the swap. A
+        // fragment's records have all been recorded by the time splitmuxsink announces it.
+        std::deque<Record> pending;
+        pending.swap(_pending);
+        auto fragments = std::exchange(_fragments, {});
+        auto stopping = _stopping;
+        auto closed = _closed;
+        lock.unlock();
+
+        _queue.insert(
+            _queue.end(),
+            std::make_move_iterator(pending.begin()),
+            std::make_move_iterator(pending.end())
+        );
+        for (auto &fragment : fragments) {
+            if (fragment.location.empty()) {
+                close(fragment.running_time);
+            } else {
+                open(fragment.location, fragment.running_time);
+            }
+        }
+        if (_queue.size() >= SPILL_RECORDS && _file.is_open() &&
+            _queue.back().timestamp > SPILL_HORIZON) {
+            write_before(_queue.back().timestamp - SPILL_HORIZON);
+        }
+
+        if (stopping) {
+            if (!_file.is_open()) return;
+            // The frames left belong to the last fragment.
+            write_before(GST_CLOCK_TIME_NONE);
+            _file.close();
+            if (!closed) spdlog::warn("Recording ended before {} was closed", _file_path.string());
+            return;
+        }
+        lock.lock();
+    }
+}
+
+void SidecarWriter::open(const fs::path &location, GstClockTime running_time)
+{
+    if (_file.is_open()) {
+        // The new fragment starts exactly at running_time.
+        write_before(running_time);
+        _file.close();
+    }
+    // Anything older than the first fragment came from before the branch was linked.
+    while (!_queue.empty() && _queue.front().timestamp < running_time) _queue.pop_front();
+
+    _file_path = sidecar_path(location);
+    _file.rdbuf()->pubsetbuf(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+    _file.open(_file_path, std::ios::binary | std::ios::trunc);
+    if (!_file) spdlog::error("Failed to create {}", _file_path.string());
+}
+
+void SidecarWriter::close(GstClockTime running_time)
+{
+    if (!_file.is_open()) return;
+    // Depending on the GStreamer version running_time is the fragment's last frame or the
+    // next one's first, so only frames before it are certain to be in this fragment.
+    write_before(running_time);
+    _file.flush();
+    spdlog::info("Wrote frame metadata to {}", _file_path.string());
+}
+
+void SidecarWriter::write_before(GstClockTime end)
+{
+    // Packed little-endian records, exactly as the post-recording parser writes them.
+    char record[RECORD_SIZE];
+    while (!_queue.empty() && _queue.front().timestamp < end) {
+        auto &pending = _queue.front();
+        std::uint64_t timestamp = pending.timestamp / CONTAINER_RESOLUTION * CONTAINER_RESOLUTION;
+        std::memcpy(record, &timestamp, sizeof(timestamp));
+        std::memcpy(record + sizeof(timestamp), &pending.metadata, sizeof(XDAQFrameData));
+        _file.write(record, sizeof(record));
+        _queue.pop_front();
+    }
+}
\ No newline at end of file
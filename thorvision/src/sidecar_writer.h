@@ -0,0 +1,95 @@
+#pragma once
+
+#include <gst/gstbuffer.h>
+#include <gst/gstclock.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "xdaqmetadata/metadata_handler.h"
+
+
+namespace fs = std::filesystem;
+
+
+// Frame metadata carried on the parsed buffer itself, so every branch of the tee and the
+// pre-record ring see the metadata of exactly the frame they hold.
+void attach_frame_metadata(GstBuffer *buffer, const XDAQFrameData &metadata);
+const XDAQFrameData *frame_metadata(GstBuffer *buffer);
+
+
+// Writes the metadata of one JPEG recording while it is recorded: for every splitmuxsink
+// fragment a .bin next to it holding the 40-byte video_timestamp + XDAQFrameData records
+// described in docs/metadata-processing.md, so closed fragments don't have to be read back
+// and parsed. Records are kept in memory until the fragment they belong to is known and
+// then appended in large writes, all on a thread of the writer's own, so neither the
+// streaming nor the bus thread waits on the disk.
+class SidecarWriter
+{
+public:
+    static auto constexpr RECORD_SIZE = sizeof(std::uint64_t) + sizeof(XDAQFrameData);
+
+    // prefix is the path handed to xvc, which names the fragments after it.
+    explicit SidecarWriter(fs::path prefix);
+    ~SidecarWriter();
+    SidecarWriter(const SidecarWriter &) = delete;
+    SidecarWriter &operator=(const SidecarWriter &) = delete;
+
+    static fs::path sidecar_path(const fs::path &fragment);
+
+    // Streaming thread. timestamp is the running time the muxer stores for the frame.
+    void record(GstClockTime timestamp, const XDAQFrameData &metadata);
+
+    // Bus thread, from splitmuxsink's fragment messages, which are handed on to the writer
+    // thread. Return false for a fragment of another recording.
+    bool fragment_opened(const fs::path &location, GstClockTime running_time);
+    bool fragment_closed(const fs::path &location, GstClockTime running_time);
+
+    // The last fragment has been closed, so no more frames are expected for this recording.
+    // Its .bin is complete once the writer is destroyed.
+    bool idle() const;
+
+private:
+    struct Record {
+        GstClockTime timestamp;
+        XDAQFrameData metadata;
+    };
+    // A fragment message; location is empty for a close.
+    struct Fragment {
+        fs::path location;
+        GstClockTime running_time;
+    };
+
+    bool owns(const fs::path &location) const;
+
+    // Writer thread.
+    void run();
+    void open(const fs::path &location, GstClockTime running_time);
+    void close(GstClockTime running_time);
+    // Appends the queued records from before end to the open fragment.
+    void write_before(GstClockTime end);
+
+    const std::string _prefix;
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    // Guarded by _mutex, which is only held to hand these over.
+    std::deque<Record> _pending;
+    std::deque<Fragment> _fragments;
+    bool _opened;
+    bool _closed;
+    bool _stopping;
+
+    // Writer thread only. The file stays open after splitmuxsink has closed its fragment,
+    // until the next fragment's start time says which of the remaining records are its own.
+    std::deque<Record> _queue;
+    std::vector<char> _buffer;
+    std::ofstream _file;
+    fs::path _file_path;
+    std::jthread _thread;
+};
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "storage_probe.h"
+
+#include <fmt/core.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <QDir>
+#include <QSettings>
+#include <QVariantMap>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "bitrate_estimator.h"
+#include "block_writer.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+auto constexpr STORAGE_BANDWIDTH = "storage_bandwidth";
+auto constexpr STORAGE_PROBE_SIZE = "storage_probe_size";
+auto constexpr STORAGE_HEADROOM = "storage_headroom";
+
+auto constexpr PROBE_FILE = ".thorvision-storage-probe";
+
+QString cache_key(const QString &path) { return QDir::cleanPath(QDir(path).absolutePath()); }
+
+double frame_rate(const char *caps)
+{
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> parsed(
+        gst_caps_from_string(caps), gst_caps_unref
+    );
+    if (!parsed || gst_caps_is_empty(parsed.get())) return 0;
+    auto structure = gst_caps_get_structure(parsed.get(), 0);
+    int fps_n, fps_d;
+    if (!gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d) || fps_d == 0) {
+        return 0;
+    }
+    return static_cast<double>(fps_n) / fps_d;
+}
+}  // namespace
+
+
+std::optional<double> cached_bandwidth(const QString &path)
+{
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    auto cache = settings.value(STORAGE_BANDWIDTH).toMap();
+    auto it = cache.find(cache_key(path));
+    if (it == cache.end()) return std::nullopt;
+    return it->toDouble();
+}
+
+double measure_bandwidth(const QString &path, unsigned int size_mb)
+{
+    auto file = fs::path(path.toStdString()) / PROBE_FILE;
+    BlockWriter::Options options;
+    options.direct = true;
+    options.sync = true;
+    BlockWriter writer(options);
+
+    // Random data, so compressing filesystems can't make the disk look faster.
+    std::vector<char> chunk(1 << 20);
+    std::mt19937 random;
+    for (auto &byte : chunk) byte = static_cast<char>(random());
+
+    auto begin = std::chrono::steady_clock::now();
+    auto written = writer.open(file);
+    for (unsigned int i = 0; written && i < size_mb; ++i) {
+        written = writer.write(chunk.data(), chunk.size());
+    }
+    written = writer.close() && written;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::error_code ec;
+    fs::remove(file, ec);
+    if (!written || elapsed.count() <= 0) {
+        spdlog::error("Failed to measure the write bandwidth of {}", path.toStdString());
+        return 0;
+    }
+
+    auto bandwidth = size_mb / elapsed.count();
+    spdlog::info("{} sustains {:.0f} MB/s of sequential writes", path.toStdString(), bandwidth);
+
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    auto cache = settings.value(STORAGE_BANDWIDTH).toMap();
+    cache.insert(cache_key(path), bandwidth);
+    settings.setValue(STORAGE_BANDWIDTH, cache);
+    return bandwidth;
+}
+
+unsigned int probe_size_mb()
+{
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    return std::max(16u, settings.value(STORAGE_PROBE_SIZE, 512).toUInt());
+}
+
+
+BandwidthCheck BandwidthCheck::evaluate(
+    std::optional<double> available, std::uint64_t bytes_per_second
+)
+{
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    BandwidthCheck check;
+    check.required = static_cast<double>(bytes_per_second) / (1 << 20);
+    check.available = available.value_or(0);
+    check.headroom = std::clamp(settings.value(STORAGE_HEADROOM, 80).toInt(), 1, 100);
+
+    if (!available) {
+        check.verdict = Verdict::Unknown;
+    } else if (check.required > check.available) {
+        check.verdict = Verdict::Block;
+    } else if (check.required > check.available * check.headroom / 100) {
+        check.verdict = Verdict::Warn;
+    } else {
+        check.verdict = Verdict::Ok;
+    }
+    return check;
+}
+
+
+int run_storage_benchmark(int argc, char **argv)
+{
+    if (argc < 1) {
+        fmt::print(stderr, "Usage: ThorVision --storage-benchmark <path> [caps...]\n");
+        return 2;
+    }
+    gst_init(nullptr, nullptr);
+
+    auto path = QString::fromLocal8Bit(argv[0]);
+    auto size_mb = probe_size_mb();
+    fmt::print("Writing {} MB to {} ...\n", size_mb, path.toStdString());
+    auto bandwidth = measure_bandwidth(path, size_mb);
+    if (bandwidth <= 0) return 2;
+
+    std::uint64_t bytes_per_second = 0;
+    for (int i = 1; i < argc; ++i) {
+        auto bitrate = estimate_bitrate(argv[i]);
+        if (bitrate == 0) {
+            fmt::print(stderr, "Can't estimate the bitrate of {}\n", argv[i]);
+            return 2;
+        }
+        fmt::print("{}: {:.1f} MB/s\n", argv[i], static_cast<double>(bitrate) / (1 << 20));
+        bytes_per_second += bitrate;
+    }
+
+    auto check = BandwidthCheck::evaluate(bandwidth, bytes_per_second);
+    fmt::print(
+        "Sustained write bandwidth: {:.0f} MB/s, required: {:.1f} MB/s ({}% headroom limit)\n",
+        check.available,
+        check.required,
+        check.headroom
+    );
+
+    // Raw caps can be recorded losslessly instead, which the disk bounds long before the CPU.
+    // Frame rates are for one camera alone within the headroom.
+    auto budget = check.available * check.headroom / 100 * (1 << 20);
+    for (int i = 1; i < argc; ++i) {
+        auto raw = estimate_raw_bitrate(argv[i]);
+        if (raw == 0) continue;
+        auto jpeg = estimate_bitrate(argv[i]);
+        auto fps = frame_rate(argv[i]);
+        fmt::print(
+            "{}: M-JPEG {:.1f} MB/s, up to {:.0f} fps; "
+            "lossless .y4m {:.1f} MB/s, up to {:.0f} fps\n",
+            argv[i],
+            static_cast<double>(jpeg) / (1 << 20),
+            fps * budget / jpeg,
+            static_cast<double>(raw) / (1 << 20),
+            fps * budget / raw
+        );
+    }
+
+    switch (check.verdict) {
+    case BandwidthCheck::Verdict::Block:
+        fmt::print("Exceeds the disk's bandwidth, frames will be dropped.\n");
+        return 1;
+    case BandwidthCheck::Verdict::Warn:
+        fmt::print("Fits, but without the configured headroom.\n");
+        return 0;
+    default: fmt::print("Fits.\n"); return 0;
+    }
+}
\ No newline at end of file
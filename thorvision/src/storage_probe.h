@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QString>
+#include <cstdint>
+#include <optional>
+
+
+// Sustained sequential write bandwidth of the disk behind a save path, and whether it can
+// absorb what the open cameras are about to record.
+
+// MB/s from the last measurement of path, if it has been measured.
+std::optional<double> cached_bandwidth(const QString &path);
+
+// Writes size_mb of incompressible data to a temporary file in path through the recording
+// BlockWriter, bypassing the page cache where the filesystem allows, and syncs it before the
+// clock stops. Caches and returns MB/s, or 0 if the file couldn't be written. Blocks for as
+// long as the write takes, so call it off the UI thread.
+double measure_bandwidth(const QString &path, unsigned int size_mb);
+
+// Size of a measurement, from the "storage_probe_size" setting.
+unsigned int probe_size_mb();
+
+
+struct BandwidthCheck {
+    enum class Verdict {
+        Unknown,  // The path hasn't been measured.
+        Ok,
+        Warn,   // Over the headroom the "storage_headroom" setting leaves.
+        Block,  // Over the measured bandwidth.
+    };
+
+    Verdict verdict;
+    double required;   // MB/s
+    double available;  // MB/s
+    int headroom;      // Percent of available that recordings may use.
+
+    static BandwidthCheck evaluate(std::optional<double> available, std::uint64_t bytes_per_second);
+};
+
+
+// The command line check: ThorVision --storage-benchmark <path> [caps...]
+// Measures path and checks the bitrate the caps would record at against it.
+// Returns 0 if it fits, 1 if it doesn't and 2 on bad arguments or a failed measurement.
+int run_storage_benchmark(int argc, char **argv);
\ No newline at end of file
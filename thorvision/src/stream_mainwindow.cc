@@ -1,8 +1,18 @@
 #include "stream_mainwindow.h"
 
+#include <spdlog/spdlog.h>
+
+#include <QSettings>
+
 #include "stream_window.h"
 
 
+namespace
+{
+auto constexpr MOSAIC_VIEW = "mosaic_view";
+}  // namespace
+
+
 StreamMainWindow::StreamMainWindow(QWidget *parent) : QMainWindow(parent)
 {
     setDockOptions(QMainWindow::AnimatedDocks);
@@ -12,6 +22,64 @@ StreamMainWindow::StreamMainWindow(QWidget *parent) : QMainWindow(parent)
 
     setWindowTitle(tr(" "));
     setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+
+    _mosaic = new MosaicView(this);
+    _mosaic->hide();
+    setCentralWidget(_mosaic);
+
+    _mosaic_action = new QAction(tr("Mosaic view"), this);
+    _mosaic_action->setCheckable(true);
+    connect(_mosaic_action, &QAction::toggled, this, [this](bool checked) {
+        QSettings settings("KonteX Neuroscience", "Thor Vision");
+        settings.setValue(MOSAIC_VIEW, checked);
+        set_mosaic(checked);
+    });
+    // The dock title bars that normally open the popup menu are hidden in mosaic mode.
+    _mosaic->setContextMenuPolicy(Qt::ActionsContextMenu);
+    _mosaic->addAction(_mosaic_action);
+
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    _mosaic_action->setChecked(settings.value(MOSAIC_VIEW, false).toBool());
+}
+
+void StreamMainWindow::add_stream(StreamWindow *window)
+{
+    addDockWidget(Qt::TopDockWidgetArea, window);
+    _mosaic->add(window);
+
+    auto windows = findChildren<StreamWindow *>();
+    auto count = static_cast<int>(windows.size());
+
+    if (count == 3) {
+        splitDockWidget(windows[0], windows[2], Qt::Vertical);
+    } else if (count == 4) {
+        splitDockWidget(windows[1], windows[3], Qt::Vertical);
+    }
+
+    window->set_tiled(_mosaic_action->isChecked());
+}
+
+void StreamMainWindow::remove_stream(StreamWindow *window)
+{
+    _mosaic->remove(window);
+    removeDockWidget(window);
+}
+
+QMenu *StreamMainWindow::createPopupMenu()
+{
+    auto menu = QMainWindow::createPopupMenu();
+    if (!menu) menu = new QMenu(this);
+    menu->addSeparator();
+    menu->addAction(_mosaic_action);
+    return menu;
+}
+
+void StreamMainWindow::set_mosaic(bool mosaic)
+{
+    spdlog::info("Show streams as {}", mosaic ? "a mosaic" : "dock widgets");
+    for (auto window : findChildren<StreamWindow *>()) window->set_tiled(mosaic);
+    _mosaic->setVisible(mosaic);
+    adjustSize();
 }
 
 void StreamMainWindow::closeEvent(QCloseEvent *e)
@@ -1,9 +1,15 @@
 #pragma once
 
+#include <QAction>
 #include <QCloseEvent>
 #include <QMainWindow>
+#include <QMenu>
 #include <QWidget>
 
+#include "mosaic_view.h"
+
+
+class StreamWindow;
 
 class StreamMainWindow : public QMainWindow
 {
@@ -13,6 +19,18 @@ public:
     explicit StreamMainWindow(QWidget *parent = nullptr);
     ~StreamMainWindow() = default;
 
+    void add_stream(StreamWindow *window);
+    void remove_stream(StreamWindow *window);
+
+    QMenu *createPopupMenu() override;
+
 protected:
     void closeEvent(QCloseEvent *e) override;
+
+private:
+    // Shows every stream as a tile of _mosaic instead of as its own dock widget.
+    void set_mosaic(bool mosaic);
+
+    MosaicView *_mosaic;
+    QAction *_mosaic_action;
 };
\ No newline at end of file
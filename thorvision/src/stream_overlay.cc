@@ -0,0 +1,105 @@
+#include "stream_overlay.h"
+
+#include <QFontMetricsF>
+#include <QString>
+
+
+namespace
+{
+auto constexpr MARGIN = 10;
+
+QString hex(std::uint64_t value, int digits)
+{
+    return QString::number(value, 16).rightJustified(digits, u'0');
+}
+}  // namespace
+
+
+StreamOverlay::StreamOverlay()
+    : _xdaq_label(QStringLiteral("XDAQ Time ")),
+      _ephys_label(QStringLiteral("Ephys Time ")),
+      _do_label(QStringLiteral("DO word ")),
+      _device_pixel_ratio(0),
+      _ttl_in(0),
+      _ttl_out(0),
+      _valid(false),
+      _fpga_timestamp(0),
+      _rhythm_timestamp(0),
+      _xdaq_x(0),
+      _ephys_x(0)
+{
+    for (auto text : {&_xdaq_label, &_ephys_label, &_do_label, &_xdaq_time, &_ephys_time}) {
+        text->setTextFormat(Qt::PlainText);
+        text->setPerformanceHint(QStaticText::AggressiveCaching);
+    }
+}
+
+void StreamOverlay::paint(QPainter &painter, const QSize &size, const XDAQFrameData &metadata)
+{
+    if (!_valid || size != _size || painter.device()->devicePixelRatioF() != _device_pixel_ratio ||
+        painter.font() != _font || metadata.ttl_in != _ttl_in || metadata.ttl_out != _ttl_out) {
+        update_layer(painter, size, metadata);
+    }
+    painter.drawPixmap(0, 0, _layer);
+
+    if (_xdaq_time.text().isEmpty() || metadata.fpga_timestamp != _fpga_timestamp) {
+        _fpga_timestamp = metadata.fpga_timestamp;
+        _xdaq_time.setText(hex(_fpga_timestamp, 8));
+    }
+    if (_ephys_time.text().isEmpty() || metadata.rhythm_timestamp != _rhythm_timestamp) {
+        _rhythm_timestamp = metadata.rhythm_timestamp;
+        _ephys_time.setText(hex(_rhythm_timestamp, 4));
+    }
+
+    auto height = size.height();
+    painter.setPen(Qt::white);
+    painter.drawStaticText(QPointF(_xdaq_x, height - 60), _xdaq_time);
+    painter.drawStaticText(QPointF(_ephys_x, height - 30), _ephys_time);
+}
+
+void StreamOverlay::update_layer(
+    const QPainter &painter, const QSize &size, const XDAQFrameData &metadata
+)
+{
+    _size = size;
+    _device_pixel_ratio = painter.device()->devicePixelRatioF();
+    _font = painter.font();
+    _ttl_in = metadata.ttl_in;
+    _ttl_out = metadata.ttl_out;
+    _valid = true;
+
+    _layer = QPixmap(size * _device_pixel_ratio);
+    _layer.setDevicePixelRatio(_device_pixel_ratio);
+    _layer.fill(Qt::transparent);
+
+    QPainter layer(&_layer);
+    layer.setFont(_font);
+    layer.setRenderHint(QPainter::Antialiasing);
+
+    if (_ttl_in >= 1 && _ttl_in <= 32) {
+        layer.setPen(Qt::NoPen);
+        layer.setBrush(QBrush(QColor(181, 157, 99)));
+
+        QPointF DI(16, 16);
+        layer.setOpacity(0.5);
+        layer.drawEllipse(DI, 10, 10);
+
+        QRectF text(DI.x() - 8, DI.y() - 8, 15, 15);
+        layer.setOpacity(1);
+        layer.setPen(QPen(Qt::black));
+        layer.drawText(text, Qt::AlignCenter, QString::number(_ttl_in));
+    }
+
+    auto width = size.width();
+    auto height = size.height();
+    QFontMetricsF metrics(_font);
+    layer.setPen(QPen(Qt::white));
+    layer.drawStaticText(MARGIN, height - 60, _xdaq_label);
+    layer.drawStaticText(MARGIN, height - 30, _ephys_label);
+    layer.drawStaticText(width - 130, height - 30, _do_label);
+    auto do_x = width - 130 + metrics.horizontalAdvance(_do_label.text());
+    layer.drawText(QRectF(do_x, height - 30, width, 30), hex(_ttl_out, 4));
+
+    _xdaq_x = MARGIN + metrics.horizontalAdvance(_xdaq_label.text());
+    _ephys_x = MARGIN + metrics.horizontalAdvance(_ephys_label.text());
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QPainter>
+#include <QPixmap>
+#include <QSize>
+#include <QStaticText>
+#include <cstdint>
+
+#include "xdaqmetadata/metadata_handler.h"
+
+
+// Draws the DI indicator and the XDAQ timestamps on top of a preview frame.
+// Everything except the two timestamps goes into a cached translucent layer that is only
+// redrawn when the DI or DO values, the size or the font change; the timestamps are kept as
+// QStaticText and re-laid out only when their values change.
+class StreamOverlay
+{
+public:
+    StreamOverlay();
+
+    void paint(QPainter &painter, const QSize &size, const XDAQFrameData &metadata);
+
+private:
+    void update_layer(const QPainter &painter, const QSize &size, const XDAQFrameData &metadata);
+
+    QStaticText _xdaq_label;
+    QStaticText _ephys_label;
+    QStaticText _do_label;
+
+    QPixmap _layer;
+    QSize _size;
+    qreal _device_pixel_ratio;
+    QFont _font;
+    std::uint32_t _ttl_in;
+    std::uint32_t _ttl_out;
+    bool _valid;
+
+    QStaticText _xdaq_time;
+    QStaticText _ephys_time;
+    std::uint64_t _fpga_timestamp;
+    std::uint32_t _rhythm_timestamp;
+    // Where the timestamp values start, right after their labels.
+    qreal _xdaq_x;
+    qreal _ephys_x;
+};
\ No newline at end of file
@@ -22,17 +22,25 @@
 #include <QPainter>
 #include <QPixmap>
 #include <QPropertyAnimation>
+#include <QScreen>
 #include <QSettings>
-#include <QStandardPaths>
 #include <QString>
 #include <QStyle>
+#include <algorithm>
 #include <atomic>
 #include <filesystem>
+#include <limits>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <utility>
 
+#include "block_writer.h"
+#include "post_processing_pool.h"
+#include "recording_sink.h"
 #include "stream_mainwindow.h"
+#include "xdaq_camera_control.h"
 #include "xdaqvc/xvc.h"
 
 
@@ -42,19 +50,25 @@ using namespace std::chrono_literals;
 
 namespace
 {
-#ifdef TTL
-auto constexpr CONTINUOUS = "continuous";
-auto constexpr TRIGGER_ON = "trigger_on";
-auto constexpr DIGITAL_CHANNEL = "digital_channel";
-auto constexpr TRIGGER_CONDITION = "trigger_condition";
-auto constexpr TRIGGER_DURATION = "trigger_duration";
+auto constexpr PREVIEW_RENDERER = "preview_renderer";
+auto constexpr RENDERER_OPENGL = "opengl";
+auto constexpr PREVIEW_FPS = "preview_fps";
+// Converted to RGB by FramePool when they aren't RGB already.
+auto constexpr PAINTER_FORMATS = "{ YUY2, NV12, I420, RGB }";
+
+auto constexpr IP = "192.168.177.100";
 
-auto constexpr MAX_SIZE_TIME = "max_size_time";
-auto constexpr MAX_FILES = "max_files";
+auto constexpr VIDEO_RAW = "video/x-raw";
+auto constexpr VIDEO_MJPEG = "image/jpeg";
 
-auto constexpr SAVE_PATHS = "save_paths";
-auto constexpr DIR_DATE = "dir_date";
-auto constexpr DIR_NAME = "dir_name";
+// Posted on the pipeline bus behind the stop, see StreamWindow::stop_recording().
+auto constexpr DRAIN_MARKER = "thor-recording-drain";
+// How long a stop waits for the last fragment to be closed, which includes flushing it.
+auto constexpr DRAIN_TIMEOUT = 30s;
+// The stop number of a blocking stop_recording(), which only gives up as the window closes.
+auto constexpr UNNUMBERED_STOP = std::numeric_limits<std::uint64_t>::max();
+// Raw frames the encoding branch may fall behind by before it holds up the tee.
+auto constexpr JPEG_QUEUE_TIME = GST_SECOND;
 
 void create_directory(const QString &save_path, const QString &dir_name)
 {
@@ -69,12 +83,62 @@ void create_directory(const QString &save_path, const QString &dir_name)
         }
     }
 }
-#endif
 
-auto constexpr IP = "192.168.177.100";
+// Of a splitmuxsink fragment message.
+GstClockTime fragment_running_time(const GstStructure *structure)
+{
+    GstClockTime time = GST_CLOCK_TIME_NONE;
+    gst_structure_get_clock_time(structure, "running-time", &time);
+    return time;
+}
 
-auto constexpr VIDEO_RAW = "video/x-raw";
-auto constexpr VIDEO_MJPEG = "image/jpeg";
+bool records_jpeg(Camera *camera)
+{
+    return camera->current_cap().find(VIDEO_MJPEG) != std::string::npos ||
+           camera->current_cap().find(VIDEO_RAW) != std::string::npos;
+}
+
+// Whether the tee is fed raw video that RawRecorder can record, rather than JPEG.
+bool carries_raw_video(GstElement *tee)
+{
+    auto pad = gst_element_get_static_pad(tee, "sink");
+    auto caps = gst_pad_get_current_caps(pad);
+    gst_object_unref(pad);
+    auto raw = caps && RawRecorder::supports(caps);
+    if (caps) gst_caps_unref(caps);
+    return raw;
+}
+
+// Unlinks a recording branch from its tee pad between two frames and sends it EOS, so it
+// closes its last fragment.
+void end_branch(GstPad *tee_pad, GstElement *branch)
+{
+    gst_pad_add_probe(
+        tee_pad,
+        GST_PAD_PROBE_TYPE_IDLE,
+        [](GstPad *pad, GstPadProbeInfo *, gpointer user_data) {
+            auto sink_pad = gst_element_get_static_pad(GST_ELEMENT(user_data), "sink");
+            gst_pad_unlink(pad, sink_pad);
+            gst_pad_send_event(sink_pad, gst_event_new_eos());
+            gst_object_unref(sink_pad);
+            return GST_PAD_PROBE_REMOVE;
+        },
+        branch,
+        nullptr
+    );
+}
+
+// Takes the branch out of the pipeline and gives the tee pad back.
+void remove_branch(GstElement *pipeline, GstPad *tee_pad, GstElement *branch)
+{
+    gst_element_set_state(branch, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(pipeline), branch);
+    if (auto tee = gst_pad_get_parent_element(tee_pad)) {
+        gst_element_release_request_pad(tee, tee_pad);
+        gst_object_unref(tee);
+    }
+    gst_object_unref(tee_pad);
+}
 
 void set_state(GstElement *element, GstState state)
 {
@@ -91,289 +155,93 @@ void set_state(GstElement *element, GstState state)
     }
 }
 
-GstFlowReturn draw_image(GstAppSink *sink, void *user_data)
+// What use_recording_sink sets the sink of one recording up with.
+struct RecordingSinkSetup {
+    const TriggerConfig *config;
+    std::shared_ptr<FrameIndexWriter> index;
+    // Of the stream, to size the sink's buffers by.
+    std::uint64_t bytes_per_second;
+};
+
+// "deep-element-added" handler that hands a new splitmuxsink a thorrecordingsink before it
+// creates its own filesink, or, without the recording sink, a filesink that is indexed.
+void use_recording_sink(GstBin *, GstBin *, GstElement *element, gpointer user_data)
 {
-    std::unique_ptr<GstSample, decltype(&gst_sample_unref)> sample(
-        gst_app_sink_pull_sample(sink), gst_sample_unref
+    auto &setup = *static_cast<RecordingSinkSetup *>(user_data);
+    auto config = setup.config;
+    auto factory = gst_element_get_factory(element);
+    if (!factory) return;
+    if (std::string_view(gst_plugin_feature_get_name(factory)) != "splitmuxsink") return;
+
+    auto sink = config->recording_sink ? gst_element_factory_make("thorrecordingsink", nullptr)
+                                       : nullptr;
+    if (config->recording_sink && !sink) {
+        spdlog::warn("thorrecordingsink is not registered, recording through filesink");
+    }
+    if (!sink) {
+        // The same sink splitmuxsink would make, only made here to be indexed.
+        if (!setup.index) return;
+        sink = gst_element_factory_make("filesink", nullptr);
+        if (!sink) return;
+        index_filesink(sink, setup.index);
+        g_object_set(element, "sink", sink, nullptr);
+        return;
+    }
+    auto buffers = BlockWriter::Options::for_bitrate(setup.bytes_per_second);
+    g_object_set(
+        sink,
+        "block-size",
+        static_cast<guint>(buffers.block_size),
+        "queue-blocks",
+        static_cast<guint>(buffers.queue_blocks),
+        "preallocate",
+        static_cast<guint64>(config->preallocate) << 20,
+        "direct",
+        static_cast<gboolean>(config->direct_io),
+        nullptr
     );
-    if (!sample) return GST_FLOW_OK;
+    if (setup.index) thor_recording_sink_set_index(THOR_RECORDING_SINK(sink), setup.index);
+    g_object_set(element, "sink", sink, nullptr);
+}
 
-    auto buffer = gst_sample_get_buffer(sample.get());
-    GstMapInfo info;  // contains the actual image
-    if (gst_buffer_map(buffer, &info, GST_MAP_READ)) {
-        std::unique_ptr<GstVideoInfo, decltype(&gst_video_info_free)> video_info(
-            gst_video_info_new(), gst_video_info_free
-        );
-        if (!gst_video_info_from_caps(video_info.get(), gst_sample_get_caps(sample.get()))) {
-            spdlog::critical("Failed to parse video info");
-            gst_buffer_unmap(buffer, &info);
-            return GST_FLOW_ERROR;
-        }
-        auto caps = gst_sample_get_caps(sample.get());
-        auto structure = gst_caps_get_structure(caps, 0);
-        auto width = static_cast<int>(g_value_get_int(gst_structure_get_value(structure, "width")));
-        auto height =
-            static_cast<int>(g_value_get_int(gst_structure_get_value(structure, "height")));
-
-        auto stream_window = (StreamWindow *) user_data;
-        auto image_data = static_cast<unsigned char *>(info.data);
-        QImage image(image_data, width, height, QImage::Format::Format_RGB888);
-
-        auto xdaqmetadata =
-            stream_window->_handler.get()->safe_deque.check_pts_pop_timestamp(buffer->pts);
-        auto metadata = xdaqmetadata.value_or(XDAQFrameData{0, 0, 0, 0, 0, 0});
-
-        QMetaObject::invokeMethod(
-            stream_window,
-            [stream_window, image, metadata]() {
-                stream_window->set_image(image);
-                stream_window->set_metadata(metadata);
-            },
-            Qt::QueuedConnection
-        );
+// Keeps the encoded frames a recording may reach back to, within the camera's budget.
+GstPadProbeReturn keep_pre_record(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto stream_window = static_cast<StreamWindow *>(user_data);
+    auto config = stream_window->_trigger_config.get();
+    stream_window->_pre_record->set_budget(
+        config->pre_record_time * GST_SECOND,
+        static_cast<std::size_t>(config->pre_record_size) * 1024 * 1024
+    );
+    stream_window->_pre_record->push(GST_PAD_PROBE_INFO_BUFFER(info));
+    return GST_PAD_PROBE_OK;
+}
 
+// Runs on the parser's src pad, while the buffer has not reached the tee yet. xdaqmetadata
+// hands what it parses out only through the handler's safe_deque, so the frame is parsed and
+// popped in this one probe: the deque never holds more than this frame's entry and nothing
+// else takes its lock, so the pop doesn't wait. Everything downstream reads the frame's
+// metadata from the buffer or from _metadata_ring instead.
+template <GstPadProbeCallback parse>
+GstPadProbeReturn track_metadata(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto stream_window = static_cast<StreamWindow *>(user_data);
+    if (auto ret = parse(pad, info, stream_window->_handler.get()); ret != GST_PAD_PROBE_OK) {
+        return ret;
+    }
+    auto pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    stream_window->_bitrate.add(pts, gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info)));
+    auto metadata = stream_window->_handler->safe_deque.check_pts_pop_timestamp(pts);
+    if (!metadata) return GST_PAD_PROBE_OK;
+
+    attach_frame_metadata(GST_PAD_PROBE_INFO_BUFFER(info), *metadata);
+    stream_window->_metadata_ring.push(pts, *metadata);
+    stream_window->_last_fpga_timestamp.store(metadata->fpga_timestamp, std::memory_order_relaxed);
+    stream_window->_tick_rate.add(pts, metadata->fpga_timestamp);
 #ifdef TTL
-        QSettings settings("KonteX Neuroscience", "Thor Vision");
-        auto continuous = settings.value(CONTINUOUS, true).toBool();
-
-        auto max_size_time = settings.value(MAX_SIZE_TIME, 0).toInt();
-        auto max_files = settings.value(MAX_FILES, 10).toInt();
-
-        auto save_path =
-            settings
-                .value(
-                    SAVE_PATHS, QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
-                )
-                .toStringList()
-                .first();
-        auto dir_name = settings.value(DIR_DATE, true).toBool()
-                            ? QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss")
-                            : settings.value(DIR_NAME).toString();
-
-        settings.beginGroup(stream_window->_camera->name());
-        if (!settings.value(TRIGGER_ON, true).toBool()) {
-            gst_buffer_unmap(buffer, &info);
-            return GST_FLOW_OK;
-        }
-        auto digital_channel = settings.value(DIGITAL_CHANNEL, 0).toUInt();
-        auto trigger_condition = settings.value(TRIGGER_CONDITION, 0).toUInt();
-        auto trigger_duration = settings.value(TRIGGER_DURATION, 1).toUInt();
-        settings.endGroup();
-
-        if (digital_channel + 1 == metadata.ttl_in && metadata.ttl_in >= 1 &&
-            metadata.ttl_in <= 32) {
-            stream_window->_status =
-                stream_window->_status == StreamWindow::Record::KeepNo
-                    ? stream_window->_status = StreamWindow::Record::Start  // 0 -> 1
-                    : stream_window->_status = StreamWindow::Record::Keep;  // 1 -> 1
-        } else {
-            stream_window->_status =
-                stream_window->_status == StreamWindow::Record::Keep
-                    ? stream_window->_status = StreamWindow::Record::Stop     // 1 -> 0
-                    : stream_window->_status = StreamWindow::Record::KeepNo;  // 0 -> 0
-        }
-
-        // TODO: UGLY HACK
-        auto main_window =
-            qobject_cast<XDAQCameraControl *>(stream_window->parentWidget()->parentWidget());
-
-        if (trigger_condition == 0) {
-            if (stream_window->_status == StreamWindow::Record::Start) {
-                create_directory(save_path, dir_name);
-
-                QMetaObject::invokeMethod(stream_window, [=]() {
-                    auto filepath = fs::path(save_path.toStdString()) / dir_name.toStdString() /
-                                    stream_window->_camera->name();
-
-                    if (stream_window->_camera->current_cap().find(VIDEO_MJPEG) !=
-                            std::string::npos ||
-                        stream_window->_camera->current_cap().find(VIDEO_RAW) !=
-                            std::string::npos) {
-                        xvc::start_jpeg_recording(
-                            GST_PIPELINE(stream_window->_pipeline.get()),
-                            filepath,
-                            continuous,
-                            max_size_time,
-                            max_files
-                        );
-                    } else {
-                        // TODO: disable h265 for now
-                        stream_window->start_h265_recording(
-                            filepath, continuous, max_size_time, max_files
-                        );
-                    }
-                    main_window->_timer->start(1000);
-                    main_window->_elapsed_time = 0;
-                    main_window->_camera_list->setDisabled(true);
-                    main_window->_record_button->setDisabled(true);
-                    main_window->_record_button->setText("STOP");
-                    main_window->_record_time->setText("00:00:00");
-                    main_window->_recording = true;
-                });
-            } else if (stream_window->_status == StreamWindow::Record::Stop) {
-                QMetaObject::invokeMethod(stream_window, [=]() {
-                    if (stream_window->_camera->current_cap().find(VIDEO_MJPEG) !=
-                            std::string::npos ||
-                        stream_window->_camera->current_cap().find(VIDEO_RAW) !=
-                            std::string::npos) {
-                        std::promise<void> promise;
-                        std::future<void> future = promise.get_future();
-                        stream_window->_parsing_threads.emplace_back(
-                            std::thread([stream_window, promise = std::move(promise)]() mutable {
-                                xvc::stop_jpeg_recording(GST_PIPELINE(stream_window->_pipeline.get()
-                                ));
-                                promise.set_value();
-                            }),
-                            std::move(future)
-                        );
-
-                    } else {
-                        // TODO: disable h265 for now
-                        std::promise<void> promise;
-                        std::future<void> future = promise.get_future();
-                        stream_window->_parsing_threads.emplace_back(
-                            std::thread([stream_window, promise = std::move(promise)]() mutable {
-                                xvc::stop_jpeg_recording(GST_PIPELINE(stream_window->_pipeline.get()
-                                ));
-                                promise.set_value();
-                            }),
-                            std::move(future)
-                        );
-                    }
-                    main_window->_timer->stop();
-                    main_window->_camera_list->setDisabled(false);
-                    main_window->_record_button->setDisabled(false);
-                    main_window->_record_button->setText("REC");
-                });
-            }
-        } else if (trigger_condition == 1) {
-            if (stream_window->_status == StreamWindow::Record::Start && !main_window->_recording) {
-                create_directory(save_path, dir_name);
-
-                QMetaObject::invokeMethod(stream_window, [=]() {
-                    auto filepath = fs::path(save_path.toStdString()) / dir_name.toStdString() /
-                                    stream_window->_camera->name();
-
-                    if (stream_window->_camera->current_cap().find(VIDEO_MJPEG) !=
-                            std::string::npos ||
-                        stream_window->_camera->current_cap().find(VIDEO_RAW) !=
-                            std::string::npos) {
-                        xvc::start_jpeg_recording(
-                            GST_PIPELINE(stream_window->_pipeline.get()),
-                            filepath,
-                            continuous,
-                            max_size_time,
-                            max_files
-                        );
-                    } else {
-                        // TODO: disable h265 for now
-                        stream_window->start_h265_recording(
-                            filepath, continuous, max_size_time, max_files
-                        );
-                    }
-                    main_window->_timer->start(1000);
-                    main_window->_elapsed_time = 0;
-                    main_window->_camera_list->setDisabled(true);
-                    main_window->_record_button->setDisabled(true);
-                    main_window->_record_button->setText("STOP");
-                    main_window->_record_time->setText("00:00:00");
-                    main_window->_recording = true;
-                });
-            } else if (stream_window->_status == StreamWindow::Record::Start &&
-                       main_window->_recording) {
-                QMetaObject::invokeMethod(stream_window, [=]() {
-                    if (stream_window->_camera->current_cap().find(VIDEO_MJPEG) !=
-                            std::string::npos ||
-                        stream_window->_camera->current_cap().find(VIDEO_RAW) !=
-                            std::string::npos) {
-                        std::promise<void> promise;
-                        std::future<void> future = promise.get_future();
-                        stream_window->_parsing_threads.emplace_back(
-                            std::thread([stream_window, promise = std::move(promise)]() mutable {
-                                xvc::stop_jpeg_recording(GST_PIPELINE(stream_window->_pipeline.get()
-                                ));
-                                promise.set_value();
-                            }),
-                            std::move(future)
-                        );
-                    } else {
-                        // TODO: disable h265 for now
-                        xvc::stop_h265_recording(GST_PIPELINE(stream_window->_pipeline.get()));
-                    }
-                    main_window->_timer->stop();
-                    main_window->_camera_list->setDisabled(false);
-                    main_window->_record_button->setDisabled(false);
-                    main_window->_record_button->setText("REC");
-                    main_window->_recording = false;
-                });
-            }
-        } else if (trigger_condition == 2) {
-            if (stream_window->_status == StreamWindow::Record::Start && !main_window->_recording) {
-                create_directory(save_path, dir_name);
-
-                QMetaObject::invokeMethod(stream_window, [=]() {
-                    auto filepath = fs::path(save_path.toStdString()) / dir_name.toStdString() /
-                                    stream_window->_camera->name();
-
-                    if (stream_window->_camera->current_cap().find(VIDEO_MJPEG) !=
-                            std::string::npos ||
-                        stream_window->_camera->current_cap().find(VIDEO_RAW) !=
-                            std::string::npos) {
-                        xvc::start_jpeg_recording(
-                            GST_PIPELINE(stream_window->_pipeline.get()),
-                            filepath,
-                            continuous,
-                            max_size_time,
-                            max_files
-                        );
-                    } else {
-                        // TODO: disable h265 for now
-                        stream_window->start_h265_recording(
-                            filepath, continuous, max_size_time, max_files
-                        );
-                    }
-                    main_window->_elapsed_time = 0;
-                    main_window->_timer->start(1000);
-                    main_window->_camera_list->setDisabled(true);
-                    main_window->_record_button->setDisabled(true);
-                    main_window->_record_button->setText("STOP");
-                    main_window->_record_time->setText("00:00:00");
-                    main_window->_recording = true;
-
-                    QTimer::singleShot(trigger_duration * 1000, [main_window, stream_window]() {
-                        if (stream_window->_camera->current_cap().find(VIDEO_MJPEG) !=
-                                std::string::npos ||
-                            stream_window->_camera->current_cap().find(VIDEO_RAW) !=
-                                std::string::npos) {
-                            std::promise<void> promise;
-                            std::future<void> future = promise.get_future();
-                            stream_window->_parsing_threads.emplace_back(
-                                std::thread([stream_window,
-                                             promise = std::move(promise)]() mutable {
-                                    xvc::stop_jpeg_recording(
-                                        GST_PIPELINE(stream_window->_pipeline.get())
-                                    );
-                                    promise.set_value();
-                                }),
-                                std::move(future)
-                            );
-                        } else {
-                            // TODO: disable h265 for now
-                            xvc::stop_h265_recording(GST_PIPELINE(stream_window->_pipeline.get()));
-                        }
-                        main_window->_timer->stop();
-                        main_window->_camera_list->setDisabled(false);
-                        main_window->_record_button->setDisabled(false);
-                        main_window->_record_button->setText("REC");
-                        main_window->_recording = false;
-                    });
-                });
-            }
-        }
+    stream_window->evaluate_trigger(pts, *metadata);
 #endif
-        gst_buffer_unmap(buffer, &info);
-    }
-    return GST_FLOW_OK;
+    return GST_PAD_PROBE_OK;
 }
 }  // namespace
 
@@ -381,12 +249,34 @@ StreamWindow::StreamWindow(Camera *camera, QWidget *parent)
     : QDockWidget(parent),
       _camera(nullptr),
       _pipeline(nullptr, gst_object_unref),
-      _status(StreamWindow::Record::KeepNo),
-      _pause(false)
+      _trigger_config(camera->name()),
+      _last_fpga_timestamp(0),
+      _receiver(camera->name(), _frames, _mailbox, _metadata_ring),
+      _pause(false),
+      _metadata{0, 0, 0, 0, 0, 0},
+      _gl_renderer(nullptr),
+      _frames_painted(0),
+      _paint_time(0),
+      _preview_open(true),
+      _viewed(true),
+      _tiled(false),
+      _jpeg_branch(nullptr),
+      _jpeg_branch_pad(nullptr),
+      _arming(Arming::Idle),
+      _armed_for(0),
+      _arming_requested(false),
+      _trigger_held(false),
+      _arming_deferred(false),
+      _open_fragments(0),
+      _drain_posted(0),
+      _drain_seen(0),
+      _stops_queued(0),
+      _stops_abandoned(0)
 {
     _camera = camera;
 
     _handler = std::make_unique<MetadataHandler>();
+    _pre_record = std::make_shared<PreRecordRing>();
 
     setFixedSize(480, 360);
     setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
@@ -399,6 +289,10 @@ StreamWindow::StreamWindow(Camera *camera, QWidget *parent)
     auto opacity = new QGraphicsOpacityEffect(_icon);
     _icon->setGraphicsEffect(opacity);
     _fade = new QPropertyAnimation(_icon);
+
+    _repaint_timer = new QTimer(this);
+    _repaint_timer->setTimerType(Qt::PreciseTimer);
+    connect(_repaint_timer, &QTimer::timeout, this, &StreamWindow::repaint_latest);
     _pipeline = {gst_pipeline_new(camera->name().c_str()), gst_object_unref};
 
     auto uri = fmt::format("{}:{}", IP, camera->port());
@@ -411,11 +305,13 @@ StreamWindow::StreamWindow(Camera *camera, QWidget *parent)
             gst_element_get_static_pad(parser, "src"), gst_object_unref
         );
         gst_pad_add_probe(
-            src_pad.get(), GST_PAD_PROBE_TYPE_BUFFER, parse_jpeg_metadata, _handler.get(), nullptr
+            src_pad.get(),
+            GST_PAD_PROBE_TYPE_BUFFER,
+            track_metadata<parse_jpeg_metadata>,
+            this,
+            nullptr
         );
-
-        _bus_thread_running = true;
-        _bus_thread = std::jthread(&StreamWindow::poll_bus_messages, this);
+        gst_pad_add_probe(src_pad.get(), GST_PAD_PROBE_TYPE_BUFFER, keep_pre_record, this, nullptr);
     } else if (camera->id() == -1) {
         xvc::mock_camera(GST_PIPELINE(_pipeline.get()), uri);
     } else {
@@ -427,13 +323,42 @@ StreamWindow::StreamWindow(Camera *camera, QWidget *parent)
             gst_element_get_static_pad(parser, "src"), gst_object_unref
         );
         gst_pad_add_probe(
-            src_pad.get(), GST_PAD_PROBE_TYPE_BUFFER, parse_h265_metadata, _handler.get(), nullptr
+            src_pad.get(),
+            GST_PAD_PROBE_TYPE_BUFFER,
+            track_metadata<parse_h265_metadata>,
+            this,
+            nullptr
         );
     }
 
-    GstAppSinkCallbacks callbacks = {nullptr, nullptr, draw_image, nullptr, nullptr, {nullptr}};
+    _bus_watch = BusReactor::instance().watch(
+        GST_PIPELINE(_pipeline.get()),
+        [this](GstMessage *message) { handle_bus_message(message); }
+    );
+
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    if (settings.value(PREVIEW_RENDERER).toString() == RENDERER_OPENGL) {
+        // The shader converts colour, so take decoded YUV as it is.
+        _gl_renderer = new GLStreamRenderer(this);
+        setWidget(_gl_renderer);
+        _receiver.set_rgb_frames(false);
+        _icon->raise();
+        _preview = std::make_unique<PreviewBranch>(
+            GST_PIPELINE(_pipeline.get()), GLStreamRenderer::CAPS_FORMATS
+        );
+    } else {
+        // Raw cameras and the JPEG decoder deliver YUV; converting it after scaling is cheaper
+        // than letting videoconvert do it.
+        _preview = std::make_unique<PreviewBranch>(GST_PIPELINE(_pipeline.get()), PAINTER_FORMATS);
+    }
+    update_preview_size();
+
+    settings.beginGroup(QString::fromStdString(camera->name()));
+    set_preview_fps(settings.value(PREVIEW_FPS, 0).toInt());
+    settings.endGroup();
+
     auto appsink = gst_bin_get_by_name(GST_BIN(_pipeline.get()), "appsink");
-    gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, this, nullptr);
+    _receiver.attach(GST_APP_SINK(appsink));
 }
 
 void StreamWindow::cleanupParsingThreads()
@@ -460,21 +385,49 @@ void StreamWindow::cleanupParsingThreads()
 
 StreamWindow::~StreamWindow()
 {
-    _bus_thread_running = false;
+    _bus_watch.reset();
+
+    // No fragment message arrives any more, so a stop still waiting for one gives up, and the
+    // threads, which use this window, are joined rather than left to outlive it. What they
+    // post back to it is discarded along with the window.
+    {
+        std::lock_guard lock(_drain_mutex);
+        _stops_abandoned = UNNUMBERED_STOP;
+    }
+    _drain_changed.notify_all();
+    wait_for_stops();
 
-    // First, clean up any threads that have already finished.
-    cleanupParsingThreads();
+    set_state(_pipeline.get(), GST_STATE_NULL);
 
-    // For any remaining threads (still running), detach them to avoid blocking
-    // the UI thread during window shutdown.
-    for (auto &thread_future : _parsing_threads) {
-        if (thread_future.first.joinable()) {
-            thread_future.first.detach();
-        }
+    spdlog::info(
+        "Camera '{}' preview dropped {} of {} frames superseded before display",
+        _camera->name(),
+        _mailbox.dropped(),
+        _mailbox.posted()
+    );
+
+    spdlog::info(
+        "Camera '{}' found metadata for {} of {} frames",
+        _camera->name(),
+        _metadata_ring.lookups() - _metadata_ring.misses(),
+        _metadata_ring.lookups()
+    );
+
+    auto frames = _gl_renderer ? _gl_renderer->frames_rendered() : _frames_painted;
+    auto time = _gl_renderer ? _gl_renderer->render_time() : _paint_time;
+    if (frames > 0) {
+        spdlog::info(
+            "Camera '{}' {} preview drew {} frames in {} us on average",
+            _camera->name(),
+            _gl_renderer ? "OpenGL" : "QPainter",
+            frames,
+            std::chrono::duration_cast<std::chrono::microseconds>(time).count() / frames
+        );
     }
-    _parsing_threads.clear();
 
-    set_state(_pipeline.get(), GST_STATE_NULL);
+    // The renderer may still hold a frame of _frames, which is destroyed before the children.
+    delete _gl_renderer;
+    _gl_renderer = nullptr;
 }
 
 void StreamWindow::closeEvent(QCloseEvent *e)
@@ -485,52 +438,139 @@ void StreamWindow::closeEvent(QCloseEvent *e)
     _handler->last_frame_buffers.clear();
 
     auto stream_mainwindow = qobject_cast<StreamMainWindow *>(parentWidget());
-    stream_mainwindow->removeDockWidget(this);
+    stream_mainwindow->remove_stream(this);
 
     emit window_close();
 
     e->accept();
 }
 
+void StreamWindow::showEvent(QShowEvent *e)
+{
+    auto refresh_rate = screen() ? screen()->refreshRate() : 60.0;
+    _repaint_timer->start(static_cast<int>(1000.0 / std::max(refresh_rate, 1.0)));
+    update_preview_size();
+    update_preview_gate();
+    QDockWidget::showEvent(e);
+}
+
+void StreamWindow::hideEvent(QHideEvent *e)
+{
+    _repaint_timer->stop();
+    update_preview_gate();
+    QDockWidget::hideEvent(e);
+}
+
+void StreamWindow::resizeEvent(QResizeEvent *e)
+{
+    update_preview_size();
+    QDockWidget::resizeEvent(e);
+}
+
+void StreamWindow::update_preview_size()
+{
+    // Ask the pipeline for frames at the widget's physical pixel size, so painting
+    // is a plain blit and nothing is converted at full camera resolution.
+    if (!_preview) return;
+    if (_tiled) {
+        if (!_tile_size.isEmpty()) _preview->set_size(_tile_size.width(), _tile_size.height());
+        return;
+    }
+    auto ratio = devicePixelRatioF();
+    _preview->set_size(qRound(width() * ratio), qRound(height() * ratio));
+}
+
+void StreamWindow::update_preview_gate()
+{
+    if (!_preview) return;
+    auto shown = _tiled ? _viewed && !_tile_size.isEmpty() : isVisible();
+    auto open = shown && !_pause;
+    if (open == _preview_open) return;
+    _preview_open = open;
+    spdlog::info("Camera '{}' preview {}", _camera->name(), open ? "resumed" : "gated");
+    _preview->set_open(open);
+}
+
+void StreamWindow::set_viewed(bool viewed)
+{
+    _viewed = viewed;
+    if (!_tiled) setVisible(viewed);
+    update_preview_gate();
+}
+
+void StreamWindow::set_tiled(bool tiled)
+{
+    _tiled = tiled;
+    if (_gl_renderer && _preview) {
+        // The mosaic paints with QPainter, so it needs frames convert_to_rgb() can handle.
+        _preview->set_formats(tiled ? PAINTER_FORMATS : GLStreamRenderer::CAPS_FORMATS);
+        _receiver.set_rgb_frames(tiled);
+    }
+    setVisible(!tiled && _viewed);
+    update_preview_size();
+    update_preview_gate();
+}
+
+void StreamWindow::set_tile_size(const QSize &size)
+{
+    if (size == _tile_size) return;
+    _tile_size = size;
+    update_preview_size();
+    update_preview_gate();
+}
+
+std::uint64_t StreamWindow::recording_bitrate() const
+{
+    auto measured = _bitrate.bytes_per_second();
+    return measured > 0 ? measured : estimate_bitrate(_camera->current_cap());
+}
+
+void StreamWindow::set_preview_fps(int fps)
+{
+    if (!_preview) return;
+    if (fps > 0) spdlog::info("Camera '{}' preview capped at {} FPS", _camera->name(), fps);
+    _preview->set_max_fps(fps);
+}
+
 void StreamWindow::paintEvent(QPaintEvent *)
 {
+    if (_gl_renderer) return;
+
+    auto start = std::chrono::steady_clock::now();
     QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
-    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
-    painter.drawImage(QRect(0, 0, width(), height()), _image, _image.rect());
-    painter.setPen(QPen(Qt::white));
-    if (_metadata.ttl_in >= 1 && _metadata.ttl_in <= 32) {
-        painter.setPen(Qt::NoPen);
-        painter.setBrush(QBrush(QColor(181, 157, 99)));
-
-        QPointF DI(16, 16);
-        painter.setOpacity(0.5);
-        painter.drawEllipse(DI, 10, 10);
-
-        QRectF text(DI.x() - 8, DI.y() - 8, 15, 15);
-        painter.setOpacity(1);
-        painter.setPen(QPen(Qt::black));
-        painter.drawText(text, Qt::AlignCenter, QString::number(_metadata.ttl_in));
-
-        painter.setPen(QPen(Qt::white));
-    }
-    painter.drawText(
-        QRect(10, height() - 60, width() / 2, height() - 60),
-        QString::fromStdString(fmt::format("XDAQ Time {:08x}", _metadata.fpga_timestamp))
-    );
-    painter.drawText(
-        QRect(10, height() - 30, width() / 2, height() - 30),
-        QString::fromStdString(fmt::format("Ephys Time {:04x}", _metadata.rhythm_timestamp))
-    );
-    painter.drawText(
-        QRect(width() - 130, height() - 30, width(), height() - 30),
-        QString::fromStdString(fmt::format("DO word {:04x}", _metadata.ttl_out))
-    );
+    if (_frame && _frame.rgb()) {
+        // Wraps the frame's pixels without copying; _frame keeps them alive while painting.
+        auto format = _frame.rgb_format() == RGBFormat::RGBX ? QImage::Format_RGBX8888
+                                                             : QImage::Format_RGB888;
+        QImage image(_frame.rgb(), _frame.width(), _frame.height(), _frame.rgb_stride(), format);
+        // The preview branch scales to the window, so this is a plain copy once the new caps
+        // have reached the appsink; only frames negotiated before a resize get scaled here.
+        auto physical = size() * devicePixelRatioF();
+        auto fitted = QSize(
+            PreviewBranch::frame_size(physical.width()),
+            PreviewBranch::frame_size(physical.height())
+        );
+        if (image.size() == fitted) {
+            image.setDevicePixelRatio(devicePixelRatioF());
+            painter.drawImage(0, 0, image);
+        } else {
+            painter.setRenderHint(QPainter::SmoothPixmapTransform);
+            painter.drawImage(rect(), image, image.rect());
+            painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        }
+    }
+    _overlay.paint(painter, size(), _metadata);
+
+    if (_frame) {
+        ++_frames_painted;
+        _paint_time += std::chrono::steady_clock::now() - start;
+    }
 }
 
 void StreamWindow::mousePressEvent(QMouseEvent *)
 {
     _pause = !_pause;
+    update_preview_gate();
 
     auto pixmap = _pause ? style()->standardPixmap(QStyle::SP_MediaPause)
                          : style()->standardPixmap(QStyle::SP_MediaPlay);
@@ -567,20 +607,209 @@ void StreamWindow::mousePressEvent(QMouseEvent *)
     _fade->start();
 }
 
-void StreamWindow::set_image(const QImage &image)
+void StreamWindow::repaint_latest()
+{
+    auto frame = _mailbox.take();
+    if (!frame || _pause) return;
+
+    if (_gl_renderer) {
+        _gl_renderer->set_frame(std::move(frame));
+        return;
+    }
+    _frame = std::move(frame);
+    _metadata = _frame.metadata();
+    update();
+}
+
+std::uint64_t StreamWindow::tick_rate() const
 {
-    if (!_pause) {
-        _image = image;
-        update();
+    auto configured = _trigger_config.get()->tick_rate;
+    return configured > 0 ? configured : _tick_rate.ticks_per_second();
+}
+
+void StreamWindow::evaluate_trigger(GstClockTime pts, const XDAQFrameData &metadata)
+{
+    // Published by the UI thread whenever a setting changes; no settings I/O per frame.
+    auto config = _trigger_config.get();
+    auto wanted = config->trigger_on ? config->version : 0;
+    if (_arming.load(std::memory_order_acquire) != Arming::Triggered &&
+        _armed_for.load(std::memory_order_acquire) != wanted &&
+        !_arming_requested.exchange(true)) {
+        QMetaObject::invokeMethod(this, [this]() { update_trigger_arming(); });
+    }
+    if (!config->trigger_on) return;
+
+    // Durations are counted in FPGA ticks, so nothing triggers before the rate is known.
+    auto ticks_per_second = tick_rate();
+    if (ticks_per_second == 0) return;
+    _trigger.set_settings(config->engine(ticks_per_second));
+    auto ttl_in = TriggerEngine::mask_from_channel_number(metadata.ttl_in);
+    switch (_trigger.update(ttl_in, metadata.fpga_timestamp)) {
+    case TriggerEngine::Action::Start: start_triggered_recording(pts); break;
+    case TriggerEngine::Action::Stop: stop_triggered_recording(pts); break;
+    case TriggerEngine::Action::None: break;
     }
 }
 
-void StreamWindow::set_metadata(const XDAQFrameData &metadata)
+void StreamWindow::hold_trigger(bool hold)
 {
-    if (!_pause) {
-        _metadata = metadata;
-        update();
+    _trigger_held = hold;
+    // Once released, the streaming thread finds nothing armed and asks for a branch.
+    disarm_trigger();
+}
+
+void StreamWindow::update_trigger_arming()
+{
+    // Also covers requests the streaming thread would make while this runs.
+    _arming_requested = true;
+    // A triggered recording arms the next one once it has drained.
+    if (disarm_trigger()) {
+        // xvc can't build a branch while the last one is still stopping, so this runs again
+        // once it has; the streaming thread doesn't ask meanwhile.
+        if (stopping()) {
+            if (!std::exchange(_arming_deferred, true)) {
+                after_stops([this]() {
+                    _arming_deferred = false;
+                    update_trigger_arming();
+                });
+            }
+            return;
+        }
+        auto config = _trigger_config.get();
+        // Even if nothing can be armed, so the streaming thread only asks again once the
+        // settings change.
+        _armed_for.store(config->trigger_on ? config->version : 0, std::memory_order_release);
+        if (config->trigger_on && !_trigger_held) arm_trigger(*config);
     }
+    _arming_requested = false;
+}
+
+void StreamWindow::arm_trigger(const TriggerConfig &config)
+{
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> tee(
+        gst_bin_get_by_name(GST_BIN(_pipeline.get()), "t"), gst_object_unref
+    );
+    if (!tee) {
+        spdlog::error("Camera '{}' pipeline has no tee to record from", _camera->name());
+        return;
+    }
+
+    // Named when the branch is built rather than when the trigger fires, so a dated directory
+    // carries the time the recording was armed: when triggering was switched on or the last
+    // triggered recording ended.
+    auto dir_name = config.dir_date
+                        ? QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss")
+                        : config.dir_name;
+    create_directory(config.save_path, dir_name);
+    auto directory = fs::path(config.save_path.toStdString()) / dir_name.toStdString();
+    auto filepath = directory / _camera->name();
+
+    std::shared_ptr<RecordingGate> gate;
+    if (records_jpeg(_camera)) {
+        gate = start_jpeg_recording(
+            filepath,
+            config.continuous,
+            config.max_size_time,
+            config.max_files,
+            GST_CLOCK_TIME_NONE
+        );
+    } else {
+        gate = RecordingGate::open(tee.get(), GST_CLOCK_TIME_NONE, [&] {
+            start_h265_recording(
+                filepath, config.continuous, config.max_size_time, config.max_files
+            );
+        });
+    }
+    if (!gate) {
+        spdlog::error("Camera '{}' failed to arm a triggered recording", _camera->name());
+        return;
+    }
+    _armed_directory = directory;
+    _armed_gate = std::move(gate);
+    _arming.store(Arming::Armed, std::memory_order_release);
+    spdlog::info(
+        "Camera '{}' armed a triggered recording to {}", _camera->name(), filepath.string()
+    );
+}
+
+bool StreamWindow::disarm_trigger()
+{
+    auto state = Arming::Armed;
+    if (!_arming.compare_exchange_strong(state, Arming::Idle) && state == Arming::Triggered) {
+        return false;
+    }
+    _armed_for.store(0, std::memory_order_release);
+    auto directory = std::exchange(_armed_directory, fs::path());
+    auto gate = std::exchange(_armed_gate, nullptr);
+    if (!gate) return true;
+
+    // Never opened, so nothing was written, but xvc's stop still blocks, so it runs off the UI
+    // thread like any other. The directory goes too unless another camera records into it.
+    gate->close_at(0);
+    stop_recording_async([this, directory]() {
+        std::error_code ec;
+        fs::remove(directory, ec);
+        spdlog::info("Camera '{}' disarmed its triggered recording", _camera->name());
+    });
+    return true;
+}
+
+void StreamWindow::start_triggered_recording(GstClockTime pts)
+{
+    // Built ahead on the UI thread, see update_trigger_arming(); opening it is all that is
+    // left, so the frame isn't held up by I/O or state changes.
+    auto state = Arming::Armed;
+    if (!_arming.compare_exchange_strong(state, Arming::Triggered)) {
+        spdlog::warn("Camera '{}' has no recording armed, trigger ignored", _camera->name());
+        _trigger.cancel();
+        return;
+    }
+    _armed_for.store(0, std::memory_order_release);
+    auto gate = std::exchange(_armed_gate, nullptr);
+    // JPEG frames can be cut anywhere; h265 has to start from the cached GOP.
+    gate->open_at(records_jpeg(_camera) ? pts : 0, 0, nullptr);
+    _recording_gate = std::move(gate);
+    spdlog::info("Camera '{}' trigger started recording at PTS {}", _camera->name(), pts);
+
+    QMetaObject::invokeMethod(this, [this]() { show_triggered_recording(true); });
+}
+
+void StreamWindow::stop_triggered_recording(GstClockTime pts)
+{
+    // Frames from pts on never reach the file, however long the stop below takes.
+    if (_recording_gate) _recording_gate->close_at(pts);
+    _recording_gate.reset();
+    spdlog::info("Camera '{}' trigger stopped recording at PTS {}", _camera->name(), pts);
+
+    QMetaObject::invokeMethod(this, [this]() {
+        stop_recording_async([this]() {
+            // Idle only once the files are complete, so the next recording isn't armed on top
+            // of one that is still flushing.
+            _arming.store(Arming::Idle, std::memory_order_release);
+            update_trigger_arming();
+        });
+        show_triggered_recording(false);
+    });
+}
+
+void StreamWindow::show_triggered_recording(bool recording)
+{
+    // TODO: UGLY HACK
+    auto main_window = qobject_cast<XDAQCameraControl *>(parentWidget()->parentWidget());
+    if (!main_window) return;
+
+    if (recording) {
+        main_window->_elapsed_time = 0;
+        main_window->_timer->start(1000);
+        main_window->_record_time->setText("00:00:00");
+        main_window->_record_button->setText("STOP");
+    } else {
+        main_window->_timer->stop();
+        main_window->_record_button->setText("REC");
+    }
+    main_window->_camera_list->setDisabled(recording);
+    main_window->_record_button->setDisabled(recording);
+    main_window->_recording = recording;
 }
 
 void StreamWindow::play()
@@ -591,8 +820,172 @@ void StreamWindow::play()
 
 void StreamWindow::stop()
 {
+    disarm_trigger();
     _camera->stop();
     set_state(_pipeline.get(), GST_STATE_NULL);
+    // The pipeline is down, so no fragment message will come for the stops still running.
+    abandon_stops();
+}
+
+std::shared_ptr<RecordingGate> StreamWindow::start_jpeg_recording(
+    fs::path &filepath, bool continuous, int max_size_time, int max_files, GstClockTime start_pts
+)
+{
+    auto config = _trigger_config.get();
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> tee(
+        gst_bin_get_by_name(GST_BIN(_pipeline.get()), "t"), gst_object_unref
+    );
+    // Raw segments carry their own metadata and need no index, since frames are fixed-size.
+    auto raw_tee = tee && carries_raw_video(tee.get());
+    auto raw = config->raw_recording && raw_tee;
+    auto parallel = raw_tee && !raw && config->parallel_jpeg;
+    RecordingSinkSetup setup{config.get(), nullptr, recording_bitrate()};
+    if (!raw && config->frame_index) setup.index = std::make_shared<FrameIndexWriter>();
+    auto start = [&] {
+        if (raw && start_raw_recording(tee.get(), filepath, continuous, max_size_time, max_files)) {
+            return;
+        }
+        // The splitmuxsink is built inside the calls below, so the handler only sees its branch.
+        gulong handler = 0;
+        if (config->recording_sink || setup.index) {
+            handler = g_signal_connect(
+                _pipeline.get(), "deep-element-added", G_CALLBACK(use_recording_sink), &setup
+            );
+        }
+        auto encoding = false;
+        if (parallel) {
+            encoding = start_parallel_jpeg_recording(
+                tee.get(), filepath, continuous, max_size_time, max_files
+            );
+        }
+        if (!encoding) {
+            xvc::start_jpeg_recording(
+                GST_PIPELINE(_pipeline.get()), filepath, continuous, max_size_time, max_files
+            );
+        }
+        if (handler) g_signal_handler_disconnect(_pipeline.get(), handler);
+    };
+    if (!tee) {
+        start();
+        return nullptr;
+    }
+
+    std::shared_ptr<SidecarWriter> sidecar;
+    if (!raw && config->inline_metadata) sidecar = std::make_shared<SidecarWriter>(filepath);
+    auto gate = RecordingGate::open(tee.get(), start_pts, start, _pre_record, sidecar, setup.index);
+    // Raw segments are cut by frame count.
+    auto ticks_per_second = tick_rate();
+    if (gate && !raw && !continuous && config->aligned_splits && ticks_per_second == 0) {
+        spdlog::warn(
+            "Camera '{}' FPGA timestamp rate is not known yet, fragments split on their own",
+            _camera->name()
+        );
+    } else if (gate && !raw && !continuous && config->aligned_splits) {
+        auto interval = static_cast<std::uint64_t>(std::max(1, max_size_time)) * 60 *
+                        ticks_per_second;
+        std::shared_ptr<RecordingManifest> manifest;
+        {
+            std::lock_guard lock(_manifest_mutex);
+            manifest = _manifest;
+        }
+        if (manifest) manifest->set_split_interval(interval, ticks_per_second);
+        gate->split_on_ticks(interval, [manifest, filepath](auto boundary, auto frame_tick) {
+            if (manifest) manifest->split_at(filepath, boundary, frame_tick);
+        });
+    }
+    // Without a gate nothing feeds the sidecar, so the fragments are parsed afterwards.
+    if (gate && sidecar) {
+        std::lock_guard lock(_sidecar_mutex);
+        std::erase_if(_sidecars, [](auto &writer) { return writer->idle(); });
+        _sidecars.push_back(std::move(sidecar));
+    }
+    return gate;
+}
+
+bool StreamWindow::start_raw_recording(
+    GstElement *tee, const fs::path &filepath, bool continuous, int max_size_time, int max_files
+)
+{
+    auto config = _trigger_config.get();
+    RawRecorder::Options options;
+    options.direct = config->direct_io;
+    if (!continuous) {
+        GstVideoInfo info;
+        auto pad = gst_element_get_static_pad(tee, "sink");
+        auto caps = gst_pad_get_current_caps(pad);
+        gst_object_unref(pad);
+        auto fps = 30.0;
+        if (caps && gst_video_info_from_caps(&info, caps) && GST_VIDEO_INFO_FPS_N(&info) > 0) {
+            fps = static_cast<double>(GST_VIDEO_INFO_FPS_N(&info)) / GST_VIDEO_INFO_FPS_D(&info);
+        }
+        if (caps) gst_caps_unref(caps);
+        options.segment_frames =
+            static_cast<std::uint64_t>(std::max(1, max_size_time) * 60 * fps + 0.5);
+        options.max_files = max_files;
+    }
+    options.fragment_opened = [this](auto &location, auto running_time) {
+        fragment_opened(location, running_time);
+    };
+    options.fragment_closed = [this](auto &location, auto running_time) {
+        fragment_closed(location, running_time);
+    };
+
+    auto recorder = std::make_unique<RawRecorder>(filepath, std::move(options));
+    if (!recorder->start(_pipeline.get(), tee)) {
+        spdlog::error("Camera '{}' falls back to xvc for its raw recording", _camera->name());
+        return false;
+    }
+    std::lock_guard lock(_branch_mutex);
+    _raw_recorder = std::move(recorder);
+    return true;
+}
+
+bool StreamWindow::start_parallel_jpeg_recording(
+    GstElement *tee, const fs::path &filepath, bool continuous, int max_size_time, int max_files
+)
+{
+    auto config = _trigger_config.get();
+    // The same fragments as xvc's branch, with the frames encoded on a thread pool.
+    auto description = fmt::format(
+        "queue max-size-buffers=0 max-size-bytes=0 max-size-time={} ! thorjpegenc threads={} ! "
+        "splitmuxsink muxer-factory=matroskamux location=\"{}-%05d.mkv\" max-size-time={} "
+        "max-files={}",
+        JPEG_QUEUE_TIME,
+        config->jpeg_encoder_threads,
+        filepath.generic_string(),
+        continuous ? 0 : static_cast<guint64>(std::max(1, max_size_time)) * 60 * GST_SECOND,
+        continuous ? 0 : max_files
+    );
+    GError *error = nullptr;
+    auto branch = gst_parse_bin_from_description(description.c_str(), TRUE, &error);
+    if (error) {
+        spdlog::error(
+            "Camera '{}' can't build its JPEG encoding branch: {}", _camera->name(), error->message
+        );
+        g_error_free(error);
+        if (branch) gst_object_unref(branch);
+        return false;
+    }
+
+    gst_bin_add(GST_BIN(_pipeline.get()), branch);
+    gst_element_sync_state_with_parent(branch);
+    // Linked last, so the first frame finds the branch playing.
+    auto templ = gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(tee), "src_%u");
+    auto tee_pad = gst_element_request_pad(tee, templ, nullptr, nullptr);
+    auto sink_pad = gst_element_get_static_pad(branch, "sink");
+    auto linked = gst_pad_link(tee_pad, sink_pad) == GST_PAD_LINK_OK;
+    gst_object_unref(sink_pad);
+    if (!linked) {
+        spdlog::error("Camera '{}' can't link its JPEG encoding branch", _camera->name());
+        remove_branch(_pipeline.get(), tee_pad, branch);
+        return false;
+    }
+    spdlog::info("Camera '{}' encodes its recording on thorjpegenc", _camera->name());
+
+    std::lock_guard lock(_branch_mutex);
+    _jpeg_branch = branch;
+    _jpeg_branch_pad = tee_pad;
+    return true;
 }
 
 void StreamWindow::start_h265_recording(
@@ -618,80 +1011,260 @@ void StreamWindow::start_h265_recording(
     }
 }
 
-void StreamWindow::poll_bus_messages()
+bool StreamWindow::stop_recording()
+{
+    return stop_recording(UNNUMBERED_STOP);
+}
+
+void StreamWindow::stop_recording_async(std::function<void()> drained)
 {
-    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
-        gst_pipeline_get_bus(GST_PIPELINE(_pipeline.get())), gst_object_unref
+    run_after_stops(++_stops_queued, std::move(drained));
+}
+
+void StreamWindow::after_stops(std::function<void()> ready)
+{
+    if (!stopping()) {
+        ready();
+        return;
+    }
+    run_after_stops(0, std::move(ready));
+}
+
+bool StreamWindow::stopping()
+{
+    cleanupParsingThreads();
+    return !_parsing_threads.empty();
+}
+
+void StreamWindow::wait_for_stops()
+{
+    for (auto &[thread, future] : _parsing_threads) {
+        if (thread.joinable()) thread.join();
+    }
+    _parsing_threads.clear();
+}
+
+void StreamWindow::run_after_stops(std::uint64_t stop, std::function<void()> then)
+{
+    cleanupParsingThreads();
+    // Each thread waits for the one started before it, so the stops of a camera never overlap.
+    auto previous = _parsing_threads.empty() ? std::shared_future<void>()
+                                             : _parsing_threads.back().second;
+    std::promise<void> promise;
+    auto future = promise.get_future().share();
+    _parsing_threads.emplace_back(
+        std::thread([=, this, promise = std::move(promise), then = std::move(then)]() mutable {
+            if (previous.valid()) previous.wait();
+            if (stop > 0) stop_recording(stop);
+            promise.set_value();
+            if (then) QMetaObject::invokeMethod(this, std::move(then));
+        }),
+        std::move(future)
+    );
+}
+
+void StreamWindow::abandon_stops()
+{
+    {
+        std::lock_guard lock(_drain_mutex);
+        _stops_abandoned = std::max(_stops_abandoned, _stops_queued);
+    }
+    _drain_changed.notify_all();
+}
+
+bool StreamWindow::stop_recording(std::uint64_t stop)
+{
+    std::unique_ptr<RawRecorder> raw;
+    GstElement *branch;
+    GstPad *branch_pad;
+    {
+        std::lock_guard lock(_branch_mutex);
+        raw = std::move(_raw_recorder);
+        branch = std::exchange(_jpeg_branch, nullptr);
+        branch_pad = std::exchange(_jpeg_branch_pad, nullptr);
+    }
+    if (raw) {
+        // The recorder closes its own last segment, so there is no fragment message to wait for.
+        auto begin = std::chrono::steady_clock::now();
+        auto stopped = raw->stop();
+        raw.reset();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - begin
+        );
+        spdlog::info(
+            "Camera '{}' raw recording drained in {} ms", _camera->name(), elapsed.count()
+        );
+        return stopped;
+    }
+
+    if (branch) {
+        end_branch(branch_pad, branch);
+    } else if (records_jpeg(_camera)) {
+        xvc::stop_jpeg_recording(GST_PIPELINE(_pipeline.get()));
+    } else {
+        xvc::stop_h265_recording(GST_PIPELINE(_pipeline.get()));
+    }
+    auto drained = wait_for_drain(stop);
+    if (branch) remove_branch(_pipeline.get(), branch_pad, branch);
+    return drained;
+}
+
+bool StreamWindow::wait_for_drain(std::uint64_t stop)
+{
+    // Bus messages are delivered in order, so once the marker comes through, the opening of
+    // every fragment the EOS will close has been counted.
+    std::unique_lock lock(_drain_mutex);
+    auto marker = ++_drain_posted;
+    gst_element_post_message(
+        _pipeline.get(),
+        gst_message_new_application(
+            GST_OBJECT(_pipeline.get()),
+            gst_structure_new(DRAIN_MARKER, "marker", G_TYPE_UINT64, marker, nullptr)
+        )
+    );
+    auto begin = std::chrono::steady_clock::now();
+    auto drained = _drain_changed.wait_for(lock, DRAIN_TIMEOUT, [this, marker] {
+        return _stops_abandoned >= stop || (_drain_seen >= marker && _open_fragments == 0);
+    });
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - begin
     );
-    while (_bus_thread_running) {
-        std::unique_ptr<GstMessage, decltype(&gst_message_unref)> msg(
-            gst_bus_timed_pop(bus.get(), 100 * GST_MSECOND), gst_message_unref
+    if (_stops_abandoned >= stop) {
+        spdlog::warn(
+            "Camera '{}' stopped streaming before its recording drained, {} fragment(s) open",
+            _camera->name(),
+            _open_fragments
         );
-        if (msg) {
-            switch (GST_MESSAGE_TYPE(msg.get())) {
-            case GST_MESSAGE_ERROR: {
-                GError *err = nullptr;
-                gchar *debug = nullptr;
-                gst_message_parse_error(msg.get(), &err, &debug);
-                if (err) {
-                    spdlog::error("Error: {}", err->message);
-                    g_error_free(err);
-                }
-                if (debug) {
-                    spdlog::error("Debug: {}", debug);
-                    g_free(debug);
-                }
-                break;
+        return false;
+    }
+    if (!drained) {
+        spdlog::error(
+            "Camera '{}' recording did not finish within {} s, {} fragment(s) still open",
+            _camera->name(),
+            std::chrono::duration_cast<std::chrono::seconds>(DRAIN_TIMEOUT).count(),
+            _open_fragments
+        );
+        _open_fragments = 0;
+        return false;
+    }
+    spdlog::info("Camera '{}' recording drained in {} ms", _camera->name(), elapsed.count());
+    return true;
+}
+
+void StreamWindow::set_manifest(std::shared_ptr<RecordingManifest> manifest)
+{
+    std::lock_guard lock(_manifest_mutex);
+    _manifest = std::move(manifest);
+}
+
+bool StreamWindow::fragment_opened(const fs::path &location, GstClockTime running_time)
+{
+    {
+        std::lock_guard lock(_drain_mutex);
+        ++_open_fragments;
+    }
+    {
+        std::lock_guard lock(_manifest_mutex);
+        if (_manifest) _manifest->fragment_opened(location, running_time);
+    }
+    std::lock_guard lock(_sidecar_mutex);
+    return std::any_of(_sidecars.begin(), _sidecars.end(), [&](auto &writer) {
+        return writer->fragment_opened(location, running_time);
+    });
+}
+
+bool StreamWindow::fragment_closed(const fs::path &location, GstClockTime running_time)
+{
+    {
+        std::lock_guard lock(_drain_mutex);
+        _open_fragments = std::max(0, _open_fragments - 1);
+    }
+    _drain_changed.notify_all();
+    {
+        std::lock_guard lock(_manifest_mutex);
+        if (_manifest) _manifest->fragment_closed(location, running_time);
+    }
+    std::lock_guard lock(_sidecar_mutex);
+    return std::any_of(_sidecars.begin(), _sidecars.end(), [&](auto &writer) {
+        return writer->fragment_closed(location, running_time);
+    });
+}
+
+void StreamWindow::handle_bus_message(GstMessage *message)
+{
+    switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_ERROR: {
+        GError *err = nullptr;
+        gchar *debug = nullptr;
+        gst_message_parse_error(message, &err, &debug);
+        if (err) {
+            spdlog::error("Error: {}", err->message);
+            g_error_free(err);
+        }
+        if (debug) {
+            spdlog::error("Debug: {}", debug);
+            g_free(debug);
+        }
+        break;
+    }
+    case GST_MESSAGE_WARNING: {
+        GError *err = nullptr;
+        gchar *debug = nullptr;
+        gst_message_parse_warning(message, &err, &debug);
+        if (err) {
+            spdlog::warn("Warning: {}", err->message);
+            g_error_free(err);
+        }
+        if (debug) {
+            spdlog::error("Debug: {}", debug);
+            g_free(debug);
+        }
+        break;
+    }
+    case GST_MESSAGE_APPLICATION: {
+        auto s = gst_message_get_structure(message);
+        guint64 marker = 0;
+        if (s && gst_structure_has_name(s, DRAIN_MARKER) &&
+            gst_structure_get_uint64(s, "marker", &marker)) {
+            {
+                std::lock_guard lock(_drain_mutex);
+                _drain_seen = std::max<std::uint64_t>(_drain_seen, marker);
             }
-            case GST_MESSAGE_WARNING: {
-                GError *err = nullptr;
-                gchar *debug = nullptr;
-                gst_message_parse_warning(msg.get(), &err, &debug);
-                if (err) {
-                    spdlog::warn("Warning: {}", err->message);
-                    g_error_free(err);
-                }
-                if (debug) {
-                    spdlog::error("Debug: {}", debug);
-                    g_free(debug);
+            _drain_changed.notify_all();
+        }
+        break;
+    }
+    case GST_MESSAGE_ELEMENT: {
+        const GstStructure *s = gst_message_get_structure(message);
+        if (s) {
+            const gchar *msg_name = gst_structure_get_name(s);
+            if (g_strcmp0(msg_name, "splitmuxsink-fragment-closed") == 0) {
+                const gchar *location = gst_structure_get_string(s, "location");
+                if (location) {
+                    spdlog::info("Fragment closed. File saved: {}", location);
                 }
-                break;
-            }
-            case GST_MESSAGE_ELEMENT: {
-                const GstStructure *s = gst_message_get_structure(msg.get());
-                if (s) {
-                    const gchar *msg_name = gst_structure_get_name(s);
-                    if (g_strcmp0(msg_name, "splitmuxsink-fragment-closed") == 0) {
-                        const gchar *location = gst_structure_get_string(s, "location");
-                        if (location) {
-                            spdlog::info("Fragment closed. File saved: {}", location);
-                            // Post-processing in split mode:
-                            std::string file_loc(location);
-                            std::promise<void> promise;
-                            std::future<void> future = promise.get_future();
-                            _parsing_threads.emplace_back(
-                                std::thread([file_loc, promise = std::move(promise)]() mutable {
-                                    std::this_thread::sleep_for(std::chrono::seconds(4));
-                                    xvc::parse_video_save_binary_jpeg(file_loc);
-                                    promise.set_value();  // Signal completion
-                                }),
-                                std::move(future)
-                            );
-                        } else {
-                            spdlog::info("Fragment closed, but no location field found.");
+                // The bus is watched for h265 streams too, which have no JPEG metadata to parse.
+                auto written = location && fragment_closed(location, fragment_running_time(s));
+                if (location && records_jpeg(_camera) && !written) {
+                    // splitmuxsink has closed the file, so it can be parsed right away.
+                    PostProcessingPool::instance().submit(
+                        _camera->name(), location, [](const fs::path &file) {
+                            xvc::parse_video_save_binary_jpeg(file.string());
                         }
-                    } else if (g_strcmp0(msg_name, "splitmuxsink-fragment-opened") == 0) {
-                        spdlog::info("Fragment opened message received.");
-                    } else {
-                        spdlog::debug(
-                            "Unknown splitmuxsink element message received: {}", msg_name
-                        );
-                    }
+                    );
+                } else if (!location) {
+                    spdlog::info("Fragment closed, but no location field found.");
                 }
-                break;
-            }
-            default: break;
+            } else if (g_strcmp0(msg_name, "splitmuxsink-fragment-opened") == 0) {
+                spdlog::info("Fragment opened message received.");
+                const gchar *location = gst_structure_get_string(s, "location");
+                if (location) fragment_opened(location, fragment_running_time(s));
+            } else {
+                spdlog::debug("Unknown splitmuxsink element message received: {}", msg_name);
             }
         }
+        break;
+    }
+    default: break;
     }
 }
\ No newline at end of file
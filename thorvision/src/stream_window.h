@@ -7,10 +7,33 @@
 #include <QImage>
 #include <QLabel>
 #include <QPropertyAnimation>
+#include <QSize>
+#include <QTimer>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <future>
+#include <mutex>
 #include <thread>
 
+#include "bitrate_estimator.h"
+#include "bus_reactor.h"
+#include "gl_stream_renderer.h"
+#include "metadata_ring.h"
+#include "pre_record_ring.h"
+#include "preview_branch.h"
+#include "raw_recorder.h"
+#include "recording_gate.h"
+#include "recording_manifest.h"
+#include "sidecar_writer.h"
+#include "stream_overlay.h"
+#include "tick_rate.h"
+#include "trigger_config.h"
+#include "trigger_engine.h"
+#include "video_frame.h"
 #include "xdaqmetadata/metadata_handler.h"
 #include "xdaqvc/camera.h"
 
@@ -28,36 +51,197 @@ public:
 
     Camera *_camera;
     std::unique_ptr<GstElement, decltype(&gst_object_unref)> _pipeline;
-    std::vector<std::pair<std::thread, std::future<void>>> _parsing_threads;
+    // The threads of stop_recording_async() and after_stops(), each with its completion.
+    std::vector<std::pair<std::thread, std::shared_future<void>>> _parsing_threads;
 
-    enum class Record { KeepNo, Start, Keep, Stop };
-    Record _status;
     std::unique_ptr<MetadataHandler> _handler;
+    TriggerConfigSlot _trigger_config;
+    MetadataRing _metadata_ring;
+    // Bytes leaving the parser, which is what the recording branch writes.
+    BitrateMeter _bitrate;
+    // FPGA timestamp of the newest frame with XDAQ metadata; 0 until one arrives.
+    std::atomic<std::uint64_t> _last_fpga_timestamp;
+    TickRateMeter _tick_rate;
+    std::shared_ptr<PreRecordRing> _pre_record;
+    // Metadata writers of the JPEG recordings whose last fragment isn't closed yet.
+    std::mutex _sidecar_mutex;
+    std::vector<std::shared_ptr<SidecarWriter>> _sidecars;
+    FramePool _frames;
+    FrameMailbox _mailbox;
+    // The appsink's callback, which fills _mailbox.
+    FrameReceiver _receiver;
 
     void play();
     void stop();
-    void set_image(const QImage &image);
-    void set_metadata(const XDAQFrameData &metadata);
+
+    // Ticks per second of the FPGA timestamps: the fpga_timestamp_rate setting if there is one,
+    // else measured from the stream, which takes its first seconds. 0 until then.
+    std::uint64_t tick_rate() const;
+
+    // Streaming thread only: runs the TTL trigger on a frame that is about to enter the tee.
+    void evaluate_trigger(GstClockTime pts, const XDAQFrameData &metadata);
+    // UI thread only. While held, as during a recording started with REC, no triggered
+    // recording is armed; the one armed already is dropped.
+    void hold_trigger(bool hold);
+
+    // Starts the JPEG recording branch with the pre-record frames ahead of the first frame
+    // from start_pts on. With GST_CLOCK_TIME_NONE the branch is built but its gate stays shut
+    // until it is opened. While the tee carries raw video, the branch records lossless .y4m
+    // segments if raw_recording is set, or else encodes on thorjpegenc if parallel_jpeg is.
+    std::shared_ptr<RecordingGate> start_jpeg_recording(
+        fs::path &filepath,
+        bool continuous,
+        int max_size_time,
+        int max_files,
+        GstClockTime start_pts = 0
+    );
 
     // TODO: UGLY HACK.
     void start_h265_recording(
         fs::path &filepath, bool continuous, int max_size_time, int max_files
     );
 
+    // Sends the recording branch EOS and blocks until splitmuxsink has closed its last
+    // fragment, so the files are complete when it returns. Not on the BusReactor thread, which
+    // delivers the fragment messages. False if the branch didn't drain within a timeout.
+    bool stop_recording();
+    // UI thread. Runs stop_recording() on a thread once every stop of this camera started
+    // earlier has drained, then drained, if given, back on the UI thread.
+    void stop_recording_async(std::function<void()> drained = nullptr);
+    // UI thread. Runs ready on the UI thread once the stops started so far have drained, at
+    // once if none is running; xvc can't start a recording on a camera that is still stopping.
+    void after_stops(std::function<void()> ready);
+    // UI thread; whether a stop is still running.
+    bool stopping();
+    // UI thread; blocks until every stop has drained.
+    void wait_for_stops();
+
+    // Bytes per second a recording would write: measured once the stream has run for a
+    // second, estimated from the camera's caps before that.
+    std::uint64_t recording_bitrate() const;
+
+    // Caps how many frames per second reach the preview; 0 shows every frame.
+    void set_preview_fps(int fps);
+
+    // Whether the camera's View button is checked.
+    void set_viewed(bool viewed);
+    bool viewed() const { return _viewed; }
+    // While tiled the dock stays hidden and a MosaicView takes frames from _mailbox instead.
+    void set_tiled(bool tiled);
+    // Physical size of the camera's mosaic tile; empty while the tile can't be seen.
+    void set_tile_size(const QSize &size);
+
+    // The manifest of the recording started next, which lists its fragments as they are
+    // written. Kept until the next recording, since fragments close after the stop.
+    void set_manifest(std::shared_ptr<RecordingManifest> manifest);
+
 private:
     bool _pause;
-    QImage _image;
+    FrameRef _frame;
     XDAQFrameData _metadata;
+    StreamOverlay _overlay;
+
+    // Drains _mailbox once per display refresh instead of once per camera frame.
+    QTimer *_repaint_timer;
+    void repaint_latest();
+
+    std::unique_ptr<PreviewBranch> _preview;
+    void update_preview_size();
+    // Stops decoding for the preview while the window or its tile is hidden, or paused.
+    void update_preview_gate();
+    bool _preview_open;
+
+    bool _viewed;
+    bool _tiled;
+    QSize _tile_size;
+
+    // Set when the "preview_renderer" setting selects OpenGL; otherwise paintEvent draws.
+    GLStreamRenderer *_gl_renderer;
+    std::uint64_t _frames_painted;
+    std::chrono::nanoseconds _paint_time;
+
+
+    TriggerEngine _trigger;
+    std::shared_ptr<RecordingGate> _recording_gate;
+    // Take the place of xvc's JPEG branch while the tee carries raw video, see
+    // start_jpeg_recording: a lossless recording, or queue ! thorjpegenc ! splitmuxsink in a
+    // bin, linked to _jpeg_branch_pad of the tee.
+    std::mutex _branch_mutex;
+    std::unique_ptr<RawRecorder> _raw_recorder;
+    GstElement *_jpeg_branch;
+    GstPad *_jpeg_branch_pad;
+    bool start_raw_recording(
+        GstElement *tee, const fs::path &filepath, bool continuous, int max_size_time, int max_files
+    );
+    bool start_parallel_jpeg_recording(
+        GstElement *tee, const fs::path &filepath, bool continuous, int max_size_time, int max_files
+    );
+    // The next triggered recording's branch is built on the UI thread behind a shut gate, so
+    // the streaming thread only has to open it when the trigger fires. Whoever moves _arming
+    // away from Armed owns _armed_gate: the trigger, to record, or the UI thread, to drop it.
+    // _arming's release and acquire hand it over, so the pointer itself is not atomic.
+    // Triggered lasts until the recording has drained, since xvc can't overlap a start with a
+    // stop.
+    enum class Arming { Idle, Armed, Triggered };
+    std::atomic<Arming> _arming;
+    std::shared_ptr<RecordingGate> _armed_gate;
+    // TriggerConfig::version of the config the branch was armed from, 0 while nothing is. The
+    // streaming thread asks the UI thread to arm again when it no longer matches the current one.
+    std::atomic<std::uint64_t> _armed_for;
+    std::atomic_bool _arming_requested;
+    // UI thread only.
+    fs::path _armed_directory;
+    bool _trigger_held;
+    // update_trigger_arming() is waiting for a stop to drain before it arms.
+    bool _arming_deferred;
+    // UI thread; rebuilds the armed branch from the current config.
+    void update_trigger_arming();
+    void arm_trigger(const TriggerConfig &config);
+    // UI thread; false while a triggered recording runs, which is left alone.
+    bool disarm_trigger();
+    void start_triggered_recording(GstClockTime pts);
+    void stop_triggered_recording(GstClockTime pts);
+    void show_triggered_recording(bool recording);
+
     QLabel *_icon;
     QPropertyAnimation *_fade;
 
-    std::atomic_bool _bus_thread_running;
-    std::jthread _bus_thread;
-    void poll_bus_messages();
+    BusWatch _bus_watch;
+    // Runs on the BusReactor thread.
+    void handle_bus_message(GstMessage *message);
+    std::mutex _manifest_mutex;
+    std::shared_ptr<RecordingManifest> _manifest;
+    // Hand a splitmuxsink fragment to the manifest and the sidecar of its recording; false if
+    // there is no sidecar.
+    bool fragment_opened(const fs::path &location, GstClockTime running_time);
+    bool fragment_closed(const fs::path &location, GstClockTime running_time);
     void cleanupParsingThreads();
 
+    // Fragments opened but not closed yet, and the drain markers posted on the bus by
+    // stop_recording() and seen by handle_bus_message(). Once a marker is seen, every fragment
+    // opened before the stop has been counted.
+    std::mutex _drain_mutex;
+    std::condition_variable _drain_changed;
+    int _open_fragments;
+    std::uint64_t _drain_posted;
+    std::uint64_t _drain_seen;
+    // Stops handed to a thread are numbered on the UI thread; once stop() has taken the
+    // pipeline down, those up to _stops_abandoned give up waiting, and all do as the window
+    // is destroyed.
+    std::uint64_t _stops_queued;
+    std::uint64_t _stops_abandoned;
+    void run_after_stops(std::uint64_t stop, std::function<void()> then);
+    void abandon_stops();
+    bool stop_recording(std::uint64_t stop);
+    // Blocks until every fragment opened before the call has closed; false on a timeout or
+    // once the stop is abandoned.
+    bool wait_for_drain(std::uint64_t stop);
+
 protected:
     void closeEvent(QCloseEvent *e) override;
+    void showEvent(QShowEvent *e) override;
+    void hideEvent(QHideEvent *e) override;
+    void resizeEvent(QResizeEvent *e) override;
     void paintEvent(QPaintEvent *) override;
     void mousePressEvent(QMouseEvent *e) override;
 
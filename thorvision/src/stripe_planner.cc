@@ -0,0 +1,123 @@
+#include "stripe_planner.h"
+
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <numeric>
+#include <system_error>
+#include <tuple>
+
+#include "storage_probe.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+auto constexpr SAVE_PATHS = "save_paths";
+auto constexpr STRIPE_PATHS = "stripe_paths";
+
+// A target this close to full is a last resort.
+auto constexpr FULL_HORIZON_SECONDS = 3600;
+
+bool writable_directory(const QString &path)
+{
+    QFileInfo info(path);
+    return info.exists() && info.isDir() && info.isWritable();
+}
+}  // namespace
+
+
+std::vector<StripeTarget> stripe_targets()
+{
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    auto paths = settings
+                     .value(
+                         SAVE_PATHS,
+                         QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
+                     )
+                     .toStringList();
+    if (paths.isEmpty()) {
+        paths << QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+    }
+    auto count = std::max(1, settings.value(STRIPE_PATHS, 1).toInt());
+
+    std::vector<StripeTarget> targets;
+    for (const auto &path : paths) {
+        if (static_cast<int>(targets.size()) == count) break;
+        // The current path is used even if it can't be checked, as without striping.
+        if (!targets.empty() && !writable_directory(path)) continue;
+
+        std::error_code ec;
+        auto space = fs::space(path.toStdString(), ec);
+        targets.push_back(
+            {path,
+             cached_bandwidth(path).value_or(0),
+             ec ? std::numeric_limits<std::uint64_t>::max() : space.available,
+             0}
+        );
+    }
+    return targets;
+}
+
+std::optional<double> stripe_bandwidth(const std::vector<StripeTarget> &targets)
+{
+    if (targets.empty()) return std::nullopt;
+    auto total = 0.0;
+    for (const auto &target : targets) {
+        if (target.bandwidth <= 0) return std::nullopt;
+        total += target.bandwidth;
+    }
+    return total;
+}
+
+std::vector<std::size_t> assign_cameras(
+    const std::vector<std::uint64_t> &bitrates, std::vector<StripeTarget> &targets
+)
+{
+    std::vector<std::size_t> assignment(bitrates.size(), 0);
+    if (targets.size() < 2) return assignment;
+
+    auto measured = 0;
+    auto measured_sum = 0.0;
+    for (const auto &target : targets) {
+        if (target.bandwidth <= 0) continue;
+        ++measured;
+        measured_sum += target.bandwidth;
+    }
+    auto fallback = measured > 0 ? measured_sum / measured : 1.0;
+    auto bandwidth = [&](const StripeTarget &target) {
+        return target.bandwidth > 0 ? target.bandwidth : fallback;
+    };
+
+    std::vector<std::size_t> order(bitrates.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+        return bitrates[a] > bitrates[b];
+    });
+
+    for (auto camera : order) {
+        auto best = std::size_t{0};
+        auto best_fills = true;
+        auto best_load = std::numeric_limits<double>::max();
+        for (std::size_t i = 0; i < targets.size(); ++i) {
+            auto load = targets[i].load + bitrates[camera];
+            auto fills = static_cast<double>(targets[i].free) <
+                         static_cast<double>(load) * FULL_HORIZON_SECONDS;
+            auto relative = static_cast<double>(load) / bandwidth(targets[i]);
+            if (std::tie(fills, relative) < std::tie(best_fills, best_load)) {
+                best = i;
+                best_fills = fills;
+                best_load = relative;
+            }
+        }
+        assignment[camera] = best;
+        targets[best].load += bitrates[camera];
+    }
+    return assignment;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+// Spreads the cameras of one recording over several save paths, so the disks behind them
+// add up their bandwidth.
+
+struct StripeTarget {
+    QString path;
+    double bandwidth;    // MB/s measured by the storage probe, 0 if never measured
+    std::uint64_t free;  // bytes
+    std::uint64_t load;  // bytes per second of the cameras assigned so far
+};
+
+// The save paths a recording may use: the "stripe_paths" most recent save paths that are
+// writable directories, always including the current one.
+std::vector<StripeTarget> stripe_targets();
+
+// Combined bandwidth of the targets in MB/s, if every one of them has been measured.
+std::optional<double> stripe_bandwidth(const std::vector<StripeTarget> &targets);
+
+// Picks a target for each bitrate, returning target indices in the order of bitrates. The
+// largest cameras go first, each to the target it would load the least relative to its
+// bandwidth; targets it would fill within an hour are only used when every target would.
+// Unmeasured targets are taken to be as fast as the average measured one.
+std::vector<std::size_t> assign_cameras(
+    const std::vector<std::uint64_t> &bitrates, std::vector<StripeTarget> &targets
+);
\ No newline at end of file
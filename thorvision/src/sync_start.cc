@@ -0,0 +1,111 @@
+#include "sync_start.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+#include "sidecar_writer.h"
+
+
+SyncStart::SyncStart(std::uint64_t tick_rate)
+    : _tick_rate(tick_rate), _remaining(0)
+{
+}
+
+void SyncStart::commit(const std::vector<Camera> &cameras)
+{
+    if (cameras.empty()) return;
+    {
+        std::lock_guard lock(_mutex);
+        for (const auto &camera : cameras) _names.push_back(camera.name);
+        _clock_times.assign(cameras.size(), GST_CLOCK_TIME_NONE);
+        _ticks.assign(cameras.size(), std::nullopt);
+        _remaining = cameras.size();
+    }
+
+    auto pre_record_time = std::min_element(cameras.begin(), cameras.end(), [](auto &a, auto &b) {
+                               return a.pre_record_time < b.pre_record_time;
+                           })->pre_record_time;
+    auto by_tick = _tick_rate > 0 && std::all_of(cameras.begin(), cameras.end(), [](auto &camera) {
+        return camera.last_tick > 0;
+    });
+    auto self = shared_from_this();
+
+    auto first_frame = [self](std::size_t camera, GstElement *pipeline) {
+        auto base_time = gst_element_get_base_time(pipeline);
+        return [self, camera, base_time](GstBuffer *buffer, GstClockTime running_time) {
+            auto metadata = frame_metadata(buffer);
+            self->first_frame(
+                camera,
+                base_time + running_time,
+                metadata ? std::optional(metadata->fpga_timestamp) : std::nullopt
+            );
+        };
+    };
+
+    if (by_tick) {
+        auto newest = std::max_element(cameras.begin(), cameras.end(), [](auto &a, auto &b) {
+                          return a.last_tick < b.last_tick;
+                      })->last_tick;
+        auto tick = newest + MARGIN * _tick_rate / GST_SECOND;
+        auto pre_record_tick = tick - std::min<std::uint64_t>(tick, pre_record_time * _tick_rate);
+        spdlog::info("Starting {} cameras at FPGA timestamp {}", cameras.size(), tick);
+        for (std::size_t i = 0; i < cameras.size(); ++i) {
+            cameras[i].gate->open_at_tick(
+                tick, pre_record_tick, first_frame(i, cameras[i].pipeline)
+            );
+        }
+        return;
+    }
+
+    // Every pipeline uses the system clock, so one clock time is the same moment on all.
+    auto clock = gst_system_clock_obtain();
+    auto boundary = gst_clock_get_time(clock) + MARGIN;
+    gst_object_unref(clock);
+    spdlog::info("Starting {} cameras at clock time {}", cameras.size(), boundary);
+    for (std::size_t i = 0; i < cameras.size(); ++i) {
+        auto base_time = gst_element_get_base_time(cameras[i].pipeline);
+        auto start = boundary > base_time ? boundary - base_time : 0;
+        auto pre_record_start =
+            start - std::min<GstClockTime>(start, pre_record_time * GST_SECOND);
+        cameras[i].gate->open_at_running_time(
+            start, pre_record_start, first_frame(i, cameras[i].pipeline)
+        );
+    }
+}
+
+void SyncStart::first_frame(
+    std::size_t camera, GstClockTime clock_time, std::optional<std::uint64_t> tick
+)
+{
+    std::lock_guard lock(_mutex);
+    _clock_times[camera] = clock_time;
+    _ticks[camera] = tick;
+    spdlog::debug(
+        "Camera '{}' recording starts at clock time {}, FPGA timestamp {}",
+        _names[camera],
+        clock_time,
+        tick.value_or(0)
+    );
+    if (--_remaining > 0) return;
+
+    auto [earliest, latest] = std::minmax_element(_clock_times.begin(), _clock_times.end());
+    auto clock_skew = (*latest - *earliest) / GST_USECOND;
+    auto have_ticks =
+        std::all_of(_ticks.begin(), _ticks.end(), [](auto &tick) { return tick.has_value(); });
+    if (_tick_rate > 0 && have_ticks) {
+        auto [first, last] = std::minmax_element(_ticks.begin(), _ticks.end());
+        auto tick_skew = (**last - **first) * 1'000'000 / _tick_rate;
+        spdlog::info(
+            "{} cameras started recording within {} us of FPGA time and {} us of clock time",
+            _names.size(),
+            tick_skew,
+            clock_skew
+        );
+    } else {
+        spdlog::info(
+            "{} cameras started recording within {} us of clock time", _names.size(), clock_skew
+        );
+    }
+}
\ No newline at end of file
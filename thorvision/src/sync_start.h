@@ -0,0 +1,61 @@
+#pragma once
+
+#include <gst/gstclock.h>
+#include <gst/gstelement.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "recording_gate.h"
+
+
+// Starts the recordings of several cameras on corresponding frames. Every camera's branch
+// is first built behind a shut RecordingGate, which takes as long as it takes; commit() then
+// opens all the gates on one boundary. The start skew the first recorded frames actually
+// show is logged once every camera has recorded one.
+class SyncStart : public std::enable_shared_from_this<SyncStart>
+{
+public:
+    struct Camera {
+        std::string name;
+        std::shared_ptr<RecordingGate> gate;
+        GstElement *pipeline;
+        // Newest FPGA timestamp seen on the camera; 0 if it has no XDAQ metadata.
+        std::uint64_t last_tick;
+        unsigned int pre_record_time;  // s
+    };
+
+    // How far past the newest frame the boundary is put, so every gate is armed before any
+    // camera reaches it.
+    static auto constexpr MARGIN = 100 * GST_MSECOND;
+
+    // tick_rate is in FPGA ticks per second, or 0 if it isn't known.
+    explicit SyncStart(std::uint64_t tick_rate);
+
+    // The boundary is an FPGA timestamp when every camera has XDAQ metadata and the tick rate
+    // is known, since the cameras' pipelines don't share a running time, and a time on the
+    // system clock all pipelines run on otherwise. A clock time is turned into each
+    // pipeline's running time, and each gate maps that to PTS through its branch's segment,
+    // so a camera whose PTS don't start at its base time still starts on the boundary.
+    // Pre-record frames are trimmed to the shortest pre-record time of the cameras, so the
+    // files still begin on corresponding frames.
+    void commit(const std::vector<Camera> &cameras);
+
+private:
+    // Streaming threads.
+    void first_frame(
+        std::size_t camera, GstClockTime clock_time, std::optional<std::uint64_t> tick
+    );
+
+    const std::uint64_t _tick_rate;
+    std::mutex _mutex;
+    std::vector<std::string> _names;
+    std::vector<GstClockTime> _clock_times;
+    std::vector<std::optional<std::uint64_t>> _ticks;
+    std::size_t _remaining;
+};
\ No newline at end of file
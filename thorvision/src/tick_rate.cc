@@ -0,0 +1,24 @@
+#include "tick_rate.h"
+
+#include <cmath>
+#include <limits>
+
+
+void TickRateMeter::add(std::uint64_t pts, std::uint64_t tick)
+{
+    if (pts == std::numeric_limits<std::uint64_t>::max()) return;
+
+    // The PTS goes backwards when the stream restarts, the counter when the acquisition does.
+    // The rate measured so far is kept, since the sample rate rarely changes in between.
+    if (!_has_base || pts < _base_pts || tick < _base_tick) {
+        _has_base = true;
+        _base_pts = pts;
+        _base_tick = tick;
+        return;
+    }
+
+    auto span = pts - _base_pts;
+    if (span < MIN_SPAN) return;
+    auto rate = static_cast<double>(tick - _base_tick) * 1e9 / static_cast<double>(span);
+    _rate.store(static_cast<std::uint64_t>(std::llround(rate)), std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+
+// Ticks per second of XDAQFrameData::fpga_timestamp, measured against the PTS of the frames
+// that carry it. The FPGA counts at the acquisition's sample rate, which ThorVision isn't told,
+// so the rate is taken from the stream unless the fpga_timestamp_rate setting overrides it.
+// One thread adds the frames; any thread may read the rate.
+class TickRateMeter
+{
+public:
+    // Frames have to span this much PTS before there is a rate; it keeps improving after.
+    static auto constexpr MIN_SPAN = 2'000'000'000ull;  // ns
+
+    // Streaming thread only. pts is in nanoseconds, as GstClockTime.
+    void add(std::uint64_t pts, std::uint64_t tick);
+
+    // Ticks per second, rounded; 0 until frames have spanned MIN_SPAN.
+    std::uint64_t ticks_per_second() const { return _rate.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::uint64_t> _rate{0};
+    bool _has_base = false;
+    std::uint64_t _base_pts = 0;
+    std::uint64_t _base_tick = 0;
+};
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "trigger_config.h"
+
+#include <spdlog/spdlog.h>
+
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+auto constexpr CONTINUOUS = "continuous";
+auto constexpr TRIGGER_ON = "trigger_on";
+auto constexpr DIGITAL_CHANNEL = "digital_channel";
+auto constexpr TRIGGER_CONDITION = "trigger_condition";
+auto constexpr TRIGGER_DURATION = "trigger_duration";
+auto constexpr PRE_RECORD_TIME = "pre_record_time";
+auto constexpr PRE_RECORD_SIZE = "pre_record_size";
+auto constexpr TRIGGER_DEBOUNCE = "trigger_debounce";
+auto constexpr FPGA_TIMESTAMP_RATE = "fpga_timestamp_rate";
+
+auto constexpr MAX_SIZE_TIME = "max_size_time";
+auto constexpr MAX_FILES = "max_files";
+auto constexpr ALIGNED_SPLITS = "aligned_splits";
+
+auto constexpr SAVE_PATHS = "save_paths";
+auto constexpr DIR_DATE = "dir_date";
+auto constexpr DIR_NAME = "dir_name";
+auto constexpr INLINE_METADATA = "inline_metadata";
+auto constexpr RECORDING_SINK = "recording_sink";
+auto constexpr PREALLOCATE = "recording_preallocate";
+auto constexpr DIRECT_IO = "recording_direct_io";
+auto constexpr FRAME_INDEX = "frame_index";
+auto constexpr RAW_RECORDING = "raw_recording";
+auto constexpr PARALLEL_JPEG = "parallel_jpeg";
+auto constexpr JPEG_ENCODER_THREADS = "jpeg_encoder_threads";
+
+// Config slots of the open stream windows. Only touched on the UI thread.
+std::vector<TriggerConfigSlot *> registered;
+}  // namespace
+
+
+TriggerConfig TriggerConfig::load(const std::string &camera_name)
+{
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    TriggerConfig config;
+    config.version = 0;
+    config.continuous = settings.value(CONTINUOUS, true).toBool();
+    config.max_size_time = settings.value(MAX_SIZE_TIME, 0).toInt();
+    config.max_files = settings.value(MAX_FILES, 10).toInt();
+    config.aligned_splits = settings.value(ALIGNED_SPLITS, true).toBool();
+    config.save_path = settings.value(SAVE_PATHS).toStringList().value(
+        0, QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
+    );
+    config.dir_date = settings.value(DIR_DATE, true).toBool();
+    config.dir_name = settings.value(DIR_NAME).toString();
+    config.inline_metadata = settings.value(INLINE_METADATA, false).toBool();
+    config.recording_sink = settings.value(RECORDING_SINK, false).toBool();
+    config.preallocate = settings.value(PREALLOCATE, 256).toUInt();
+    config.direct_io = settings.value(DIRECT_IO, false).toBool();
+    config.frame_index = settings.value(FRAME_INDEX, true).toBool();
+    config.raw_recording = settings.value(RAW_RECORDING, false).toBool();
+    config.parallel_jpeg = settings.value(PARALLEL_JPEG, true).toBool();
+    config.jpeg_encoder_threads = settings.value(JPEG_ENCODER_THREADS, 0).toUInt();
+    config.tick_rate = settings.value(FPGA_TIMESTAMP_RATE, 0).toULongLong();
+    config.debounce_ms = settings.value(TRIGGER_DEBOUNCE, 0).toUInt();
+
+    settings.beginGroup(QString::fromStdString(camera_name));
+    config.trigger_on = settings.value(TRIGGER_ON, true).toBool();
+    config.digital_channel = settings.value(DIGITAL_CHANNEL, 0).toUInt();
+    config.trigger_condition = settings.value(TRIGGER_CONDITION, 0).toUInt();
+    config.trigger_duration = settings.value(TRIGGER_DURATION, 1).toUInt();
+    config.pre_record_time = settings.value(PRE_RECORD_TIME, 0).toUInt();
+    config.pre_record_size = settings.value(PRE_RECORD_SIZE, 256).toUInt();
+    settings.endGroup();
+    return config;
+}
+
+TriggerEngine::Settings TriggerConfig::engine(std::uint64_t ticks_per_second) const
+{
+    TriggerEngine::Settings engine;
+    engine.condition = static_cast<TriggerEngine::Condition>(std::min(trigger_condition, 2u));
+    engine.channel_mask = TriggerEngine::channel_mask(digital_channel);
+    engine.debounce_ticks = std::uint64_t{debounce_ms} * ticks_per_second / 1000;
+    engine.on_for_ticks = std::uint64_t{trigger_duration} * ticks_per_second;
+    return engine;
+}
+
+
+TriggerConfigSlot::Snapshot::Snapshot(Snapshot &&other) noexcept
+    : _readers(std::exchange(other._readers, nullptr)), _config(other._config)
+{
+}
+
+TriggerConfigSlot::Snapshot::~Snapshot()
+{
+    if (_readers) _readers->fetch_sub(1, std::memory_order_release);
+}
+
+
+TriggerConfigSlot::TriggerConfigSlot(const std::string &camera_name)
+    : _camera_name(camera_name), _published(0), _current(nullptr), _readers{}, _epoch(0)
+{
+    reload();
+    registered.push_back(this);
+}
+
+TriggerConfigSlot::~TriggerConfigSlot()
+{
+    registered.erase(std::remove(registered.begin(), registered.end(), this), registered.end());
+    // Readers are gone with the stream window that owned the slot.
+    delete _current.load(std::memory_order_relaxed);
+    for (auto &retired : _retired) delete retired.config;
+}
+
+TriggerConfigSlot::Snapshot TriggerConfigSlot::get() const
+{
+    // Counted before the load, so reload() can't free what is loaded. seq_cst orders the
+    // increment before the load against reload()'s exchange and counter checks.
+    auto &readers = _readers[_epoch.load(std::memory_order_relaxed) & 1];
+    readers.fetch_add(1, std::memory_order_seq_cst);
+    return Snapshot(&readers, _current.load(std::memory_order_seq_cst));
+}
+
+void TriggerConfigSlot::reload()
+{
+    auto config = new TriggerConfig(TriggerConfig::load(_camera_name));
+    config->version = ++_published;
+    if (auto replaced = _current.exchange(config, std::memory_order_seq_cst)) {
+        _retired.push_back({replaced, _epoch.load(std::memory_order_relaxed)});
+    }
+    collect();
+    spdlog::debug("Published trigger config of camera {}", _camera_name);
+}
+
+void TriggerConfigSlot::collect()
+{
+    // Only reload() moves the epoch; a reader that keeps a counter busy just defers the
+    // snapshots to the next reload.
+    for (auto moves = 0; moves < 2 && !_retired.empty(); ++moves) {
+        auto epoch = _epoch.load(std::memory_order_relaxed);
+        if (_readers[(epoch + 1) & 1].load(std::memory_order_seq_cst) != 0) break;
+        _epoch.store(epoch + 1, std::memory_order_seq_cst);
+    }
+    auto epoch = _epoch.load(std::memory_order_relaxed);
+    std::erase_if(_retired, [epoch](const Retired &retired) {
+        if (epoch < retired.epoch + 2) return false;
+        delete retired.config;
+        return true;
+    });
+}
+
+void TriggerConfigSlot::reload_camera(const std::string &camera_name)
+{
+    for (auto slot : registered) {
+        if (slot->_camera_name == camera_name) slot->reload();
+    }
+}
+
+void TriggerConfigSlot::reload_all()
+{
+    for (auto slot : registered) slot->reload();
+}
\ No newline at end of file
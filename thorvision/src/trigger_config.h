@@ -0,0 +1,130 @@
+#pragma once
+
+#include <QString>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "trigger_engine.h"
+
+
+// Everything the streaming thread needs to decide whether and where to record, read from
+// QSettings once instead of on every frame.
+struct TriggerConfig {
+    // Tells the snapshots of one slot apart; the first it publishes is 1.
+    std::uint64_t version;
+
+    // Global record settings.
+    bool continuous;
+    int max_size_time;
+    int max_files;
+    // In split mode, cut every camera's fragments on common FPGA timestamp boundaries.
+    bool aligned_splits;
+    QString save_path;
+    bool dir_date;
+    QString dir_name;
+    // Write each JPEG fragment's metadata .bin while recording instead of parsing it after.
+    bool inline_metadata;
+    // Write fragments through thorrecordingsink instead of splitmuxsink's filesink.
+    bool recording_sink;
+    unsigned int preallocate;  // MB per fragment
+    bool direct_io;
+    // Write a .idx of frame offsets next to each fragment, through either sink.
+    bool frame_index;
+    // Record raw camera video losslessly as .y4m segments instead of through xvc.
+    bool raw_recording;
+    // Otherwise encode it to JPEG on thorjpegenc's thread pool; 0 threads is one per core.
+    bool parallel_jpeg;
+    unsigned int jpeg_encoder_threads;
+    // Ticks per second of XDAQFrameData::fpga_timestamp from the fpga_timestamp_rate setting,
+    // or 0 to measure it from the stream, see TickRateMeter.
+    std::uint64_t tick_rate;
+    unsigned int debounce_ms;
+
+    // Settings of the camera's group.
+    bool trigger_on;
+    unsigned int digital_channel;
+    unsigned int trigger_condition;
+    unsigned int trigger_duration;
+    // Frames kept from before a recording starts; zero seconds disables it.
+    unsigned int pre_record_time;
+    unsigned int pre_record_size;  // MB
+
+    // The trigger settings above, with durations converted to FPGA timestamp ticks.
+    TriggerEngine::Settings engine(std::uint64_t ticks_per_second) const;
+
+    static TriggerConfig load(const std::string &camera_name);
+};
+
+
+// The current TriggerConfig of one camera. The UI thread publishes a new immutable snapshot
+// whenever a setting changes; readers on any thread pin the current one with an atomic
+// increment and a load, never a lock. A replaced snapshot is freed on a later reload, once
+// every reader that could have pinned it has let go.
+class TriggerConfigSlot
+{
+public:
+    // Keeps a snapshot alive. Hold it for one callback or call, not across them.
+    class Snapshot
+    {
+    public:
+        Snapshot(Snapshot &&other) noexcept;
+        Snapshot &operator=(Snapshot &&) = delete;
+        ~Snapshot();
+
+        const TriggerConfig *get() const { return _config; }
+        const TriggerConfig *operator->() const { return _config; }
+        const TriggerConfig &operator*() const { return *_config; }
+
+    private:
+        friend class TriggerConfigSlot;
+        Snapshot(std::atomic<std::uint32_t> *readers, const TriggerConfig *config)
+            : _readers(readers), _config(config)
+        {
+        }
+
+        std::atomic<std::uint32_t> *_readers;
+        const TriggerConfig *_config;
+    };
+
+    explicit TriggerConfigSlot(const std::string &camera_name);
+    ~TriggerConfigSlot();
+    TriggerConfigSlot(const TriggerConfigSlot &) = delete;
+    TriggerConfigSlot &operator=(const TriggerConfigSlot &) = delete;
+
+    Snapshot get() const;
+
+    // UI thread only.
+    void reload();
+    // Reloads the slots of one camera; call after writing a setting of its group.
+    // UI thread only.
+    static void reload_camera(const std::string &camera_name);
+    // Reloads every camera that has a slot; call after writing a global setting that
+    // TriggerConfig covers. UI thread only.
+    static void reload_all();
+
+    // Replaced snapshots not freed yet, since a reader may still hold them. UI thread only.
+    std::size_t retired() const { return _retired.size(); }
+
+private:
+    struct Retired {
+        const TriggerConfig *config;
+        std::uint64_t epoch;
+    };
+
+    // Frees the replaced snapshots no reader can hold any more. UI thread only.
+    void collect();
+
+    std::string _camera_name;
+    std::uint64_t _published;
+    std::atomic<const TriggerConfig *> _current;
+    // A reader counts itself in the counter of the current epoch's parity while it holds a
+    // snapshot. The epoch only moves on once the counter it moves to is back to 0, so after
+    // two moves every reader that could have loaded a replaced snapshot is done with it.
+    mutable std::array<std::atomic<std::uint32_t>, 2> _readers;
+    std::atomic<std::uint64_t> _epoch;
+    std::vector<Retired> _retired;
+};
\ No newline at end of file
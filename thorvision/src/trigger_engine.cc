@@ -0,0 +1,73 @@
+#include "trigger_engine.h"
+
+
+TriggerEngine::Action TriggerEngine::update(std::uint32_t ttl_in, std::uint64_t fpga_timestamp)
+{
+    auto raw = (ttl_in & _settings.channel_mask) != 0;
+    auto rising = false;
+    auto falling = false;
+    if (raw == _input) {
+        _changing = false;
+    } else {
+        if (!_changing) {
+            _changing = true;
+            _changing_since = fpga_timestamp;
+        }
+        if (fpga_timestamp - _changing_since >= _settings.debounce_ticks) {
+            _input = raw;
+            _changing = false;
+            rising = raw;
+            falling = !raw;
+        }
+    }
+
+    auto start = [this, fpga_timestamp] {
+        _recording = true;
+        _started_at = fpga_timestamp;
+        return Action::Start;
+    };
+    auto stop = [this] {
+        _recording = false;
+        return Action::Stop;
+    };
+
+    switch (_settings.condition) {
+    case Condition::Level:
+        if (rising && !_recording) return start();
+        if (falling && _recording) return stop();
+        break;
+    case Condition::Toggle:
+        if (rising) return _recording ? stop() : start();
+        break;
+    case Condition::OnFor:
+        if (_recording) {
+            // The FPGA counter restarts with the acquisition; measure from there on.
+            if (fpga_timestamp < _started_at) _started_at = fpga_timestamp;
+            if (fpga_timestamp - _started_at >= _settings.on_for_ticks) return stop();
+        } else if (rising) {
+            return start();
+        }
+        break;
+    }
+    return Action::None;
+}
+
+void TriggerEngine::reset()
+{
+    _input = false;
+    _changing = false;
+    _changing_since = 0;
+    _recording = false;
+    _started_at = 0;
+}
+
+std::uint32_t TriggerEngine::mask_from_channel_number(std::uint32_t ttl_in)
+{
+    if (ttl_in < 1 || ttl_in > 32) return 0;
+    return 1u << (ttl_in - 1);
+}
+
+std::uint32_t TriggerEngine::channel_mask(unsigned int digital_channel)
+{
+    return digital_channel < 32 ? 1u << digital_channel : 0;
+}
\ No newline at end of file
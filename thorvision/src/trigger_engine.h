@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Decides when a TTL-triggered recording starts and stops, one frame at a time.
+// Plain state machine without Qt or GStreamer, so it can be driven by synthetic metadata.
+class TriggerEngine
+{
+public:
+    // Same order as the trigger condition combo box.
+    enum class Condition { Level = 0, Toggle = 1, OnFor = 2 };
+    enum class Action { None, Start, Stop };
+
+    struct Settings {
+        Condition condition = Condition::Level;
+        // Bit n is DI n + 1; the trigger is active while any selected input is high.
+        std::uint32_t channel_mask = 1;
+        // An input change has to persist this many FPGA ticks before it counts as an edge.
+        std::uint64_t debounce_ticks = 0;
+        // Recording length for Condition::OnFor, in FPGA ticks.
+        std::uint64_t on_for_ticks = 0;
+
+        bool operator==(const Settings &) const = default;
+    };
+
+    TriggerEngine() = default;
+
+    // Keeps the input and recording state, so a settings change doesn't cut a recording.
+    void set_settings(const Settings &settings) { _settings = settings; }
+    const Settings &settings() const { return _settings; }
+
+    // Feeds one frame: the TTL inputs as a bitmask and the frame's FPGA timestamp.
+    Action update(std::uint32_t ttl_in, std::uint64_t fpga_timestamp);
+
+    // Forgets a recording that couldn't be started or was stopped from elsewhere.
+    void cancel() { _recording = false; }
+    void reset();
+    bool recording() const { return _recording; }
+
+    // XDAQFrameData::ttl_in carries the number of the active DI (1-32), or 0 for none.
+    static std::uint32_t mask_from_channel_number(std::uint32_t ttl_in);
+    // digital_channel is the 0-based index of the DI combo box.
+    static std::uint32_t channel_mask(unsigned int digital_channel);
+
+private:
+    Settings _settings;
+
+    // Debounced input level, and when the raw input started to differ from it.
+    bool _input = false;
+    bool _changing = false;
+    std::uint64_t _changing_since = 0;
+
+    bool _recording = false;
+    std::uint64_t _started_at = 0;
+};
\ No newline at end of file
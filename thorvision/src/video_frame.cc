@@ -0,0 +1,218 @@
+#include "video_frame.h"
+
+#include <spdlog/spdlog.h>
+
+#include <utility>
+
+
+FrameRef FramePool::acquire(
+    GstSample *sample, const GstVideoInfo &info, const XDAQFrameData &metadata
+)
+{
+    for (auto &slot : _slots) {
+        auto expected = false;
+        if (!slot.busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            continue;
+        }
+
+        auto buffer = gst_sample_get_buffer(sample);
+        auto video_info = const_cast<GstVideoInfo *>(&info);
+        auto mapped = buffer && gst_video_frame_map(&slot.frame, video_info, buffer, GST_MAP_READ);
+        gst_sample_unref(sample);
+        if (!mapped) {
+            spdlog::error("Failed to map video frame");
+            slot.busy.store(false, std::memory_order_release);
+            return {};
+        }
+        slot.metadata = metadata;
+        set_rgb(slot);
+        slot.refs.store(1, std::memory_order_relaxed);
+        return FrameRef(&slot);
+    }
+
+    gst_sample_unref(sample);
+    return {};
+}
+
+void FramePool::enable_rgb_conversion(const ColourMatrix &matrix)
+{
+    _convert = true;
+    _matrix = matrix;
+}
+
+void FramePool::disable_rgb_conversion()
+{
+    _convert = false;
+}
+
+void FramePool::set_rgb(Slot &slot)
+{
+    slot.rgb = nullptr;
+    slot.rgb_stride = 0;
+    slot.rgb_format = RGBFormat::RGB888;
+
+    auto format = GST_VIDEO_FRAME_FORMAT(&slot.frame);
+    if (format == GST_VIDEO_FORMAT_RGB) {
+        auto data = GST_VIDEO_FRAME_PLANE_DATA(&slot.frame, 0);
+        slot.rgb = static_cast<const unsigned char *>(data);
+        slot.rgb_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&slot.frame, 0);
+        return;
+    }
+    if (!_convert || !can_convert_to_rgb(format)) return;
+
+    auto stride = GST_VIDEO_FRAME_WIDTH(&slot.frame) * 4;
+    slot.converted.resize(static_cast<std::size_t>(stride) * GST_VIDEO_FRAME_HEIGHT(&slot.frame));
+    convert_to_rgb(slot.frame, _matrix, slot.converted.data(), stride, RGBFormat::RGBX);
+    slot.rgb = slot.converted.data();
+    slot.rgb_stride = stride;
+    slot.rgb_format = RGBFormat::RGBX;
+}
+
+void FramePool::release(Slot *slot)
+{
+    if (slot->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+    // Last reference: unmap, which drops the buffer, before the slot is handed out again.
+    gst_video_frame_unmap(&slot->frame);
+    slot->busy.store(false, std::memory_order_release);
+}
+
+
+FrameRef::FrameRef(const FrameRef &other) : _slot(other._slot)
+{
+    if (_slot) _slot->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+FrameRef::FrameRef(FrameRef &&other) noexcept : _slot(std::exchange(other._slot, nullptr)) {}
+
+FrameRef &FrameRef::operator=(FrameRef other) noexcept
+{
+    std::swap(_slot, other._slot);
+    return *this;
+}
+
+FrameRef::~FrameRef()
+{
+    if (_slot) FramePool::release(_slot);
+}
+
+
+FrameMailbox::~FrameMailbox()
+{
+    if (auto slot = _slot.exchange(nullptr, std::memory_order_acquire)) FramePool::release(slot);
+}
+
+void FrameMailbox::post(FrameRef frame)
+{
+    _posted.fetch_add(1, std::memory_order_relaxed);
+    if (!frame) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    auto stale = _slot.exchange(std::exchange(frame._slot, nullptr), std::memory_order_acq_rel);
+    if (stale) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        FramePool::release(stale);
+    }
+}
+
+FrameRef FrameMailbox::take()
+{
+    return FrameRef(_slot.exchange(nullptr, std::memory_order_acq_rel));
+}
+
+FrameReceiver::FrameReceiver(
+    std::string name, FramePool &frames, FrameMailbox &mailbox, MetadataRing &metadata
+)
+    : _name(std::move(name)),
+      _frames(frames),
+      _mailbox(mailbox),
+      _metadata(metadata),
+      _video_caps(nullptr),
+      _rgb_frames(true),
+      _converting(false),
+      _metadata_miss_report()
+{
+    gst_video_info_init(&_video_info);
+}
+
+FrameReceiver::~FrameReceiver()
+{
+    gst_caps_replace(&_video_caps, nullptr);
+}
+
+void FrameReceiver::attach(GstAppSink *sink)
+{
+    GstAppSinkCallbacks callbacks = {nullptr, nullptr, new_sample, nullptr, nullptr, {nullptr}};
+    gst_app_sink_set_callbacks(sink, &callbacks, this, nullptr);
+}
+
+GstFlowReturn FrameReceiver::new_sample(GstAppSink *sink, gpointer user_data)
+{
+    auto receiver = static_cast<FrameReceiver *>(user_data);
+    auto sample = gst_app_sink_pull_sample(sink);
+    if (!sample) return GST_FLOW_OK;
+
+    if (!receiver->update_video_info(gst_sample_get_caps(sample))) {
+        spdlog::critical("Failed to parse video info");
+        gst_sample_unref(sample);
+        return GST_FLOW_ERROR;
+    }
+
+    auto buffer = gst_sample_get_buffer(sample);
+    auto xdaqmetadata = receiver->_metadata.find(GST_BUFFER_PTS(buffer));
+    if (!xdaqmetadata) receiver->report_metadata_miss();
+    auto metadata = xdaqmetadata.value_or(XDAQFrameData{0, 0, 0, 0, 0, 0});
+
+    // The frame keeps the buffer mapped until the UI thread has painted it. Posting
+    // replaces any frame the UI has not picked up yet, so nothing queues behind the display.
+    receiver->_mailbox.post(receiver->_frames.acquire(sample, receiver->_video_info, metadata));
+    return GST_FLOW_OK;
+}
+
+bool FrameReceiver::update_video_info(GstCaps *caps)
+{
+    // set_tiled() switched an OpenGL window between its renderer and the mosaic.
+    if (auto rgb = _rgb_frames.load(std::memory_order_relaxed); rgb != _converting) {
+        _converting = rgb;
+        gst_caps_replace(&_video_caps, nullptr);
+    }
+    if (caps == _video_caps) return true;
+    if (caps && _video_caps && gst_caps_is_equal(caps, _video_caps)) {
+        gst_caps_replace(&_video_caps, caps);
+        return true;
+    }
+    if (!caps || !gst_video_info_from_caps(&_video_info, caps)) return false;
+
+    gst_caps_replace(&_video_caps, caps);
+    if (_converting) {
+        _frames.enable_rgb_conversion(ColourMatrix::from(_video_info));
+    } else {
+        _frames.disable_rgb_conversion();
+    }
+    spdlog::info(
+        "Camera '{}' preview caps changed to {}x{} {}",
+        _name,
+        GST_VIDEO_INFO_WIDTH(&_video_info),
+        GST_VIDEO_INFO_HEIGHT(&_video_info),
+        GST_VIDEO_INFO_NAME(&_video_info)
+    );
+    return true;
+}
+
+void FrameReceiver::report_metadata_miss()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - _metadata_miss_report < std::chrono::seconds(1)) return;
+    _metadata_miss_report = now;
+
+    auto lookups = _metadata.lookups();
+    auto misses = _metadata.misses();
+    spdlog::warn(
+        "Camera '{}' has no metadata for {} of {} frames ({:.2f}%)",
+        _name,
+        misses,
+        lookups,
+        100.0 * misses / lookups
+    );
+}
\ No newline at end of file
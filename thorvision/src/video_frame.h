@@ -0,0 +1,181 @@
+#pragma once
+
+#include <gst/app/gstappsink.h>
+#include <gst/gstsample.h>
+#include <gst/video/video-frame.h>
+#include <gst/video/video-info.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "color_convert.h"
+#include "metadata_ring.h"
+#include "xdaqmetadata/metadata_handler.h"
+
+
+class FrameRef;
+class FrameMailbox;
+
+
+// Fixed set of mapped frames shared between the streaming thread and the UI thread.
+// A slot keeps the sample's buffer mapped until the last FrameRef to it is dropped, so
+// paintEvent can read GStreamer's memory directly without copying pixels. The sample itself
+// is let go at once, so appsink can reuse it for the next buffer instead of copying it.
+class FramePool
+{
+public:
+    // One frame being painted, one waiting for the UI thread and one being filled.
+    static auto constexpr SLOTS = 4;
+
+    FramePool() = default;
+    ~FramePool() = default;
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // Takes ownership of the sample reference. Returns an empty FrameRef if the buffer
+    // can't be mapped or every slot is still in use.
+    FrameRef acquire(GstSample *sample, const GstVideoInfo &info, const XDAQFrameData &metadata);
+
+    // Streaming thread only. Once set, YUV frames are converted to RGBX in acquire() using
+    // the matrix of the current caps, so FrameRef::rgb() is available for every frame.
+    void enable_rgb_conversion(const ColourMatrix &matrix);
+    // Streaming thread only. Leaves YUV frames for a renderer that converts them itself.
+    void disable_rgb_conversion();
+
+private:
+    friend class FrameRef;
+    friend class FrameMailbox;
+
+    struct Slot {
+        std::atomic_bool busy{false};
+        std::atomic_int refs{0};
+        // Holds a reference to the buffer while mapped.
+        GstVideoFrame frame{};
+        XDAQFrameData metadata{};
+
+        // Points into frame for RGB frames, into converted for YUV ones, else null.
+        const unsigned char *rgb = nullptr;
+        int rgb_stride = 0;
+        RGBFormat rgb_format = RGBFormat::RGB888;
+        // Reused across frames; only reallocated when the frame size grows.
+        std::vector<unsigned char> converted;
+    };
+
+    void set_rgb(Slot &slot);
+    static void release(Slot *slot);
+
+    std::array<Slot, SLOTS> _slots;
+    bool _convert = false;
+    ColourMatrix _matrix{};
+};
+
+
+class FrameRef
+{
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef &other);
+    FrameRef(FrameRef &&other) noexcept;
+    FrameRef &operator=(FrameRef other) noexcept;
+    ~FrameRef();
+
+    explicit operator bool() const { return _slot != nullptr; }
+
+    const GstVideoFrame &frame() const { return _slot->frame; }
+    GstVideoFormat format() const { return GST_VIDEO_FRAME_FORMAT(&_slot->frame); }
+    int width() const { return GST_VIDEO_FRAME_WIDTH(&_slot->frame); }
+    int height() const { return GST_VIDEO_FRAME_HEIGHT(&_slot->frame); }
+    const unsigned char *data(int plane = 0) const
+    {
+        auto data = GST_VIDEO_FRAME_PLANE_DATA(&_slot->frame, plane);
+        return static_cast<const unsigned char *>(data);
+    }
+    int stride(int plane = 0) const { return GST_VIDEO_FRAME_PLANE_STRIDE(&_slot->frame, plane); }
+    GstClockTime pts() const { return GST_BUFFER_PTS(_slot->frame.buffer); }
+    const XDAQFrameData &metadata() const { return _slot->metadata; }
+
+    // Packed RGB pixels of the frame, or null if it is YUV and the pool doesn't convert.
+    const unsigned char *rgb() const { return _slot->rgb; }
+    int rgb_stride() const { return _slot->rgb_stride; }
+    RGBFormat rgb_format() const { return _slot->rgb_format; }
+
+private:
+    friend class FramePool;
+    friend class FrameMailbox;
+    explicit FrameRef(FramePool::Slot *slot) : _slot(slot) {}
+
+    FramePool::Slot *_slot = nullptr;
+};
+
+
+// Lock-free single-slot handoff of the newest frame from the streaming thread to the UI.
+// A frame that is overwritten before the UI takes it is released and counted as dropped.
+class FrameMailbox
+{
+public:
+    FrameMailbox() = default;
+    ~FrameMailbox();
+    FrameMailbox(const FrameMailbox &) = delete;
+    FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+    void post(FrameRef frame);
+    // Returns an empty FrameRef if nothing new was posted since the last take().
+    FrameRef take();
+
+    std::uint64_t posted() const { return _posted.load(std::memory_order_relaxed); }
+    std::uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<FramePool::Slot *> _slot{nullptr};
+    std::atomic<std::uint64_t> _posted{0};
+    std::atomic<std::uint64_t> _dropped{0};
+};
+
+// The appsink end of the preview: maps each sample into a FramePool slot with the XDAQ
+// metadata of its frame and posts it to a FrameMailbox. Caps are re-parsed only when they
+// change, so a steady stream neither allocates nor copies pixels on the streaming thread.
+class FrameReceiver
+{
+public:
+    // name is the camera's, for the log.
+    FrameReceiver(
+        std::string name, FramePool &frames, FrameMailbox &mailbox, MetadataRing &metadata
+    );
+    ~FrameReceiver();
+    FrameReceiver(const FrameReceiver &) = delete;
+    FrameReceiver &operator=(const FrameReceiver &) = delete;
+
+    // Makes new_sample the appsink's callback.
+    void attach(GstAppSink *sink);
+    // The appsink's new-sample callback, with the receiver as user data.
+    static GstFlowReturn new_sample(GstAppSink *sink, gpointer receiver);
+
+    // Whether frames are converted to RGB for QPainter; taken up with the next frame.
+    void set_rgb_frames(bool rgb) { _rgb_frames.store(rgb, std::memory_order_relaxed); }
+
+    // Streaming thread only: re-parses the caps only when they change.
+    bool update_video_info(GstCaps *caps);
+    const GstVideoInfo &video_info() const { return _video_info; }
+
+private:
+    // Warns, at most once a second, about frames drawn without metadata.
+    void report_metadata_miss();
+
+    const std::string _name;
+    FramePool &_frames;
+    FrameMailbox &_mailbox;
+    MetadataRing &_metadata;
+
+    GstCaps *_video_caps;
+    GstVideoInfo _video_info;
+    // Whether _frames converts to RGB: always without OpenGL, and with it while the mosaic
+    // paints the frames. _converting is the streaming thread's copy.
+    std::atomic_bool _rgb_frames;
+    bool _converting;
+
+    std::chrono::steady_clock::time_point _metadata_miss_report;
+};
\ No newline at end of file
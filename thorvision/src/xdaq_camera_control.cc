@@ -14,19 +14,22 @@
 #include <QListWidget>
 #include <QMessageBox>
 #include <QSettings>
-#include <QStandardPaths>
 #include <QString>
 #include <QTimer>
 #include <QWidget>
 #include <algorithm>
-#include <future>
+#include <memory>
 #include <nlohmann/json.hpp>
-#include <thread>
 
 #include "camera_item_widget.h"
+#include "post_processing_pool.h"
 #include "record_confirm_dialog.h"
 #include "record_settings.h"
+#include "recording_manifest.h"
 #include "server_status_indicator.h"
+#include "storage_probe.h"
+#include "stripe_planner.h"
+#include "sync_start.h"
 #include "xdaqvc/xvc.h"
 
 
@@ -39,7 +42,6 @@ auto constexpr CONTINUOUS = "continuous";
 auto constexpr MAX_SIZE_TIME = "max_size_time";
 auto constexpr MAX_FILES = "max_files";
 
-auto constexpr SAVE_PATHS = "save_paths";
 auto constexpr DIR_DATE = "dir_date";
 auto constexpr DIR_NAME = "dir_name";
 
@@ -142,6 +144,7 @@ XDAQCameraControl::XDAQCameraControl()
       _record_settings(nullptr),
       _elapsed_time(0),
       _recording(false),
+      _draining(0),
       _skip_dialog(false)
 {
     spdlog::info("Creating StreamMainWindow.");
@@ -205,7 +208,10 @@ XDAQCameraControl::XDAQCameraControl()
     main_layout->addWidget(settings_button, 1, 2, Qt::AlignRight);
     main_layout->addWidget(_camera_list, 2, 0, 2, 3);
 
-    _ws_client = std::make_unique<xvc::ws_client>([this](const std::string &event) {
+    _ws_client = std::make_unique<xvc::ws_client>([=, this](const std::string &event) {
+        // Device events double as heartbeats from the server.
+        server_status_indicator->notify_activity();
+
         auto const device_event = json::parse(event);
         auto const event_type = device_event[EVENT_TYPE];
         auto const camera_json = device_event[CAMERA];
@@ -265,7 +271,18 @@ XDAQCameraControl::XDAQCameraControl()
         );
     });
     connect(_record_button, &QPushButton::clicked, [this]() mutable {
-        if (!_skip_dialog && !_recording) {
+        std::uint64_t bytes_per_second = 0;
+        if (!_recording) {
+            for (auto window : _stream_mainwindow->findChildren<StreamWindow *>()) {
+                bytes_per_second += window->recording_bitrate();
+            }
+        }
+        // Skipping the dialog doesn't skip a save path that can't keep up.
+        auto over_bandwidth =
+            !_recording && _skip_dialog &&
+            BandwidthCheck::evaluate(stripe_bandwidth(stripe_targets()), bytes_per_second)
+                    .verdict == BandwidthCheck::Verdict::Block;
+        if ((!_skip_dialog || over_bandwidth) && !_recording) {
             auto specs = QString::fromStdString("");
             for (auto [_, item] : _camera_item_map) {
                 auto widget = qobject_cast<CameraItemWidget *>(_camera_list->itemWidget(item));
@@ -275,7 +292,7 @@ XDAQCameraControl::XDAQCameraControl()
                 }
             }
 
-            RecordConfirmDialog dialog(specs);
+            RecordConfirmDialog dialog(specs, bytes_per_second);
             if (dialog.exec() == QMessageBox::Accepted) {
                 _skip_dialog = dialog.dont_ask_again() ? true : false;
                 record();
@@ -300,55 +317,17 @@ void XDAQCameraControl::record()
         _record_button->setText(tr("STOP"));
         _camera_list->setDisabled(true);
 
-        QSettings settings("KonteX Neuroscience", "Thor Vision");
-        auto continuous = settings.value(CONTINUOUS, true).toBool();
-        auto max_size_time = settings.value(MAX_SIZE_TIME, 10).toInt();
-        auto max_files = settings.value(MAX_FILES, 10).toInt();
-
-        auto save_path =
-            settings
-                .value(
-                    SAVE_PATHS, QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation)
-                )
-                .toStringList()
-                .first();
-        auto dir_name = settings.value(DIR_DATE, true).toBool()
-                            ? QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss")
-                            : settings.value(DIR_NAME).toString();
-        _start_record_dir_path = fs::path(save_path.toStdString()) / dir_name.toStdString();
-
-        // TODO: Duplicate the directory creation code from stream_window.cc here.
-        // This is for the record button press,
-        // whereas the code in stream_window.cc is used in the callback for a DDS trigger.
-        if (!fs::exists(_start_record_dir_path)) {
-            spdlog::info("create_directory = {}", _start_record_dir_path.generic_string());
-            std::error_code ec;
-            if (!fs::create_directories(_start_record_dir_path, ec)) {
-                spdlog::info(
-                    "Failed to create directory: {}. Error: {}",
-                    _start_record_dir_path.generic_string(),
-                    ec.message()
-                );
-            }
-        }
-
-        for (auto window : _stream_mainwindow->findChildren<StreamWindow *>()) {
-            auto filepath = _start_record_dir_path /
-                            fmt::format("{}-{}", window->_camera->name(), window->_camera->id());
-
-            if (window->_camera->current_cap().find(VIDEO_MJPEG) != std::string::npos ||
-                window->_camera->current_cap().find(VIDEO_RAW) != std::string::npos) {
-                xvc::start_jpeg_recording(
-                    GST_PIPELINE(window->_pipeline.get()),
-                    filepath,
-                    continuous,
-                    max_size_time,
-                    max_files
-                );
-            } else {
-                // TODO: disable h265 for now
-                window->start_h265_recording(filepath, continuous, max_size_time, max_files);
-            }
+        // A branch armed for a trigger would take the place of this recording's. It is stopped
+        // off the UI thread, so the recording starts once every camera is done stopping.
+        auto windows = _stream_mainwindow->findChildren<StreamWindow *>();
+        for (auto window : windows) window->hold_trigger(true);
+        _record_button->setEnabled(false);
+        if (windows.isEmpty()) start_recording();
+        auto stopping = std::make_shared<qsizetype>(windows.size());
+        for (auto window : windows) {
+            window->after_stops([this, stopping]() {
+                if (--*stopping == 0) start_recording();
+            });
         }
     } else {
         _recording = false;
@@ -357,74 +336,167 @@ void XDAQCameraControl::record()
         _timer->stop();
         _camera_list->setDisabled(false);
 
-        auto open_video_folder =
-            QSettings("KonteX Neuroscience", "Thor Vision").value(OPEN_VIDEO_FOLDER, true).toBool();
-
-        for (auto window : _stream_mainwindow->findChildren<StreamWindow *>()) {
-            if (window->_camera->current_cap().find(VIDEO_MJPEG) != std::string::npos ||
-                window->_camera->current_cap().find(VIDEO_RAW) != std::string::npos) {
-                xvc::stop_jpeg_recording(GST_PIPELINE(window->_pipeline.get()));
-
-                // Create promise/future pair to track completion
-                std::promise<void> promise;
-                std::future<void> future = promise.get_future();
-
-                _gstreamer_handler_threads.emplace_back(
-                    std::thread([window, promise = std::move(promise)]() mutable {
-                        xvc::stop_jpeg_recording(GST_PIPELINE(window->_pipeline.get()));
-                        promise.set_value();
-                    }),
-                    std::move(future)
-                );
-
-                if (open_video_folder) {
-                    auto directory =
-                        QFileInfo(QString::fromStdString(_start_record_dir_path.generic_string()))
-                            .filePath();
-                    QDesktopServices::openUrl(QUrl::fromLocalFile(directory));
-                }
+        // Every camera drains on its own thread, after whatever it is still stopping, and REC
+        // comes back when all of them have.
+        auto windows = _stream_mainwindow->findChildren<StreamWindow *>();
+        _draining = windows.size();
+        for (auto window : windows) {
+            window->stop_recording_async([this]() { recording_drained(); });
+        }
+        if (windows.isEmpty()) recording_drained();
+    }
+}
 
-            } else {
-                // TODO: disable h265 for now
-                xvc::stop_h265_recording(GST_PIPELINE(window->_pipeline.get()));
-            }
+void XDAQCameraControl::start_recording()
+{
+    _record_button->setEnabled(true);
+
+    QSettings settings("KonteX Neuroscience", "Thor Vision");
+    auto continuous = settings.value(CONTINUOUS, true).toBool();
+    auto max_size_time = settings.value(MAX_SIZE_TIME, 10).toInt();
+    auto max_files = settings.value(MAX_FILES, 10).toInt();
+
+    auto dir_name = settings.value(DIR_DATE, true).toBool()
+                        ? QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss")
+                        : settings.value(DIR_NAME).toString();
+
+    auto windows = _stream_mainwindow->findChildren<StreamWindow *>();
+    std::vector<std::uint64_t> bitrates;
+    for (auto window : windows) bitrates.push_back(window->recording_bitrate());
+    auto targets = stripe_targets();
+    auto assignment = assign_cameras(bitrates, targets);
+
+    // TODO: Duplicate the directory creation code from stream_window.cc here.
+    // This is for the record button press,
+    // whereas the code in stream_window.cc is used in the callback for a DDS trigger.
+    std::vector<fs::path> directories;
+    std::vector<fs::path> used_directories;
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        auto directory = fs::path(targets[i].path.toStdString()) / dir_name.toStdString();
+        directories.push_back(directory);
+        // Only the paths that got a camera hold the recording and its manifest.
+        if (i > 0 && std::find(assignment.begin(), assignment.end(), i) == assignment.end()) {
+            continue;
+        }
+        used_directories.push_back(directory);
+        if (fs::exists(directory)) continue;
+
+        spdlog::info("create_directory = {}", directory.generic_string());
+        std::error_code ec;
+        if (!fs::create_directories(directory, ec)) {
+            spdlog::info(
+                "Failed to create directory: {}. Error: {}",
+                directory.generic_string(),
+                ec.message()
+            );
+        }
+    }
+    _start_record_dir_path = directories.front();
+    auto manifest = std::make_shared<RecordingManifest>(used_directories);
+
+    // The JPEG branches are built one by one behind shut gates, since xvc's recording
+    // calls share its state and aren't safe to run concurrently, then all gates are opened
+    // on one boundary so every file begins on corresponding frames however long the
+    // building took.
+    std::vector<std::shared_ptr<RecordingGate>> gates(windows.size());
+    for (std::size_t i = 0; i < windows.size(); ++i) {
+        auto window = windows[i];
+        auto &target = targets[assignment[i]];
+        auto filepath =
+            directories[assignment[i]] /
+            fmt::format("{}-{}", window->_camera->name(), window->_camera->id());
+        manifest->add_camera(
+            window->_camera->name(),
+            window->_camera->id(),
+            filepath,
+            bitrates[i],
+            target.bandwidth
+        );
+        window->set_manifest(manifest);
+
+        if (window->_camera->current_cap().find(VIDEO_MJPEG) != std::string::npos ||
+            window->_camera->current_cap().find(VIDEO_RAW) != std::string::npos) {
+            gates[i] = window->start_jpeg_recording(
+                filepath, continuous, max_size_time, max_files, GST_CLOCK_TIME_NONE
+            );
+        } else {
+            // TODO: disable h265 for now
+            window->start_h265_recording(filepath, continuous, max_size_time, max_files);
         }
-        QTimer::singleShot(3500, [this]() {
-            _record_button->setEnabled(true);
-        });
+    }
+
+    std::vector<SyncStart::Camera> cameras;
+    for (std::size_t i = 0; i < windows.size(); ++i) {
+        if (!gates[i]) continue;
+        cameras.push_back(
+            {windows[i]->_camera->name(),
+             gates[i],
+             windows[i]->_pipeline.get(),
+             windows[i]->_last_fpga_timestamp.load(std::memory_order_relaxed),
+             windows[i]->_trigger_config.get()->pre_record_time}
+        );
+    }
+    if (!cameras.empty()) {
+        // The cameras share the FPGA clock; 0 if no camera has measured its rate yet.
+        std::uint64_t tick_rate = 0;
+        for (auto window : windows) tick_rate = std::max(tick_rate, window->tick_rate());
+        std::make_shared<SyncStart>(tick_rate)->commit(cameras);
+    }
+}
+
+void XDAQCameraControl::recording_drained()
+{
+    _draining = std::max(0, _draining - 1);
+    if (_draining > 0 || _recording) return;
+
+    for (auto window : _stream_mainwindow->findChildren<StreamWindow *>()) {
+        window->hold_trigger(false);
+    }
+    _record_button->setEnabled(true);
+    auto open_video_folder =
+        QSettings("KonteX Neuroscience", "Thor Vision").value(OPEN_VIDEO_FOLDER, true).toBool();
+    if (open_video_folder && !_start_record_dir_path.empty()) {
+        auto directory =
+            QFileInfo(QString::fromStdString(_start_record_dir_path.generic_string())).filePath();
+        QDesktopServices::openUrl(QUrl::fromLocalFile(directory));
     }
 }
 
 bool XDAQCameraControl::are_threads_finished() const
 {
-    auto *self = const_cast<XDAQCameraControl *>(this);
-    self->cleanup_finished_threads();
-    return _gstreamer_handler_threads.empty();
+    auto windows = _stream_mainwindow->findChildren<StreamWindow *>();
+    return std::none_of(windows.begin(), windows.end(), [](auto window) {
+        return window->stopping();
+    });
 }
 
 void XDAQCameraControl::wait_for_threads()
 {
-    cleanup_finished_threads();
-    for (auto &thread : _gstreamer_handler_threads) {
-        if (thread.first.joinable()) {
-            thread.first.join();
-        }
+    for (auto window : _stream_mainwindow->findChildren<StreamWindow *>()) {
+        window->wait_for_stops();
     }
-    _gstreamer_handler_threads.clear();
 }
 
 void XDAQCameraControl::closeEvent(QCloseEvent *e)
 {
-    if (!are_threads_finished()) {
+    auto &post_processing = PostProcessingPool::instance();
+    auto jobs = post_processing.remaining();
+    if (!are_threads_finished() || jobs > 0) {
         auto reply = QMessageBox::warning(
             this,
             tr("Warning"),
-            tr("Video parsing is still in progress. Do you want to wait for completion?"),
+            tr(
+                "Video parsing is still in progress (%n job(s) remaining). "
+                "Do you want to wait for completion?",
+                nullptr,
+                static_cast<int>(jobs)
+            ),
             QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel
         );
 
         if (reply == QMessageBox::Yes) {
             wait_for_threads();
+            post_processing.wait();
             for (auto camera : _cameras) {
                 camera->stop();
             }
@@ -432,12 +504,8 @@ void XDAQCameraControl::closeEvent(QCloseEvent *e)
             _stream_mainwindow->close();
             e->accept();
         } else if (reply == QMessageBox::No) {
-            // Force close, threads will be terminated
-            for (auto &thread : _gstreamer_handler_threads) {
-                if (thread.first.joinable()) {
-                    thread.first.detach();
-                }
-            }
+            // Force close; the windows give up on their stops as they close.
+            post_processing.cancel_all();
             for (auto camera : _cameras) {
                 camera->stop();
             }
@@ -455,24 +523,4 @@ void XDAQCameraControl::closeEvent(QCloseEvent *e)
         _stream_mainwindow->close();
         e->accept();
     }
-}
-
-void XDAQCameraControl::cleanup_finished_threads()
-{
-    _gstreamer_handler_threads.erase(
-        std::remove_if(
-            _gstreamer_handler_threads.begin(),
-            _gstreamer_handler_threads.end(),
-            [](auto &thread_future) {
-                auto &[thread, future] = thread_future;
-                // Check if thread is done using future
-                if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
-                    thread.join();  // Clean up the thread
-                    return true;    // Remove from vector
-                }
-                return false;  // Keep in vector
-            }
-        ),
-        _gstreamer_handler_threads.end()
-    );
 }
\ No newline at end of file
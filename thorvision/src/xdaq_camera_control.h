@@ -7,9 +7,7 @@
 #include <QPushButton>
 #include <QTimer>
 #include <filesystem>
-#include <future>
 #include <memory>
-#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -43,10 +41,15 @@ public:
     void record();
 
 private:
-    std::vector<std::pair<std::thread, std::future<void>>> _gstreamer_handler_threads;
+    // Cameras whose stop hasn't drained yet.
+    int _draining;
+    // Whether no camera is still stopping a recording, see StreamWindow::stop_recording_async.
     bool are_threads_finished() const;
     void wait_for_threads();
-    void cleanup_finished_threads();
+    // UI thread; starts the recording on every camera once none is stopping any more.
+    void start_recording();
+    // UI thread; called as each camera's stop completes, re-enables REC after the last one.
+    void recording_drained();
     std::unique_ptr<xvc::ws_client> _ws_client;
     std::unordered_map<int, QListWidgetItem *> _camera_item_map;
 
@@ -0,0 +1,187 @@
+#include <fmt/core.h>
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bus_reactor.h"
+
+
+namespace
+{
+// One pipeline per camera of a fully populated XDAQ.
+auto constexpr PIPELINES = 16;
+
+using PipelinePtr = std::unique_ptr<GstElement, decltype(&gst_object_unref)>;
+
+PipelinePtr test_pipeline(int index, int buffers)
+{
+    auto description = fmt::format(
+        "videotestsrc num-buffers={} ! video/x-raw,width=64,height=48 ! fakesink sync=false",
+        buffers
+    );
+    GError *error = nullptr;
+    PipelinePtr pipeline(gst_parse_launch(description.c_str(), &error), gst_object_unref);
+    if (error) {
+        ADD_FAILURE() << error->message;
+        g_error_free(error);
+    }
+    gst_object_set_name(GST_OBJECT(pipeline.get()), fmt::format("camera-{}", index).c_str());
+    return pipeline;
+}
+
+struct Counts {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::array<int, PIPELINES> eos{};
+    std::array<int, PIPELINES> messages{};
+    std::vector<std::thread::id> threads;
+};
+
+void record(Counts &counts, int index, GstMessage *message)
+{
+    std::lock_guard lock(counts.mutex);
+    ++counts.messages[index];
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS) ++counts.eos[index];
+    auto id = std::this_thread::get_id();
+    if (std::find(counts.threads.begin(), counts.threads.end(), id) == counts.threads.end()) {
+        counts.threads.push_back(id);
+    }
+    counts.changed.notify_all();
+}
+}  // namespace
+
+
+// Sixteen pipelines run to EOS at once; every message of every bus is handled, all of them on
+// the reactor's one thread.
+TEST(BusReactor, SixteenPipelinesShareOneThread)
+{
+    Counts counts;
+    std::vector<PipelinePtr> pipelines;
+    std::vector<BusWatch> watches;
+    for (auto i = 0; i < PIPELINES; ++i) {
+        pipelines.push_back(test_pipeline(i, 100));
+        watches.push_back(BusReactor::instance().watch(
+            GST_PIPELINE(pipelines.back().get()),
+            [&counts, i](GstMessage *message) { record(counts, i, message); }
+        ));
+    }
+    for (auto &pipeline : pipelines) gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+
+    {
+        std::unique_lock lock(counts.mutex);
+        auto all_eos = [&] {
+            return std::all_of(counts.eos.begin(), counts.eos.end(), [](int n) { return n > 0; });
+        };
+        EXPECT_TRUE(counts.changed.wait_for(lock, std::chrono::seconds(20), all_eos));
+        EXPECT_EQ(counts.threads.size(), 1u);
+        if (!counts.threads.empty()) {
+            EXPECT_EQ(counts.threads.front(), BusReactor::instance().thread_id());
+        }
+        for (auto i = 0; i < PIPELINES; ++i) {
+            EXPECT_EQ(counts.eos[i], 1) << "pipeline " << i;
+            // At least the state changes on the way to PLAYING.
+            EXPECT_GT(counts.messages[i], 3) << "pipeline " << i;
+        }
+    }
+
+    watches.clear();
+    for (auto &pipeline : pipelines) gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+}
+
+// Once reset() returns, the handler never runs again, even with messages still queued.
+TEST(BusReactor, ResetStopsTheHandler)
+{
+    auto pipeline = test_pipeline(0, -1);
+    std::atomic_int handled = 0;
+    auto watch = BusReactor::instance().watch(GST_PIPELINE(pipeline.get()), [&](GstMessage *) {
+        ++handled;
+        // A slow handler, so reset() has one to wait for.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+        gst_pipeline_get_bus(GST_PIPELINE(pipeline.get())), gst_object_unref
+    );
+    for (auto i = 0; i < 100; ++i) {
+        gst_bus_post(
+            bus.get(),
+            gst_message_new_application(
+                GST_OBJECT(pipeline.get()), gst_structure_new_empty("ping")
+            )
+        );
+    }
+    while (handled == 0) std::this_thread::yield();
+    watch.reset();
+    auto handled_before_reset = handled.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(handled, handled_before_reset);
+    EXPECT_LT(handled, 100);
+}
+
+
+// How long a message waits between gst_bus_post() and its handler while 16 buses are watched.
+TEST(BusReactorBenchmark, DispatchLatency)
+{
+    auto constexpr MESSAGES = 200;
+    std::vector<PipelinePtr> pipelines;
+    std::vector<BusWatch> watches;
+    std::mutex mutex;
+    std::condition_variable handled;
+    auto received = 0;
+    std::chrono::steady_clock::time_point arrival;
+    for (auto i = 0; i < PIPELINES; ++i) {
+        pipelines.push_back(test_pipeline(i, 1));
+        watches.push_back(BusReactor::instance().watch(
+            GST_PIPELINE(pipelines.back().get()),
+            [&](GstMessage *message) {
+                if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_APPLICATION) return;
+                std::lock_guard lock(mutex);
+                arrival = std::chrono::steady_clock::now();
+                ++received;
+                handled.notify_all();
+            }
+        ));
+    }
+
+    std::vector<double> latencies;
+    for (auto i = 0; i < MESSAGES; ++i) {
+        auto &pipeline = pipelines[i % PIPELINES];
+        std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+            gst_pipeline_get_bus(GST_PIPELINE(pipeline.get())), gst_object_unref
+        );
+        std::unique_lock lock(mutex);
+        auto expected = received + 1;
+        auto posted = std::chrono::steady_clock::now();
+        gst_bus_post(
+            bus.get(),
+            gst_message_new_application(
+                GST_OBJECT(pipeline.get()), gst_structure_new_empty("ping")
+            )
+        );
+        ASSERT_TRUE(handled.wait_for(lock, std::chrono::seconds(1), [&] {
+            return received == expected;
+        }));
+        latencies.push_back(std::chrono::duration<double, std::micro>(arrival - posted).count());
+    }
+    watches.clear();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto median = latencies[latencies.size() / 2];
+    auto worst = latencies.back();
+    RecordProperty("median_us", fmt::format("{:.1f}", median));
+    RecordProperty("max_us", fmt::format("{:.1f}", worst));
+    spdlog::info("Bus message dispatch: median {:.1f} us, max {:.1f} us", median, worst);
+    // Dispatched on wakeup, not on the 100 ms poll of the old per-window bus threads.
+    EXPECT_LT(median, 10'000.0);
+}
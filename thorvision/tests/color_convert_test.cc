@@ -0,0 +1,287 @@
+#include <fmt/ranges.h>
+#include <gst/video/video.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "color_convert.h"
+#include "test_samples.h"
+
+
+namespace
+{
+// Largest difference from videoconvert in any channel, and the mean over all of them. Ours
+// are Q14 coefficients, GstVideoConverter's 8-bit paths use 8 fractional bits or fewer, so
+// the two round apart by a few levels where the coefficients are largest.
+auto constexpr MAX_DIFFERENCE = 4;
+auto constexpr MEAN_DIFFERENCE = 1.0;
+
+// A frame with a noisy luma gradient and chroma that changes slowly, so both converters
+// pick the same chroma sample whatever siting they assume.
+GstBuffer *make_frame(const GstVideoInfo &info)
+{
+    auto buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&info), nullptr);
+    GstVideoFrame frame;
+    gst_video_frame_map(&frame, const_cast<GstVideoInfo *>(&info), buffer, GST_MAP_WRITE);
+    auto state = 1u;
+    for (auto c = 0; c < 3; ++c) {
+        auto data = static_cast<guint8 *>(GST_VIDEO_FRAME_COMP_DATA(&frame, c));
+        auto stride = GST_VIDEO_FRAME_COMP_STRIDE(&frame, c);
+        auto pstride = GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, c);
+        auto width = GST_VIDEO_FRAME_COMP_WIDTH(&frame, c);
+        auto height = GST_VIDEO_FRAME_COMP_HEIGHT(&frame, c);
+        for (auto y = 0; y < height; ++y) {
+            for (auto x = 0; x < width; ++x) {
+                int value;
+                if (c == 0) {
+                    state = state * 1664525u + 1013904223u;
+                    value = (x + y) * 255 / (width + height) + static_cast<int>(state >> 28);
+                } else {
+                    // Sweeps the whole chroma range, so every coefficient gets clamped somewhere.
+                    value = (c == 1 ? x * 255 / width : y * 255 / height);
+                }
+                data[y * stride + x * pstride] = static_cast<guint8>(std::clamp(value, 0, 255));
+            }
+        }
+    }
+    gst_video_frame_unmap(&frame);
+    return buffer;
+}
+
+// What videoconvert would output as RGBx, with its chroma upsampling and dithering turned off
+// to match convert_to_rgb.
+std::vector<unsigned char> videoconvert(const GstVideoInfo &in_info, GstBuffer *buffer)
+{
+    auto out_info = video_info(
+        GST_VIDEO_FORMAT_RGBx, GST_VIDEO_INFO_WIDTH(&in_info), GST_VIDEO_INFO_HEIGHT(&in_info)
+    );
+    auto config = gst_structure_new(
+        "GstVideoConverter",
+        GST_VIDEO_CONVERTER_OPT_CHROMA_RESAMPLER_METHOD,
+        GST_TYPE_VIDEO_RESAMPLER_METHOD,
+        GST_VIDEO_RESAMPLER_METHOD_NEAREST,
+        GST_VIDEO_CONVERTER_OPT_DITHER_METHOD,
+        GST_TYPE_VIDEO_DITHER_METHOD,
+        GST_VIDEO_DITHER_NONE,
+        GST_VIDEO_CONVERTER_OPT_THREADS,
+        G_TYPE_UINT,
+        1u,
+        nullptr
+    );
+    auto converter = gst_video_converter_new(
+        const_cast<GstVideoInfo *>(&in_info), &out_info, config
+    );
+    auto out = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&out_info), nullptr);
+    GstVideoFrame src, dst;
+    gst_video_frame_map(&src, const_cast<GstVideoInfo *>(&in_info), buffer, GST_MAP_READ);
+    gst_video_frame_map(&dst, &out_info, out, GST_MAP_WRITE);
+    gst_video_converter_frame(converter, &src, &dst);
+
+    auto width = GST_VIDEO_INFO_WIDTH(&out_info);
+    std::vector<unsigned char> rgb(static_cast<std::size_t>(width) * 4 * out_info.height);
+    for (auto y = 0; y < out_info.height; ++y) {
+        auto row = static_cast<const unsigned char *>(GST_VIDEO_FRAME_PLANE_DATA(&dst, 0)) +
+                   y * GST_VIDEO_FRAME_PLANE_STRIDE(&dst, 0);
+        std::copy_n(row, width * 4, rgb.data() + y * width * 4);
+    }
+
+    gst_video_frame_unmap(&dst);
+    gst_video_frame_unmap(&src);
+    gst_buffer_unref(out);
+    gst_video_converter_free(converter);
+    return rgb;
+}
+
+std::vector<unsigned char> convert(const GstVideoInfo &info, GstBuffer *buffer)
+{
+    auto width = GST_VIDEO_INFO_WIDTH(&info);
+    std::vector<unsigned char> rgb(static_cast<std::size_t>(width) * 4 * info.height);
+    GstVideoFrame frame;
+    gst_video_frame_map(&frame, const_cast<GstVideoInfo *>(&info), buffer, GST_MAP_READ);
+    EXPECT_TRUE(convert_to_rgb(
+        frame, ColourMatrix::from(info), rgb.data(), width * 4, RGBFormat::RGBX
+    ));
+    gst_video_frame_unmap(&frame);
+    return rgb;
+}
+
+// The same with one kernel set, into rows padded past the pixels so stray stores show.
+std::vector<unsigned char> convert_with(
+    const char *kernels, const GstVideoInfo &info, GstBuffer *buffer, RGBFormat format
+)
+{
+    auto width = GST_VIDEO_INFO_WIDTH(&info);
+    auto stride = width * (format == RGBFormat::RGBX ? 4 : 3) + 32;
+    std::vector<unsigned char> rgb(static_cast<std::size_t>(stride) * info.height, 0xA5);
+    GstVideoFrame frame;
+    gst_video_frame_map(&frame, const_cast<GstVideoInfo *>(&info), buffer, GST_MAP_READ);
+    EXPECT_TRUE(
+        convert_to_rgb_with(kernels, frame, ColourMatrix::from(info), rgb.data(), stride, format)
+    ) << kernels;
+    gst_video_frame_unmap(&frame);
+    return rgb;
+}
+
+struct Case {
+    GstVideoFormat format;
+    const char *colorimetry;
+};
+
+std::string name(const testing::TestParamInfo<Case> &info)
+{
+    std::string name = gst_video_format_to_string(info.param.format);
+    name += "_";
+    for (auto c : std::string(info.param.colorimetry)) {
+        if (std::isalnum(static_cast<unsigned char>(c))) name += c;
+    }
+    return name;
+}
+
+class ColorConvert : public testing::TestWithParam<Case>
+{
+protected:
+    GstVideoInfo info(int width, int height) const
+    {
+        auto info = video_info(GetParam().format, width, height);
+        gst_video_colorimetry_from_string(&info.colorimetry, GetParam().colorimetry);
+        return info;
+    }
+};
+}  // namespace
+
+
+TEST_P(ColorConvert, MatchesVideoconvert)
+{
+    // Odd sizes exercise the SIMD kernels' scalar tails.
+    for (auto [width, height] : {std::pair{640, 360}, std::pair{321, 241}}) {
+        auto const info = this->info(width, height);
+        auto buffer = make_frame(info);
+        auto expected = videoconvert(info, buffer);
+        auto actual = convert(info, buffer);
+        gst_buffer_unref(buffer);
+
+        auto largest = 0;
+        auto total = 0.0;
+        auto channels = 0;
+        for (std::size_t i = 0; i < actual.size(); ++i) {
+            if (i % 4 == 3) continue;
+            auto difference = std::abs(actual[i] - expected[i]);
+            largest = std::max(largest, difference);
+            total += difference;
+            ++channels;
+        }
+        auto mean = total / channels;
+        RecordProperty(fmt::format("max_difference_{}x{}", width, height), largest);
+        auto mean_name = fmt::format("mean_difference_{}x{}", width, height);
+        RecordProperty(mean_name, fmt::format("{:.3f}", mean));
+        EXPECT_LE(largest, MAX_DIFFERENCE) << width << "x" << height;
+        EXPECT_LE(mean, MEAN_DIFFERENCE) << width << "x" << height;
+    }
+}
+
+TEST_P(ColorConvert, KernelsMatchScalar)
+{
+    auto kernels = convert_kernel_names();
+    ASSERT_STREQ(kernels.back(), "scalar");
+    RecordProperty("kernels", fmt::format("{}", fmt::join(kernels, ", ")));
+    // The SIMD kernels take 4 or 8 pixels a step; odd widths leave them a scalar tail.
+    for (auto [width, height] : {std::pair{640, 360}, std::pair{321, 241}, std::pair{47, 9}}) {
+        auto const info = this->info(width, height);
+        auto buffer = make_frame(info);
+        for (auto format : {RGBFormat::RGB888, RGBFormat::RGBX}) {
+            auto expected = convert_with("scalar", info, buffer, format);
+            for (auto name : kernels) {
+                EXPECT_EQ(convert_with(name, info, buffer, format), expected)
+                    << name << " " << width << "x" << height
+                    << (format == RGBFormat::RGBX ? " RGBX" : " RGB888");
+            }
+        }
+        gst_buffer_unref(buffer);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Formats,
+    ColorConvert,
+    testing::Values(
+        Case{GST_VIDEO_FORMAT_YUY2, "bt601"},
+        Case{GST_VIDEO_FORMAT_YUY2, "bt709"},
+        Case{GST_VIDEO_FORMAT_NV12, "bt601"},
+        Case{GST_VIDEO_FORMAT_NV12, "bt709"},
+        Case{GST_VIDEO_FORMAT_I420, "bt601"},
+        // Full range BT.601, as JPEG decodes to.
+        Case{GST_VIDEO_FORMAT_I420, "1:4:0:0"}
+    ),
+    name
+);
+
+
+// Megapixels per second of every kernel set this CPU runs, and of GstVideoConverter on one
+// thread, which is what the preview ran before the pipeline stopped converting. A 720p frame
+// is mapped and its output allocated once, so only the conversion is timed.
+TEST(ColorConvertBenchmark, Throughput)
+{
+    auto constexpr WIDTH = 1280;
+    auto constexpr HEIGHT = 720;
+    auto constexpr FRAMES = 100;
+    spdlog::info("Colour conversion kernels in use: {}", convert_kernel_name());
+    RecordProperty("kernels", convert_kernel_name());
+
+    auto mpix_per_second = [](auto &&run) {
+        run();
+        auto start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < FRAMES; ++i) run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return static_cast<double>(WIDTH) * HEIGHT * FRAMES / elapsed.count() / 1e6;
+    };
+
+    for (auto format : {GST_VIDEO_FORMAT_YUY2, GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_I420}) {
+        auto const info = video_info(format, WIDTH, HEIGHT);
+        auto out_info = video_info(GST_VIDEO_FORMAT_RGBx, WIDTH, HEIGHT);
+        auto matrix = ColourMatrix::from(info);
+        auto buffer = make_frame(info);
+        auto out = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&out_info), nullptr);
+        GstVideoFrame src, dst;
+        gst_video_frame_map(&src, const_cast<GstVideoInfo *>(&info), buffer, GST_MAP_READ);
+        gst_video_frame_map(&dst, &out_info, out, GST_MAP_WRITE);
+        auto rgb = static_cast<unsigned char *>(GST_VIDEO_FRAME_PLANE_DATA(&dst, 0));
+        auto stride = GST_VIDEO_FRAME_PLANE_STRIDE(&dst, 0);
+        auto format_name = std::string(gst_video_format_to_string(format));
+
+        for (auto kernels : convert_kernel_names()) {
+            auto mpix = mpix_per_second([&] {
+                convert_to_rgb_with(kernels, src, matrix, rgb, stride, RGBFormat::RGBX);
+            });
+            RecordProperty(
+                fmt::format("{}_{}_mpix_per_s", format_name, kernels), fmt::format("{:.0f}", mpix)
+            );
+            spdlog::info("{} to RGBX, {}: {:.0f} Mpix/s", format_name, kernels, mpix);
+            EXPECT_GT(mpix, 0.0);
+        }
+
+        auto config = gst_structure_new(
+            "GstVideoConverter", GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT, 1u, nullptr
+        );
+        auto converter = gst_video_converter_new(
+            const_cast<GstVideoInfo *>(&info), &out_info, config
+        );
+        auto mpix = mpix_per_second([&] { gst_video_converter_frame(converter, &src, &dst); });
+        gst_video_converter_free(converter);
+        RecordProperty(
+            fmt::format("{}_videoconvert_mpix_per_s", format_name), fmt::format("{:.0f}", mpix)
+        );
+        spdlog::info("{} to RGBX, videoconvert: {:.0f} Mpix/s", format_name, mpix);
+
+        gst_video_frame_unmap(&dst);
+        gst_video_frame_unmap(&src);
+        gst_buffer_unref(out);
+        gst_buffer_unref(buffer);
+    }
+}
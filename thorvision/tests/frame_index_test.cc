@@ -0,0 +1,152 @@
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_index.h"
+#include "recording_gate.h"
+#include "recording_sink.h"
+#include "test_recording.h"
+
+
+namespace
+{
+auto constexpr FPS = 30;
+auto constexpr FRAMES = 100;
+
+bool has_metadata(std::uint64_t frame)
+{
+    return frame % 4 != 1;
+}
+
+std::uint64_t fpga_timestamp(std::uint64_t frame)
+{
+    return 5'000 + 1'000 * frame;
+}
+
+GstPadProbeReturn tag_frames(GstPad *, GstPadProbeInfo *info, gpointer)
+{
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    auto frame = gst_util_uint64_scale_round(GST_BUFFER_PTS(buffer), FPS, GST_SECOND);
+    if (has_metadata(frame)) {
+        attach_frame_metadata(buffer, XDAQFrameData{fpga_timestamp(frame), 0, 0, 0, 0, 0});
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// A fragment with a .idx of one frame, as FrameIndexWriter writes them.
+void write_fragment(const fs::path &fragment)
+{
+    std::ofstream(fragment, std::ios::binary) << "\xFF\xD8\xFF\xD9";
+    FrameIndexWriter index;
+    index.frame(0, std::nullopt);
+    ASSERT_TRUE(index.open(fragment));
+    index.written(0, 0, 4);
+    index.close();
+}
+}  // namespace
+
+
+// Only "<prefix>-<number>" fragments belong to the recording, not those of a camera whose name
+// merely starts with the same characters.
+TEST(FrameIndex, LoadsOnlyTheRecordingsFragments)
+{
+    auto directory = test_directory();
+    for (auto name : {
+             "camera-00000.mkv",
+             "camera-00001.mkv",
+             "camera-2-00000.mkv",
+             "camera2-00000.mkv",
+             "camera-.mkv",
+             "camera.mkv",
+             "camera-0000a.mkv",
+         }) {
+        write_fragment(directory / name);
+    }
+
+    auto index = FrameIndex::load_recording(directory / "camera");
+    ASSERT_TRUE(index);
+    std::vector<fs::path> expected{directory / "camera-00000.mkv", directory / "camera-00001.mkv"};
+    EXPECT_EQ(index->fragments(), expected);
+    EXPECT_EQ(index->size(), 2u);
+}
+
+// The sink a recording is written through: thorrecordingsink, or filesink as splitmuxsink
+// uses by default.
+class FrameIndexSink : public testing::TestWithParam<const char *>
+{
+};
+
+// Records into several fragments and checks every entry of the index against the file
+// GStreamer's demuxer reads: the same frames in the same order, at the container's
+// timestamps, with the JPEG at the recorded offset. Then looks frames up.
+TEST_P(FrameIndexSink, MatchesTheRecordedFile)
+{
+    ASSERT_TRUE(register_recording_sink());
+    auto directory = test_directory();
+    auto prefix = directory / "camera";
+    auto pipeline = jpeg_stream(FRAMES, FPS);
+    ASSERT_TRUE(pipeline);
+    auto tee = child(pipeline.get(), "t");
+    auto tee_sink = gst_element_get_static_pad(tee.get(), "sink");
+    gst_pad_add_probe(tee_sink, GST_PAD_PROBE_TYPE_BUFFER, tag_frames, nullptr, nullptr);
+    gst_object_unref(tee_sink);
+
+    auto writer = std::make_shared<FrameIndexWriter>();
+    auto sink = gst_element_factory_make(GetParam(), nullptr);
+    ASSERT_TRUE(sink);
+    if (THOR_IS_RECORDING_SINK(sink)) {
+        thor_recording_sink_set_index(THOR_RECORDING_SINK(sink), writer);
+    } else {
+        index_filesink(sink, writer);
+    }
+    auto gate = RecordingGate::open(
+        tee.get(),
+        0,
+        [&] { add_recording_branch(pipeline.get(), tee.get(), prefix, GST_SECOND, sink); },
+        nullptr,
+        nullptr,
+        writer
+    );
+    ASSERT_TRUE(gate);
+    ASSERT_TRUE(run_to_eos(pipeline.get()));
+
+    auto index = FrameIndex::load_recording(prefix);
+    ASSERT_TRUE(index);
+    auto files = fragments(prefix);
+    ASSERT_GE(files.size(), 3u);
+    ASSERT_EQ(index->fragments(), files);
+
+    std::uint64_t frame = 0;
+    std::vector<char> jpeg;
+    for (std::size_t fragment = 0; fragment < files.size(); ++fragment) {
+        for (auto &recorded : read_container(files[fragment])) {
+            auto entry = index->at_frame(frame);
+            ASSERT_TRUE(entry) << "frame " << frame;
+            EXPECT_EQ(entry->frame, frame);
+            EXPECT_EQ(entry->fragment, fragment) << "frame " << frame;
+            EXPECT_EQ(entry->pts, recorded.pts) << "frame " << frame;
+            ASSERT_TRUE(index->read(*entry, jpeg)) << "frame " << frame;
+            EXPECT_EQ(std::vector<unsigned char>(jpeg.begin(), jpeg.end()), recorded.jpeg)
+                << "frame " << frame;
+            EXPECT_EQ(entry->flags == FrameIndexWriter::HAS_METADATA, has_metadata(frame));
+            if (has_metadata(frame)) EXPECT_EQ(entry->fpga_timestamp, fpga_timestamp(frame));
+            EXPECT_EQ(index->at_pts(entry->pts), entry);
+            ++frame;
+        }
+    }
+    EXPECT_EQ(frame, std::uint64_t{FRAMES});
+    EXPECT_EQ(index->size(), std::size_t{FRAMES});
+
+    // A frame without metadata is skipped for the next one with it.
+    EXPECT_EQ(index->at_fpga_timestamp(fpga_timestamp(1))->frame, 2u);
+    EXPECT_EQ(index->at_fpga_timestamp(fpga_timestamp(40))->frame, 40u);
+    EXPECT_EQ(index->at_fpga_timestamp(fpga_timestamp(FRAMES)), nullptr);
+    EXPECT_EQ(index->at_frame(FRAMES), nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(Sinks, FrameIndexSink, testing::Values("thorrecordingsink", "filesink"));
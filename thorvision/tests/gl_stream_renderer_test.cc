@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <QImage>
+#include <QOpenGLContext>
+#include <QPainter>
+#include <chrono>
+
+#include "gl_stream_renderer.h"
+#include "test_samples.h"
+#include "video_frame.h"
+
+
+namespace
+{
+auto constexpr FRAMES = 60;
+
+// Renders FRAMES frames of format through grabFramebuffer(), which runs paintGL() right away,
+// and returns the renderer's mean upload and draw time.
+std::chrono::nanoseconds render(GstVideoFormat format, int width, int height)
+{
+    auto const info = video_info(format, width, height);
+    FramePool pool;
+    GLStreamRenderer renderer;
+    renderer.resize(width, height);
+    renderer.show();
+    if (!renderer.context() || !renderer.context()->isValid()) return {};
+
+    for (auto i = 0; i < FRAMES; ++i) {
+        auto sample = make_sample(info, static_cast<GstClockTime>(i));
+        renderer.set_frame(pool.acquire(sample, info, XDAQFrameData{}));
+        renderer.grabFramebuffer();
+    }
+    EXPECT_EQ(renderer.frames_rendered(), std::uint64_t{FRAMES});
+    return renderer.render_time() / FRAMES;
+}
+
+// The QPainter preview's work for the same frames: converting YUV to RGB on the streaming
+// thread, as FramePool does for it, and drawing the frame into a raster surface the size of
+// the window, as paintEvent does once the preview branch has scaled it. Returns the mean.
+std::chrono::nanoseconds paint(GstVideoFormat format, int width, int height)
+{
+    auto const info = video_info(format, width, height);
+    FramePool pool;
+    pool.enable_rgb_conversion(ColourMatrix::from(info));
+    QImage surface(width, height, QImage::Format_ARGB32_Premultiplied);
+
+    std::chrono::nanoseconds time{0};
+    for (auto i = 0; i < FRAMES; ++i) {
+        auto sample = make_sample(info, static_cast<GstClockTime>(i));
+        auto start = std::chrono::steady_clock::now();
+        auto frame = pool.acquire(sample, info, XDAQFrameData{});
+        if (!frame || !frame.rgb()) return {};
+        auto rgb_format = frame.rgb_format() == RGBFormat::RGBX ? QImage::Format_RGBX8888
+                                                                 : QImage::Format_RGB888;
+        QImage image(frame.rgb(), frame.width(), frame.height(), frame.rgb_stride(), rgb_format);
+        QPainter painter(&surface);
+        painter.drawImage(0, 0, image);
+        painter.end();
+        time += std::chrono::steady_clock::now() - start;
+    }
+    return time / FRAMES;
+}
+}  // namespace
+
+
+// Time per frame of the OpenGL preview against the QPainter one it replaces, recorded for
+// comparison rather than checked: both depend on the host and its OpenGL driver.
+TEST(GLStreamRendererBenchmark, RenderTime)
+{
+    struct Case {
+        GstVideoFormat format;
+        int width;
+        int height;
+    };
+    for (auto [format, width, height] : {
+             Case{GST_VIDEO_FORMAT_YUY2, 1280, 720},
+             Case{GST_VIDEO_FORMAT_I420, 1280, 720},
+             Case{GST_VIDEO_FORMAT_NV12, 1920, 1080},
+             Case{GST_VIDEO_FORMAT_RGB, 640, 360},
+         }) {
+        auto name = fmt::format("{}_{}x{}", gst_video_format_to_string(format), width, height);
+        auto us = [](std::chrono::nanoseconds time) {
+            return std::chrono::duration<double, std::micro>(time).count();
+        };
+        auto painter = paint(format, width, height);
+        ASSERT_GT(painter.count(), 0) << name;
+        RecordProperty(name + "_qpainter_us", fmt::format("{:.1f}", us(painter)));
+
+        auto gl = render(format, width, height);
+        if (gl.count() == 0) {
+            spdlog::info("QPainter preview draws {} in {:.1f} us, no OpenGL", name, us(painter));
+            continue;
+        }
+        RecordProperty(name + "_opengl_us", fmt::format("{:.1f}", us(gl)));
+        spdlog::info(
+            "{}: OpenGL preview renders it in {:.1f} us, QPainter in {:.1f} us",
+            name,
+            us(gl),
+            us(painter)
+        );
+    }
+}
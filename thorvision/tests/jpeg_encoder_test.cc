@@ -0,0 +1,168 @@
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "jpeg_encoder.h"
+
+
+namespace
+{
+auto constexpr QUALITY = 85;
+auto constexpr FRAMES = 24;
+
+enum class Format { YUY2, I420, GRAY8 };
+
+// Frames of one format with a noisy gradient that moves from frame to frame, laid out as
+// GStreamer lays them out, and the RawImage of each.
+class Frames
+{
+public:
+    Frames(Format format, int width, int height) : _format(format), _width(width), _height(height)
+    {
+        std::mt19937 random(1);
+        for (auto frame = 0; frame < FRAMES; ++frame) {
+            std::vector<std::uint8_t> data(size());
+            for (std::size_t i = 0; i < data.size(); ++i) {
+                data[i] = static_cast<std::uint8_t>(i * 3 + frame * 5 + (random() & 7));
+            }
+            _data.push_back(std::move(data));
+        }
+    }
+
+    RawImage image(int frame) const
+    {
+        auto data = _data[frame].data();
+        switch (_format) {
+        case Format::YUY2: {
+            auto stride = yuy2_stride();
+            return RawImage{
+                _width,
+                _height,
+                3,
+                1,
+                0,
+                {{data, stride, 2}, {data + 1, stride, 4}, {data + 3, stride, 4}}
+            };
+        }
+        case Format::I420: {
+            auto chroma = _data[frame].data() + _width * _height;
+            auto chroma_size = chroma_width() * chroma_height();
+            return RawImage{
+                _width,
+                _height,
+                3,
+                1,
+                1,
+                {{data, _width, 1},
+                 {chroma, chroma_width(), 1},
+                 {chroma + chroma_size, chroma_width(), 1}}
+            };
+        }
+        case Format::GRAY8:
+            return RawImage{_width, _height, 1, 0, 0, {{data, _width, 1}}};
+        }
+        return {};
+    }
+
+private:
+    int yuy2_stride() const { return (_width + 1) / 2 * 4; }
+    int chroma_width() const { return (_width + 1) / 2; }
+    int chroma_height() const { return (_height + 1) / 2; }
+
+    std::size_t size() const
+    {
+        switch (_format) {
+        case Format::YUY2:
+            return static_cast<std::size_t>(yuy2_stride()) * _height;
+        case Format::I420:
+            return static_cast<std::size_t>(_width) * _height +
+                   2 * static_cast<std::size_t>(chroma_width()) * chroma_height();
+        case Format::GRAY8:
+            return static_cast<std::size_t>(_width) * _height;
+        }
+        return 0;
+    }
+
+    Format _format;
+    int _width;
+    int _height;
+    std::vector<std::vector<std::uint8_t>> _data;
+};
+
+using Encoded = std::vector<std::vector<std::uint8_t>>;
+
+Encoded encode_alone(const Frames &frames)
+{
+    JpegEncoder encoder;
+    Encoded encoded;
+    for (auto frame = 0; frame < FRAMES; ++frame) {
+        std::size_t size = 0;
+        auto data = encoder.encode(frames.image(frame), QUALITY, size);
+        EXPECT_TRUE(data) << "frame " << frame;
+        if (!data) return encoded;
+        encoded.emplace_back(data, data + size);
+        std::free(data);
+    }
+    return encoded;
+}
+
+// Submits every frame as the element does, taking back whatever is done in between, and
+// checks the frames come back in order.
+Encoded encode_on_pool(const Frames &frames, unsigned int threads)
+{
+    JpegEncoderPool pool(threads, QUALITY);
+    Encoded encoded;
+    auto take = [&](bool wait) {
+        while (auto frame = pool.next(wait)) {
+            EXPECT_EQ(reinterpret_cast<std::intptr_t>(frame->tag), std::ssize(encoded));
+            EXPECT_TRUE(frame->data);
+            if (frame->data) encoded.emplace_back(frame->data, frame->data + frame->size);
+            std::free(frame->data);
+            if (wait) return;
+        }
+    };
+    for (auto frame = 0; frame < FRAMES; ++frame) {
+        while (pool.full()) take(true);
+        pool.submit(frames.image(frame), reinterpret_cast<void *>(std::intptr_t{frame}));
+        take(false);
+    }
+    while (!pool.empty()) take(true);
+    return encoded;
+}
+}  // namespace
+
+
+// The pool encodes each frame on its own, so whatever the number of threads the recording is
+// byte for byte what one encoder makes, in every format thorjpegenc takes and at a size that
+// isn't a whole number of JPEG blocks.
+TEST(JpegEncoderPool, EncodesTheSameBytesOnAnyNumberOfThreads)
+{
+    struct Case {
+        const char *name;
+        Format format;
+    };
+    Case const cases[] = {{"YUY2", Format::YUY2}, {"I420", Format::I420}, {"GRAY8", Format::GRAY8}};
+    for (auto &[name, format] : cases) {
+        for (auto [width, height] : {std::pair{640, 360}, std::pair{643, 361}}) {
+            auto label = fmt::format("{} {}x{}", name, width, height);
+            Frames frames(format, width, height);
+            auto expected = encode_alone(frames);
+            ASSERT_EQ(expected.size(), std::size_t{FRAMES}) << label;
+            for (auto threads : {1u, 2u, 4u, 8u}) {
+                auto encoded = encode_on_pool(frames, threads);
+                ASSERT_EQ(encoded.size(), expected.size()) << label << " on " << threads;
+                for (std::size_t frame = 0; frame < encoded.size(); ++frame) {
+                    EXPECT_EQ(encoded[frame], expected[frame])
+                        << label << " frame " << frame << " on " << threads << " threads";
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <QApplication>
+
+
+int main(int argc, char **argv)
+{
+    // Widgets are rendered offscreen so the tests run without a display.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    gst_init(&argc, &argv);
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+
+#include "metadata_ring.h"
+
+
+namespace
+{
+// 300 fps.
+auto constexpr FRAME = GstClockTime{3'333'333};
+
+XDAQFrameData metadata(std::uint64_t frame)
+{
+    auto low = static_cast<std::uint32_t>(frame);
+    return XDAQFrameData{frame * 7, low, low, ~low, low * 3, ~frame};
+}
+
+bool matches(const XDAQFrameData &data, std::uint64_t frame)
+{
+    auto expected = metadata(frame);
+    return data.fpga_timestamp == expected.fpga_timestamp &&
+           data.rhythm_timestamp == expected.rhythm_timestamp &&
+           data.ttl_in == expected.ttl_in && data.ttl_out == expected.ttl_out &&
+           data.spi_perf_counter == expected.spi_perf_counter &&
+           data.reserved == expected.reserved;
+}
+}  // namespace
+
+
+TEST(MetadataRing, FindsRecentFrames)
+{
+    MetadataRing ring;
+    for (std::uint64_t frame = 0; frame < 500; ++frame) ring.push(frame * FRAME, metadata(frame));
+    for (std::uint64_t frame = 200; frame < 500; ++frame) {
+        auto found = ring.find(frame * FRAME);
+        ASSERT_TRUE(found) << frame;
+        EXPECT_TRUE(matches(*found, frame)) << frame;
+    }
+    EXPECT_FALSE(ring.find(500 * FRAME));
+    EXPECT_EQ(ring.misses(), 1u);
+}
+
+TEST(MetadataRing, ReplacesFramesFromBeforeAPtsReset)
+{
+    MetadataRing ring;
+    for (std::uint64_t frame = 0; frame < 2000; ++frame) ring.push(frame * FRAME, metadata(frame));
+    // The pipeline restarted and its PTS with it.
+    for (std::uint64_t frame = 0; frame < 10; ++frame) {
+        ring.push(frame * FRAME + 5, metadata(frame + 1));
+    }
+    for (std::uint64_t frame = 0; frame < 10; ++frame) {
+        auto found = ring.find(frame * FRAME + 5);
+        ASSERT_TRUE(found) << frame;
+        EXPECT_TRUE(matches(*found, frame + 1)) << frame;
+    }
+}
+
+// The parser probe writes while the appsink reads a little behind, skipping and reordering
+// frames the way a busy preview does. Every read must be whole, and a frame is only missed
+// when the read races the write of its slot.
+TEST(MetadataRing, StressReadsNeverTear)
+{
+    auto constexpr FRAMES = 300 * 60;
+    MetadataRing ring;
+    std::atomic<std::int64_t> written = -1;
+    std::atomic<std::int64_t> reading = 0;
+    std::uint64_t torn = 0;
+    std::uint64_t reads = 0;
+
+    std::thread reader([&] {
+        std::mt19937 random(3);
+        std::int64_t next = 0;
+        while (next < FRAMES) {
+            auto newest = written.load(std::memory_order_acquire);
+            if (newest < next) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto frame = next;
+            if (random() % 10 == 0 && next + 1 <= newest) {
+                frame = next + 1;
+            } else {
+                ++next;
+            }
+            reading.store(next, std::memory_order_relaxed);
+            if (random() % 20 == 0) continue;
+            ++reads;
+            auto found = ring.find(static_cast<GstClockTime>(frame) * FRAME);
+            if (found && !matches(*found, frame)) ++torn;
+        }
+    });
+
+    for (std::int64_t frame = 0; frame < FRAMES; ++frame) {
+        // The appsink queue holds a few frames, never hundreds.
+        while (frame - reading.load(std::memory_order_relaxed) > 256) std::this_thread::yield();
+        ring.push(static_cast<GstClockTime>(frame) * FRAME, metadata(frame));
+        written.store(frame, std::memory_order_release);
+        if (frame % 64 == 0) std::this_thread::yield();
+    }
+    reader.join();
+
+    RecordProperty("misses", static_cast<int>(ring.misses()));
+    EXPECT_EQ(torn, 0u);
+    EXPECT_EQ(ring.lookups(), reads);
+    // A miss needs a read to race the write of the same slot twice in a row.
+    EXPECT_LE(ring.misses(), reads / 1000);
+}
+
+
+// What each frame costs the parser probe and the appsink together.
+TEST(MetadataRingBenchmark, PushAndFind)
+{
+    auto constexpr FRAMES = 1'000'000;
+    MetadataRing ring;
+    auto found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto frame = 0; frame < FRAMES; ++frame) {
+        ring.push(static_cast<GstClockTime>(frame) * FRAME, metadata(frame));
+        found += ring.find(static_cast<GstClockTime>(frame) * FRAME).has_value();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    auto ns = std::chrono::duration<double, std::nano>(elapsed).count() / FRAMES;
+
+    EXPECT_EQ(found, FRAMES);
+    RecordProperty("push_find_ns", fmt::format("{:.1f}", ns));
+    spdlog::info("Metadata ring push and find: {:.1f} ns per frame", ns);
+    // Far below a frame's budget at 300 fps, even unoptimised.
+    EXPECT_LT(ns, 10'000.0);
+}
@@ -0,0 +1,195 @@
+#include <fmt/core.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+#include "parallel_jpeg_enc.h"
+#include "raw_recorder.h"
+#include "test_recording.h"
+
+
+namespace
+{
+auto constexpr FRAME_MARKER = std::string_view("FRAME\n");
+
+struct Cap {
+    const char *format;
+    int width;
+    int height;
+    int fps;
+};
+
+// The TEST cameras' caps, see XDAQCameraControl.
+Cap constexpr TEST_CAPS[] = {{"YUY2", 1280, 720, 30}, {"YUY2", 640, 360, 260}};
+
+GstCaps *gray_caps(int width, int height)
+{
+    return gst_caps_new_simple(
+        "video/x-raw",
+        "format",
+        G_TYPE_STRING,
+        "GRAY8",
+        "width",
+        G_TYPE_INT,
+        width,
+        "height",
+        G_TYPE_INT,
+        height,
+        "framerate",
+        GST_TYPE_FRACTION,
+        30,
+        1,
+        nullptr
+    );
+}
+
+struct Segment {
+    std::string header;
+    std::uint64_t frames;
+    bool whole;
+};
+
+// A segment's header line and how many frames of frame_size follow it.
+Segment read_segment(const fs::path &file, std::size_t frame_size)
+{
+    std::ifstream in(file, std::ios::binary);
+    Segment segment;
+    std::getline(in, segment.header);
+    auto body = fs::file_size(file) - segment.header.size() - 1;
+    auto stored = FRAME_MARKER.size() + frame_size;
+    segment.frames = body / stored;
+    segment.whole = body % stored == 0;
+    return segment;
+}
+
+// Plays caps from videotestsrc into a tee with the given branch on it, to EOS, and returns the
+// frames per second the whole pipeline kept up.
+template <typename AddBranch>
+double sustained_fps(const Cap &cap, int frames, AddBranch &&add_branch)
+{
+    auto description = fmt::format(
+        "videotestsrc num-buffers={} pattern=ball ! "
+        "video/x-raw,format={},width={},height={},framerate={}/1 ! tee name=t",
+        frames,
+        cap.format,
+        cap.width,
+        cap.height,
+        cap.fps
+    );
+    ElementPtr pipeline(gst_parse_launch(description.c_str(), nullptr), gst_object_unref);
+    EXPECT_TRUE(pipeline);
+    if (!pipeline) return 0;
+    auto tee = child(pipeline.get(), "t");
+    auto after = add_branch(pipeline.get(), tee.get());
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(run_to_eos(pipeline.get(), {}, {}, 120 * GST_SECOND));
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    after();
+    return frames / seconds;
+}
+}  // namespace
+
+
+// A resolution change mid-recording closes the segment and opens the next with the new size,
+// so every segment holds whole frames of one size.
+TEST(RawRecorder, StartsANewSegmentOnCapsChange)
+{
+    auto constexpr FRAMES = 20;
+    auto directory = test_directory();
+    auto prefix = directory / "camera";
+    ElementPtr pipeline(
+        gst_parse_launch("appsrc name=src format=time ! tee name=t", nullptr), gst_object_unref
+    );
+    ASSERT_TRUE(pipeline);
+    auto src = child(pipeline.get(), "src");
+    auto tee = child(pipeline.get(), "t");
+    RawRecorder recorder(prefix, {});
+    ASSERT_TRUE(recorder.start(pipeline.get(), tee.get()));
+
+    std::jthread feeder([&] {
+        auto frame = 0;
+        for (auto [width, height] : {std::pair{64, 48}, std::pair{32, 24}}) {
+            auto caps = gray_caps(width, height);
+            gst_app_src_set_caps(GST_APP_SRC(src.get()), caps);
+            gst_caps_unref(caps);
+            for (auto i = 0; i < FRAMES; ++i, ++frame) {
+                auto buffer = gst_buffer_new_allocate(nullptr, width * height, nullptr);
+                gst_buffer_memset(buffer, 0, static_cast<guint8>(frame), width * height);
+                GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(frame, GST_SECOND, 30);
+                gst_app_src_push_buffer(GST_APP_SRC(src.get()), buffer);
+            }
+        }
+        gst_app_src_end_of_stream(GST_APP_SRC(src.get()));
+    });
+    ASSERT_TRUE(run_to_eos(pipeline.get()));
+    feeder.join();
+    EXPECT_TRUE(recorder.stop());
+
+    auto files = fragments(prefix, ".y4m");
+    ASSERT_EQ(files.size(), 2u);
+    auto first = read_segment(files[0], 64 * 48);
+    auto second = read_segment(files[1], 32 * 24);
+    EXPECT_EQ(first.header, "YUV4MPEG2 W64 H48 F30:1 Ip A1:1 Cmono");
+    EXPECT_EQ(second.header, "YUV4MPEG2 W32 H24 F30:1 Ip A1:1 Cmono");
+    EXPECT_TRUE(first.whole);
+    EXPECT_TRUE(second.whole);
+    EXPECT_EQ(first.frames, std::uint64_t{FRAMES});
+    EXPECT_EQ(second.frames, std::uint64_t{FRAMES});
+}
+
+
+// Frames per second a whole pipeline sustains while recording each TEST camera's caps as Y4M
+// and, as it would be without raw_recording, as M-JPEG on thorjpegenc. Three seconds of video
+// each, against the camera's own frame rate.
+TEST(RawRecorderBenchmark, SustainedFps)
+{
+    ASSERT_TRUE(register_parallel_jpeg_enc());
+    for (auto &cap : TEST_CAPS) {
+        auto frames = cap.fps * 3;
+        auto name = fmt::format("{}_{}x{}_{}", cap.format, cap.width, cap.height, cap.fps);
+        auto directory = test_directory() / name;
+        fs::create_directories(directory);
+
+        auto y4m = sustained_fps(cap, frames, [&](GstElement *pipeline, GstElement *tee) {
+            auto recorder =
+                std::make_shared<RawRecorder>(directory / "raw", RawRecorder::Options());
+            EXPECT_TRUE(recorder->start(pipeline, tee));
+            return [recorder] { EXPECT_TRUE(recorder->stop()); };
+        });
+        auto mjpeg = sustained_fps(cap, frames, [&](GstElement *pipeline, GstElement *tee) {
+            auto description = fmt::format(
+                "queue ! thorjpegenc ! splitmuxsink muxer-factory=matroskamux "
+                "location=\"{}-%05d.mkv\"",
+                (directory / "jpeg").generic_string()
+            );
+            auto branch = gst_parse_bin_from_description(description.c_str(), TRUE, nullptr);
+            EXPECT_TRUE(branch);
+            gst_bin_add(GST_BIN(pipeline), branch);
+            EXPECT_TRUE(gst_element_link(tee, branch));
+            return [] {};
+        });
+
+        EXPECT_EQ(fragments(directory / "raw", ".y4m").size(), 1u) << name;
+        EXPECT_EQ(fragments(directory / "jpeg").size(), 1u) << name;
+        fs::remove_all(directory);
+
+        RecordProperty(fmt::format("{}_y4m_fps", name), fmt::format("{:.0f}", y4m));
+        RecordProperty(fmt::format("{}_mjpeg_fps", name), fmt::format("{:.0f}", mjpeg));
+        spdlog::info(
+            "{} at {} fps: Y4M sustains {:.0f} fps, M-JPEG {:.0f} fps", name, cap.fps, y4m, mjpeg
+        );
+        EXPECT_GT(y4m, 0.0);
+        EXPECT_GT(mjpeg, 0.0);
+    }
+}
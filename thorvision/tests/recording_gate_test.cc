@@ -0,0 +1,74 @@
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "recording_gate.h"
+#include "test_recording.h"
+
+
+namespace
+{
+auto constexpr FPS = 30;
+auto constexpr FRAMES = 60;
+auto constexpr FIRST_FRAME = 20;
+// Running time is this far ahead of PTS, as in a pipeline that has been paused.
+auto constexpr SEGMENT_BASE = 5 * GST_SECOND;
+
+GstClockTime pts(std::uint64_t frame)
+{
+    return gst_util_uint64_scale(frame, GST_SECOND, FPS);
+}
+
+GstPadProbeReturn shift_segment(GstPad *, GstPadProbeInfo *info, gpointer)
+{
+    auto event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_SEGMENT) return GST_PAD_PROBE_OK;
+    const GstSegment *segment;
+    gst_event_parse_segment(event, &segment);
+    GstSegment shifted;
+    gst_segment_copy_into(segment, &shifted);
+    shifted.base = SEGMENT_BASE;
+    gst_event_unref(event);
+    GST_PAD_PROBE_INFO_DATA(info) = gst_event_new_segment(&shifted);
+    return GST_PAD_PROBE_OK;
+}
+}  // namespace
+
+
+// A gate opened on a running time, as SyncStart opens it on a clock time, starts on the frame
+// at that running time rather than on the frame whose PTS equals it.
+TEST(RecordingGate, OpensAtRunningTimeThroughTheSegment)
+{
+    auto directory = test_directory();
+    auto prefix = directory / "camera";
+    auto pipeline = jpeg_stream(FRAMES, FPS);
+    ASSERT_TRUE(pipeline);
+    auto tee = child(pipeline.get(), "t");
+    auto tee_sink = gst_element_get_static_pad(tee.get(), "sink");
+    gst_pad_add_probe(
+        tee_sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, shift_segment, nullptr, nullptr
+    );
+    gst_object_unref(tee_sink);
+
+    auto gate = RecordingGate::open(tee.get(), GST_CLOCK_TIME_NONE, [&] {
+        add_recording_branch(pipeline.get(), tee.get(), prefix, 0);
+    });
+    ASSERT_TRUE(gate);
+    auto start = SEGMENT_BASE + pts(FIRST_FRAME);
+    std::vector<GstClockTime> first;
+    gate->open_at_running_time(start, start, [&](GstBuffer *buffer, GstClockTime running_time) {
+        first = {GST_BUFFER_PTS(buffer), running_time};
+    });
+    ASSERT_TRUE(run_to_eos(pipeline.get()));
+
+    ASSERT_EQ(first.size(), 2u);
+    EXPECT_EQ(first[0], pts(FIRST_FRAME));
+    EXPECT_EQ(first[1], start);
+    auto files = fragments(prefix);
+    ASSERT_EQ(files.size(), 1u);
+    auto frames = read_container(files.front());
+    ASSERT_EQ(frames.size(), std::size_t{FRAMES - FIRST_FRAME});
+    EXPECT_EQ(frames.front().pts, start);
+}
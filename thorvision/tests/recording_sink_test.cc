@@ -0,0 +1,253 @@
+#include <fmt/core.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "block_writer.h"
+#include "recording_sink.h"
+#include "test_recording.h"
+
+
+namespace
+{
+auto constexpr FPS = 30;
+
+std::vector<char> read_file(const fs::path &file)
+{
+    std::ifstream in(file, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), {}};
+}
+
+// A thorrecordingsink set up the way StreamWindow sets it up for a stream of this rate.
+GstElement *recording_sink(std::uint64_t bytes_per_second, bool direct)
+{
+    auto buffers = BlockWriter::Options::for_bitrate(bytes_per_second);
+    auto sink = gst_element_factory_make("thorrecordingsink", nullptr);
+    g_object_set(
+        sink,
+        "block-size",
+        static_cast<guint>(buffers.block_size),
+        "queue-blocks",
+        static_cast<guint>(buffers.queue_blocks),
+        "preallocate",
+        guint64{64} << 20,
+        "direct",
+        static_cast<gboolean>(direct),
+        nullptr
+    );
+    return sink;
+}
+
+// One 1080p frame of noise, which compresses about as badly as a camera image can.
+std::vector<unsigned char> camera_jpeg()
+{
+    ElementPtr pipeline(
+        gst_parse_launch(
+            "videotestsrc num-buffers=1 pattern=snow ! "
+            "video/x-raw,format=I420,width=1920,height=1080 ! jpegenc quality=90 ! "
+            "appsink name=sink sync=false",
+            nullptr
+        ),
+        gst_object_unref
+    );
+    std::vector<unsigned char> jpeg;
+    if (!pipeline) return jpeg;
+    auto sink = child(pipeline.get(), "sink");
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    if (auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink.get()))) {
+        GstMapInfo map;
+        gst_buffer_map(gst_sample_get_buffer(sample), &map, GST_MAP_READ);
+        jpeg.assign(map.data, map.data + map.size);
+        gst_buffer_unmap(gst_sample_get_buffer(sample), &map);
+        gst_sample_unref(sample);
+    }
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    return jpeg;
+}
+
+struct Throughput {
+    double seconds;
+    double mb_per_second;
+    // Longest time the streaming thread waited to hand a frame on.
+    double max_push_ms;
+};
+
+// Records the same frame as fast as the branch takes it, into two-second fragments.
+Throughput record(
+    const std::vector<unsigned char> &jpeg, int frames, const fs::path &prefix, GstElement *sink
+)
+{
+    auto description = fmt::format(
+        "appsrc name=src format=time block=true max-bytes={} "
+        "caps=\"image/jpeg,width=1920,height=1080,framerate={}/1\" ! "
+        "jpegparse ! tee name=t",
+        4 * jpeg.size(),
+        FPS
+    );
+    ElementPtr pipeline(gst_parse_launch(description.c_str(), nullptr), gst_object_unref);
+    EXPECT_TRUE(pipeline);
+    if (!pipeline) return {};
+    auto tee = child(pipeline.get(), "t");
+    add_recording_branch(pipeline.get(), tee.get(), prefix, 2 * GST_SECOND, sink);
+    auto src = child(pipeline.get(), "src");
+
+    double max_push_ms = 0;
+    std::jthread feeder([&] {
+        for (auto frame = 0; frame < frames; ++frame) {
+            auto buffer = gst_buffer_new_memdup(jpeg.data(), jpeg.size());
+            GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(frame, GST_SECOND, FPS);
+            GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale(1, GST_SECOND, FPS);
+            auto begin = std::chrono::steady_clock::now();
+            gst_app_src_push_buffer(GST_APP_SRC(src.get()), buffer);
+            auto elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - begin
+            );
+            max_push_ms = std::max(max_push_ms, elapsed.count());
+        }
+        gst_app_src_end_of_stream(GST_APP_SRC(src.get()));
+    });
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(run_to_eos(pipeline.get(), {}, {}, 120 * GST_SECOND));
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    feeder.join();
+
+    std::uint64_t bytes = 0;
+    for (auto &file : fragments(prefix)) bytes += fs::file_size(file);
+    return {seconds, static_cast<double>(bytes) / seconds / 1e6, max_push_ms};
+}
+}  // namespace
+
+
+// Random-sized writes with header rewrites, as muxers make them, read back the same with and
+// without O_DIRECT; blocks are small so most writes straddle a sector.
+TEST(BlockWriter, DirectFilesMatchBufferedOnes)
+{
+    auto directory = test_directory();
+    for (auto direct : {false, true}) {
+        BlockWriter::Options options;
+        options.block_size = 8192;
+        options.queue_blocks = 2;
+        options.preallocate = 1 << 20;
+        options.direct = direct;
+        BlockWriter writer(options);
+        auto file = directory / fmt::format("direct-{}.bin", direct);
+        ASSERT_TRUE(writer.open(file));
+
+        std::mt19937 random(1);
+        std::vector<char> expected;
+        for (auto i = 0; i < 300; ++i) {
+            std::vector<char> data(random() % 3000 + 1);
+            for (auto &byte : data) byte = static_cast<char>(random());
+            ASSERT_TRUE(writer.write(data.data(), data.size()));
+            expected.insert(expected.end(), data.begin(), data.end());
+        }
+        std::string header = "HEADER";
+        ASSERT_TRUE(writer.seek(5));
+        ASSERT_TRUE(writer.write(header.data(), header.size()));
+        std::copy(header.begin(), header.end(), expected.begin() + 5);
+        ASSERT_TRUE(writer.seek(expected.size()));
+        ASSERT_TRUE(writer.write("end", 3));
+        expected.insert(expected.end(), {'e', 'n', 'd'});
+        ASSERT_TRUE(writer.close());
+
+        EXPECT_EQ(read_file(file), expected) << "direct " << direct;
+    }
+}
+
+TEST(BlockWriter, SizesBuffersByBitrate)
+{
+    auto defaults = BlockWriter::Options::for_bitrate(0);
+    EXPECT_EQ(defaults.block_size, BlockWriter::Options{}.block_size);
+
+    // 720p M-JPEG: a megabyte of buffers instead of 36.
+    auto mjpeg = BlockWriter::Options::for_bitrate(1'000'000);
+    EXPECT_LE(mjpeg.block_size * (mjpeg.queue_blocks + 1), std::size_t{2} << 20);
+    EXPECT_GE(mjpeg.block_size * mjpeg.queue_blocks, 1'000'000u);
+
+    // Raw 1080p60 YUY2 still queues a second of it.
+    auto raw = BlockWriter::Options::for_bitrate(1920 * 1080 * 2 * 60);
+    EXPECT_GE(raw.block_size * raw.queue_blocks, std::size_t{1920 * 1080 * 2 * 60});
+    EXPECT_EQ(raw.block_size % 4096, 0u);
+}
+
+// thorrecordingsink stores the same frames at the same timestamps as splitmuxsink's own
+// filesink, fragment for fragment.
+TEST(RecordingSink, RecordsWhatFilesinkRecords)
+{
+    ASSERT_TRUE(register_recording_sink());
+    auto directory = test_directory();
+    auto pipeline = jpeg_stream(150, FPS);
+    ASSERT_TRUE(pipeline);
+    auto tee = child(pipeline.get(), "t");
+    add_recording_branch(pipeline.get(), tee.get(), directory / "filesink", GST_SECOND);
+    add_recording_branch(
+        pipeline.get(), tee.get(), directory / "thor", GST_SECOND, recording_sink(1'000'000, true)
+    );
+    ASSERT_TRUE(run_to_eos(pipeline.get()));
+
+    auto expected = fragments(directory / "filesink");
+    auto written = fragments(directory / "thor");
+    ASSERT_GE(expected.size(), 4u);
+    ASSERT_EQ(written.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        auto expected_frames = read_container(expected[i]);
+        auto frames = read_container(written[i]);
+        ASSERT_FALSE(frames.empty()) << written[i];
+        ASSERT_EQ(frames.size(), expected_frames.size()) << written[i];
+        for (std::size_t frame = 0; frame < frames.size(); ++frame) {
+            EXPECT_EQ(frames[frame].pts, expected_frames[frame].pts) << written[i];
+            EXPECT_EQ(frames[frame].jpeg, expected_frames[frame].jpeg) << written[i];
+        }
+    }
+}
+
+
+// Throughput of a 1080p M-JPEG recording through thorrecordingsink, with and without direct
+// I/O, against splitmuxsink's filesink, and how long the streaming thread waited at most.
+TEST(RecordingSinkBenchmark, AgainstFilesink)
+{
+    auto constexpr FRAMES = 300;
+    ASSERT_TRUE(register_recording_sink());
+    auto jpeg = camera_jpeg();
+    ASSERT_FALSE(jpeg.empty());
+    auto bitrate = static_cast<std::uint64_t>(jpeg.size()) * FPS;
+    auto directory = test_directory();
+
+    auto filesink = record(jpeg, FRAMES, directory / "filesink", nullptr);
+    auto buffered = record(jpeg, FRAMES, directory / "buffered", recording_sink(bitrate, false));
+    auto direct = record(jpeg, FRAMES, directory / "direct", recording_sink(bitrate, true));
+    fs::remove_all(directory);
+
+    std::pair<const char *, Throughput> const results[] = {
+        {"filesink", filesink}, {"thorrecordingsink", buffered}, {"direct", direct}
+    };
+    for (auto &[name, result] : results) {
+        RecordProperty(
+            fmt::format("{}_mb_per_s", name), fmt::format("{:.0f}", result.mb_per_second)
+        );
+        RecordProperty(
+            fmt::format("{}_max_push_ms", name), fmt::format("{:.1f}", result.max_push_ms)
+        );
+        spdlog::info(
+            "{}: {:.0f} MB/s, streaming thread waited at most {:.1f} ms",
+            name,
+            result.mb_per_second,
+            result.max_push_ms
+        );
+    }
+    // The sink only moves the writes to another thread; it must not be slower for it.
+    EXPECT_GT(buffered.mb_per_second, 0.5 * filesink.mb_per_second);
+}
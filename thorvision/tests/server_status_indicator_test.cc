@@ -0,0 +1,398 @@
+#include <fmt/core.h>
+#include <gio/gio.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "server_status_indicator.h"
+
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+auto constexpr REQUEST = std::string_view("GET /status HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+auto constexpr RESPONSE = std::string_view("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+
+bool wait_on(GSocket *socket, GIOCondition condition, std::chrono::milliseconds timeout)
+{
+    auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(timeout).count();
+    return g_socket_condition_timed_wait(socket, condition, microseconds, nullptr, nullptr);
+}
+
+// Stands in for the camera server: a local HTTP endpoint that answers while it is up and
+// refuses connections while it is down. Its probe() does what xvc::server_status does, over
+// a real connection to it, and records when it was made.
+class StandInServer
+{
+public:
+    StandInServer() : _port(0), _up(false), _applied(false), _running(true)
+    {
+        _thread = std::thread(&StandInServer::serve, this);
+    }
+
+    ~StandInServer()
+    {
+        {
+            std::lock_guard lock(_mutex);
+            _running = false;
+        }
+        _thread.join();
+    }
+
+    // Returns once the endpoint listens or refuses.
+    void set_up(bool up)
+    {
+        std::unique_lock lock(_mutex);
+        _up = up;
+        _applied = false;
+        _changed.wait(lock, [this] { return _applied; });
+    }
+
+    ServerStatusIndicator::Probe probe()
+    {
+        return [this](std::chrono::milliseconds timeout) {
+            guint16 port;
+            {
+                std::lock_guard lock(_mutex);
+                _probes.push_back(Clock::now());
+                port = _port;
+            }
+            return port > 0 && request(port, timeout);
+        };
+    }
+
+    std::vector<Clock::time_point> probes()
+    {
+        std::lock_guard lock(_mutex);
+        return _probes;
+    }
+
+    std::size_t probes_since(Clock::time_point start)
+    {
+        auto all = probes();
+        return static_cast<std::size_t>(
+            std::count_if(all.begin(), all.end(), [&](auto time) { return time >= start; })
+        );
+    }
+
+private:
+    static bool request(guint16 port, std::chrono::milliseconds timeout)
+    {
+        auto socket = g_socket_new(
+            G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, nullptr
+        );
+        if (!socket) return false;
+        g_socket_set_blocking(socket, FALSE);
+        auto loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+        auto address = g_inet_socket_address_new(loopback, port);
+        GError *error = nullptr;
+        auto connected = g_socket_connect(socket, address, nullptr, &error);
+        if (!connected && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_PENDING)) {
+            connected = wait_on(socket, G_IO_OUT, timeout) &&
+                        g_socket_check_connect_result(socket, nullptr);
+        }
+        g_clear_error(&error);
+        g_object_unref(address);
+        g_object_unref(loopback);
+
+        auto answered = false;
+        if (connected &&
+            g_socket_send(socket, REQUEST.data(), REQUEST.size(), nullptr, nullptr) > 0 &&
+            wait_on(socket, G_IO_IN, timeout)) {
+            char reply[64] = {};
+            auto size = g_socket_receive(socket, reply, sizeof(reply) - 1, nullptr, nullptr);
+            answered = size > 0 && std::string_view(reply).starts_with("HTTP/1.1 200");
+        }
+        g_socket_close(socket, nullptr);
+        g_object_unref(socket);
+        return answered;
+    }
+
+    // Rebinds the same port each time it comes up, as a restarted server would.
+    void serve()
+    {
+        GSocket *listener = nullptr;
+        std::unique_lock lock(_mutex);
+        while (_running) {
+            if (_up && !listener) listener = listen();
+            if (!_up && listener) {
+                g_socket_close(listener, nullptr);
+                g_object_unref(listener);
+                listener = nullptr;
+            }
+            if (!_applied) {
+                _applied = true;
+                _changed.notify_all();
+            }
+            lock.unlock();
+            if (listener && wait_on(listener, G_IO_IN, 10ms)) {
+                if (auto client = g_socket_accept(listener, nullptr, nullptr)) {
+                    char request[256];
+                    if (wait_on(client, G_IO_IN, 500ms)) {
+                        g_socket_receive(client, request, sizeof(request), nullptr, nullptr);
+                        g_socket_send(client, RESPONSE.data(), RESPONSE.size(), nullptr, nullptr);
+                    }
+                    g_socket_close(client, nullptr);
+                    g_object_unref(client);
+                }
+            } else if (!listener) {
+                std::this_thread::sleep_for(10ms);
+            }
+            lock.lock();
+        }
+        if (listener) {
+            g_socket_close(listener, nullptr);
+            g_object_unref(listener);
+        }
+    }
+
+    // Called with _mutex held.
+    GSocket *listen()
+    {
+        auto socket = g_socket_new(
+            G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, nullptr
+        );
+        auto loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+        auto address = g_inet_socket_address_new(loopback, _port);
+        auto listening = socket && g_socket_bind(socket, address, TRUE, nullptr) &&
+                         g_socket_listen(socket, nullptr);
+        g_object_unref(address);
+        g_object_unref(loopback);
+        if (!listening) {
+            ADD_FAILURE() << "The stand-in server can't listen on port " << _port;
+            if (socket) g_object_unref(socket);
+            return nullptr;
+        }
+        if (_port == 0) {
+            auto local = g_socket_get_local_address(socket, nullptr);
+            _port = g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(local));
+            g_object_unref(local);
+        }
+        return socket;
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    // 0 until the server has been up once.
+    guint16 _port;
+    bool _up;
+    bool _applied;
+    bool _running;
+    std::vector<Clock::time_point> _probes;
+    std::thread _thread;
+};
+
+// Counts status_change, which is emitted on the indicator's thread.
+struct Transitions {
+    std::atomic_int on = 0;
+    std::atomic_int off = 0;
+
+    void watch(ServerStatusIndicator &indicator)
+    {
+        QObject::connect(
+            &indicator,
+            &ServerStatusIndicator::status_change,
+            &indicator,
+            [this](bool is_on) { ++(is_on ? on : off); },
+            Qt::DirectConnection
+        );
+    }
+};
+
+template <typename Predicate>
+bool wait_for(Predicate &&predicate, std::chrono::milliseconds timeout)
+{
+    auto deadline = Clock::now() + timeout;
+    while (!predicate()) {
+        if (Clock::now() > deadline) return false;
+        std::this_thread::sleep_for(5ms);
+    }
+    return true;
+}
+
+// CPU time of the whole process, user and system.
+std::chrono::microseconds process_cpu_time()
+{
+#if defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    auto ticks = [](const FILETIME &time) {
+        return (static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+    };
+    return std::chrono::microseconds((ticks(kernel) + ticks(user)) / 10);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    auto microseconds = [](const timeval &time) {
+        return std::chrono::seconds(time.tv_sec) + std::chrono::microseconds(time.tv_usec);
+    };
+    return microseconds(usage.ru_utime) + microseconds(usage.ru_stime);
+#endif
+}
+}  // namespace
+
+
+TEST(ServerStatusIndicator, BacksOffWhileServerIsDown)
+{
+    StandInServer server;
+    ServerStatusIndicator indicator(nullptr, server.probe());
+    std::this_thread::sleep_for(1900ms);
+
+    // Probes at 0, 250, 750, 1250 and 1750 ms: the wait doubles from 250 ms up to 500 ms.
+    auto probes = server.probes();
+    ASSERT_GE(probes.size(), 4u);
+    EXPECT_LE(probes.size(), 5u);
+    EXPECT_GE(probes[2] - probes[1], 1.5 * (probes[1] - probes[0]));
+    for (std::size_t i = 2; i < probes.size(); ++i) {
+        EXPECT_LT(probes[i] - probes[i - 1], 600ms);
+    }
+}
+
+// The latency the backoff must not give up: a server that comes back without a word is seen
+// within half a second, however long it was down.
+TEST(ServerStatusIndicator, NoticesServerComingUpWithinHalfASecond)
+{
+    StandInServer server;
+    Transitions transitions;
+    ServerStatusIndicator indicator(nullptr, server.probe());
+    transitions.watch(indicator);
+    std::this_thread::sleep_for(3s);
+
+    for (auto outage = 1; outage <= 2; ++outage) {
+        server.set_up(true);
+        auto start = Clock::now();
+        ASSERT_TRUE(wait_for([&] { return transitions.on == outage; }, 2s));
+        EXPECT_LT(Clock::now() - start, 600ms) << "after outage " << outage;
+
+        server.set_up(false);
+        ASSERT_TRUE(wait_for([&] { return transitions.off == outage; }, 4s));
+        std::this_thread::sleep_for(2s);
+    }
+}
+
+TEST(ServerStatusIndicator, ActivityCutsBackoffShort)
+{
+    StandInServer server;
+    Transitions transitions;
+    auto indicator = std::make_unique<ServerStatusIndicator>(nullptr, server.probe());
+    transitions.watch(*indicator);
+    // Waiting out a 500 ms backoff by now.
+    std::this_thread::sleep_for(800ms);
+
+    server.set_up(true);
+    auto start = Clock::now();
+    indicator->notify_activity();
+    ASSERT_TRUE(wait_for([&] { return transitions.on == 1; }, 500ms));
+    EXPECT_LT(Clock::now() - start, 200ms);
+    EXPECT_EQ(transitions.off, 0);
+}
+
+TEST(ServerStatusIndicator, TrafficReplacesHeartbeatProbes)
+{
+    StandInServer server;
+    server.set_up(true);
+    Transitions transitions;
+    ServerStatusIndicator indicator(nullptr, server.probe());
+    transitions.watch(indicator);
+    ASSERT_TRUE(wait_for([&] { return server.probes().size() == 1; }, 500ms));
+
+    // Messages from the server every 100 ms for three heartbeat intervals' worth.
+    auto start = Clock::now();
+    while (Clock::now() - start < 3s) {
+        indicator.notify_activity();
+        std::this_thread::sleep_for(100ms);
+    }
+    EXPECT_EQ(server.probes_since(start), 0u);
+
+    // Silence: the next heartbeat probe finds the server gone, and says so once.
+    server.set_up(false);
+    auto silent = Clock::now();
+    ASSERT_TRUE(wait_for([&] { return transitions.off == 1; }, 3s));
+    EXPECT_GE(Clock::now() - silent, 1500ms);
+    std::this_thread::sleep_for(600ms);
+    EXPECT_EQ(transitions.off, 1);
+}
+
+TEST(ServerStatusIndicator, SignalsOnlyTransitions)
+{
+    StandInServer server;
+    Transitions transitions;
+    ServerStatusIndicator indicator(nullptr, server.probe());
+    // Connected before the server comes up, so the first transition is seen.
+    transitions.watch(indicator);
+    server.set_up(true);
+    indicator.notify_activity();
+    ASSERT_TRUE(wait_for([&] { return transitions.on == 1; }, 500ms));
+
+    // Heartbeat probes every 2 s find it still up.
+    std::this_thread::sleep_for(4500ms);
+    EXPECT_GE(server.probes().size(), 3u);
+    EXPECT_EQ(transitions.on, 1);
+    EXPECT_EQ(transitions.off, 0);
+}
+
+TEST(ServerStatusIndicator, DestructorDoesNotWaitForBackoff)
+{
+    StandInServer server;
+    auto indicator = std::make_unique<ServerStatusIndicator>(nullptr, server.probe());
+    // Well into a backoff wait.
+    std::this_thread::sleep_for(1000ms);
+    auto start = Clock::now();
+    indicator.reset();
+    EXPECT_LT(Clock::now() - start, 100ms);
+}
+
+// CPU the process spends while nothing happens, with the stand-in server up and silent, so
+// the indicator only sends heartbeat probes, and down, so it retries every 500 ms. The
+// stand-in's own accept loop is included, so these are upper bounds.
+TEST(ServerStatusIndicatorBenchmark, IdleCpu)
+{
+    auto constexpr WINDOW = 6s;
+    StandInServer server;
+    Transitions transitions;
+    ServerStatusIndicator indicator(nullptr, server.probe());
+    transitions.watch(indicator);
+
+    auto idle_cpu = [&](const char *state) {
+        auto probes = server.probes().size();
+        auto cpu = process_cpu_time();
+        std::this_thread::sleep_for(WINDOW);
+        auto percent = 100.0 * std::chrono::duration<double>(process_cpu_time() - cpu) / WINDOW;
+        probes = server.probes().size() - probes;
+        RecordProperty(fmt::format("{}_cpu_percent", state), fmt::format("{:.3f}", percent));
+        RecordProperty(fmt::format("{}_probes", state), static_cast<int>(probes));
+        spdlog::info(
+            "Server status while {}: {:.3f} % CPU, {} probes in {} s",
+            state,
+            percent,
+            probes,
+            std::chrono::duration_cast<std::chrono::seconds>(WINDOW).count()
+        );
+    };
+
+    std::this_thread::sleep_for(1s);
+    idle_cpu("down");
+    server.set_up(true);
+    ASSERT_TRUE(wait_for([&] { return transitions.on == 1; }, 1s));
+    idle_cpu("up");
+}
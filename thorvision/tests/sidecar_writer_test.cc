@@ -0,0 +1,241 @@
+#include <fmt/core.h>
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "recording_gate.h"
+#include "sidecar_writer.h"
+#include "test_recording.h"
+#include "xdaqvc/xvc.h"
+
+
+namespace
+{
+auto constexpr FPS = 30;
+auto constexpr FRAMES = 120;
+// The gate opens on this frame.
+auto constexpr FIRST_FRAME = 10;
+// Moves the stream's running time away from its PTS, as a pipeline that has been paused or
+// restarted has.
+auto constexpr SEGMENT_BASE = 7 * GST_SECOND;
+
+bool has_metadata(std::uint64_t frame)
+{
+    return frame % 5 != 2;
+}
+
+XDAQFrameData metadata(std::uint64_t frame)
+{
+    auto low = static_cast<std::uint32_t>(frame);
+    return XDAQFrameData{1'000 * frame + 5, low * 3, low % 3, low % 7, low, ~frame};
+}
+
+GstClockTime pts(std::uint64_t frame)
+{
+    return gst_util_uint64_scale(frame, GST_SECOND, FPS);
+}
+
+std::uint64_t frame_at(GstClockTime running_time)
+{
+    return gst_util_uint64_scale_round(running_time - SEGMENT_BASE, FPS, GST_SECOND);
+}
+
+// Attaches metadata like track_metadata does, skipping some frames, and shifts the segment.
+GstPadProbeReturn tag_frames(GstPad *, GstPadProbeInfo *info, gpointer)
+{
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+        auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        auto frame = gst_util_uint64_scale_round(GST_BUFFER_PTS(buffer), FPS, GST_SECOND);
+        if (has_metadata(frame)) attach_frame_metadata(buffer, metadata(frame));
+        return GST_PAD_PROBE_OK;
+    }
+    auto event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) != GST_EVENT_SEGMENT) return GST_PAD_PROBE_OK;
+    const GstSegment *segment;
+    gst_event_parse_segment(event, &segment);
+    GstSegment shifted;
+    gst_segment_copy_into(segment, &shifted);
+    shifted.base = SEGMENT_BASE;
+    gst_event_unref(event);
+    GST_PAD_PROBE_INFO_DATA(info) = gst_event_new_segment(&shifted);
+    return GST_PAD_PROBE_OK;
+}
+
+struct Record {
+    std::uint64_t timestamp;
+    XDAQFrameData metadata;
+};
+
+std::vector<Record> read_sidecar(const fs::path &file)
+{
+    std::ifstream in(file, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), {});
+    EXPECT_EQ(bytes.size() % SidecarWriter::RECORD_SIZE, 0u) << file;
+    std::vector<Record> records(bytes.size() / SidecarWriter::RECORD_SIZE);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        auto record = bytes.data() + i * SidecarWriter::RECORD_SIZE;
+        std::memcpy(&records[i].timestamp, record, sizeof(std::uint64_t));
+        std::memcpy(&records[i].metadata, record + sizeof(std::uint64_t), sizeof(XDAQFrameData));
+    }
+    return records;
+}
+
+std::vector<char> read_bytes(const fs::path &file)
+{
+    std::ifstream in(file, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), {}};
+}
+
+// Parses the XDAQ metadata embedded in each JPEG and attaches it, as StreamWindow does.
+GstPadProbeReturn parse_frames(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto handler = static_cast<MetadataHandler *>(user_data);
+    if (auto ret = parse_jpeg_metadata(pad, info, handler); ret != GST_PAD_PROBE_OK) return ret;
+    auto buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    auto metadata = handler->safe_deque.check_pts_pop_timestamp(GST_BUFFER_PTS(buffer));
+    if (metadata) attach_frame_metadata(buffer, *metadata);
+    return GST_PAD_PROBE_OK;
+}
+}  // namespace
+
+
+// Records a stream with a shifted segment into three fragments and checks every .bin record
+// against the frame the container holds: the timestamp xvc::parse_video_save_binary_jpeg
+// reads back for it, and the frame's own metadata. Frames without metadata are in the video
+// but get no record.
+TEST(SidecarWriter, MatchesContainerTimestamps)
+{
+    auto directory = test_directory();
+    auto prefix = directory / "camera";
+    auto pipeline = jpeg_stream(FRAMES, FPS);
+    ASSERT_TRUE(pipeline);
+
+    auto tee = child(pipeline.get(), "t");
+    auto tee_sink = gst_element_get_static_pad(tee.get(), "sink");
+    gst_pad_add_probe(
+        tee_sink,
+        static_cast<GstPadProbeType>(
+            GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM
+        ),
+        tag_frames,
+        nullptr,
+        nullptr
+    );
+    gst_object_unref(tee_sink);
+
+    auto sidecar = std::make_shared<SidecarWriter>(prefix);
+    auto gate = RecordingGate::open(
+        tee.get(),
+        pts(FIRST_FRAME),
+        [&] { add_recording_branch(pipeline.get(), tee.get(), prefix, 1500 * GST_MSECOND); },
+        nullptr,
+        sidecar
+    );
+    ASSERT_TRUE(gate);
+    ASSERT_TRUE(run_to_eos(
+        pipeline.get(),
+        [&](auto &location, auto time) { EXPECT_TRUE(sidecar->fragment_opened(location, time)); },
+        [&](auto &location, auto time) { EXPECT_TRUE(sidecar->fragment_closed(location, time)); }
+    ));
+    EXPECT_TRUE(sidecar->idle());
+    sidecar.reset();
+
+    auto files = fragments(prefix);
+    ASSERT_GE(files.size(), 3u);
+    std::uint64_t recorded = 0;
+    std::uint64_t next_frame = FIRST_FRAME;
+    for (auto &file : files) {
+        auto frames = read_container(file);
+        auto records = read_sidecar(SidecarWriter::sidecar_path(file));
+        ASSERT_FALSE(frames.empty()) << file;
+
+        std::size_t record = 0;
+        for (auto &frame : frames) {
+            auto index = frame_at(frame.pts);
+            EXPECT_EQ(index, next_frame++) << file;
+            if (!has_metadata(index)) continue;
+            ASSERT_LT(record, records.size()) << file << " frame " << index;
+            auto &entry = records[record++];
+            EXPECT_EQ(entry.timestamp, frame.pts) << file << " frame " << index;
+            auto expected = metadata(index);
+            EXPECT_EQ(std::memcmp(&entry.metadata, &expected, sizeof(expected)), 0)
+                << file << " frame " << index;
+        }
+        EXPECT_EQ(record, records.size()) << file;
+        recorded += records.size();
+    }
+    EXPECT_EQ(next_frame, std::uint64_t{FRAMES});
+    // Every frame from the gate on, less those without metadata.
+    std::uint64_t expected = 0;
+    for (std::uint64_t frame = FIRST_FRAME; frame < FRAMES; ++frame) {
+        expected += has_metadata(frame);
+    }
+    EXPECT_EQ(recorded, expected);
+}
+
+
+// Replays an XDAQ camera recording, whose JPEGs carry the metadata in libxdaqmetadata's own
+// format, through the same parsing and recording path as a live camera, and checks every .bin
+// is byte for byte what xvc::parse_video_save_binary_jpeg makes of its fragment afterwards.
+// The embedding format is private to the library, so the frames have to come from a camera:
+// set THORVISION_XDAQ_RECORDING to an M-JPEG .mkv recorded from one.
+TEST(SidecarWriter, MatchesParsedRecording)
+{
+    auto source = std::getenv("THORVISION_XDAQ_RECORDING");
+    if (!source) GTEST_SKIP() << "THORVISION_XDAQ_RECORDING is not set";
+
+    auto directory = test_directory();
+    auto prefix = directory / "camera";
+    auto description = fmt::format(
+        "filesrc location=\"{}\" ! matroskademux ! jpegparse name=parser ! tee name=t ! queue ! "
+        "fakesink sync=false",
+        source
+    );
+    ElementPtr pipeline(gst_parse_launch(description.c_str(), nullptr), gst_object_unref);
+    ASSERT_TRUE(pipeline);
+
+    MetadataHandler handler;
+    auto parser = child(pipeline.get(), "parser");
+    auto parser_src = gst_element_get_static_pad(parser.get(), "src");
+    gst_pad_add_probe(parser_src, GST_PAD_PROBE_TYPE_BUFFER, parse_frames, &handler, nullptr);
+    gst_object_unref(parser_src);
+
+    auto tee = child(pipeline.get(), "t");
+    auto sidecar = std::make_shared<SidecarWriter>(prefix);
+    auto gate = RecordingGate::open(
+        tee.get(),
+        0,
+        [&] { add_recording_branch(pipeline.get(), tee.get(), prefix, 1500 * GST_MSECOND); },
+        nullptr,
+        sidecar
+    );
+    ASSERT_TRUE(gate);
+    ASSERT_TRUE(run_to_eos(
+        pipeline.get(),
+        [&](auto &location, auto time) { EXPECT_TRUE(sidecar->fragment_opened(location, time)); },
+        [&](auto &location, auto time) { EXPECT_TRUE(sidecar->fragment_closed(location, time)); },
+        120 * GST_SECOND
+    ));
+    sidecar.reset();
+
+    auto files = fragments(prefix);
+    ASSERT_FALSE(files.empty());
+    for (auto &file : files) {
+        auto bin = SidecarWriter::sidecar_path(file);
+        auto inline_bin = fs::path(bin).replace_extension(".inline.bin");
+        fs::rename(bin, inline_bin);
+        xvc::parse_video_save_binary_jpeg(file.string());
+
+        auto expected = read_bytes(bin);
+        EXPECT_FALSE(expected.empty()) << file;
+        EXPECT_EQ(read_bytes(inline_bin), expected) << file;
+    }
+}
@@ -0,0 +1,153 @@
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <QImage>
+#include <QPainter>
+#include <QString>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "stream_overlay.h"
+
+
+namespace
+{
+auto constexpr FRAMES = 300;
+// The preview windows' default size.
+auto const WINDOW = QSize(480, 360);
+
+// An RGBX frame like the ones FramePool converts, with some texture so the scaler has work.
+QImage frame(QSize size)
+{
+    QImage image(size, QImage::Format_RGBX8888);
+    for (auto y = 0; y < size.height(); ++y) {
+        auto row = image.scanLine(y);
+        for (auto x = 0; x < size.width(); ++x) {
+            row[x * 4] = static_cast<uchar>(x ^ y);
+            row[x * 4 + 1] = static_cast<uchar>(x + y);
+            row[x * 4 + 2] = static_cast<uchar>(x * y);
+            row[x * 4 + 3] = 255;
+        }
+    }
+    return image;
+}
+
+// Metadata that changes every frame, with DI and DO changing every 30.
+XDAQFrameData metadata(int frame)
+{
+    auto ttl = static_cast<std::uint32_t>(frame / 30 % 4);
+    return XDAQFrameData{
+        1'000'000u + static_cast<std::uint64_t>(frame) * 1'000,
+        static_cast<std::uint32_t>(frame) * 600,
+        ttl,
+        ttl * 3,
+        0,
+        0
+    };
+}
+
+// What paintEvent did before the overlay was cached and the preview branch scaled frames to
+// the window: a smooth-scaled full frame and every label laid out again.
+void paint_before(QPainter &painter, const QImage &image, const XDAQFrameData &metadata)
+{
+    auto width = WINDOW.width();
+    auto height = WINDOW.height();
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(QRect(QPoint(0, 0), WINDOW), image, image.rect());
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+
+    painter.setPen(QPen(Qt::white));
+    if (metadata.ttl_in >= 1 && metadata.ttl_in <= 32) {
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(QBrush(QColor(181, 157, 99)));
+        QPointF DI(16, 16);
+        painter.setOpacity(0.5);
+        painter.drawEllipse(DI, 10, 10);
+        QRectF text(DI.x() - 8, DI.y() - 8, 15, 15);
+        painter.setOpacity(1);
+        painter.setPen(QPen(Qt::black));
+        painter.drawText(text, Qt::AlignCenter, QString::number(metadata.ttl_in));
+        painter.setPen(QPen(Qt::white));
+    }
+    painter.drawText(
+        QRect(10, height - 60, width / 2, height - 60),
+        QString::fromStdString(fmt::format("XDAQ Time {:08x}", metadata.fpga_timestamp))
+    );
+    painter.drawText(
+        QRect(10, height - 30, width / 2, height - 30),
+        QString::fromStdString(fmt::format("Ephys Time {:04x}", metadata.rhythm_timestamp))
+    );
+    painter.drawText(
+        QRect(width - 130, height - 30, width, height - 30),
+        QString::fromStdString(fmt::format("DO word {:04x}", metadata.ttl_out))
+    );
+}
+
+template <typename Paint>
+double time_paints(Paint &&paint)
+{
+    QImage window(WINDOW, QImage::Format_ARGB32_Premultiplied);
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < FRAMES; ++i) {
+        QPainter painter(&window);
+        paint(painter, i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / FRAMES;
+}
+}  // namespace
+
+
+TEST(StreamOverlay, RepaintsChangedTimestamps)
+{
+    QImage first(WINDOW, QImage::Format_ARGB32_Premultiplied);
+    QImage second(WINDOW, QImage::Format_ARGB32_Premultiplied);
+    first.fill(Qt::black);
+    second.fill(Qt::black);
+    StreamOverlay overlay;
+    {
+        QPainter painter(&first);
+        overlay.paint(painter, WINDOW, metadata(0));
+    }
+    {
+        // Same DI and DO, so only the cached layer's timestamps differ.
+        QPainter painter(&second);
+        overlay.paint(painter, WINDOW, metadata(1));
+    }
+    EXPECT_NE(first, second);
+
+    QImage again(WINDOW, QImage::Format_ARGB32_Premultiplied);
+    again.fill(Qt::black);
+    {
+        QPainter painter(&again);
+        overlay.paint(painter, WINDOW, metadata(0));
+    }
+    EXPECT_EQ(first, again);
+}
+
+
+// Paint time of one preview window, as StreamWindow::paintEvent runs it, against the way it
+// painted before. Eight windows at 60 fps leave about 2 ms per paint.
+TEST(StreamOverlayBenchmark, PaintTime)
+{
+    auto const full = frame(QSize(1280, 720));
+    auto const fitted = frame(WINDOW);
+    std::vector<XDAQFrameData> frames;
+    for (auto i = 0; i < FRAMES; ++i) frames.push_back(metadata(i));
+
+    StreamOverlay overlay;
+    auto now = time_paints([&](QPainter &painter, int i) {
+        painter.drawImage(0, 0, fitted);
+        overlay.paint(painter, WINDOW, frames[i]);
+    });
+    auto before = time_paints([&](QPainter &painter, int i) {
+        paint_before(painter, full, frames[i]);
+    });
+
+    RecordProperty("paint_us", fmt::format("{:.1f}", now));
+    RecordProperty("paint_before_us", fmt::format("{:.1f}", before));
+    spdlog::info("Preview paint {:.1f} us, before caching {:.1f} us", now, before);
+    EXPECT_LT(now, 2000.0);
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <fmt/core.h>
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Recordings made the way StreamWindow makes them, from a JPEG stream through a tee branch
+// into splitmuxsink, and read back with GStreamer's own demuxer.
+
+namespace fs = std::filesystem;
+
+using ElementPtr = std::unique_ptr<GstElement, decltype(&gst_object_unref)>;
+
+// A camera-like JPEG stream: "videotestsrc ! jpegenc ! jpegparse ! tee name=t" with the tee
+// also feeding a fakesink, as the preview branch would.
+inline ElementPtr jpeg_stream(int frames, int fps, int width = 320, int height = 240)
+{
+    auto description = fmt::format(
+        "videotestsrc num-buffers={} pattern=ball ! "
+        "video/x-raw,format=I420,width={},height={},framerate={}/1 ! "
+        "jpegenc ! jpegparse name=parser ! tee name=t ! queue ! fakesink sync=false",
+        frames,
+        width,
+        height,
+        fps
+    );
+    GError *error = nullptr;
+    ElementPtr pipeline(gst_parse_launch(description.c_str(), &error), gst_object_unref);
+    if (error) {
+        ADD_FAILURE() << error->message;
+        g_error_free(error);
+    }
+    return pipeline;
+}
+
+inline ElementPtr child(GstElement *pipeline, const char *name)
+{
+    return {gst_bin_get_by_name(GST_BIN(pipeline), name), gst_object_unref};
+}
+
+// Adds "queue ! splitmuxsink" on a new tee pad, writing <prefix>-00000.mkv and on, like
+// xvc's recordings. Returns the splitmuxsink.
+inline GstElement *add_recording_branch(
+    GstElement *pipeline,
+    GstElement *tee,
+    const fs::path &prefix,
+    GstClockTime max_size_time,
+    GstElement *sink = nullptr
+)
+{
+    auto queue = gst_element_factory_make("queue", nullptr);
+    auto splitmuxsink = gst_element_factory_make("splitmuxsink", nullptr);
+    auto location = prefix.string() + "-%05d.mkv";
+    g_object_set(
+        splitmuxsink,
+        "location",
+        location.c_str(),
+        "max-size-time",
+        max_size_time,
+        "muxer-factory",
+        "matroskamux",
+        nullptr
+    );
+    if (sink) g_object_set(splitmuxsink, "sink", sink, nullptr);
+    gst_bin_add_many(GST_BIN(pipeline), queue, splitmuxsink, nullptr);
+    gst_element_link(queue, splitmuxsink);
+
+    auto templ = gst_element_get_pad_template(tee, "src_%u");
+    auto tee_pad = gst_element_request_pad(tee, templ, nullptr, nullptr);
+    auto queue_pad = gst_element_get_static_pad(queue, "sink");
+    EXPECT_EQ(gst_pad_link(tee_pad, queue_pad), GST_PAD_LINK_OK);
+    gst_object_unref(queue_pad);
+    gst_object_unref(tee_pad);
+    gst_element_sync_state_with_parent(queue);
+    gst_element_sync_state_with_parent(splitmuxsink);
+    return splitmuxsink;
+}
+
+// splitmuxsink's fragment messages: the file and the running time it starts or ends at.
+using FragmentMessage = std::function<void(const fs::path &location, GstClockTime time)>;
+
+// Plays the pipeline to EOS on the calling thread. Returns false on an error or timeout.
+inline bool run_to_eos(
+    GstElement *pipeline,
+    const FragmentMessage &opened = {},
+    const FragmentMessage &closed = {},
+    GstClockTime timeout = 30 * GST_SECOND
+)
+{
+    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+        gst_element_get_bus(pipeline), gst_object_unref
+    );
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    auto done = false;
+    auto ok = false;
+    while (!done) {
+        auto message = gst_bus_timed_pop_filtered(
+            bus.get(),
+            timeout,
+            static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_ELEMENT)
+        );
+        if (!message) break;
+        switch (GST_MESSAGE_TYPE(message)) {
+        case GST_MESSAGE_EOS: done = ok = true; break;
+        case GST_MESSAGE_ERROR: {
+            GError *error = nullptr;
+            gst_message_parse_error(message, &error, nullptr);
+            ADD_FAILURE() << error->message;
+            g_error_free(error);
+            done = true;
+            break;
+        }
+        default: {
+            auto structure = gst_message_get_structure(message);
+            auto location = structure ? gst_structure_get_string(structure, "location") : nullptr;
+            GstClockTime time = GST_CLOCK_TIME_NONE;
+            if (location) gst_structure_get_clock_time(structure, "running-time", &time);
+            if (location && gst_structure_has_name(structure, "splitmuxsink-fragment-opened")) {
+                if (opened) opened(location, time);
+            } else if (location &&
+                       gst_structure_has_name(structure, "splitmuxsink-fragment-closed")) {
+                if (closed) closed(location, time);
+            }
+            break;
+        }
+        }
+        gst_message_unref(message);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    return ok;
+}
+
+// Each frame of a recorded file: the timestamp the container stores and the JPEG image.
+struct ContainerFrame {
+    GstClockTime pts;
+    std::vector<unsigned char> jpeg;
+};
+
+inline std::vector<ContainerFrame> read_container(const fs::path &file)
+{
+    auto description = fmt::format(
+        "filesrc location=\"{}\" ! matroskademux ! appsink name=sink sync=false", file.string()
+    );
+    ElementPtr pipeline(gst_parse_launch(description.c_str(), nullptr), gst_object_unref);
+    std::vector<ContainerFrame> frames;
+    if (!pipeline) return frames;
+    auto sink = child(pipeline.get(), "sink");
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    while (auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink.get()))) {
+        auto buffer = gst_sample_get_buffer(sample);
+        GstMapInfo map;
+        gst_buffer_map(buffer, &map, GST_MAP_READ);
+        frames.push_back({GST_BUFFER_PTS(buffer), {map.data, map.data + map.size}});
+        gst_buffer_unmap(buffer, &map);
+        gst_sample_unref(sample);
+    }
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    return frames;
+}
+
+// The recording's fragments in order.
+inline std::vector<fs::path> fragments(const fs::path &prefix, const char *extension = ".mkv")
+{
+    std::vector<fs::path> files;
+    for (auto index = 0;; ++index) {
+        auto file = fs::path(fmt::format("{}-{:05d}{}", prefix.string(), index, extension));
+        if (!fs::exists(file)) break;
+        files.push_back(file);
+    }
+    return files;
+}
+
+// A fresh directory for one test's files.
+inline fs::path test_directory()
+{
+    auto info = testing::UnitTest::GetInstance()->current_test_info();
+    auto directory = fs::temp_directory_path() / "thorvision-tests" /
+                     fmt::format("{}.{}", info->test_suite_name(), info->name());
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    return directory;
+}
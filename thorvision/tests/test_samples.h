@@ -0,0 +1,44 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <cstdint>
+
+
+// Video samples for the tests, filled with a pattern that changes with seed so consecutive
+// frames differ.
+
+inline GstVideoInfo video_info(GstVideoFormat format, int width, int height)
+{
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, format, width, height);
+    return info;
+}
+
+inline GstBuffer *make_buffer(const GstVideoInfo &info, std::uint32_t seed = 0)
+{
+    auto size = GST_VIDEO_INFO_SIZE(&info);
+    auto buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    auto state = seed * 2654435761u + 1;
+    for (gsize i = 0; i < size; ++i) {
+        // Smooth gradients with a little noise, roughly like a camera image.
+        state = state * 1664525u + 1013904223u;
+        map.data[i] = static_cast<guint8>((i / 7 + seed) + (state >> 29));
+    }
+    gst_buffer_unmap(buffer, &map);
+    return buffer;
+}
+
+inline GstSample *make_sample(const GstVideoInfo &info, GstClockTime pts = 0)
+{
+    auto buffer = make_buffer(info, static_cast<std::uint32_t>(pts));
+    GST_BUFFER_PTS(buffer) = pts;
+    auto caps = gst_video_info_to_caps(&info);
+    auto sample = gst_sample_new(buffer, caps, nullptr, nullptr);
+    gst_caps_unref(caps);
+    gst_buffer_unref(buffer);
+    return sample;
+}
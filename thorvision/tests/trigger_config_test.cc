@@ -0,0 +1,109 @@
+#include <fmt/core.h>
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "trigger_config.h"
+
+
+namespace
+{
+auto constexpr CAMERA = "trigger-config-test";
+
+// What the streaming thread reads of the config for one frame: the pre-record budget and the
+// trigger settings.
+std::uint64_t read_frame_settings(const TriggerConfig &config)
+{
+    return config.pre_record_time + config.pre_record_size + config.trigger_on +
+           config.digital_channel + config.trigger_condition + config.trigger_duration +
+           config.debounce_ms + config.tick_rate;
+}
+}  // namespace
+
+
+// A reader's snapshot outlives any number of reloads; it is freed on the first reload after
+// the reader lets go.
+TEST(TriggerConfigSlot, KeepsSnapshotsUntilReadersLetGo)
+{
+    TriggerConfigSlot slot(CAMERA);
+    {
+        auto pinned = slot.get();
+        ASSERT_EQ(pinned->version, 1u);
+        for (auto i = 0; i < 3; ++i) slot.reload();
+        EXPECT_EQ(pinned->version, 1u);
+        EXPECT_EQ(slot.get()->version, 4u);
+        EXPECT_GT(slot.retired(), 0u);
+    }
+    slot.reload();
+    EXPECT_EQ(slot.get()->version, 5u);
+    EXPECT_EQ(slot.retired(), 0u);
+}
+
+// Readers on other threads never see a snapshot freed under them while the UI thread
+// publishes new ones; run under a sanitizer to catch it.
+TEST(TriggerConfigSlot, ReadersRaceReloads)
+{
+    TriggerConfigSlot slot(CAMERA);
+    std::atomic_bool done = false;
+    std::vector<std::jthread> readers;
+    std::atomic<std::uint64_t> reads = 0;
+    for (auto i = 0; i < 3; ++i) {
+        readers.emplace_back([&] {
+            std::uint64_t last = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                auto config = slot.get();
+                // Versions only grow, and a freed snapshot would have lost its own.
+                EXPECT_GE(config->version, last);
+                last = config->version;
+                read_frame_settings(*config);
+                reads.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto i = 0; i < 2000; ++i) slot.reload();
+    done = true;
+    readers.clear();
+    slot.reload();
+    slot.reload();
+    EXPECT_GT(reads.load(), 0u);
+    EXPECT_EQ(slot.retired(), 0u);
+}
+
+
+// What one frame costs the streaming thread to learn the settings: reading them from
+// QSettings as it did before, against pinning the published snapshot.
+TEST(TriggerConfigBenchmark, PerFrame)
+{
+    auto constexpr SETTINGS_FRAMES = 200;
+    auto constexpr SNAPSHOT_FRAMES = 1'000'000;
+    TriggerConfigSlot slot(CAMERA);
+    std::uint64_t sink = 0;
+
+    auto ns_per_frame = [](int frames, auto &&frame) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < frames; ++i) frame();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / frames;
+    };
+    auto settings = ns_per_frame(SETTINGS_FRAMES, [&] {
+        sink += read_frame_settings(TriggerConfig::load(CAMERA));
+    });
+    auto snapshot = ns_per_frame(SNAPSHOT_FRAMES, [&] {
+        sink += read_frame_settings(*slot.get());
+    });
+
+    RecordProperty("qsettings_ns_per_frame", fmt::format("{:.0f}", settings));
+    RecordProperty("snapshot_ns_per_frame", fmt::format("{:.1f}", snapshot));
+    spdlog::info(
+        "Trigger settings per frame: {:.0f} ns from QSettings, {:.1f} ns from the snapshot ({})",
+        settings,
+        snapshot,
+        sink
+    );
+    EXPECT_LT(snapshot, settings);
+}
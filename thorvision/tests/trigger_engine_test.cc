@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include "tick_rate.h"
+#include "trigger_engine.h"
+
+
+namespace
+{
+using Action = TriggerEngine::Action;
+using Condition = TriggerEngine::Condition;
+
+// DI 1 and DI 3 as XDAQFrameData::ttl_in reports them.
+auto const DI1 = TriggerEngine::mask_from_channel_number(1);
+auto const DI3 = TriggerEngine::mask_from_channel_number(3);
+
+TriggerEngine engine(Condition condition, std::uint64_t debounce = 0, std::uint64_t on_for = 0)
+{
+    TriggerEngine::Settings settings;
+    settings.condition = condition;
+    settings.channel_mask = TriggerEngine::channel_mask(0);
+    settings.debounce_ticks = debounce;
+    settings.on_for_ticks = on_for;
+    TriggerEngine engine;
+    engine.set_settings(settings);
+    return engine;
+}
+}  // namespace
+
+
+TEST(TriggerEngine, ChannelMasks)
+{
+    EXPECT_EQ(TriggerEngine::mask_from_channel_number(0), 0u);
+    EXPECT_EQ(TriggerEngine::mask_from_channel_number(1), 1u);
+    EXPECT_EQ(TriggerEngine::mask_from_channel_number(32), 1u << 31);
+    EXPECT_EQ(TriggerEngine::mask_from_channel_number(33), 0u);
+    EXPECT_EQ(TriggerEngine::channel_mask(0), 1u);
+    EXPECT_EQ(TriggerEngine::channel_mask(31), 1u << 31);
+    EXPECT_EQ(TriggerEngine::channel_mask(32), 0u);
+}
+
+TEST(TriggerEngine, LevelRecordsWhileInputIsHigh)
+{
+    auto trigger = engine(Condition::Level);
+    EXPECT_EQ(trigger.update(0, 100), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 200), Action::Start);
+    EXPECT_TRUE(trigger.recording());
+    EXPECT_EQ(trigger.update(DI1, 300), Action::None);
+    EXPECT_EQ(trigger.update(0, 400), Action::Stop);
+    EXPECT_FALSE(trigger.recording());
+    EXPECT_EQ(trigger.update(0, 500), Action::None);
+}
+
+TEST(TriggerEngine, IgnoresOtherChannels)
+{
+    auto trigger = engine(Condition::Level);
+    EXPECT_EQ(trigger.update(DI3, 100), Action::None);
+    EXPECT_EQ(trigger.update(DI3, 200), Action::None);
+    EXPECT_FALSE(trigger.recording());
+}
+
+TEST(TriggerEngine, ToggleStartsAndStopsOnRisingEdges)
+{
+    auto trigger = engine(Condition::Toggle);
+    EXPECT_EQ(trigger.update(DI1, 100), Action::Start);
+    EXPECT_EQ(trigger.update(0, 200), Action::None);
+    EXPECT_TRUE(trigger.recording());
+    EXPECT_EQ(trigger.update(DI1, 300), Action::Stop);
+    EXPECT_EQ(trigger.update(0, 400), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 500), Action::Start);
+}
+
+TEST(TriggerEngine, OnForStopsAfterDuration)
+{
+    auto trigger = engine(Condition::OnFor, 0, 1000);
+    EXPECT_EQ(trigger.update(DI1, 100), Action::Start);
+    // Falling and rising edges don't matter while it records.
+    EXPECT_EQ(trigger.update(0, 500), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 900), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 1099), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 1100), Action::Stop);
+    // Still high, so no new edge.
+    EXPECT_EQ(trigger.update(DI1, 1200), Action::None);
+    EXPECT_EQ(trigger.update(0, 1300), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 1400), Action::Start);
+}
+
+TEST(TriggerEngine, OnForSurvivesCounterRestart)
+{
+    auto trigger = engine(Condition::OnFor, 0, 1000);
+    EXPECT_EQ(trigger.update(DI1, 5000), Action::Start);
+    // The acquisition restarted and the counter with it; the duration counts from there.
+    EXPECT_EQ(trigger.update(DI1, 10), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 1009), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 1010), Action::Stop);
+}
+
+TEST(TriggerEngine, DebounceIgnoresGlitches)
+{
+    auto trigger = engine(Condition::Level, 50);
+    EXPECT_EQ(trigger.update(DI1, 100), Action::None);
+    EXPECT_EQ(trigger.update(0, 120), Action::None);
+    EXPECT_FALSE(trigger.recording());
+
+    EXPECT_EQ(trigger.update(DI1, 200), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 249), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 250), Action::Start);
+
+    EXPECT_EQ(trigger.update(0, 300), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 320), Action::None);
+    EXPECT_EQ(trigger.update(0, 400), Action::None);
+    EXPECT_EQ(trigger.update(0, 450), Action::Stop);
+}
+
+TEST(TriggerEngine, SettingsChangeKeepsRecording)
+{
+    auto trigger = engine(Condition::Level);
+    EXPECT_EQ(trigger.update(DI1, 100), Action::Start);
+
+    auto settings = trigger.settings();
+    settings.condition = Condition::Toggle;
+    trigger.set_settings(settings);
+    EXPECT_TRUE(trigger.recording());
+    EXPECT_EQ(trigger.update(0, 200), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 300), Action::Stop);
+}
+
+TEST(TriggerEngine, CancelAndReset)
+{
+    auto trigger = engine(Condition::Level);
+    EXPECT_EQ(trigger.update(DI1, 100), Action::Start);
+    trigger.cancel();
+    EXPECT_FALSE(trigger.recording());
+    // The input is still high, so nothing starts until the next edge.
+    EXPECT_EQ(trigger.update(DI1, 200), Action::None);
+    EXPECT_EQ(trigger.update(0, 300), Action::None);
+    EXPECT_EQ(trigger.update(DI1, 400), Action::Start);
+
+    trigger.reset();
+    EXPECT_FALSE(trigger.recording());
+    EXPECT_EQ(trigger.update(DI1, 500), Action::Start);
+}
+
+
+TEST(TickRateMeter, MeasuresTicksPerSecond)
+{
+    TickRateMeter meter;
+    auto constexpr RATE = 30'000ull;
+    auto constexpr FRAME = 33'333'333ull;  // ns, 30 fps
+    for (std::uint64_t frame = 0; frame < 59; ++frame) {
+        meter.add(frame * FRAME, 1'000 + frame * FRAME * RATE / 1'000'000'000);
+    }
+    // Under two seconds of frames.
+    EXPECT_EQ(meter.ticks_per_second(), 0u);
+    for (std::uint64_t frame = 59; frame < 300; ++frame) {
+        meter.add(frame * FRAME, 1'000 + frame * FRAME * RATE / 1'000'000'000);
+    }
+    EXPECT_NEAR(static_cast<double>(meter.ticks_per_second()), RATE, 1.0);
+}
+
+TEST(TickRateMeter, RestartsBaseWhenCounterRestarts)
+{
+    TickRateMeter meter;
+    for (std::uint64_t second = 0; second <= 3; ++second) {
+        meter.add(second * 1'000'000'000, 5'000'000 + second * 20'000);
+    }
+    EXPECT_EQ(meter.ticks_per_second(), 20'000u);
+
+    // A new acquisition at another rate; the old rate stands until the new one is measured.
+    meter.add(4'000'000'000, 0);
+    meter.add(5'000'000'000, 30'000);
+    EXPECT_EQ(meter.ticks_per_second(), 20'000u);
+    meter.add(6'000'000'000, 60'000);
+    EXPECT_EQ(meter.ticks_per_second(), 30'000u);
+}
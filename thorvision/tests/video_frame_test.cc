@@ -0,0 +1,257 @@
+#include <fmt/core.h>
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "metadata_ring.h"
+#include "test_samples.h"
+#include "video_frame.h"
+
+
+namespace
+{
+// Counts every malloc, calloc and realloc on the calling thread while set, whoever calls
+// them: GLib's g_malloc and g_slice, GStreamer's and operator new all end up there.
+thread_local bool counting = false;
+thread_local std::size_t allocations = 0;
+
+// What the streaming thread's callback allocated once past the first frames.
+struct CountedReceiver {
+    FrameReceiver *receiver;
+    int warmup;
+    int frames;
+    std::size_t allocations;
+};
+
+// The receiver's own callback, counted.
+GstFlowReturn count_new_sample(GstAppSink *sink, gpointer user_data)
+{
+    auto &counted = *static_cast<CountedReceiver *>(user_data);
+    allocations = 0;
+    counting = counted.frames++ >= counted.warmup;
+    auto ret = FrameReceiver::new_sample(sink, counted.receiver);
+    counting = false;
+    counted.allocations += allocations;
+    return ret;
+}
+
+// Stands in for the parser probe, so every frame finds its metadata.
+GstPadProbeReturn push_metadata(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+    static_cast<MetadataRing *>(user_data)->push(pts, XDAQFrameData{pts, 0, 0, 0, 0, 0});
+    return GST_PAD_PROBE_OK;
+}
+}  // namespace
+
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *memory, std::size_t size);
+
+void *malloc(std::size_t size)
+{
+    if (counting) ++allocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size)
+{
+    if (counting) ++allocations;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *memory, std::size_t size)
+{
+    if (counting) ++allocations;
+    return __libc_realloc(memory, size);
+}
+}
+#endif
+
+
+// Frames from videotestsrc through the appsink callback StreamWindow installs, taken and
+// dropped on another thread as the UI takes them. Once the first frames have parsed the caps,
+// neither side allocates: the caps are parsed once, appsink reuses its sample since the pool
+// keeps only the buffer, and the slots reuse their RGB buffers.
+TEST(FrameReceiver, SteadyStateDoesNotAllocate)
+{
+#ifndef __GLIBC__
+    GTEST_SKIP() << "Counts allocations through glibc's malloc";
+#endif
+    auto constexpr WIDTH = 320;
+    auto constexpr HEIGHT = 240;
+    auto constexpr WARMUP = 10;
+    auto constexpr FRAMES = 300;
+
+    FramePool pool;
+    FrameMailbox mailbox;
+    MetadataRing metadata;
+    FrameReceiver receiver("test", pool, mailbox, metadata);
+    // Size every slot's RGB buffer, as the first few seconds of a stream would.
+    {
+        auto const info = video_info(GST_VIDEO_FORMAT_YUY2, WIDTH, HEIGHT);
+        pool.enable_rgb_conversion(ColourMatrix::from(info));
+        std::vector<FrameRef> held;
+        for (auto i = 0; i < FramePool::SLOTS; ++i) {
+            held.push_back(pool.acquire(make_sample(info), info, XDAQFrameData{}));
+        }
+    }
+
+    auto description = fmt::format(
+        "videotestsrc num-buffers={} pattern=ball ! "
+        "video/x-raw,format=YUY2,width={},height={},framerate=30/1 ! "
+        "appsink name=sink sync=false",
+        WARMUP + FRAMES,
+        WIDTH,
+        HEIGHT
+    );
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_parse_launch(description.c_str(), nullptr), gst_object_unref
+    );
+    ASSERT_TRUE(pipeline);
+    auto sink = gst_bin_get_by_name(GST_BIN(pipeline.get()), "sink");
+    CountedReceiver counted{&receiver, WARMUP, 0, 0};
+    GstAppSinkCallbacks callbacks = {
+        nullptr, nullptr, count_new_sample, nullptr, nullptr, {nullptr}
+    };
+    gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, &counted, nullptr);
+    auto sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, push_metadata, &metadata, nullptr);
+    gst_object_unref(sink_pad);
+    gst_object_unref(sink);
+
+    // The UI: keeps the frame it paints until the next one comes, as StreamWindow::_frame does.
+    std::atomic_bool done = false;
+    std::size_t ui_allocations = 0;
+    int taken = 0;
+    std::thread ui([&] {
+        FrameRef painted;
+        auto take = [&] {
+            auto frame = mailbox.take();
+            if (!frame) return;
+            EXPECT_NE(frame.rgb(), nullptr);
+            EXPECT_EQ(frame.metadata().fpga_timestamp, frame.pts());
+            allocations = 0;
+            counting = mailbox.posted() > WARMUP;
+            painted = std::move(frame);
+            counting = false;
+            ui_allocations += allocations;
+            ++taken;
+        };
+        while (!done.load(std::memory_order_acquire)) {
+            take();
+            std::this_thread::yield();
+        }
+        take();
+    });
+
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    auto bus = gst_element_get_bus(pipeline.get());
+    auto message = gst_bus_timed_pop_filtered(
+        bus, 30 * GST_SECOND, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+    );
+    EXPECT_TRUE(message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS);
+    if (message) gst_message_unref(message);
+    gst_object_unref(bus);
+    done.store(true, std::memory_order_release);
+    ui.join();
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+
+    EXPECT_EQ(counted.frames, WARMUP + FRAMES);
+    EXPECT_GT(taken, 0);
+    EXPECT_EQ(metadata.misses(), 0u);
+    EXPECT_EQ(counted.allocations, 0u);
+    EXPECT_EQ(ui_allocations, 0u);
+}
+
+TEST(FramePool, ReleasesBufferWithLastReference)
+{
+    auto const info = video_info(GST_VIDEO_FORMAT_RGB, 64, 48);
+    FramePool pool;
+
+    auto sample = make_sample(info);
+    auto buffer = gst_sample_get_buffer(sample);
+    gst_buffer_ref(buffer);
+    {
+        auto frame = pool.acquire(sample, info, XDAQFrameData{});
+        ASSERT_TRUE(frame);
+        auto copy = frame;
+        frame = FrameRef();
+        // Still mapped through the copy.
+        EXPECT_GT(GST_MINI_OBJECT_REFCOUNT_VALUE(buffer), 1);
+        EXPECT_EQ(copy.width(), 64);
+    }
+    EXPECT_EQ(GST_MINI_OBJECT_REFCOUNT_VALUE(buffer), 1);
+    gst_buffer_unref(buffer);
+}
+
+TEST(FramePool, EmptyWhenEverySlotIsHeld)
+{
+    auto const info = video_info(GST_VIDEO_FORMAT_RGB, 64, 48);
+    FramePool pool;
+
+    std::vector<FrameRef> held;
+    for (auto i = 0; i < FramePool::SLOTS; ++i) {
+        held.push_back(pool.acquire(make_sample(info), info, XDAQFrameData{}));
+        ASSERT_TRUE(held.back());
+    }
+    EXPECT_FALSE(pool.acquire(make_sample(info), info, XDAQFrameData{}));
+
+    held.pop_back();
+    EXPECT_TRUE(pool.acquire(make_sample(info), info, XDAQFrameData{}));
+}
+
+
+TEST(FrameMailbox, StressKeepsNewestFrameAndCountsDrops)
+{
+    auto const info = video_info(GST_VIDEO_FORMAT_RGB, 64, 48);
+    auto constexpr FRAMES = 20000;
+    FramePool pool;
+    FrameMailbox mailbox;
+
+    std::atomic_bool done = false;
+    std::uint64_t taken = 0;
+    std::thread ui([&] {
+        auto last = GstClockTime{0};
+        auto check = [&](const FrameRef &frame) {
+            // Never the same frame twice, never an older one.
+            EXPECT_GT(frame.pts(), last);
+            last = frame.pts();
+            ++taken;
+        };
+        while (!done.load(std::memory_order_acquire)) {
+            if (auto frame = mailbox.take()) check(frame);
+            std::this_thread::yield();
+        }
+        if (auto frame = mailbox.take()) check(frame);
+        EXPECT_EQ(last, GstClockTime{FRAMES});
+    });
+
+    for (auto pts = 1; pts <= FRAMES; ++pts) {
+        // The newest frame always gets a slot: at most one is in the mailbox and one with the UI.
+        auto frame = pool.acquire(make_sample(info, pts), info, XDAQFrameData{});
+        EXPECT_TRUE(frame);
+        mailbox.post(std::move(frame));
+    }
+    done.store(true, std::memory_order_release);
+    ui.join();
+
+    EXPECT_EQ(mailbox.posted(), std::uint64_t{FRAMES});
+    EXPECT_EQ(taken + mailbox.dropped(), mailbox.posted());
+    // Every slot was handed back.
+    std::vector<FrameRef> held;
+    for (auto i = 0; i < FramePool::SLOTS; ++i) {
+        held.push_back(pool.acquire(make_sample(info), info, XDAQFrameData{}));
+        EXPECT_TRUE(held.back());
+    }
+}